@@ -25,6 +25,51 @@ int getOnlineCores (void)
 	return 1;
 }
 
+void threadMemoryBarrier()
+{
+	__sync_synchronize();
+}
+
+int threadAtomicAdd(volatile int *value, int amount)
+{
+	return __sync_fetch_and_add(value, amount);
+}
+
+//libctru has no tls keys to hand out, so each ThreadLocalPointer takes a slot of a __thread array
+#define THREAD_LOCAL_POINTER_SLOTS 8
+static __thread void *threadLocalSlots[THREAD_LOCAL_POINTER_SLOTS];
+static volatile int threadLocalSlotCount = 0;
+
+class ThreadLocalPointer::Impl {
+public:
+	int slot; //-1 once the slots ran out; such a pointer stays NULL
+};
+
+ThreadLocalPointer::ThreadLocalPointer() : impl(new ThreadLocalPointer::Impl())
+{
+	impl->slot = threadAtomicAdd(&threadLocalSlotCount, 1);
+	if (impl->slot >= THREAD_LOCAL_POINTER_SLOTS) {
+		printf("ThreadLocalPointer: out of slots\n");
+		impl->slot = -1;
+	}
+}
+
+ThreadLocalPointer::~ThreadLocalPointer()
+{
+	delete impl;
+}
+
+void* ThreadLocalPointer::get() const
+{
+	return (impl->slot >= 0) ? threadLocalSlots[impl->slot] : NULL;
+}
+
+void ThreadLocalPointer::set(void *value)
+{
+	if (impl->slot >= 0)
+		threadLocalSlots[impl->slot] = value;
+}
+
 class Task::Impl {
 private:
 	Thread _thread;
@@ -34,7 +79,7 @@ public:
 	Impl();
 	~Impl();
 
-	void start(bool spinlock);
+	bool start(bool spinlock, bool ownCore);
 	void execute(const TWork &work, void *param);
 	void* finish();
 	void shutdown();
@@ -86,25 +131,39 @@ Task::Impl::~Impl()
 	svcCloseHandle(condWork);
 }
 
-void Task::Impl::start(bool spinlock)
+bool Task::Impl::start(bool spinlock, bool ownCore)
 {
 	if (this->_isThreadRunning) {
-		return;
+		return true;
 	}
 
 	this->workFunc = NULL;
 	this->workFuncParam = NULL;
 	this->ret = NULL;
 	this->exitThread = false;
-	this->_thread = threadCreate(taskProc, this, 4 * 1024 * 1024, 0x18, -2, true);
-	this->_isThreadRunning = true;
+	// the appcore is 0. on the New3DS core 2 is ours to use in full; elsewhere we get the syscore's share,
+	// which is nothing until the app asks for some
+	int core = -2;
+	if (ownCore) {
+		bool isNew3DS = false;
+		APT_CheckNew3DS(&isNew3DS);
+		core = isNew3DS ? 2 : 1;
+		if (!isNew3DS && R_FAILED(APT_SetAppCpuTimeLimit(80))) {
+			core = -2;
+		}
+	}
 
+	this->_thread = threadCreate(taskProc, this, 4 * 1024 * 1024, 0x18, core, true);
+	if (this->_thread == NULL && core != -2) {
+		this->_thread = threadCreate(taskProc, this, 4 * 1024 * 1024, 0x18, -2, true);
+	}
+	this->_isThreadRunning = (this->_thread != NULL);
+
+	return this->_isThreadRunning;
 }
 
 void Task::Impl::execute(const TWork &work, void *param)
 {
-	printf("execute");
-
 	if (work == NULL || !this->_isThreadRunning) {
 		return;
 	}
@@ -150,7 +209,7 @@ void Task::Impl::shutdown()
 	this->_isThreadRunning = false;
 }
 
-void Task::start(bool spinlock) { impl->start(spinlock); }
+bool Task::start(bool spinlock, bool ownCore) { return impl->start(spinlock, ownCore); }
 void Task::shutdown() { impl->shutdown(); }
 Task::Task() : impl(new Task::Impl()) {}
 Task::~Task() { delete impl; }
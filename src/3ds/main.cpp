@@ -30,6 +30,9 @@
 #include "../slot2.h"
 #include "../mic.h"
 #include "../SPU.h"
+#include "../driver.h"
+#include "../utils/blit.h"
+#include "../utils/trace.h"
 
 #include "input.h"
 
@@ -43,13 +46,6 @@ volatile bool execute = FALSE;
 
 #define FPS_LIMITER_FRAME_PERIOD 8
 
-unsigned int ABGR1555toRGBA8(unsigned short c)
-{
-    const unsigned int a = c&0x8000, b = c&0x7C00, g = c&0x03E0, r = c&0x1F;
-    const unsigned int rgb = (r << 27) | (g << 14) | (b << 1);
-    return ((a * 0xFF) >> 15) | rgb | ((rgb >> 5) & 0x07070700);
-}
-
 GPU3DInterface *core3DList[] = {
 	&gpu3DNull,
 	&gpu3DRasterize,
@@ -80,6 +76,14 @@ const char * save_type_names[] = {
 
 int cycles;
 
+class D3DSDriver : public BaseDriver
+{
+public:
+	virtual u64 EMU_GetTicks() { return svcGetSystemTick(); }
+	virtual u64 EMU_GetTicksPerSecond() { return SYSCLOCK_ARM11; }
+};
+static D3DSDriver d3dsDriver;
+
 static unsigned short keypad;
 touchPosition touch;
 
@@ -126,6 +130,14 @@ int main(int argc, char **argv)
 	/* default the firmware settings, they may get changed later */
 	NDS_FillDefaultFirmwareConfigData(&fw_config);
 
+	driver = &d3dsDriver;
+	CommonSettings.autoFrameSkip = true;
+
+	// the ARM7 gets its own core on the New3DS; the Old3DS has to give up part of the syscore for it, so it's opt-in there
+	bool isNew3DS = false;
+	APT_CheckNew3DS(&isNew3DS);
+	CommonSettings.arm7_threaded = isNew3DS || access( "sdmc:/DeSmuME/ARM7THREAD", F_OK ) != -1;
+
   	NDS_Init();
 	if( access( "sdmc:/DeSmuME/SD.IMG", F_OK ) != -1 ) {
 	
@@ -244,30 +256,49 @@ int main(int argc, char **argv)
 	
 	execute = TRUE;
 
-	u32 *tfb = (u32*)gfxGetFramebuffer(GFX_TOP, GFX_LEFT, NULL, NULL);
-	u32 *bfb = (u32*)gfxGetFramebuffer(GFX_BOTTOM, GFX_LEFT, NULL, NULL);
+	//the panels are scanned out sideways: each framebuffer row is a screen column, bottom to top
+	BlitTarget top, bottom;
+	top.buffer = gfxGetFramebuffer(GFX_TOP, GFX_LEFT, NULL, NULL);
+	top.format = BlitFormat_RGBA8888;
+	top.rotation = BlitRotation_90;
+	top.width = 400;
+	top.height = top.pitch = 240;
+	bottom = top;
+	bottom.buffer = gfxGetFramebuffer(GFX_BOTTOM, GFX_LEFT, NULL, NULL);
+	bottom.width = 320;
+
+	const u64 frameTicks = SYSCLOCK_ARM11 / CommonSettings.autoFrameSkipTarget;
+	u64 nextFrame = svcGetSystemTick() + frameTicks;
 
 	while(aptMainLoop()) {
-		
-		NDS_SkipNextFrame();
-		NDS_exec<false>();
 
+		//one emulated frame per pass. the core skips rendering when it falls behind (CommonSettings.autoFrameSkip)
 		desmume_cycle();
 
-		u16 * src = (u16 *)GPU->GetDisplayInfo().masterNativeBuffer;
-		int x,y;
-		
-
 		if((kHeld & KEY_A) && (kHeld & KEY_L) && (kHeld & KEY_R) && (kHeld & KEY_DOWN)){
 			break;
 		}
 
-		for(x=0; x<256; x++){
-    		for(y=0; y<192;y++){
-        		tfb[(((x + 72) * 240) + (191 - y))] = ABGR1555toRGBA8(src[( y * 256 ) + x]);
-        		bfb[(((x + 32)*240) + (239 - y))] = ABGR1555toRGBA8(src[( (y + 192) * 256 ) + x]);
-    		}
+		const NDSDisplayInfo &displayInfo = GPU->GetDisplayInfo();
+		Blit_Display(displayInfo, NDSDisplayID_Main, top, 72, 48);
+		Blit_Display(displayInfo, NDSDisplayID_Touch, bottom, 32, 0);
+
+#ifdef HAVE_TRACE
+		//ZL+ZR aren't DS buttons, so they're free to save what the tracer has
+		if((hidKeysHeld() & (KEY_ZL | KEY_ZR)) == (KEY_ZL | KEY_ZR) && (hidKeysDown() & (KEY_ZL | KEY_ZR)))
+			Trace_Dump("sdmc:/DeSmuME/trace.json");
+#endif
+
+		//don't run ahead of the target rate when there's time to spare. when behind, don't try to catch up here;
+		//the core is already skipping for that
+		const u64 now = svcGetSystemTick();
+		if(now < nextFrame)
+		{
+			svcSleepThread(((nextFrame - now) * 1000000000ULL) / SYSCLOCK_ARM11);
+			nextFrame += frameTicks;
 		}
+		else
+			nextFrame = now + frameTicks;
 
     }
 	
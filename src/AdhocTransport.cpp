@@ -0,0 +1,639 @@
+/*
+	Copyright (C) 2016 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "types.h"
+
+#ifdef EXPERIMENTAL_WIFI_COMM
+
+#ifdef HOST_WINDOWS
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	#define socket_t    SOCKET
+#else
+	#include <unistd.h>
+	#include <fcntl.h>
+	#include <errno.h>
+	#include <arpa/inet.h>
+	#include <sys/socket.h>
+	#include <sys/select.h>
+	#define socket_t    int
+	#define closesocket close
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <rthreads/rthreads.h>
+
+#include "AdhocTransport.h"
+#include "utils/task.h"
+
+#ifndef INVALID_SOCKET
+	#define INVALID_SOCKET  (socket_t)-1
+#endif
+
+//batched socket calls, where the host has them
+#if defined(__linux__) && !defined(_3DS)
+	#define ADHOC_MMSG
+#endif
+
+#define ADHOC_MAGIC				"NDSWIFI\0"
+#define ADHOC_PROTOCOL_VERSION	0x0100  // v1.0
+#define ADHOC_PORT				7000
+
+//slots per receive ring. a power of two, so the free running indices wrap cleanly
+#define ADHOC_RING_SLOTS		64
+//frames per send or receive batch
+#define ADHOC_BATCH				16
+#define ADHOC_RELAY_STATIONS	16
+
+typedef struct _Adhoc_FrameHeader
+{
+	char magic[8];			// "NDSWIFI\0" (null terminated string)
+	u16 version;			// Ad-hoc protocol version (for example 0x0502 = v5.2)
+	u16 packetLen;			// Length of the packet
+
+} Adhoc_FrameHeader;
+
+//A single producer, single consumer ring of frame slots. The producer fills slots from tail on and publishes
+//them by moving tail; the consumer hands them out from next on and gives them back by moving head once every
+//slot before it has been released. Only the producer writes tail and only the consumer writes head, so the two
+//sides never wait on each other. A slot with length 0 held a datagram that wasn't a frame and is just skipped.
+struct AdhocRing
+{
+	u8 data[ADHOC_RING_SLOTS][ADHOC_SLOT_SIZE];
+	u32 len[ADHOC_RING_SLOTS];
+	bool released[ADHOC_RING_SLOTS];
+	volatile u32 tail;
+	volatile u32 head;
+	u32 next;
+	u32 dropped;
+};
+
+static void ring_Reset(AdhocRing *r)
+{
+	r->tail = r->head = r->next = 0;
+	r->dropped = 0;
+	memset(r->released, 0, sizeof(r->released));
+}
+
+static u32 ring_Free(const AdhocRing *r)
+{
+	return ADHOC_RING_SLOTS - (r->tail - r->head);
+}
+
+static u8* ring_Slot(AdhocRing *r, u32 index)
+{
+	return r->data[index % ADHOC_RING_SLOTS];
+}
+
+static void ring_Publish(AdhocRing *r, u32 count)
+{
+	//the slots have to be complete before the consumer can see them
+	threadMemoryBarrier();
+	r->tail += count;
+}
+
+static u8* ring_Take(AdhocRing *r, u32 *len, int *slot)
+{
+	if (r->next == r->tail)
+		return NULL;
+	threadMemoryBarrier();
+
+	u32 i = r->next++ % ADHOC_RING_SLOTS;
+	*len = r->len[i];
+	*slot = i;
+	return r->data[i];
+}
+
+static void ring_Release(AdhocRing *r, int slot)
+{
+	r->released[slot] = true;
+
+	u32 head = r->head;
+	while (head != r->next && r->released[head % ADHOC_RING_SLOTS])
+	{
+		r->released[head % ADHOC_RING_SLOTS] = false;
+		head++;
+	}
+
+	//done with the slots before the producer may fill them again
+	threadMemoryBarrier();
+	r->head = head;
+}
+
+static void adhoc_WriteHeader(u8 *slot, u32 len)
+{
+	Adhoc_FrameHeader header;
+	memcpy(header.magic, ADHOC_MAGIC, 8);
+	header.version = ADHOC_PROTOCOL_VERSION;
+	header.packetLen = len;
+	memcpy(slot, &header, ADHOC_HEADER_SIZE);
+}
+
+//the frame length a received datagram carries, or 0 when it isn't one of ours
+static u32 adhoc_CheckHeader(const u8 *slot, u32 size)
+{
+	if (size < ADHOC_HEADER_SIZE)
+		return 0;
+
+	Adhoc_FrameHeader header;
+	memcpy(&header, slot, ADHOC_HEADER_SIZE);
+	if (memcmp(header.magic, ADHOC_MAGIC, 8))
+		return 0;
+	if (header.version != ADHOC_PROTOCOL_VERSION)
+		return 0;
+	if (header.packetLen > size - ADHOC_HEADER_SIZE)
+		return 0;
+
+	return header.packetLen;
+}
+
+struct AdhocBackend
+{
+	bool (*Open)();
+	void (*Close)();
+	void (*Flush)();
+	void (*Poll)();
+};
+
+static AdhocBackend *backend = NULL;
+static AdhocRing *rxRing = NULL;
+
+//frames waiting to go out, each already behind its header
+static u8 txBatch[ADHOC_BATCH][ADHOC_SLOT_SIZE];
+static u32 txLen[ADHOC_BATCH];
+static u32 txCount = 0;
+
+/*******************************************************************************
+
+	UDP backend
+
+ *******************************************************************************/
+
+static socket_t udpSocket = INVALID_SOCKET;
+static struct sockaddr_in udpSendAddr;
+static AdhocRing *udpRing = NULL;
+static Task *udpTask = NULL;
+static volatile bool udpStop;
+
+static void udp_Drain()
+{
+	AdhocRing *r = udpRing;
+
+	for (;;)
+	{
+		u32 room = ring_Free(r);
+		if (room == 0)
+			return; //the socket buffer holds the rest until the wifi core catches up
+		if (room > ADHOC_BATCH)
+			room = ADHOC_BATCH;
+
+		u32 got = 0;
+#ifdef ADHOC_MMSG
+		struct mmsghdr msgs[ADHOC_BATCH];
+		struct iovec iov[ADHOC_BATCH];
+		memset(msgs, 0, sizeof(msgs[0]) * room);
+		for (u32 i = 0; i < room; i++)
+		{
+			//straight into the ring
+			iov[i].iov_base = ring_Slot(r, r->tail + i);
+			iov[i].iov_len = ADHOC_SLOT_SIZE;
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		int res = recvmmsg(udpSocket, msgs, room, MSG_DONTWAIT, NULL);
+		if (res <= 0)
+			return;
+		got = res;
+
+		for (u32 i = 0; i < got; i++)
+		{
+			u32 index = (r->tail + i) % ADHOC_RING_SLOTS;
+			if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+				r->len[index] = 0;
+			else
+				r->len[index] = adhoc_CheckHeader(r->data[index], msgs[i].msg_len);
+		}
+#else
+		for (; got < room; got++)
+		{
+			u32 index = (r->tail + got) % ADHOC_RING_SLOTS;
+			int nbytes = recvfrom(udpSocket, (char*)r->data[index], ADHOC_SLOT_SIZE, 0, NULL, NULL);
+			if (nbytes <= 0)
+				break;
+			r->len[index] = adhoc_CheckHeader(r->data[index], nbytes);
+		}
+		if (got == 0)
+			return;
+#endif
+
+		ring_Publish(r, got);
+		if (got < room)
+			return;
+	}
+}
+
+static void udp_Nap()
+{
+#ifdef HOST_WINDOWS
+	Sleep(1);
+#else
+	usleep(1000);
+#endif
+}
+
+static void* udp_IOWork(void *)
+{
+	while (!udpStop)
+	{
+		if (ring_Free(udpRing) == 0)
+		{
+			udp_Nap();
+			continue;
+		}
+
+		//wake up now and then to see whether we're being closed
+		fd_set fd;
+		struct timeval tv;
+		FD_ZERO(&fd);
+		FD_SET(udpSocket, &fd);
+		tv.tv_sec = 0;
+		tv.tv_usec = 20000;
+
+		if (select(udpSocket + 1, &fd, NULL, NULL, &tv) > 0)
+			udp_Drain();
+	}
+	return NULL;
+}
+
+static bool udp_Open()
+{
+	BOOL opt_true = TRUE;
+
+	// Create an UDP socket
+	udpSocket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (udpSocket == INVALID_SOCKET)
+	{
+		printf("WIFI: Ad-hoc: Failed to create socket.\n");
+		return false;
+	}
+
+	// Enable the socket to be bound to an address/port that is already in use
+	// This enables us to communicate with another DeSmuME instance running on the same computer.
+	setsockopt(udpSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&opt_true, sizeof(BOOL));
+
+	// Bind the socket to any address on port 7000
+	struct sockaddr_in saddr;
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sin_family = AF_INET;
+	saddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	saddr.sin_port = htons(ADHOC_PORT);
+	if (bind(udpSocket, (struct sockaddr*)&saddr, sizeof(saddr)) < 0)
+	{
+		printf("WIFI: Ad-hoc: failed to bind the socket.\n");
+		closesocket(udpSocket); udpSocket = INVALID_SOCKET;
+		return false;
+	}
+
+	// Enable broadcast mode
+	// Not doing so results in failure when sendto'ing to broadcast address
+	if (setsockopt(udpSocket, SOL_SOCKET, SO_BROADCAST, (const char*)&opt_true, sizeof(BOOL)) < 0)
+	{
+		printf("WIFI: Ad-hoc: failed to enable broadcast mode.\n");
+		closesocket(udpSocket); udpSocket = INVALID_SOCKET;
+		return false;
+	}
+
+	// Neither side ever waits on the socket: the emulator would rather drop a frame than stall
+#ifdef HOST_WINDOWS
+	u_long opt_nonblock = 1;
+	ioctlsocket(udpSocket, FIONBIO, &opt_nonblock);
+#else
+	fcntl(udpSocket, F_SETFL, fcntl(udpSocket, F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+	memset(&udpSendAddr, 0, sizeof(udpSendAddr));
+	udpSendAddr.sin_family = AF_INET;
+	udpSendAddr.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+	udpSendAddr.sin_port = htons(ADHOC_PORT);
+
+	if (udpRing == NULL)
+		udpRing = new AdhocRing();
+	ring_Reset(udpRing);
+	rxRing = udpRing;
+
+	//a thread that mostly sleeps in select() isn't worth it on a single core; the wifi core polls instead
+	if (getOnlineCores() > 1)
+	{
+		udpStop = false;
+		udpTask = new Task();
+		udpTask->start(false);
+		udpTask->execute(udp_IOWork, NULL);
+	}
+
+	return true;
+}
+
+static void udp_Close()
+{
+	if (udpTask)
+	{
+		udpStop = true;
+		udpTask->finish();
+		udpTask->shutdown();
+		delete udpTask;
+		udpTask = NULL;
+	}
+
+	if (udpSocket != INVALID_SOCKET)
+	{
+		closesocket(udpSocket);
+		udpSocket = INVALID_SOCKET;
+	}
+}
+
+static void udp_Flush()
+{
+#ifdef ADHOC_MMSG
+	struct mmsghdr msgs[ADHOC_BATCH];
+	struct iovec iov[ADHOC_BATCH];
+	memset(msgs, 0, sizeof(msgs[0]) * txCount);
+	for (u32 i = 0; i < txCount; i++)
+	{
+		iov[i].iov_base = txBatch[i];
+		iov[i].iov_len = ADHOC_HEADER_SIZE + txLen[i];
+		msgs[i].msg_hdr.msg_name = &udpSendAddr;
+		msgs[i].msg_hdr.msg_namelen = sizeof(udpSendAddr);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	//whatever the socket won't take right now is lost, as it would be over the air
+	u32 sent = 0;
+	while (sent < txCount)
+	{
+		int res = sendmmsg(udpSocket, msgs + sent, txCount - sent, MSG_DONTWAIT);
+		if (res <= 0)
+			break;
+		sent += res;
+	}
+#else
+	for (u32 i = 0; i < txCount; i++)
+		sendto(udpSocket, (const char*)txBatch[i], ADHOC_HEADER_SIZE + txLen[i], 0, (struct sockaddr*)&udpSendAddr, sizeof(udpSendAddr));
+#endif
+}
+
+static void udp_Poll()
+{
+	if (udpTask == NULL)
+		udp_Drain();
+}
+
+static AdhocBackend udpBackend = {
+	udp_Open,
+	udp_Close,
+	udp_Flush,
+	udp_Poll
+};
+
+/*******************************************************************************
+
+	In-process relay
+
+ *******************************************************************************/
+
+//each station's ring has many producers (every other station), so they take turns under the lock;
+//the station reading its ring never takes it.
+static AdhocRing *relayStations[ADHOC_RELAY_STATIONS];
+static slock_t *relayLock = NULL;
+static int relaySelf = -1;
+
+int AdhocRelay_Attach()
+{
+	if (relayLock == NULL)
+		relayLock = slock_new();
+
+	AdhocRing *ring = new AdhocRing();
+	ring_Reset(ring);
+
+	int station = -1;
+	slock_lock(relayLock);
+	for (int i = 0; i < ADHOC_RELAY_STATIONS; i++)
+	{
+		if (relayStations[i] == NULL)
+		{
+			relayStations[i] = ring;
+			station = i;
+			break;
+		}
+	}
+	slock_unlock(relayLock);
+
+	if (station < 0)
+		delete ring;
+	return station;
+}
+
+void AdhocRelay_Detach(int station)
+{
+	if (station < 0 || station >= ADHOC_RELAY_STATIONS || relayLock == NULL)
+		return;
+
+	slock_lock(relayLock);
+	AdhocRing *ring = relayStations[station];
+	relayStations[station] = NULL;
+	slock_unlock(relayLock);
+
+	delete ring;
+}
+
+void AdhocRelay_Send(int station, const u8 *frame, u32 len)
+{
+	if (len > ADHOC_MAX_FRAME || relayLock == NULL)
+		return;
+
+	slock_lock(relayLock);
+	for (int i = 0; i < ADHOC_RELAY_STATIONS; i++)
+	{
+		AdhocRing *r = relayStations[i];
+		if (r == NULL || i == station)
+			continue;
+		if (ring_Free(r) == 0)
+		{
+			r->dropped++;
+			continue;
+		}
+
+		u8 *slot = ring_Slot(r, r->tail);
+		adhoc_WriteHeader(slot, len);
+		memcpy(slot + ADHOC_HEADER_SIZE, frame, len);
+		r->len[r->tail % ADHOC_RING_SLOTS] = len;
+		ring_Publish(r, 1);
+	}
+	slock_unlock(relayLock);
+}
+
+u32 AdhocRelay_Receive(int station, u8 *buf, u32 size)
+{
+	if (station < 0 || station >= ADHOC_RELAY_STATIONS || relayLock == NULL)
+		return 0;
+
+	//held throughout, so that the station can't be detached and its ring freed underneath us
+	slock_lock(relayLock);
+	AdhocRing *r = relayStations[station];
+	u32 ret = 0;
+	while (r != NULL)
+	{
+		u32 len;
+		int slot;
+		u8 *data = ring_Take(r, &len, &slot);
+		if (data == NULL)
+			break;
+
+		bool fits = (len <= size);
+		if (fits)
+			memcpy(buf, data + ADHOC_HEADER_SIZE, len);
+		ring_Release(r, slot);
+		if (fits)
+		{
+			ret = len;
+			break;
+		}
+	}
+	slock_unlock(relayLock);
+
+	return ret;
+}
+
+static bool relay_Open()
+{
+	relaySelf = AdhocRelay_Attach();
+	if (relaySelf < 0)
+	{
+		printf("WIFI: Ad-hoc: the relay is full.\n");
+		return false;
+	}
+
+	rxRing = relayStations[relaySelf];
+	return true;
+}
+
+static void relay_Close()
+{
+	AdhocRelay_Detach(relaySelf);
+	relaySelf = -1;
+}
+
+static void relay_Flush()
+{
+	for (u32 i = 0; i < txCount; i++)
+		AdhocRelay_Send(relaySelf, txBatch[i] + ADHOC_HEADER_SIZE, txLen[i]);
+}
+
+static void relay_Poll()
+{
+}
+
+static AdhocBackend relayBackend = {
+	relay_Open,
+	relay_Close,
+	relay_Flush,
+	relay_Poll
+};
+
+/*******************************************************************************
+
+	Transport
+
+ *******************************************************************************/
+
+bool AdhocTransport_Open(int type)
+{
+	AdhocTransport_Close();
+
+	AdhocBackend *which = (type == ADHOC_TRANSPORT_RELAY) ? &relayBackend : &udpBackend;
+	txCount = 0;
+	if (!which->Open())
+	{
+		rxRing = NULL;
+		return false;
+	}
+
+	backend = which;
+	return true;
+}
+
+void AdhocTransport_Close()
+{
+	if (backend == NULL)
+		return;
+
+	backend->Close();
+	backend = NULL;
+	rxRing = NULL;
+	txCount = 0;
+}
+
+void AdhocTransport_Send(const u8 *frame, u32 len)
+{
+	if (backend == NULL || len > ADHOC_MAX_FRAME)
+		return;
+
+	adhoc_WriteHeader(txBatch[txCount], len);
+	memcpy(txBatch[txCount] + ADHOC_HEADER_SIZE, frame, len);
+	txLen[txCount] = len;
+	if (++txCount == ADHOC_BATCH)
+		AdhocTransport_Flush();
+}
+
+void AdhocTransport_Flush()
+{
+	if (backend == NULL || txCount == 0)
+		return;
+
+	backend->Flush();
+	txCount = 0;
+}
+
+void AdhocTransport_Poll()
+{
+	if (backend)
+		backend->Poll();
+}
+
+u8* AdhocTransport_Receive(u32 *len, int *slot)
+{
+	if (rxRing == NULL)
+		return NULL;
+
+	for (;;)
+	{
+		u8 *data = ring_Take(rxRing, len, slot);
+		if (data == NULL || *len != 0)
+			return data;
+		ring_Release(rxRing, *slot);
+	}
+}
+
+void AdhocTransport_Release(int slot)
+{
+	if (rxRing)
+		ring_Release(rxRing, slot);
+}
+
+#endif
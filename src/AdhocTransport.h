@@ -0,0 +1,75 @@
+/*
+	Copyright (C) 2016 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ADHOCTRANSPORT_H_
+#define _ADHOCTRANSPORT_H_
+
+#include "types.h"
+
+#ifdef EXPERIMENTAL_WIFI_COMM
+
+//Moves ad-hoc wifi frames between DSs, for the ad-hoc interface in wifi.cpp.
+//
+//Frames arrive into a ring of fixed slots and stay in their slot until the wifi core has fed them to the
+//emulated receiver, so a frame is never copied between the socket and wifi ram. Every slot starts with
+//ADHOC_HEADER_SIZE bytes of ad-hoc header, which is exactly the size of the rx header the wifi core puts in
+//front of a received frame; it writes that header over the ad-hoc one in place.
+//
+//Two backends:
+//ADHOC_TRANSPORT_UDP: broadcasts over udp, which is how DeSmuMEs have always found each other. the socket is
+//non-blocking and drained in batches (recvmmsg/sendmmsg on linux), by an i/o thread where there's a core to
+//spare for one, else by AdhocTransport_Poll().
+//ADHOC_TRANSPORT_RELAY: a hub in this process. every station attached to it hears what every other one sends,
+//with no network at all. the emulated DS is one station; a test driver can attach as many more as it likes
+//(AdhocRelay_*) to talk to it or load it up.
+
+#define ADHOC_HEADER_SIZE	12
+#define ADHOC_SLOT_SIZE		2048
+#define ADHOC_MAX_FRAME		(ADHOC_SLOT_SIZE - ADHOC_HEADER_SIZE)
+
+enum AdhocTransportType
+{
+	ADHOC_TRANSPORT_UDP = 0,
+	ADHOC_TRANSPORT_RELAY = 1
+};
+
+bool AdhocTransport_Open(int type);
+void AdhocTransport_Close();
+
+//queues a frame to go out. queued frames leave together on AdhocTransport_Flush(), or as soon as the batch is full
+void AdhocTransport_Send(const u8 *frame, u32 len);
+void AdhocTransport_Flush();
+
+//drains the socket when there is no i/o thread doing it. cheap to call when there's nothing there.
+void AdhocTransport_Poll();
+
+//the oldest frame not handed out yet, or NULL. returns the start of its slot (the header, with the frame after it)
+//and the frame length. the slot is the caller's until it releases it; slots may be released in any order.
+u8* AdhocTransport_Receive(u32 *len, int *slot);
+void AdhocTransport_Release(int slot);
+
+//stations on the in-process relay, besides the emulated DS. Attach returns -1 when the relay is full.
+int AdhocRelay_Attach();
+void AdhocRelay_Detach(int station);
+void AdhocRelay_Send(int station, const u8 *frame, u32 len);
+//copies the oldest frame for the station into buf and returns its length, or 0 when there is none.
+//frames longer than size are dropped.
+u32 AdhocRelay_Receive(int station, u8 *buf, u32 size);
+
+#endif
+
+#endif
@@ -212,6 +212,11 @@ bool gpu_loadstate(EMUFILE* is, int size)
 		//subEngine->refreshAffineStartRegs(-1,-1);
 	}
 	
+	mainEngine->InvalidateLineCache();
+	subEngine->InvalidateLineCache();
+	mainEngine->InvalidateSpriteLists();
+	subEngine->InvalidateSpriteLists();
+	
 	mainEngine->ParseAllRegisters<GPUEngineID_Main>();
 	subEngine->ParseAllRegisters<GPUEngineID_Sub>();
 	
@@ -429,6 +434,10 @@ void GPUEngineBase::_Reset_Base()
 		this->isLineOutputNative[l] = true;
 	}
 	
+	this->cachedLineCount = 0;
+	this->InvalidateLineCache();
+	this->InvalidateSpriteLists();
+	
 	this->_sprBoundary = 0;
 	this->_sprBMPBoundary = 0;
 	
@@ -876,83 +885,69 @@ FORCEINLINE FragmentColor GPUEngineBase::_ColorEffectDecreaseBrightness(const Fr
 	return newColor;
 }
 
-#ifdef ENABLE_SSE2
+#ifdef ENABLE_SIMD128
 
-FORCEINLINE __m128i GPUEngineBase::_ColorEffectIncreaseBrightness(const __m128i &col, const __m128i &blendEVY)
+FORCEINLINE v128u16 GPUEngineBase::_ColorEffectIncreaseBrightness(const v128u16 &col, const v128u16 &blendEVY)
 {
-	__m128i r_vec128 = _mm_and_si128( col, _mm_set1_epi16(0x001F) );
-	__m128i g_vec128 = _mm_srli_epi16( _mm_and_si128(col, _mm_set1_epi16(0x03E0)),  5 );
-	__m128i b_vec128 = _mm_srli_epi16( _mm_and_si128(col, _mm_set1_epi16(0x7C00)), 10 );
+	v128u16 r_vec128 = v128u16_and( col, v128u16_set1(0x001F) );
+	v128u16 g_vec128 = v128u16_srli<5>( v128u16_and(col, v128u16_set1(0x03E0)) );
+	v128u16 b_vec128 = v128u16_srli<10>( v128u16_and(col, v128u16_set1(0x7C00)) );
 	
-	r_vec128 = _mm_add_epi16( r_vec128, _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_set1_epi16(31), r_vec128), blendEVY), 4) );
-	g_vec128 = _mm_add_epi16( g_vec128, _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_set1_epi16(31), g_vec128), blendEVY), 4) );
-	b_vec128 = _mm_add_epi16( b_vec128, _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(_mm_set1_epi16(31), b_vec128), blendEVY), 4) );
+	r_vec128 = v128u16_add( r_vec128, v128u16_srli<4>(v128u16_mullo(v128u16_sub(v128u16_set1(31), r_vec128), blendEVY)) );
+	g_vec128 = v128u16_add( g_vec128, v128u16_srli<4>(v128u16_mullo(v128u16_sub(v128u16_set1(31), g_vec128), blendEVY)) );
+	b_vec128 = v128u16_add( b_vec128, v128u16_srli<4>(v128u16_mullo(v128u16_sub(v128u16_set1(31), b_vec128), blendEVY)) );
 	
-	return _mm_or_si128(r_vec128, _mm_or_si128( _mm_slli_epi16(g_vec128, 5), _mm_slli_epi16(b_vec128, 10)) );
+	return v128u16_or(r_vec128, v128u16_or( v128u16_slli<5>(g_vec128), v128u16_slli<10>(b_vec128)) );
 }
 
-FORCEINLINE __m128i GPUEngineBase::_ColorEffectDecreaseBrightness(const __m128i &col, const __m128i &blendEVY)
+FORCEINLINE v128u16 GPUEngineBase::_ColorEffectDecreaseBrightness(const v128u16 &col, const v128u16 &blendEVY)
 {
-	__m128i r_vec128 = _mm_and_si128( col, _mm_set1_epi16(0x001F) );
-	__m128i g_vec128 = _mm_srli_epi16( _mm_and_si128(col, _mm_set1_epi16(0x03E0)),  5 );
-	__m128i b_vec128 = _mm_srli_epi16( _mm_and_si128(col, _mm_set1_epi16(0x7C00)), 10 );
+	v128u16 r_vec128 = v128u16_and( col, v128u16_set1(0x001F) );
+	v128u16 g_vec128 = v128u16_srli<5>( v128u16_and(col, v128u16_set1(0x03E0)) );
+	v128u16 b_vec128 = v128u16_srli<10>( v128u16_and(col, v128u16_set1(0x7C00)) );
 	
-	r_vec128 = _mm_sub_epi16( r_vec128, _mm_srli_epi16(_mm_mullo_epi16(r_vec128, blendEVY), 4) );
-	g_vec128 = _mm_sub_epi16( g_vec128, _mm_srli_epi16(_mm_mullo_epi16(g_vec128, blendEVY), 4) );
-	b_vec128 = _mm_sub_epi16( b_vec128, _mm_srli_epi16(_mm_mullo_epi16(b_vec128, blendEVY), 4) );
+	r_vec128 = v128u16_sub( r_vec128, v128u16_srli<4>(v128u16_mullo(r_vec128, blendEVY)) );
+	g_vec128 = v128u16_sub( g_vec128, v128u16_srli<4>(v128u16_mullo(g_vec128, blendEVY)) );
+	b_vec128 = v128u16_sub( b_vec128, v128u16_srli<4>(v128u16_mullo(b_vec128, blendEVY)) );
 	
-	return _mm_or_si128(r_vec128, _mm_or_si128( _mm_slli_epi16(g_vec128, 5), _mm_slli_epi16(b_vec128, 10)) );
+	return v128u16_or(r_vec128, v128u16_or( v128u16_slli<5>(g_vec128), v128u16_slli<10>(b_vec128)) );
 }
 
-FORCEINLINE __m128i GPUEngineBase::_ColorEffectBlend(const __m128i &colA, const __m128i &colB, const __m128i &blendEVA, const __m128i &blendEVB)
+FORCEINLINE v128u16 GPUEngineBase::_ColorEffectBlend(const v128u16 &colA, const v128u16 &colB, const v128u16 &blendEVA, const v128u16 &blendEVB)
 {
-	__m128i ra_vec128 = _mm_and_si128( colA, _mm_set1_epi16(0x001F) );
-	__m128i ga_vec128 = _mm_srli_epi16( _mm_and_si128(colA, _mm_set1_epi16(0x03E0)),  5 );
-	__m128i ba_vec128 = _mm_srli_epi16( _mm_and_si128(colA, _mm_set1_epi16(0x7C00)), 10 );
-	__m128i rb_vec128 = _mm_and_si128( colB, _mm_set1_epi16(0x001F) );
-	__m128i gb_vec128 = _mm_srli_epi16( _mm_and_si128(colB, _mm_set1_epi16(0x03E0)),  5 );
-	__m128i bb_vec128 = _mm_srli_epi16( _mm_and_si128(colB, _mm_set1_epi16(0x7C00)), 10 );
+	v128u16 ra_vec128 = v128u16_and( colA, v128u16_set1(0x001F) );
+	v128u16 ga_vec128 = v128u16_srli<5>( v128u16_and(colA, v128u16_set1(0x03E0)) );
+	v128u16 ba_vec128 = v128u16_srli<10>( v128u16_and(colA, v128u16_set1(0x7C00)) );
+	v128u16 rb_vec128 = v128u16_and( colB, v128u16_set1(0x001F) );
+	v128u16 gb_vec128 = v128u16_srli<5>( v128u16_and(colB, v128u16_set1(0x03E0)) );
+	v128u16 bb_vec128 = v128u16_srli<10>( v128u16_and(colB, v128u16_set1(0x7C00)) );
 	
-	ra_vec128 = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16(ra_vec128, blendEVA), _mm_mullo_epi16(rb_vec128, blendEVB)), 4 );
-	ra_vec128 = _mm_min_epi16(ra_vec128, _mm_set1_epi16(31));
+	ra_vec128 = v128u16_srli<4>( v128u16_add( v128u16_mullo(ra_vec128, blendEVA), v128u16_mullo(rb_vec128, blendEVB)) );
+	ra_vec128 = v128u16_min(ra_vec128, v128u16_set1(31));
 	
-	ga_vec128 = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16(ga_vec128, blendEVA), _mm_mullo_epi16(gb_vec128, blendEVB)), 4 );
-	ga_vec128 = _mm_min_epi16(ga_vec128, _mm_set1_epi16(31));
+	ga_vec128 = v128u16_srli<4>( v128u16_add( v128u16_mullo(ga_vec128, blendEVA), v128u16_mullo(gb_vec128, blendEVB)) );
+	ga_vec128 = v128u16_min(ga_vec128, v128u16_set1(31));
 	
-	ba_vec128 = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16(ba_vec128, blendEVA), _mm_mullo_epi16(bb_vec128, blendEVB)), 4 );
-	ba_vec128 = _mm_min_epi16(ba_vec128, _mm_set1_epi16(31));
+	ba_vec128 = v128u16_srli<4>( v128u16_add( v128u16_mullo(ba_vec128, blendEVA), v128u16_mullo(bb_vec128, blendEVB)) );
+	ba_vec128 = v128u16_min(ba_vec128, v128u16_set1(31));
 	
-	return _mm_or_si128(ra_vec128, _mm_or_si128( _mm_slli_epi16(ga_vec128, 5), _mm_slli_epi16(ba_vec128, 10)) );
+	return v128u16_or(ra_vec128, v128u16_or( v128u16_slli<5>(ga_vec128), v128u16_slli<10>(ba_vec128)) );
 }
 
-FORCEINLINE __m128i GPUEngineBase::_ColorEffectBlend3D(const __m128i &colA_Lo, const __m128i &colA_Hi, const __m128i &colB)
+FORCEINLINE v128u16 GPUEngineBase::_ColorEffectBlend3D(const v128u16 &colA_R, const v128u16 &colA_G, const v128u16 &colA_B, const v128u16 &colA_A, const v128u16 &colB)
 {
-	__m128i rb = _mm_slli_epi16( _mm_and_si128(_mm_set1_epi16(0x001F), colB), 1);
-	__m128i gb = _mm_srli_epi16( _mm_and_si128(_mm_set1_epi16(0x03E0), colB), 4);
-	__m128i bb = _mm_srli_epi16( _mm_and_si128(_mm_set1_epi16(0x7C00), colB), 9);
-	
-	__m128i ra_lo = _mm_and_si128(_mm_set1_epi32(0x000000FF), colA_Lo);
-	__m128i ga_lo = _mm_srli_epi32( _mm_and_si128(_mm_set1_epi32(0x0000FF00), colA_Lo), 8 );
-	__m128i ba_lo = _mm_srli_epi32( _mm_and_si128(_mm_set1_epi32(0x00FF0000), colA_Lo), 16 );
-	__m128i aa_lo = _mm_srli_epi32( _mm_and_si128(_mm_set1_epi32(0xFF000000), colA_Lo), 24 );
+	const v128u16 rb = v128u16_slli<1>( v128u16_and(v128u16_set1(0x001F), colB) );
+	const v128u16 gb = v128u16_srli<4>( v128u16_and(v128u16_set1(0x03E0), colB) );
+	const v128u16 bb = v128u16_srli<9>( v128u16_and(v128u16_set1(0x7C00), colB) );
 	
-	__m128i ra_hi = _mm_and_si128(_mm_set1_epi32(0x000000FF), colA_Hi);
-	__m128i ga_hi = _mm_srli_epi32( _mm_and_si128(_mm_set1_epi32(0x0000FF00), colA_Hi), 8 );
-	__m128i ba_hi = _mm_srli_epi32( _mm_and_si128(_mm_set1_epi32(0x00FF0000), colA_Hi), 16 );
-	__m128i aa_hi = _mm_srli_epi32( _mm_and_si128(_mm_set1_epi32(0xFF000000), colA_Hi), 24 );
+	const v128u16 aa = v128u16_add(colA_A, v128u16_set1(1));
+	const v128u16 ab = v128u16_sub(v128u16_set1(32), aa);
 	
-	__m128i ra = _mm_packs_epi32(ra_lo, ra_hi);
-	__m128i ga = _mm_packs_epi32(ga_lo, ga_hi);
-	__m128i ba = _mm_packs_epi32(ba_lo, ba_hi);
-	__m128i aa = _mm_packs_epi32(aa_lo, aa_hi);
+	const v128u16 r = v128u16_srli<6>( v128u16_add(v128u16_mullo(colA_R, aa), v128u16_mullo(rb, ab)) );
+	const v128u16 g = v128u16_srli<6>( v128u16_add(v128u16_mullo(colA_G, aa), v128u16_mullo(gb, ab)) );
+	const v128u16 b = v128u16_srli<6>( v128u16_add(v128u16_mullo(colA_B, aa), v128u16_mullo(bb, ab)) );
 	
-	aa = _mm_add_epi16(aa, _mm_set1_epi16(1));
-	
-	ra = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16(ra, aa), _mm_mullo_epi16(rb, _mm_sub_epi16(_mm_set1_epi16(32), aa)) ), 6 );
-	ga = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16(ga, aa), _mm_mullo_epi16(gb, _mm_sub_epi16(_mm_set1_epi16(32), aa)) ), 6 );
-	ba = _mm_srli_epi16( _mm_add_epi16( _mm_mullo_epi16(ba, aa), _mm_mullo_epi16(bb, _mm_sub_epi16(_mm_set1_epi16(32), aa)) ), 6 );
-	
-	return _mm_or_si128( _mm_or_si128(ra, _mm_slli_epi16(ga, 5)), _mm_slli_epi16(ba, 10) );
+	return v128u16_or( v128u16_or(r, v128u16_slli<5>(g)), v128u16_slli<10>(b) );
 }
 
 #endif
@@ -1234,6 +1229,111 @@ void GPUEngineBase::UpdatePropertiesWithoutRender(const u16 l)
 	}
 }
 
+u32 GPUEngineBase::_GetVRAMGeneration() const
+{
+	// The BG and OBJ windows of each engine, measured in 16KB pages of the ARM9 VRAM map.
+	const bool isMain = (this->_engineID == GPUEngineID_Main);
+	const size_t bgPage   = (isMain) ?   0 : 128;
+	const size_t bgCount  = (isMain) ?  32 :   8;
+	const size_t objPage  = (isMain) ? 256 : 384;
+	const size_t objCount = (isMain) ?  16 :   8;
+	
+	u32 gen = 0;
+	
+	for (size_t i = 0; i < bgCount; i++)
+	{
+		gen += MMU.vramPageGen[vram_arm9_map[bgPage + i] & 63];
+	}
+	
+	for (size_t i = 0; i < objCount; i++)
+	{
+		gen += MMU.vramPageGen[vram_arm9_map[objPage + i] & 63];
+	}
+	
+	// Extended palettes live in banks which aren't part of either window.
+	for (size_t i = 0; i < 4; i++)
+	{
+		gen += MMU.vramPageGen[((MMU.ExtPal[this->_engineID][i] - MMU.ARM9_LCD) >> 14) & 63];
+	}
+	
+	gen += MMU.vramPageGen[((MMU.ObjExtPal[this->_engineID][0] - MMU.ARM9_LCD) >> 14) & 63];
+	
+	return gen;
+}
+
+bool GPUEngineBase::_RenderLine_ReuseCached(const u16 l, const bool isCacheAllowed)
+{
+	const NDSDisplayInfo &dispInfo = GPU->GetDisplayInfo();
+	
+	// Only native BGR555 lines are cached. Mosaic carries colors over from the lines
+	// above, so a mosaic line can't be reproduced without composing those lines too.
+	this->_willStoreLineCache = isCacheAllowed &&
+	                            (dispInfo.colorFormat == NDSColorFormat_BGR555_Rev) &&
+	                            !dispInfo.isCustomSizeRequested &&
+	                            !this->_isBGMosaicSet &&
+	                            !this->_isOBJMosaicSet;
+	
+	if (!this->_willStoreLineCache)
+	{
+		this->_isLineCacheValid[l] = false;
+		return false;
+	}
+	
+	// The generation counters only ever increase, so comparing their sums is enough to
+	// catch a write to any page in the windows, as long as the bank mapping is unchanged.
+	LineCacheSignature &sig = this->_pendingLineSignature;
+	memcpy(sig.regs, this->_IORegisterMap, sizeof(sig.regs));
+	memset(sig.regs + 0x04, 0, 4);
+	sig.layerEnable = (this->_enableLayer[GPULayerID_BG0] ? 0x01 : 0) |
+	                  (this->_enableLayer[GPULayerID_BG1] ? 0x02 : 0) |
+	                  (this->_enableLayer[GPULayerID_BG2] ? 0x04 : 0) |
+	                  (this->_enableLayer[GPULayerID_BG3] ? 0x08 : 0) |
+	                  (this->_enableLayer[GPULayerID_OBJ] ? 0x10 : 0);
+	sig.paletteGen = MMU.paletteGen[this->_engineID];
+	sig.oamGen = MMU.oamGen[this->_engineID];
+	sig.vramMapGen = MMU.vramMapGen;
+	sig.vramGen = this->_GetVRAMGeneration();
+	
+	if ( !this->_isLineCacheValid[l] || (memcmp(&sig, &this->_lineCacheSignature[l], sizeof(LineCacheSignature)) != 0) )
+	{
+		return false;
+	}
+	
+	memcpy((u16 *)this->nativeBuffer + (l * GPU_FRAMEBUFFER_NATIVE_WIDTH), this->_lineCacheColor + (l * GPU_FRAMEBUFFER_NATIVE_WIDTH), GPU_FRAMEBUFFER_NATIVE_WIDTH * sizeof(u16));
+	
+	// Leave the affine reference points where composing the line would have left them.
+	this->_IORegisterMap->BG2X.value = this->_lineCacheAffine[l][0];
+	this->_IORegisterMap->BG2Y.value = this->_lineCacheAffine[l][1];
+	this->_IORegisterMap->BG3X.value = this->_lineCacheAffine[l][2];
+	this->_IORegisterMap->BG3Y.value = this->_lineCacheAffine[l][3];
+	
+	this->_willStoreLineCache = false;
+	this->cachedLineCount++;
+	return true;
+}
+
+void GPUEngineBase::_RenderLine_StoreCached(const u16 l)
+{
+	if (!this->_willStoreLineCache)
+	{
+		return;
+	}
+	
+	memcpy(this->_lineCacheColor + (l * GPU_FRAMEBUFFER_NATIVE_WIDTH), (u16 *)this->nativeBuffer + (l * GPU_FRAMEBUFFER_NATIVE_WIDTH), GPU_FRAMEBUFFER_NATIVE_WIDTH * sizeof(u16));
+	
+	this->_lineCacheSignature[l] = this->_pendingLineSignature;
+	this->_lineCacheAffine[l][0] = this->_IORegisterMap->BG2X.value;
+	this->_lineCacheAffine[l][1] = this->_IORegisterMap->BG2Y.value;
+	this->_lineCacheAffine[l][2] = this->_IORegisterMap->BG3X.value;
+	this->_lineCacheAffine[l][3] = this->_IORegisterMap->BG3Y.value;
+	this->_isLineCacheValid[l] = true;
+}
+
+void GPUEngineBase::InvalidateLineCache()
+{
+	memset(this->_isLineCacheValid, 0, sizeof(this->_isLineCacheValid));
+}
+
 void GPUEngineBase::FramebufferPostprocess()
 {
 	this->RefreshAffineStartRegs();
@@ -1547,201 +1647,66 @@ FORCEINLINE void GPUEngineBase::_RenderPixel_CheckWindows(const size_t srcX, boo
 	enableColorEffect = (this->_IORegisterMap->WINOUT.Effect_Enable != 0);
 }
 
-#ifdef ENABLE_SSE2
+#ifdef ENABLE_SIMD128
 
-template <GPULayerID LAYERID, bool ISCUSTOMRENDERINGNEEDED>
-FORCEINLINE void GPUEngineBase::_RenderPixel_CheckWindows16_SSE2(const size_t dstX, __m128i &didPassWindowTest, __m128i &enableColorEffect) const
+// Loads the per-pixel flags (window masks, sprite types) for PIXELCOUNT destination pixels, 16 or 8.
+// At custom resolutions, each destination pixel has to look up its flag through its native source pixel.
+template <bool ISCUSTOMRENDERINGNEEDED, size_t PIXELCOUNT>
+static FORCEINLINE v128u8 LoadPixelFlags_Vec128(const u8 *__restrict flags, const size_t dstX)
 {
-	// If no windows are enabled, then we don't need to perform any window tests.
-	// In this case, the pixel always passes and the color effect is always processed.
-	if (!this->_isAnyWindowEnabled)
+	if (!ISCUSTOMRENDERINGNEEDED)
 	{
-		didPassWindowTest = _mm_set1_epi8(1);
-		enableColorEffect = _mm_set1_epi8(1);
-		return;
+		return (PIXELCOUNT == 16) ? v128u8_loadu(flags + dstX) : v128u8_loadl(flags + dstX);
 	}
 	
-	u8 didPassValue;
-	__m128i win_vec128;
-	
-	__m128i win0HandledMask = _mm_setzero_si128();
-	__m128i win1HandledMask = _mm_setzero_si128();
-	__m128i winOBJHandledMask = _mm_setzero_si128();
-	__m128i winOUTHandledMask = _mm_setzero_si128();
-	
-	// Window 0 has the highest priority, so always check this first.
-	if (this->_WIN0_ENABLED)
+	CACHE_ALIGN u8 gathered[16];
+	for (size_t i = 0; i < PIXELCOUNT; i++)
 	{
-		switch (LAYERID)
-		{
-			case GPULayerID_BG0: didPassValue = this->_IORegisterMap->WIN0IN.BG0_Enable; break;
-			case GPULayerID_BG1: didPassValue = this->_IORegisterMap->WIN0IN.BG1_Enable; break;
-			case GPULayerID_BG2: didPassValue = this->_IORegisterMap->WIN0IN.BG2_Enable; break;
-			case GPULayerID_BG3: didPassValue = this->_IORegisterMap->WIN0IN.BG3_Enable; break;
-			case GPULayerID_OBJ: didPassValue = this->_IORegisterMap->WIN0IN.OBJ_Enable; break;
-				
-			default:
-				didPassValue = 1;
-				break;
-		}
-		
-		if (ISCUSTOMRENDERINGNEEDED)
-		{
-			win_vec128 = _mm_set_epi8(this->_curr_win[0][_gpuDstToSrcIndex[dstX+15]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+14]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+13]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+12]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+11]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+10]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+ 9]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+ 8]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+ 7]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+ 6]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+ 5]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+ 4]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+ 3]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+ 2]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+ 1]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+ 0]]);
-		}
-		else
-		{
-			win_vec128 = _mm_loadu_si128((__m128i *)(this->_curr_win[0] + dstX));
-		}
-		
-		win0HandledMask = _mm_cmpeq_epi8(win_vec128, _mm_set1_epi8(1));
-		didPassWindowTest = _mm_and_si128(win0HandledMask, _mm_set1_epi8(didPassValue));
-		enableColorEffect = _mm_and_si128(win0HandledMask, _mm_set1_epi8(this->_IORegisterMap->WIN0IN.Effect_Enable));
-	}
-	
-	// Window 1 has medium priority, and is checked after Window 0.
-	if (this->_WIN1_ENABLED)
-	{
-		switch (LAYERID)
-		{
-			case GPULayerID_BG0: didPassValue = this->_IORegisterMap->WIN1IN.BG0_Enable; break;
-			case GPULayerID_BG1: didPassValue = this->_IORegisterMap->WIN1IN.BG1_Enable; break;
-			case GPULayerID_BG2: didPassValue = this->_IORegisterMap->WIN1IN.BG2_Enable; break;
-			case GPULayerID_BG3: didPassValue = this->_IORegisterMap->WIN1IN.BG3_Enable; break;
-			case GPULayerID_OBJ: didPassValue = this->_IORegisterMap->WIN1IN.OBJ_Enable; break;
-				
-			default:
-				didPassValue = 1;
-				break;
-		}
-		
-		if (ISCUSTOMRENDERINGNEEDED)
-		{
-			win_vec128 = _mm_set_epi8(this->_curr_win[1][_gpuDstToSrcIndex[dstX+15]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+14]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+13]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+12]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+11]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+10]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+ 9]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+ 8]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+ 7]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+ 6]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+ 5]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+ 4]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+ 3]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+ 2]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+ 1]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+ 0]]);
-		}
-		else
-		{
-			win_vec128 = _mm_loadu_si128((__m128i *)(this->_curr_win[1] + dstX));
-		}
-		
-		win1HandledMask = _mm_andnot_si128( win0HandledMask, _mm_cmpeq_epi8(win_vec128, _mm_set1_epi8(1)) );
-		didPassWindowTest = _mm_or_si128( didPassWindowTest, _mm_and_si128(win1HandledMask, _mm_set1_epi8(didPassValue)) );
-		enableColorEffect = _mm_or_si128( enableColorEffect, _mm_and_si128(win1HandledMask, _mm_set1_epi8(this->_IORegisterMap->WIN1IN.Effect_Enable)) );
-	}
-	
-	// Window OBJ has low priority, and is checked after both Window 0 and Window 1.
-	if (this->_WINOBJ_ENABLED)
-	{
-		switch (LAYERID)
-		{
-			case GPULayerID_BG0: didPassValue = this->_IORegisterMap->WINOBJ.BG0_Enable; break;
-			case GPULayerID_BG1: didPassValue = this->_IORegisterMap->WINOBJ.BG1_Enable; break;
-			case GPULayerID_BG2: didPassValue = this->_IORegisterMap->WINOBJ.BG2_Enable; break;
-			case GPULayerID_BG3: didPassValue = this->_IORegisterMap->WINOBJ.BG3_Enable; break;
-			case GPULayerID_OBJ: didPassValue = this->_IORegisterMap->WINOBJ.OBJ_Enable; break;
-				
-			default:
-				didPassValue = 1;
-				break;
-		}
-		
-		if (ISCUSTOMRENDERINGNEEDED)
-		{
-			win_vec128 = _mm_set_epi8(this->_sprWin[_gpuDstToSrcIndex[dstX+15]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+14]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+13]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+12]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+11]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+10]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+ 9]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+ 8]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+ 7]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+ 6]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+ 5]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+ 4]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+ 3]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+ 2]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+ 1]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+ 0]]);
-		}
-		else
-		{
-			win_vec128 = _mm_loadu_si128((__m128i *)(this->_sprWin + dstX));
-		}
-		
-		winOBJHandledMask = _mm_andnot_si128( _mm_or_si128(win0HandledMask, win1HandledMask), _mm_cmpeq_epi8(win_vec128, _mm_set1_epi8(1)) );
-		didPassWindowTest = _mm_or_si128( didPassWindowTest, _mm_and_si128(winOBJHandledMask, _mm_set1_epi8(didPassValue)) );
-		enableColorEffect = _mm_or_si128( enableColorEffect, _mm_and_si128(winOBJHandledMask, _mm_set1_epi8(this->_IORegisterMap->WINOBJ.Effect_Enable)) );
+		gathered[i] = flags[_gpuDstToSrcIndex[dstX + i]];
 	}
 	
-	// If the pixel isn't inside any windows, then the pixel is outside, and therefore uses the WINOUT flags.
-	// This has the lowest priority, and is always checked last.
-	switch (LAYERID)
+	return (PIXELCOUNT == 16) ? v128u8_load(gathered) : v128u8_loadl(gathered);
+}
+
+template <size_t PIXELCOUNT>
+FORCEINLINE v128u8 GPUEngineBase::_RenderPixel_Blend2Mask_Vec128(const u8 *__restrict dstLayerIDLine, const v128u8 &dstLayerID_vec128) const
+{
+#ifdef ENABLE_SSSE3
+	return _mm_shuffle_epi8(this->_blend2_SSSE3, dstLayerID_vec128);
+#else
+	CACHE_ALIGN u8 blend2[16];
+	for (size_t i = 0; i < PIXELCOUNT; i++)
 	{
-		case GPULayerID_BG0: didPassValue = this->_IORegisterMap->WINOUT.BG0_Enable; break;
-		case GPULayerID_BG1: didPassValue = this->_IORegisterMap->WINOUT.BG1_Enable; break;
-		case GPULayerID_BG2: didPassValue = this->_IORegisterMap->WINOUT.BG2_Enable; break;
-		case GPULayerID_BG3: didPassValue = this->_IORegisterMap->WINOUT.BG3_Enable; break;
-		case GPULayerID_OBJ: didPassValue = this->_IORegisterMap->WINOUT.OBJ_Enable; break;
-			
-		default:
-			break;
+		blend2[i] = (this->_blend2[dstLayerIDLine[i]]) ? 1 : 0;
 	}
 	
-	winOUTHandledMask = _mm_xor_si128( _mm_or_si128(win0HandledMask, _mm_or_si128(win1HandledMask, winOBJHandledMask)), _mm_set1_epi32(0xFFFFFFFF) );
-	didPassWindowTest = _mm_or_si128( didPassWindowTest, _mm_and_si128(winOUTHandledMask, _mm_set1_epi8(didPassValue)) );
-	enableColorEffect = _mm_or_si128( enableColorEffect, _mm_and_si128(winOUTHandledMask, _mm_set1_epi8(this->_IORegisterMap->WINOUT.Effect_Enable)) );
+	return (PIXELCOUNT == 16) ? v128u8_load(blend2) : v128u8_loadl(blend2);
+#endif
 }
 
-template <GPULayerID LAYERID, bool ISCUSTOMRENDERINGNEEDED>
-FORCEINLINE void GPUEngineBase::_RenderPixel_CheckWindows8_SSE2(const size_t dstX, __m128i &didPassWindowTest, __m128i &enableColorEffect) const
+// Does the window test for 16 pixels, or for the lower 8 lanes only when PIXELCOUNT is 8.
+template <GPULayerID LAYERID, bool ISCUSTOMRENDERINGNEEDED, size_t PIXELCOUNT>
+FORCEINLINE void GPUEngineBase::_RenderPixel_CheckWindows_Vec128(const size_t dstX, v128u8 &didPassWindowTest, v128u8 &enableColorEffect) const
 {
 	// If no windows are enabled, then we don't need to perform any window tests.
 	// In this case, the pixel always passes and the color effect is always processed.
 	if (!this->_isAnyWindowEnabled)
 	{
-		didPassWindowTest = _mm_set_epi32(0, 0, 0x01010101, 0x01010101);
-		enableColorEffect = _mm_set_epi32(0, 0, 0x01010101, 0x01010101);
+		didPassWindowTest = v128u8_set1(1);
+		enableColorEffect = v128u8_set1(1);
 		return;
 	}
 	
 	u8 didPassValue;
-	__m128i win_vec128;
+	v128u8 win_vec128;
+	
+	v128u8 win0HandledMask = v128u8_setzero();
+	v128u8 win1HandledMask = v128u8_setzero();
+	v128u8 winOBJHandledMask = v128u8_setzero();
+	v128u8 winOUTHandledMask = v128u8_setzero();
 	
-	__m128i win0HandledMask = _mm_setzero_si128();
-	__m128i win1HandledMask = _mm_setzero_si128();
-	__m128i winOBJHandledMask = _mm_setzero_si128();
-	__m128i winOUTHandledMask = _mm_setzero_si128();
+	didPassWindowTest = v128u8_setzero();
+	enableColorEffect = v128u8_setzero();
 	
 	// Window 0 has the highest priority, so always check this first.
 	if (this->_WIN0_ENABLED)
@@ -1759,26 +1724,11 @@ FORCEINLINE void GPUEngineBase::_RenderPixel_CheckWindows8_SSE2(const size_t dst
 				break;
 		}
 		
-		if (ISCUSTOMRENDERINGNEEDED)
-		{
-			win_vec128 = _mm_set_epi8(0, 0, 0, 0, 0, 0, 0, 0,
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+7]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+6]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+5]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+4]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+3]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+2]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+1]],
-									  this->_curr_win[0][_gpuDstToSrcIndex[dstX+0]]);
-		}
-		else
-		{
-			win_vec128 = _mm_loadl_epi64((__m128i *)(this->_curr_win[0] + dstX));
-		}
+		win_vec128 = LoadPixelFlags_Vec128<ISCUSTOMRENDERINGNEEDED, PIXELCOUNT>(this->_curr_win[0], dstX);
 		
-		win0HandledMask = _mm_cmpeq_epi8(win_vec128, _mm_set1_epi8(1));
-		didPassWindowTest = _mm_and_si128(win0HandledMask, _mm_set1_epi8(didPassValue));
-		enableColorEffect = _mm_and_si128(win0HandledMask, _mm_set1_epi8(this->_IORegisterMap->WIN0IN.Effect_Enable));
+		win0HandledMask = v128u8_cmpeq(win_vec128, v128u8_set1(1));
+		didPassWindowTest = v128u8_and(win0HandledMask, v128u8_set1(didPassValue));
+		enableColorEffect = v128u8_and(win0HandledMask, v128u8_set1(this->_IORegisterMap->WIN0IN.Effect_Enable));
 	}
 	
 	// Window 1 has medium priority, and is checked after Window 0.
@@ -1797,26 +1747,11 @@ FORCEINLINE void GPUEngineBase::_RenderPixel_CheckWindows8_SSE2(const size_t dst
 				break;
 		}
 		
-		if (ISCUSTOMRENDERINGNEEDED)
-		{
-			win_vec128 = _mm_set_epi8(0, 0, 0, 0, 0, 0, 0, 0,
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+7]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+6]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+5]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+4]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+3]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+2]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+1]],
-									  this->_curr_win[1][_gpuDstToSrcIndex[dstX+0]]);
-		}
-		else
-		{
-			win_vec128 = _mm_loadl_epi64((__m128i *)(this->_curr_win[1] + dstX));
-		}
+		win_vec128 = LoadPixelFlags_Vec128<ISCUSTOMRENDERINGNEEDED, PIXELCOUNT>(this->_curr_win[1], dstX);
 		
-		win1HandledMask = _mm_andnot_si128( win0HandledMask, _mm_cmpeq_epi8(win_vec128, _mm_set1_epi8(1)) );
-		didPassWindowTest = _mm_or_si128( didPassWindowTest, _mm_and_si128(win1HandledMask, _mm_set1_epi8(didPassValue)) );
-		enableColorEffect = _mm_or_si128( enableColorEffect, _mm_and_si128(win1HandledMask, _mm_set1_epi8(this->_IORegisterMap->WIN1IN.Effect_Enable)) );
+		win1HandledMask = v128u8_andnot( win0HandledMask, v128u8_cmpeq(win_vec128, v128u8_set1(1)) );
+		didPassWindowTest = v128u8_or( didPassWindowTest, v128u8_and(win1HandledMask, v128u8_set1(didPassValue)) );
+		enableColorEffect = v128u8_or( enableColorEffect, v128u8_and(win1HandledMask, v128u8_set1(this->_IORegisterMap->WIN1IN.Effect_Enable)) );
 	}
 	
 	// Window OBJ has low priority, and is checked after both Window 0 and Window 1.
@@ -1835,26 +1770,11 @@ FORCEINLINE void GPUEngineBase::_RenderPixel_CheckWindows8_SSE2(const size_t dst
 				break;
 		}
 		
-		if (ISCUSTOMRENDERINGNEEDED)
-		{
-			win_vec128 = _mm_set_epi8(0, 0, 0, 0, 0, 0, 0, 0,
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+7]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+6]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+5]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+4]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+3]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+2]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+1]],
-									  this->_sprWin[_gpuDstToSrcIndex[dstX+0]]);
-		}
-		else
-		{
-			win_vec128 = _mm_loadl_epi64((__m128i *)(this->_sprWin + dstX));
-		}
+		win_vec128 = LoadPixelFlags_Vec128<ISCUSTOMRENDERINGNEEDED, PIXELCOUNT>(this->_sprWin, dstX);
 		
-		winOBJHandledMask = _mm_andnot_si128( _mm_or_si128(win0HandledMask, win1HandledMask), _mm_cmpeq_epi8(win_vec128, _mm_set1_epi8(1)) );
-		didPassWindowTest = _mm_or_si128( didPassWindowTest, _mm_and_si128(winOBJHandledMask, _mm_set1_epi8(didPassValue)) );
-		enableColorEffect = _mm_or_si128( enableColorEffect, _mm_and_si128(winOBJHandledMask, _mm_set1_epi8(this->_IORegisterMap->WINOBJ.Effect_Enable)) );
+		winOBJHandledMask = v128u8_andnot( v128u8_or(win0HandledMask, win1HandledMask), v128u8_cmpeq(win_vec128, v128u8_set1(1)) );
+		didPassWindowTest = v128u8_or( didPassWindowTest, v128u8_and(winOBJHandledMask, v128u8_set1(didPassValue)) );
+		enableColorEffect = v128u8_or( enableColorEffect, v128u8_and(winOBJHandledMask, v128u8_set1(this->_IORegisterMap->WINOBJ.Effect_Enable)) );
 	}
 	
 	// If the pixel isn't inside any windows, then the pixel is outside, and therefore uses the WINOUT flags.
@@ -1868,12 +1788,13 @@ FORCEINLINE void GPUEngineBase::_RenderPixel_CheckWindows8_SSE2(const size_t dst
 		case GPULayerID_OBJ: didPassValue = this->_IORegisterMap->WINOUT.OBJ_Enable; break;
 			
 		default:
+			didPassValue = 1;
 			break;
 	}
 	
-	winOUTHandledMask = _mm_and_si128( _mm_set_epi32(0, 0, 0xFFFFFFFF, 0xFFFFFFFF), _mm_xor_si128(_mm_or_si128(win0HandledMask, _mm_or_si128(win1HandledMask, winOBJHandledMask)), _mm_set1_epi32(0xFFFFFFFF)) );
-	didPassWindowTest = _mm_or_si128( didPassWindowTest, _mm_and_si128(winOUTHandledMask, _mm_set1_epi8(didPassValue)) );
-	enableColorEffect = _mm_or_si128( enableColorEffect, _mm_and_si128(winOUTHandledMask, _mm_set1_epi8(this->_IORegisterMap->WINOUT.Effect_Enable)) );
+	winOUTHandledMask = v128u8_xor( v128u8_or(win0HandledMask, v128u8_or(win1HandledMask, winOBJHandledMask)), v128u8_set1(0xFF) );
+	didPassWindowTest = v128u8_or( didPassWindowTest, v128u8_and(winOUTHandledMask, v128u8_set1(didPassValue)) );
+	enableColorEffect = v128u8_or( enableColorEffect, v128u8_and(winOUTHandledMask, v128u8_set1(this->_IORegisterMap->WINOUT.Effect_Enable)) );
 }
 
 #endif
@@ -2026,55 +1947,55 @@ FORCEINLINE void GPUEngineBase::_RenderPixel(const size_t srcX, const u16 src, c
 	*dstLayerIDLine = LAYERID;
 }
 
-#ifdef ENABLE_SSE2
+#ifdef ENABLE_SIMD128
 
 template <GPULayerID LAYERID, bool ISDEBUGRENDER, bool NOWINDOWSENABLEDHINT, bool COLOREFFECTDISABLEDHINT, bool ISCUSTOMRENDERINGNEEDED>
-FORCEINLINE void GPUEngineBase::_RenderPixel16_SSE2(const size_t dstX,
-													const __m128i &srcColorHi_vec128,
-													const __m128i &srcColorLo_vec128,
-													const __m128i &srcOpaqueMask,
-													const u8 *__restrict srcAlpha,
-													u16 *__restrict dstColorLine,
-													u8 *__restrict dstLayerIDLine)
+FORCEINLINE void GPUEngineBase::_RenderPixel16_Vec128(const size_t dstX,
+													  const v128u16 &srcColorHi_vec128,
+													  const v128u16 &srcColorLo_vec128,
+													  const v128u8 &srcOpaqueMask,
+													  const u8 *__restrict srcAlpha,
+													  u16 *__restrict dstColorLine,
+													  u8 *__restrict dstLayerIDLine)
 {
-	const __m128i dstColorLo_vec128 = _mm_load_si128((__m128i *)dstColorLine);
-	const __m128i dstColorHi_vec128 = _mm_load_si128((__m128i *)(dstColorLine + 8));
-	const __m128i dstLayerID_vec128 = _mm_load_si128((__m128i *)dstLayerIDLine);
+	const v128u16 dstColorLo_vec128 = v128u16_load(dstColorLine);
+	const v128u16 dstColorHi_vec128 = v128u16_load(dstColorLine + 8);
+	const v128u8 dstLayerID_vec128 = v128u8_load(dstLayerIDLine);
 	
-	const __m128i srcOpaqueMaskLo = _mm_cmpeq_epi16( _mm_unpacklo_epi8(srcOpaqueMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF));
-	const __m128i srcOpaqueMaskHi = _mm_cmpeq_epi16( _mm_unpackhi_epi8(srcOpaqueMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF));
+	const v128u16 srcOpaqueMaskLo = v128u16_cmpeq( v128u8_unpacklo_u16(srcOpaqueMask), v128u16_set1(0x00FF) );
+	const v128u16 srcOpaqueMaskHi = v128u16_cmpeq( v128u8_unpackhi_u16(srcOpaqueMask), v128u16_set1(0x00FF) );
 	
 	if (ISDEBUGRENDER)
 	{
 		// If we're rendering pixels to a debugging context, then assume that the pixel
 		// always passes the window test and that the color effect is always disabled.
-		_mm_store_si128( (__m128i *)dstColorLine, _mm_or_si128(_mm_and_si128(srcOpaqueMaskLo, _mm_or_si128(srcColorLo_vec128, _mm_set1_epi16(0x8000))), _mm_andnot_si128(srcOpaqueMaskLo, dstColorLo_vec128)) );
-		_mm_store_si128( (__m128i *)(dstColorLine + 8), _mm_or_si128(_mm_and_si128(srcOpaqueMaskHi, _mm_or_si128(srcColorHi_vec128, _mm_set1_epi16(0x8000))), _mm_andnot_si128(srcOpaqueMaskHi, dstColorHi_vec128)) );
-		_mm_store_si128( (__m128i *)dstLayerIDLine, _mm_or_si128(_mm_and_si128(srcOpaqueMask, _mm_set1_epi8(LAYERID)), _mm_andnot_si128(srcOpaqueMask, dstLayerID_vec128)) );
+		v128u16_store( dstColorLine, v128u16_or(v128u16_and(srcOpaqueMaskLo, v128u16_or(srcColorLo_vec128, v128u16_set1(0x8000))), v128u16_andnot(srcOpaqueMaskLo, dstColorLo_vec128)) );
+		v128u16_store( dstColorLine + 8, v128u16_or(v128u16_and(srcOpaqueMaskHi, v128u16_or(srcColorHi_vec128, v128u16_set1(0x8000))), v128u16_andnot(srcOpaqueMaskHi, dstColorHi_vec128)) );
+		v128u8_store( dstLayerIDLine, v128u8_or(v128u8_and(srcOpaqueMask, v128u8_set1(LAYERID)), v128u8_andnot(srcOpaqueMask, dstLayerID_vec128)) );
 		return;
 	}
 	
-	__m128i passMaskLo = srcOpaqueMaskLo;
-	__m128i passMaskHi = srcOpaqueMaskHi;
-	__m128i passMask8 = srcOpaqueMask;
-	__m128i enableColorEffect = _mm_set1_epi8(1);
+	v128u16 passMaskLo = srcOpaqueMaskLo;
+	v128u16 passMaskHi = srcOpaqueMaskHi;
+	v128u8 passMask8 = srcOpaqueMask;
+	v128u8 enableColorEffect = v128u8_set1(1);
 	
 	if (!NOWINDOWSENABLEDHINT)
 	{
 		// Do the window test.
-		__m128i didPassWindowTest = _mm_set1_epi8(1);
-		this->_RenderPixel_CheckWindows16_SSE2<LAYERID, ISCUSTOMRENDERINGNEEDED>(dstX, didPassWindowTest, enableColorEffect);
+		v128u8 didPassWindowTest;
+		this->_RenderPixel_CheckWindows_Vec128<LAYERID, ISCUSTOMRENDERINGNEEDED, 16>(dstX, didPassWindowTest, enableColorEffect);
 		
-		passMaskLo = _mm_and_si128( passMaskLo, _mm_cmpeq_epi16(_mm_unpacklo_epi8(didPassWindowTest, _mm_setzero_si128()), _mm_set1_epi16(1)) );
-		passMaskHi = _mm_and_si128( passMaskHi, _mm_cmpeq_epi16(_mm_unpackhi_epi8(didPassWindowTest, _mm_setzero_si128()), _mm_set1_epi16(1)) );
-		passMask8 = _mm_and_si128( passMask8, _mm_packs_epi16(passMaskLo, passMaskHi) );
+		passMaskLo = v128u16_and( passMaskLo, v128u16_cmpeq(v128u8_unpacklo_u16(didPassWindowTest), v128u16_set1(1)) );
+		passMaskHi = v128u16_and( passMaskHi, v128u16_cmpeq(v128u8_unpackhi_u16(didPassWindowTest), v128u16_set1(1)) );
+		passMask8 = v128u8_and( passMask8, v128u8_packmask(passMaskLo, passMaskHi) );
 	}
 	
 	if ((LAYERID != GPULayerID_OBJ) && COLOREFFECTDISABLEDHINT)
 	{
-		_mm_store_si128( (__m128i *)dstColorLine, _mm_or_si128(_mm_and_si128(passMaskLo, _mm_or_si128(srcColorLo_vec128, _mm_set1_epi16(0x8000))), _mm_andnot_si128(passMaskLo, dstColorLo_vec128)) );
-		_mm_store_si128( (__m128i *)(dstColorLine + 8), _mm_or_si128(_mm_and_si128(passMaskHi, _mm_or_si128(srcColorHi_vec128, _mm_set1_epi16(0x8000))), _mm_andnot_si128(passMaskHi, dstColorHi_vec128)) );
-		_mm_store_si128( (__m128i *)dstLayerIDLine, _mm_or_si128(_mm_and_si128(passMask8, _mm_set1_epi8(LAYERID)), _mm_andnot_si128(passMask8, dstLayerID_vec128)) );
+		v128u16_store( dstColorLine, v128u16_or(v128u16_and(passMaskLo, v128u16_or(srcColorLo_vec128, v128u16_set1(0x8000))), v128u16_andnot(passMaskLo, dstColorLo_vec128)) );
+		v128u16_store( dstColorLine + 8, v128u16_or(v128u16_and(passMaskHi, v128u16_or(srcColorHi_vec128, v128u16_set1(0x8000))), v128u16_andnot(passMaskHi, dstColorHi_vec128)) );
+		v128u8_store( dstLayerIDLine, v128u8_or(v128u8_and(passMask8, v128u8_set1(LAYERID)), v128u8_andnot(passMask8, dstLayerID_vec128)) );
 		return;
 	}
 	
@@ -2107,79 +2028,60 @@ FORCEINLINE void GPUEngineBase::_RenderPixel16_SSE2(const size_t dstX,
 			srcEffectEnableValue = 0;
 			break;
 	}
-	const __m128i srcEffectEnableMask = _mm_cmpeq_epi8(_mm_set1_epi8(srcEffectEnableValue), _mm_set1_epi8(1));
-	
-#ifdef ENABLE_SSSE3
-	__m128i dstEffectEnableMask = _mm_shuffle_epi8(this->_blend2_SSSE3, dstLayerID_vec128);
-#else
-	__m128i dstEffectEnableMask = _mm_set_epi8(this->_blend2[dstLayerIDLine[15]],
-											   this->_blend2[dstLayerIDLine[14]],
-											   this->_blend2[dstLayerIDLine[13]],
-											   this->_blend2[dstLayerIDLine[12]],
-											   this->_blend2[dstLayerIDLine[11]],
-											   this->_blend2[dstLayerIDLine[10]],
-											   this->_blend2[dstLayerIDLine[ 9]],
-											   this->_blend2[dstLayerIDLine[ 8]],
-											   this->_blend2[dstLayerIDLine[ 7]],
-											   this->_blend2[dstLayerIDLine[ 6]],
-											   this->_blend2[dstLayerIDLine[ 5]],
-											   this->_blend2[dstLayerIDLine[ 4]],
-											   this->_blend2[dstLayerIDLine[ 3]],
-											   this->_blend2[dstLayerIDLine[ 2]],
-											   this->_blend2[dstLayerIDLine[ 1]],
-											   this->_blend2[dstLayerIDLine[ 0]]);
-#endif
+	const v128u8 srcEffectEnableMask = v128u8_cmpeq(v128u8_set1(srcEffectEnableValue), v128u8_set1(1));
 	
-	dstEffectEnableMask = _mm_and_si128(_mm_xor_si128(_mm_cmpeq_epi8(dstLayerID_vec128, _mm_set1_epi8(LAYERID)), _mm_set1_epi32(0xFFFFFFFF)),
-										_mm_xor_si128(_mm_cmpeq_epi8(dstEffectEnableMask, _mm_setzero_si128()), _mm_set1_epi32(0xFFFFFFFF)) );
+	v128u8 dstEffectEnableMask = this->_RenderPixel_Blend2Mask_Vec128<16>(dstLayerIDLine, dstLayerID_vec128);
+	dstEffectEnableMask = v128u8_and( v128u8_xor(v128u8_cmpeq(dstLayerID_vec128, v128u8_set1(LAYERID)), v128u8_set1(0xFF)),
+									  v128u8_xor(v128u8_cmpeq(dstEffectEnableMask, v128u8_setzero()), v128u8_set1(0xFF)) );
 	
 	// Select the color effect based on the BLDCNT target flags.
-	__m128i forceBlendEffectMask = _mm_setzero_si128();
-	__m128i colorEffect_vec128;
+	const v128u8 enableColorEffectMask = v128u8_cmpeq(enableColorEffect, v128u8_set1(1));
+	const v128u8 colorEffect_vec128 = v128u8_or( v128u8_and(enableColorEffectMask, v128u8_set1(BLDCNT.ColorEffect)), v128u8_andnot(enableColorEffectMask, v128u8_set1(ColorEffect_Disable)) );
+	v128u8 forceBlendEffectMask = v128u8_setzero();
 	
-	if (NOWINDOWSENABLEDHINT)
-	{
-		colorEffect_vec128 = _mm_set1_epi8(BLDCNT.ColorEffect);
-	}
-	else
-	{
-		const __m128i enableColorEffectMask = _mm_cmpeq_epi8(enableColorEffect, _mm_set1_epi8(1));
-		colorEffect_vec128 = _mm_or_si128( _mm_and_si128(enableColorEffectMask, _mm_set1_epi8(BLDCNT.ColorEffect)), _mm_andnot_si128(enableColorEffectMask, _mm_set1_epi8(ColorEffect_Disable)) );
-	}
-	
-	__m128i eva_vec128 = _mm_set1_epi16(this->_BLDALPHA_EVA);
-	__m128i evb_vec128 = _mm_set1_epi16(this->_BLDALPHA_EVB);
-	const __m128i evy_vec128 = _mm_set1_epi16(this->_BLDALPHA_EVY);
+	v128u16 evaLo_vec128 = v128u16_set1(this->_BLDALPHA_EVA);
+	v128u16 evaHi_vec128 = evaLo_vec128;
+	v128u16 evbLo_vec128 = v128u16_set1(this->_BLDALPHA_EVB);
+	v128u16 evbHi_vec128 = evbLo_vec128;
+	const v128u16 evy_vec128 = v128u16_set1(this->_BLDALPHA_EVY);
 	
 	if (LAYERID == GPULayerID_OBJ)
 	{
-		const __m128i objMode_vec128 = _mm_loadu_si128((__m128i *)(this->_sprType + dstX));
-		const __m128i isObjTranslucentMask = _mm_and_si128( dstEffectEnableMask, _mm_or_si128(_mm_cmpeq_epi8(objMode_vec128, _mm_set1_epi8(OBJMode_Transparent)), _mm_cmpeq_epi8(objMode_vec128, _mm_set1_epi8(OBJMode_Bitmap))) );
+		// Translucent-capable OBJ force the blend when the second target is satisfied, using their
+		// own alpha in place of EVA/EVB unless it's 0xFF.
+		const v128u8 objMode_vec128 = LoadPixelFlags_Vec128<false, 16>(this->_sprType, dstX);
+		const v128u8 isObjTranslucentMask = v128u8_and( v128u8_and(enableColorEffectMask, dstEffectEnableMask), v128u8_or(v128u8_cmpeq(objMode_vec128, v128u8_set1(OBJMode_Transparent)), v128u8_cmpeq(objMode_vec128, v128u8_set1(OBJMode_Bitmap))) );
 		forceBlendEffectMask = isObjTranslucentMask;
 		
-		const __m128i srcAlpha_vec128 = _mm_loadu_si128((__m128i *)(srcAlpha + dstX));
-		const __m128i srcAlphaMask = _mm_and_si128( isObjTranslucentMask, _mm_xor_si128(_mm_cmpeq_epi8(srcAlpha_vec128, _mm_set1_epi8(0xFF)), _mm_set1_epi32(0xFFFFFFFF)) );
+		const v128u8 srcAlpha_vec128 = v128u8_loadu(srcAlpha + dstX);
+		const v128u8 srcAlphaMask = v128u8_andnot( v128u8_cmpeq(srcAlpha_vec128, v128u8_set1(0xFF)), isObjTranslucentMask );
+		const v128u16 srcAlphaMaskLo = v128u16_cmpeq( v128u8_unpacklo_u16(srcAlphaMask), v128u16_set1(0x00FF) );
+		const v128u16 srcAlphaMaskHi = v128u16_cmpeq( v128u8_unpackhi_u16(srcAlphaMask), v128u16_set1(0x00FF) );
+		const v128u16 srcAlphaLo_vec128 = v128u8_unpacklo_u16(srcAlpha_vec128);
+		const v128u16 srcAlphaHi_vec128 = v128u8_unpackhi_u16(srcAlpha_vec128);
 		
-		eva_vec128 = _mm_or_si128( _mm_and_si128(srcAlphaMask, srcAlpha_vec128), _mm_andnot_si128(srcAlphaMask, eva_vec128) );
-		evb_vec128 = _mm_or_si128( _mm_and_si128(srcAlphaMask, _mm_sub_epi8(_mm_set1_epi8(16), srcAlpha_vec128)), _mm_andnot_si128(srcAlphaMask, evb_vec128) );
+		evaLo_vec128 = v128u16_or( v128u16_and(srcAlphaMaskLo, srcAlphaLo_vec128), v128u16_andnot(srcAlphaMaskLo, evaLo_vec128) );
+		evaHi_vec128 = v128u16_or( v128u16_and(srcAlphaMaskHi, srcAlphaHi_vec128), v128u16_andnot(srcAlphaMaskHi, evaHi_vec128) );
+		evbLo_vec128 = v128u16_or( v128u16_and(srcAlphaMaskLo, v128u16_sub(v128u16_set1(16), srcAlphaLo_vec128)), v128u16_andnot(srcAlphaMaskLo, evbLo_vec128) );
+		evbHi_vec128 = v128u16_or( v128u16_and(srcAlphaMaskHi, v128u16_sub(v128u16_set1(16), srcAlphaHi_vec128)), v128u16_andnot(srcAlphaMaskHi, evbHi_vec128) );
 	}
 	
-	__m128i brightnessMask = _mm_setzero_si128();
-	__m128i brightnessPixelsLo = _mm_setzero_si128();
-	__m128i brightnessPixelsHi = _mm_setzero_si128();
+	v128u8 brightnessMask = v128u8_setzero();
+	v128u16 brightnessPixelsLo = v128u16_setzero();
+	v128u16 brightnessPixelsHi = v128u16_setzero();
 	
 	switch (BLDCNT.ColorEffect)
 	{
 		case ColorEffect_IncreaseBrightness:
-			brightnessMask = _mm_andnot_si128( forceBlendEffectMask, _mm_and_si128(srcEffectEnableMask, _mm_cmpeq_epi8(colorEffect_vec128, _mm_set1_epi8(ColorEffect_IncreaseBrightness))) );
-			brightnessPixelsLo = _mm_and_si128( this->_ColorEffectIncreaseBrightness(srcColorLo_vec128, evy_vec128), _mm_cmpeq_epi16(_mm_unpacklo_epi8(brightnessMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
-			brightnessPixelsHi = _mm_and_si128( this->_ColorEffectIncreaseBrightness(srcColorHi_vec128, evy_vec128), _mm_cmpeq_epi16(_mm_unpackhi_epi8(brightnessMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
+			brightnessMask = v128u8_andnot( forceBlendEffectMask, v128u8_and(srcEffectEnableMask, v128u8_cmpeq(colorEffect_vec128, v128u8_set1(ColorEffect_IncreaseBrightness))) );
+			brightnessPixelsLo = v128u16_and( this->_ColorEffectIncreaseBrightness(srcColorLo_vec128, evy_vec128), v128u16_cmpeq(v128u8_unpacklo_u16(brightnessMask), v128u16_set1(0x00FF)) );
+			brightnessPixelsHi = v128u16_and( this->_ColorEffectIncreaseBrightness(srcColorHi_vec128, evy_vec128), v128u16_cmpeq(v128u8_unpackhi_u16(brightnessMask), v128u16_set1(0x00FF)) );
 			break;
 			
 		case ColorEffect_DecreaseBrightness:
-			brightnessMask = _mm_andnot_si128( forceBlendEffectMask, _mm_and_si128(srcEffectEnableMask, _mm_cmpeq_epi8(colorEffect_vec128, _mm_set1_epi8(ColorEffect_DecreaseBrightness))) );
-			brightnessPixelsLo = _mm_and_si128( this->_ColorEffectDecreaseBrightness(srcColorLo_vec128, evy_vec128), _mm_cmpeq_epi16(_mm_unpacklo_epi8(brightnessMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
-			brightnessPixelsHi = _mm_and_si128( this->_ColorEffectDecreaseBrightness(srcColorHi_vec128, evy_vec128), _mm_cmpeq_epi16(_mm_unpackhi_epi8(brightnessMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
+			brightnessMask = v128u8_andnot( forceBlendEffectMask, v128u8_and(srcEffectEnableMask, v128u8_cmpeq(colorEffect_vec128, v128u8_set1(ColorEffect_DecreaseBrightness))) );
+			brightnessPixelsLo = v128u16_and( this->_ColorEffectDecreaseBrightness(srcColorLo_vec128, evy_vec128), v128u16_cmpeq(v128u8_unpacklo_u16(brightnessMask), v128u16_set1(0x00FF)) );
+			brightnessPixelsHi = v128u16_and( this->_ColorEffectDecreaseBrightness(srcColorHi_vec128, evy_vec128), v128u16_cmpeq(v128u8_unpackhi_u16(brightnessMask), v128u16_set1(0x00FF)) );
 			break;
 			
 		default:
@@ -2187,63 +2089,62 @@ FORCEINLINE void GPUEngineBase::_RenderPixel16_SSE2(const size_t dstX,
 	}
 	
 	// Render the pixel using the selected color effect.
-	const __m128i blendMask = _mm_or_si128( forceBlendEffectMask, _mm_and_si128(_mm_and_si128(srcEffectEnableMask, dstEffectEnableMask), _mm_cmpeq_epi8(colorEffect_vec128, _mm_set1_epi8(ColorEffect_Blend))) );
-	const __m128i blendPixelsLo = _mm_and_si128( this->_ColorEffectBlend(srcColorLo_vec128, dstColorLo_vec128, eva_vec128, evb_vec128), _mm_cmpeq_epi16(_mm_unpacklo_epi8(blendMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
-	const __m128i blendPixelsHi = _mm_and_si128( this->_ColorEffectBlend(srcColorHi_vec128, dstColorHi_vec128, eva_vec128, evb_vec128), _mm_cmpeq_epi16(_mm_unpackhi_epi8(blendMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
+	const v128u8 blendMask = v128u8_or( forceBlendEffectMask, v128u8_and(v128u8_and(srcEffectEnableMask, dstEffectEnableMask), v128u8_cmpeq(colorEffect_vec128, v128u8_set1(ColorEffect_Blend))) );
+	const v128u16 blendPixelsLo = v128u16_and( this->_ColorEffectBlend(srcColorLo_vec128, dstColorLo_vec128, evaLo_vec128, evbLo_vec128), v128u16_cmpeq(v128u8_unpacklo_u16(blendMask), v128u16_set1(0x00FF)) );
+	const v128u16 blendPixelsHi = v128u16_and( this->_ColorEffectBlend(srcColorHi_vec128, dstColorHi_vec128, evaHi_vec128, evbHi_vec128), v128u16_cmpeq(v128u8_unpackhi_u16(blendMask), v128u16_set1(0x00FF)) );
 	
-	const __m128i disableMask = _mm_xor_si128( _mm_or_si128(brightnessMask, blendMask), _mm_set1_epi32(0xFFFFFFFF) );
-	const __m128i disablePixelsLo = _mm_and_si128( srcColorLo_vec128, _mm_cmpeq_epi16(_mm_unpacklo_epi8(disableMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
-	const __m128i disablePixelsHi = _mm_and_si128( srcColorHi_vec128, _mm_cmpeq_epi16(_mm_unpackhi_epi8(disableMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
+	const v128u8 disableMask = v128u8_xor( v128u8_or(brightnessMask, blendMask), v128u8_set1(0xFF) );
+	const v128u16 disablePixelsLo = v128u16_and( srcColorLo_vec128, v128u16_cmpeq(v128u8_unpacklo_u16(disableMask), v128u16_set1(0x00FF)) );
+	const v128u16 disablePixelsHi = v128u16_and( srcColorHi_vec128, v128u16_cmpeq(v128u8_unpackhi_u16(disableMask), v128u16_set1(0x00FF)) );
 	
 	// Combine the final colors.
-	const __m128i combinedSrcColorLo_vec128 = _mm_or_si128( _mm_or_si128(_mm_or_si128(brightnessPixelsLo, blendPixelsLo), disablePixelsLo), _mm_set1_epi16(0x8000) );
-	const __m128i combinedSrcColorHi_vec128 = _mm_or_si128( _mm_or_si128(_mm_or_si128(brightnessPixelsHi, blendPixelsHi), disablePixelsHi), _mm_set1_epi16(0x8000) );
+	const v128u16 combinedSrcColorLo_vec128 = v128u16_or( v128u16_or(v128u16_or(brightnessPixelsLo, blendPixelsLo), disablePixelsLo), v128u16_set1(0x8000) );
+	const v128u16 combinedSrcColorHi_vec128 = v128u16_or( v128u16_or(v128u16_or(brightnessPixelsHi, blendPixelsHi), disablePixelsHi), v128u16_set1(0x8000) );
 	
-	_mm_store_si128( (__m128i *)dstColorLine, _mm_or_si128(_mm_and_si128(passMaskLo, combinedSrcColorLo_vec128), _mm_andnot_si128(passMaskLo, dstColorLo_vec128)) );
-	_mm_store_si128( (__m128i *)(dstColorLine + 8), _mm_or_si128(_mm_and_si128(passMaskHi, combinedSrcColorHi_vec128), _mm_andnot_si128(passMaskHi, dstColorHi_vec128)) );
-	_mm_store_si128( (__m128i *)dstLayerIDLine, _mm_or_si128(_mm_and_si128(passMask8, _mm_set1_epi8(LAYERID)), _mm_andnot_si128(passMask8, dstLayerID_vec128)) );
+	v128u16_store( dstColorLine, v128u16_or(v128u16_and(passMaskLo, combinedSrcColorLo_vec128), v128u16_andnot(passMaskLo, dstColorLo_vec128)) );
+	v128u16_store( dstColorLine + 8, v128u16_or(v128u16_and(passMaskHi, combinedSrcColorHi_vec128), v128u16_andnot(passMaskHi, dstColorHi_vec128)) );
+	v128u8_store( dstLayerIDLine, v128u8_or(v128u8_and(passMask8, v128u8_set1(LAYERID)), v128u8_andnot(passMask8, dstLayerID_vec128)) );
 }
 
 template <GPULayerID LAYERID, bool ISDEBUGRENDER, bool NOWINDOWSENABLEDHINT, bool COLOREFFECTDISABLEDHINT, bool ISCUSTOMRENDERINGNEEDED>
-FORCEINLINE void GPUEngineBase::_RenderPixel8_SSE2(const size_t dstX,
-												   const __m128i &srcColor_vec128,
-												   const __m128i &srcOpaqueMask,
-												   const u8 *__restrict srcAlpha,
-												   u16 *__restrict dstColorLine,
-												   u8 *__restrict dstLayerIDLine)
+FORCEINLINE void GPUEngineBase::_RenderPixel8_Vec128(const size_t dstX,
+													 const v128u16 &srcColor_vec128,
+													 const v128u8 &srcOpaqueMask,
+													 const u8 *__restrict srcAlpha,
+													 u16 *__restrict dstColorLine,
+													 u8 *__restrict dstLayerIDLine)
 {
-	const __m128i dstColor_vec128 = _mm_loadu_si128((__m128i *)dstColorLine);
-	const __m128i dstLayerID_vec128 = _mm_loadl_epi64((__m128i *)dstLayerIDLine);
+	const v128u16 dstColor_vec128 = v128u16_loadu(dstColorLine);
+	const v128u8 dstLayerID_vec128 = v128u8_loadl(dstLayerIDLine);
+	const v128u16 srcOpaqueMask16 = v128u16_cmpeq( v128u8_unpacklo_u16(srcOpaqueMask), v128u16_set1(0x00FF) );
 	
 	if (ISDEBUGRENDER)
 	{
 		// If we're rendering pixels to a debugging context, then assume that the pixel
 		// always passes the window test and that the color effect is always disabled.
-		const __m128i srcOpaqueMask16 = _mm_cmpeq_epi16( _mm_unpacklo_epi8(srcOpaqueMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF));
-		_mm_storeu_si128( (__m128i *)dstColorLine, _mm_or_si128(_mm_and_si128(srcOpaqueMask16, _mm_or_si128(srcColor_vec128, _mm_set1_epi16(0x8000))), _mm_andnot_si128(srcOpaqueMask16, dstColor_vec128)) );
-		_mm_storel_epi64( (__m128i *)dstLayerIDLine, _mm_or_si128(_mm_and_si128(srcOpaqueMask, _mm_set1_epi8(LAYERID)), _mm_andnot_si128(srcOpaqueMask, dstLayerID_vec128)) );
+		v128u16_storeu( dstColorLine, v128u16_or(v128u16_and(srcOpaqueMask16, v128u16_or(srcColor_vec128, v128u16_set1(0x8000))), v128u16_andnot(srcOpaqueMask16, dstColor_vec128)) );
+		v128u8_storel( dstLayerIDLine, v128u8_or(v128u8_and(srcOpaqueMask, v128u8_set1(LAYERID)), v128u8_andnot(srcOpaqueMask, dstLayerID_vec128)) );
 		return;
 	}
 	
-	const __m128i srcOpaqueMask16 = _mm_cmpeq_epi16( _mm_unpacklo_epi8(srcOpaqueMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF));
-	__m128i passMask16 = srcOpaqueMask16;
-	__m128i passMask8 = srcOpaqueMask;
-	__m128i enableColorEffect = _mm_set_epi32(0, 0, 0x01010101, 0x01010101);
+	v128u16 passMask16 = srcOpaqueMask16;
+	v128u8 passMask8 = srcOpaqueMask;
+	v128u8 enableColorEffect = v128u8_set1(1);
 	
 	if (!NOWINDOWSENABLEDHINT)
 	{
 		// Do the window test.
-		__m128i didPassWindowTest = _mm_set_epi32(0, 0, 0x01010101, 0x01010101);
-		this->_RenderPixel_CheckWindows8_SSE2<LAYERID, ISCUSTOMRENDERINGNEEDED>(dstX, didPassWindowTest, enableColorEffect);
+		v128u8 didPassWindowTest;
+		this->_RenderPixel_CheckWindows_Vec128<LAYERID, ISCUSTOMRENDERINGNEEDED, 8>(dstX, didPassWindowTest, enableColorEffect);
 		
-		passMask16 = _mm_and_si128( passMask16, _mm_cmpeq_epi16(_mm_unpacklo_epi8(didPassWindowTest, _mm_setzero_si128()), _mm_set1_epi16(1)) );
-		passMask8 = _mm_and_si128( passMask8, _mm_cmpeq_epi8(didPassWindowTest, _mm_set1_epi8(1)) );
+		passMask16 = v128u16_and( passMask16, v128u16_cmpeq(v128u8_unpacklo_u16(didPassWindowTest), v128u16_set1(1)) );
+		passMask8 = v128u8_and( passMask8, v128u8_cmpeq(didPassWindowTest, v128u8_set1(1)) );
 	}
 	
 	if ((LAYERID != GPULayerID_OBJ) && COLOREFFECTDISABLEDHINT)
 	{
-		_mm_storeu_si128( (__m128i *)dstColorLine, _mm_or_si128(_mm_and_si128(passMask16, _mm_or_si128(srcColor_vec128, _mm_set1_epi16(0x8000))), _mm_andnot_si128(passMask16, dstColor_vec128)) );
-		_mm_storel_epi64( (__m128i *)dstLayerIDLine, _mm_or_si128(_mm_and_si128(passMask8, _mm_set1_epi8(LAYERID)), _mm_andnot_si128(passMask8, dstLayerID_vec128)) );
+		v128u16_storeu( dstColorLine, v128u16_or(v128u16_and(passMask16, v128u16_or(srcColor_vec128, v128u16_set1(0x8000))), v128u16_andnot(passMask16, dstColor_vec128)) );
+		v128u8_storel( dstLayerIDLine, v128u8_or(v128u8_and(passMask8, v128u8_set1(LAYERID)), v128u8_andnot(passMask8, dstLayerID_vec128)) );
 		return;
 	}
 	
@@ -2276,68 +2177,49 @@ FORCEINLINE void GPUEngineBase::_RenderPixel8_SSE2(const size_t dstX,
 			srcEffectEnableValue = 0;
 			break;
 	}
-	const __m128i srcEffectEnableMask = _mm_cmpeq_epi16(_mm_set1_epi16(srcEffectEnableValue), _mm_set1_epi16(1));
+	const v128u16 srcEffectEnableMask = v128u16_cmpeq(v128u16_set1(srcEffectEnableValue), v128u16_set1(1));
 	
-#ifdef ENABLE_SSSE3
-	__m128i dstEffectEnableMask = _mm_unpacklo_epi8( _mm_shuffle_epi8(this->_blend2_SSSE3, dstLayerID_vec128), _mm_setzero_si128() );
-#else
-	__m128i dstEffectEnableMask = _mm_set_epi16(this->_blend2[dstLayerIDLine[7]],
-												this->_blend2[dstLayerIDLine[6]],
-												this->_blend2[dstLayerIDLine[5]],
-												this->_blend2[dstLayerIDLine[4]],
-												this->_blend2[dstLayerIDLine[3]],
-												this->_blend2[dstLayerIDLine[2]],
-												this->_blend2[dstLayerIDLine[1]],
-												this->_blend2[dstLayerIDLine[0]]);
-#endif
-	
-	dstEffectEnableMask = _mm_and_si128( _mm_xor_si128(_mm_cmpeq_epi16(_mm_unpacklo_epi8(dstLayerID_vec128, _mm_setzero_si128()), _mm_set1_epi16(LAYERID)), _mm_set1_epi32(0xFFFFFFFF)),
-										 _mm_xor_si128(_mm_cmpeq_epi16(dstEffectEnableMask, _mm_setzero_si128()), _mm_set1_epi32(0xFFFFFFFF)) );
+	v128u16 dstEffectEnableMask = v128u8_unpacklo_u16( this->_RenderPixel_Blend2Mask_Vec128<8>(dstLayerIDLine, dstLayerID_vec128) );
+	dstEffectEnableMask = v128u16_and( v128u16_xor(v128u16_cmpeq(v128u8_unpacklo_u16(dstLayerID_vec128), v128u16_set1(LAYERID)), v128u16_set1(0xFFFF)),
+									   v128u16_xor(v128u16_cmpeq(dstEffectEnableMask, v128u16_setzero()), v128u16_set1(0xFFFF)) );
 	
 	// Select the color effect based on the BLDCNT target flags.
-	__m128i forceBlendEffectMask = _mm_setzero_si128();
-	__m128i colorEffect_vec128;
-	
-	if (NOWINDOWSENABLEDHINT)
-	{
-		colorEffect_vec128 = _mm_set1_epi16(BLDCNT.ColorEffect);
-	}
-	else
-	{
-		const __m128i enableColorEffectMask = _mm_cmpeq_epi16(_mm_unpacklo_epi8(enableColorEffect, _mm_setzero_si128()), _mm_set1_epi16(1));
-		colorEffect_vec128 = _mm_or_si128( _mm_and_si128(enableColorEffectMask, _mm_set1_epi16(BLDCNT.ColorEffect)), _mm_andnot_si128(enableColorEffectMask, _mm_set1_epi16(ColorEffect_Disable)) );
-	}
+	const v128u16 enableColorEffectMask = v128u16_cmpeq(v128u8_unpacklo_u16(enableColorEffect), v128u16_set1(1));
+	const v128u16 colorEffect_vec128 = v128u16_or( v128u16_and(enableColorEffectMask, v128u16_set1(BLDCNT.ColorEffect)), v128u16_andnot(enableColorEffectMask, v128u16_set1(ColorEffect_Disable)) );
+	v128u16 forceBlendEffectMask = v128u16_setzero();
 	
-	__m128i eva_vec128 = _mm_set1_epi16(this->_BLDALPHA_EVA);
-	__m128i evb_vec128 = _mm_set1_epi16(this->_BLDALPHA_EVB);
-	const __m128i evy_vec128 = _mm_set1_epi16(this->_BLDALPHA_EVY);
+	v128u16 eva_vec128 = v128u16_set1(this->_BLDALPHA_EVA);
+	v128u16 evb_vec128 = v128u16_set1(this->_BLDALPHA_EVB);
+	const v128u16 evy_vec128 = v128u16_set1(this->_BLDALPHA_EVY);
 	
 	if (LAYERID == GPULayerID_OBJ)
 	{
-		const __m128i objMode_vec128 = _mm_unpacklo_epi8( _mm_loadl_epi64((__m128i *)(this->_sprType + dstX)), _mm_setzero_si128() );
-		const __m128i isObjTranslucentMask = _mm_and_si128( dstEffectEnableMask, _mm_or_si128(_mm_cmpeq_epi16(objMode_vec128, _mm_set1_epi16(OBJMode_Transparent)), _mm_cmpeq_epi16(objMode_vec128, _mm_set1_epi16(OBJMode_Bitmap))) );
+		// Translucent-capable OBJ force the blend when the second target is satisfied, using their
+		// own alpha in place of EVA/EVB unless it's 0xFF.
+		const v128u16 objMode_vec128 = v128u8_unpacklo_u16( LoadPixelFlags_Vec128<false, 8>(this->_sprType, dstX) );
+		const v128u16 isObjTranslucentMask = v128u16_and( v128u16_and(enableColorEffectMask, dstEffectEnableMask), v128u16_or(v128u16_cmpeq(objMode_vec128, v128u16_set1(OBJMode_Transparent)), v128u16_cmpeq(objMode_vec128, v128u16_set1(OBJMode_Bitmap))) );
 		forceBlendEffectMask = isObjTranslucentMask;
 		
-		const __m128i srcAlpha_vec128 = _mm_unpacklo_epi8( _mm_loadl_epi64((__m128i *)(srcAlpha + dstX)), _mm_setzero_si128() );
-		const __m128i srcAlphaMask = _mm_and_si128( isObjTranslucentMask, _mm_xor_si128(_mm_cmpeq_epi16(srcAlpha_vec128, _mm_set1_epi16(0x00FF)), _mm_set1_epi32(0xFFFFFFFF)) );
+		const v128u16 srcAlpha_vec128 = v128u8_unpacklo_u16( v128u8_loadl(srcAlpha + dstX) );
+		const v128u16 srcAlphaMask = v128u16_andnot( v128u16_cmpeq(srcAlpha_vec128, v128u16_set1(0x00FF)), isObjTranslucentMask );
 		
-		eva_vec128 = _mm_or_si128( _mm_and_si128(srcAlphaMask, srcAlpha_vec128), _mm_andnot_si128(srcAlphaMask, eva_vec128) );
-		evb_vec128 = _mm_or_si128( _mm_and_si128(srcAlphaMask, _mm_sub_epi16(_mm_set1_epi16(16), srcAlpha_vec128)), _mm_andnot_si128(srcAlphaMask, evb_vec128) );
+		eva_vec128 = v128u16_or( v128u16_and(srcAlphaMask, srcAlpha_vec128), v128u16_andnot(srcAlphaMask, eva_vec128) );
+		evb_vec128 = v128u16_or( v128u16_and(srcAlphaMask, v128u16_sub(v128u16_set1(16), srcAlpha_vec128)), v128u16_andnot(srcAlphaMask, evb_vec128) );
 	}
 	
-	__m128i brightnessMask = _mm_setzero_si128();
-	__m128i brightnessPixels = _mm_setzero_si128();
+	v128u16 brightnessMask = v128u16_setzero();
+	v128u16 brightnessPixels = v128u16_setzero();
 	
 	switch (BLDCNT.ColorEffect)
 	{
 		case ColorEffect_IncreaseBrightness:
-			brightnessMask = _mm_andnot_si128( forceBlendEffectMask, _mm_and_si128(srcEffectEnableMask, _mm_cmpeq_epi16(colorEffect_vec128, _mm_set1_epi16(ColorEffect_IncreaseBrightness))) );
-			brightnessPixels = _mm_and_si128( brightnessMask, this->_ColorEffectIncreaseBrightness(srcColor_vec128, evy_vec128) );
+			brightnessMask = v128u16_andnot( forceBlendEffectMask, v128u16_and(srcEffectEnableMask, v128u16_cmpeq(colorEffect_vec128, v128u16_set1(ColorEffect_IncreaseBrightness))) );
+			brightnessPixels = v128u16_and( brightnessMask, this->_ColorEffectIncreaseBrightness(srcColor_vec128, evy_vec128) );
 			break;
 			
 		case ColorEffect_DecreaseBrightness:
-			brightnessMask = _mm_andnot_si128( forceBlendEffectMask, _mm_and_si128(srcEffectEnableMask, _mm_cmpeq_epi16(colorEffect_vec128, _mm_set1_epi16(ColorEffect_DecreaseBrightness))) );
-			brightnessPixels = _mm_and_si128( brightnessMask, this->_ColorEffectDecreaseBrightness(srcColor_vec128, evy_vec128) );
+			brightnessMask = v128u16_andnot( forceBlendEffectMask, v128u16_and(srcEffectEnableMask, v128u16_cmpeq(colorEffect_vec128, v128u16_set1(ColorEffect_DecreaseBrightness))) );
+			brightnessPixels = v128u16_and( brightnessMask, this->_ColorEffectDecreaseBrightness(srcColor_vec128, evy_vec128) );
 			break;
 			
 		default:
@@ -2345,17 +2227,17 @@ FORCEINLINE void GPUEngineBase::_RenderPixel8_SSE2(const size_t dstX,
 	}
 	
 	// Render the pixel using the selected color effect.
-	const __m128i blendMask = _mm_or_si128( forceBlendEffectMask, _mm_and_si128(_mm_and_si128(srcEffectEnableMask, dstEffectEnableMask), _mm_cmpeq_epi16(colorEffect_vec128, _mm_set1_epi16(ColorEffect_Blend))) );
-	const __m128i blendPixels = _mm_and_si128( blendMask, this->_ColorEffectBlend(srcColor_vec128, dstColor_vec128, eva_vec128, evb_vec128) );
+	const v128u16 blendMask = v128u16_or( forceBlendEffectMask, v128u16_and(v128u16_and(srcEffectEnableMask, dstEffectEnableMask), v128u16_cmpeq(colorEffect_vec128, v128u16_set1(ColorEffect_Blend))) );
+	const v128u16 blendPixels = v128u16_and( blendMask, this->_ColorEffectBlend(srcColor_vec128, dstColor_vec128, eva_vec128, evb_vec128) );
 	
-	const __m128i disableMask = _mm_xor_si128( _mm_or_si128(brightnessMask, blendMask), _mm_set1_epi32(0xFFFFFFFF) );
-	const __m128i disablePixels = _mm_and_si128(disableMask, srcColor_vec128);
+	const v128u16 disableMask = v128u16_xor( v128u16_or(brightnessMask, blendMask), v128u16_set1(0xFFFF) );
+	const v128u16 disablePixels = v128u16_and(disableMask, srcColor_vec128);
 	
 	// Combine the final colors.
-	const __m128i combinedSrcColorLo_vec128 = _mm_or_si128( _mm_or_si128(_mm_or_si128(brightnessPixels, blendPixels), disablePixels), _mm_set1_epi16(0x8000) );
+	const v128u16 combinedSrcColor_vec128 = v128u16_or( v128u16_or(v128u16_or(brightnessPixels, blendPixels), disablePixels), v128u16_set1(0x8000) );
 	
-	_mm_storeu_si128( (__m128i *)dstColorLine, _mm_or_si128(_mm_and_si128(passMask16, combinedSrcColorLo_vec128), _mm_andnot_si128(passMask16, dstColor_vec128)) );
-	_mm_storel_epi64( (__m128i *)dstLayerIDLine, _mm_or_si128(_mm_and_si128(passMask8, _mm_set1_epi8(LAYERID)), _mm_andnot_si128(passMask8, dstLayerID_vec128)) );
+	v128u16_storeu( dstColorLine, v128u16_or(v128u16_and(passMask16, combinedSrcColor_vec128), v128u16_andnot(passMask16, dstColor_vec128)) );
+	v128u8_storel( dstLayerIDLine, v128u8_or(v128u8_and(passMask8, v128u8_set1(LAYERID)), v128u8_andnot(passMask8, dstLayerID_vec128)) );
 }
 
 #endif
@@ -2453,90 +2335,72 @@ FORCEINLINE void GPUEngineBase::_RenderPixel3D(const size_t srcX, const Fragment
 	*dstLayerIDLine = GPULayerID_BG0;
 }
 
-#ifdef ENABLE_SSE2
+#ifdef ENABLE_SIMD128
 
 template <bool ISCUSTOMRENDERINGNEEDED>
-FORCEINLINE void GPUEngineBase::_RenderPixel3D_SSE2(const size_t dstX,
-													const FragmentColor *__restrict src,
-													u16 *__restrict dstColorLine,
-													u8 *__restrict dstLayerIDLine)
-{
-	const __m128i srcColor0 = _mm_load_si128((__m128i *)src);
-	const __m128i srcColor1 = _mm_load_si128((__m128i *)(src + 4));
-	const __m128i srcColor2 = _mm_load_si128((__m128i *)(src + 8));
-	const __m128i srcColor3 = _mm_load_si128((__m128i *)(src + 12));
-	
-	__m128i srcColorLo_vec128 = _mm_packs_epi32( _mm_or_si128(_mm_or_si128(_mm_srli_epi32(_mm_and_si128(srcColor0, _mm_set1_epi32(0x0000003E)), 1), _mm_srli_epi32(_mm_and_si128(srcColor0, _mm_set1_epi32(0x00003E00)), 4)), _mm_srli_epi32(_mm_and_si128(srcColor0, _mm_set1_epi32(0x003E0000)), 7)),
-												 _mm_or_si128(_mm_or_si128(_mm_srli_epi32(_mm_and_si128(srcColor1, _mm_set1_epi32(0x0000003E)), 1), _mm_srli_epi32(_mm_and_si128(srcColor1, _mm_set1_epi32(0x00003E00)), 4)), _mm_srli_epi32(_mm_and_si128(srcColor1, _mm_set1_epi32(0x003E0000)), 7)) );
-	__m128i srcColorHi_vec128 = _mm_packs_epi32( _mm_or_si128(_mm_or_si128(_mm_srli_epi32(_mm_and_si128(srcColor2, _mm_set1_epi32(0x0000003E)), 1), _mm_srli_epi32(_mm_and_si128(srcColor2, _mm_set1_epi32(0x00003E00)), 4)), _mm_srli_epi32(_mm_and_si128(srcColor2, _mm_set1_epi32(0x003E0000)), 7)),
-												 _mm_or_si128(_mm_or_si128(_mm_srli_epi32(_mm_and_si128(srcColor3, _mm_set1_epi32(0x0000003E)), 1), _mm_srli_epi32(_mm_and_si128(srcColor3, _mm_set1_epi32(0x00003E00)), 4)), _mm_srli_epi32(_mm_and_si128(srcColor3, _mm_set1_epi32(0x003E0000)), 7)) );
-	
-	const __m128i srcAlphaLo_vec128 = _mm_cmpgt_epi16( _mm_packs_epi32( _mm_srli_epi32(_mm_and_si128(srcColor0, _mm_set1_epi32(0xFF000000)), 24), _mm_srli_epi32(_mm_and_si128(srcColor1, _mm_set1_epi32(0xFF000000)), 24) ), _mm_setzero_si128() );
-	const __m128i srcAlphaHi_vec128 = _mm_cmpgt_epi16( _mm_packs_epi32( _mm_srli_epi32(_mm_and_si128(srcColor2, _mm_set1_epi32(0xFF000000)), 24), _mm_srli_epi32(_mm_and_si128(srcColor3, _mm_set1_epi32(0xFF000000)), 24) ), _mm_setzero_si128() );
-	const __m128i srcAlphaLayerID_vec128 = _mm_packs_epi16(srcAlphaLo_vec128, srcAlphaHi_vec128);
-	
-	const __m128i dstColorLo_vec128 = _mm_load_si128((__m128i *)dstColorLine);
-	const __m128i dstColorHi_vec128 = _mm_load_si128((__m128i *)(dstColorLine + 8));
-	const __m128i dstLayerID_vec128 = _mm_load_si128((__m128i *)dstLayerIDLine);
+FORCEINLINE void GPUEngineBase::_RenderPixel3D_Vec128(const size_t dstX,
+													  const FragmentColor *__restrict src,
+													  u16 *__restrict dstColorLine,
+													  u8 *__restrict dstLayerIDLine)
+{
+	v128u16 srcRLo_vec128, srcGLo_vec128, srcBLo_vec128, srcALo_vec128;
+	v128u16 srcRHi_vec128, srcGHi_vec128, srcBHi_vec128, srcAHi_vec128;
+	v128u16_load_u8x4((const u8 *)src, srcRLo_vec128, srcGLo_vec128, srcBLo_vec128, srcALo_vec128);
+	v128u16_load_u8x4((const u8 *)(src + 8), srcRHi_vec128, srcGHi_vec128, srcBHi_vec128, srcAHi_vec128);
+	
+	// Convert the RGBA6665 source to RGB555.
+	const v128u16 srcColorLo_vec128 = v128u16_or( v128u16_srli<1>(v128u16_and(srcRLo_vec128, v128u16_set1(0x003E))),
+												  v128u16_or(v128u16_slli<4>(v128u16_and(srcGLo_vec128, v128u16_set1(0x003E))), v128u16_slli<9>(v128u16_and(srcBLo_vec128, v128u16_set1(0x003E)))) );
+	const v128u16 srcColorHi_vec128 = v128u16_or( v128u16_srli<1>(v128u16_and(srcRHi_vec128, v128u16_set1(0x003E))),
+												  v128u16_or(v128u16_slli<4>(v128u16_and(srcGHi_vec128, v128u16_set1(0x003E))), v128u16_slli<9>(v128u16_and(srcBHi_vec128, v128u16_set1(0x003E)))) );
+	
+	// Only the fragments with a nonzero alpha are drawn.
+	const v128u16 srcAlphaLo_vec128 = v128u16_xor( v128u16_cmpeq(srcALo_vec128, v128u16_setzero()), v128u16_set1(0xFFFF) );
+	const v128u16 srcAlphaHi_vec128 = v128u16_xor( v128u16_cmpeq(srcAHi_vec128, v128u16_setzero()), v128u16_set1(0xFFFF) );
+	
+	const v128u16 dstColorLo_vec128 = v128u16_load(dstColorLine);
+	const v128u16 dstColorHi_vec128 = v128u16_load(dstColorLine + 8);
+	const v128u8 dstLayerID_vec128 = v128u8_load(dstLayerIDLine);
 	
 	// Do the window test.
-	__m128i didPassWindowTest = _mm_set1_epi8(1);
-	__m128i enableColorEffect = _mm_set1_epi8(1);
-	this->_RenderPixel_CheckWindows16_SSE2<GPULayerID_BG0, ISCUSTOMRENDERINGNEEDED>(dstX, didPassWindowTest, enableColorEffect);
+	v128u8 didPassWindowTest;
+	v128u8 enableColorEffect;
+	this->_RenderPixel_CheckWindows_Vec128<GPULayerID_BG0, ISCUSTOMRENDERINGNEEDED, 16>(dstX, didPassWindowTest, enableColorEffect);
 	
-	const __m128i passedWindowTestMaskLo = _mm_and_si128( srcAlphaLo_vec128, _mm_cmpeq_epi16(_mm_unpacklo_epi8(didPassWindowTest, _mm_setzero_si128()), _mm_set1_epi16(1)) );
-	const __m128i passedWindowTestMaskHi = _mm_and_si128( srcAlphaHi_vec128, _mm_cmpeq_epi16(_mm_unpackhi_epi8(didPassWindowTest, _mm_setzero_si128()), _mm_set1_epi16(1)) );
-	const __m128i passedWindowTestLayerID = _mm_and_si128( srcAlphaLayerID_vec128, _mm_packs_epi16(passedWindowTestMaskLo, passedWindowTestMaskHi) );
+	const v128u16 passedWindowTestMaskLo = v128u16_and( srcAlphaLo_vec128, v128u16_cmpeq(v128u8_unpacklo_u16(didPassWindowTest), v128u16_set1(1)) );
+	const v128u16 passedWindowTestMaskHi = v128u16_and( srcAlphaHi_vec128, v128u16_cmpeq(v128u8_unpackhi_u16(didPassWindowTest), v128u16_set1(1)) );
+	const v128u8 passedWindowTestLayerID = v128u8_packmask(passedWindowTestMaskLo, passedWindowTestMaskHi);
 	
 	const IOREG_BLDCNT &BLDCNT = this->_IORegisterMap->BLDCNT;
-	const __m128i srcEffectEnableMask = _mm_cmpeq_epi8(_mm_set1_epi8(BLDCNT.BG0_Target1), _mm_set1_epi8(1));
-	
-#ifdef ENABLE_SSSE3
-	__m128i dstEffectEnableMask = _mm_shuffle_epi8(this->_blend2_SSSE3, dstLayerID_vec128);
-#else
-	__m128i dstEffectEnableMask = _mm_set_epi8(this->_blend2[dstLayerIDLine[15]],
-											   this->_blend2[dstLayerIDLine[14]],
-											   this->_blend2[dstLayerIDLine[13]],
-											   this->_blend2[dstLayerIDLine[12]],
-											   this->_blend2[dstLayerIDLine[11]],
-											   this->_blend2[dstLayerIDLine[10]],
-											   this->_blend2[dstLayerIDLine[ 9]],
-											   this->_blend2[dstLayerIDLine[ 8]],
-											   this->_blend2[dstLayerIDLine[ 7]],
-											   this->_blend2[dstLayerIDLine[ 6]],
-											   this->_blend2[dstLayerIDLine[ 5]],
-											   this->_blend2[dstLayerIDLine[ 4]],
-											   this->_blend2[dstLayerIDLine[ 3]],
-											   this->_blend2[dstLayerIDLine[ 2]],
-											   this->_blend2[dstLayerIDLine[ 1]],
-											   this->_blend2[dstLayerIDLine[ 0]]);
-#endif
+	const v128u8 srcEffectEnableMask = v128u8_cmpeq(v128u8_set1(BLDCNT.BG0_Target1), v128u8_set1(1));
 	
-	dstEffectEnableMask = _mm_and_si128(_mm_xor_si128(_mm_cmpeq_epi8(dstLayerID_vec128, _mm_set1_epi8(GPULayerID_BG0)), _mm_set1_epi32(0xFFFFFFFF)),
-										_mm_xor_si128(_mm_cmpeq_epi8(dstEffectEnableMask, _mm_setzero_si128()), _mm_set1_epi32(0xFFFFFFFF)) );
+	v128u8 dstEffectEnableMask = this->_RenderPixel_Blend2Mask_Vec128<16>(dstLayerIDLine, dstLayerID_vec128);
+	dstEffectEnableMask = v128u8_and( v128u8_xor(v128u8_cmpeq(dstLayerID_vec128, v128u8_set1(GPULayerID_BG0)), v128u8_set1(0xFF)),
+									  v128u8_xor(v128u8_cmpeq(dstEffectEnableMask, v128u8_setzero()), v128u8_set1(0xFF)) );
 	
 	// Select the color effect based on the BLDCNT target flags.
-	const __m128i enableColorEffectMask = _mm_cmpeq_epi8(enableColorEffect, _mm_set1_epi8(1));
-	const __m128i colorEffect_vec128 = _mm_or_si128( _mm_and_si128(enableColorEffectMask, _mm_set1_epi8(BLDCNT.ColorEffect)), _mm_andnot_si128(enableColorEffectMask, _mm_set1_epi8(ColorEffect_Disable)) );
-	const __m128i forceBlendEffectMask = _mm_and_si128(enableColorEffectMask, dstEffectEnableMask);
-	const __m128i evy_vec128 = _mm_set1_epi16(this->_BLDALPHA_EVY);
+	// 3D rendering has a special override: If the destination pixel is set to blend, then always blend.
+	const v128u8 enableColorEffectMask = v128u8_cmpeq(enableColorEffect, v128u8_set1(1));
+	const v128u8 colorEffect_vec128 = v128u8_or( v128u8_and(enableColorEffectMask, v128u8_set1(BLDCNT.ColorEffect)), v128u8_andnot(enableColorEffectMask, v128u8_set1(ColorEffect_Disable)) );
+	const v128u8 forceBlendEffectMask = v128u8_and(enableColorEffectMask, dstEffectEnableMask);
+	const v128u16 evy_vec128 = v128u16_set1(this->_BLDALPHA_EVY);
 	
-	__m128i brightnessMask = _mm_setzero_si128();
-	__m128i brightnessPixelsLo = _mm_setzero_si128();
-	__m128i brightnessPixelsHi = _mm_setzero_si128();
+	v128u8 brightnessMask = v128u8_setzero();
+	v128u16 brightnessPixelsLo = v128u16_setzero();
+	v128u16 brightnessPixelsHi = v128u16_setzero();
 	
 	switch (BLDCNT.ColorEffect)
 	{
 		case ColorEffect_IncreaseBrightness:
-			brightnessMask = _mm_andnot_si128( forceBlendEffectMask, _mm_and_si128(srcEffectEnableMask, _mm_cmpeq_epi8(colorEffect_vec128, _mm_set1_epi8(ColorEffect_IncreaseBrightness))) );
-			brightnessPixelsLo = _mm_and_si128( this->_ColorEffectIncreaseBrightness(srcColorLo_vec128, evy_vec128), _mm_cmpeq_epi16(_mm_unpacklo_epi8(brightnessMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
-			brightnessPixelsHi = _mm_and_si128( this->_ColorEffectIncreaseBrightness(srcColorHi_vec128, evy_vec128), _mm_cmpeq_epi16(_mm_unpackhi_epi8(brightnessMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
+			brightnessMask = v128u8_andnot( forceBlendEffectMask, v128u8_and(srcEffectEnableMask, v128u8_cmpeq(colorEffect_vec128, v128u8_set1(ColorEffect_IncreaseBrightness))) );
+			brightnessPixelsLo = v128u16_and( this->_ColorEffectIncreaseBrightness(srcColorLo_vec128, evy_vec128), v128u16_cmpeq(v128u8_unpacklo_u16(brightnessMask), v128u16_set1(0x00FF)) );
+			brightnessPixelsHi = v128u16_and( this->_ColorEffectIncreaseBrightness(srcColorHi_vec128, evy_vec128), v128u16_cmpeq(v128u8_unpackhi_u16(brightnessMask), v128u16_set1(0x00FF)) );
 			break;
 			
 		case ColorEffect_DecreaseBrightness:
-			brightnessMask = _mm_andnot_si128( forceBlendEffectMask, _mm_and_si128(srcEffectEnableMask, _mm_cmpeq_epi8(colorEffect_vec128, _mm_set1_epi8(ColorEffect_DecreaseBrightness))) );
-			brightnessPixelsLo = _mm_and_si128( this->_ColorEffectDecreaseBrightness(srcColorLo_vec128, evy_vec128), _mm_cmpeq_epi16(_mm_unpacklo_epi8(brightnessMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
-			brightnessPixelsHi = _mm_and_si128( this->_ColorEffectDecreaseBrightness(srcColorHi_vec128, evy_vec128), _mm_cmpeq_epi16(_mm_unpackhi_epi8(brightnessMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
+			brightnessMask = v128u8_andnot( forceBlendEffectMask, v128u8_and(srcEffectEnableMask, v128u8_cmpeq(colorEffect_vec128, v128u8_set1(ColorEffect_DecreaseBrightness))) );
+			brightnessPixelsLo = v128u16_and( this->_ColorEffectDecreaseBrightness(srcColorLo_vec128, evy_vec128), v128u16_cmpeq(v128u8_unpacklo_u16(brightnessMask), v128u16_set1(0x00FF)) );
+			brightnessPixelsHi = v128u16_and( this->_ColorEffectDecreaseBrightness(srcColorHi_vec128, evy_vec128), v128u16_cmpeq(v128u8_unpackhi_u16(brightnessMask), v128u16_set1(0x00FF)) );
 			break;
 			
 		default:
@@ -2544,21 +2408,21 @@ FORCEINLINE void GPUEngineBase::_RenderPixel3D_SSE2(const size_t dstX,
 	}
 	
 	// Render the pixel using the selected color effect.
-	const __m128i blendMask = _mm_or_si128( forceBlendEffectMask, _mm_and_si128(_mm_and_si128(srcEffectEnableMask, dstEffectEnableMask), _mm_cmpeq_epi8(colorEffect_vec128, _mm_set1_epi8(ColorEffect_Blend))) );
-	const __m128i blendPixelsLo = _mm_and_si128( this->_ColorEffectBlend3D(srcColor0, srcColor1, dstColorLo_vec128), _mm_cmpeq_epi16(_mm_unpacklo_epi8(blendMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
-	const __m128i blendPixelsHi = _mm_and_si128( this->_ColorEffectBlend3D(srcColor2, srcColor3, dstColorHi_vec128), _mm_cmpeq_epi16(_mm_unpackhi_epi8(blendMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
+	const v128u8 blendMask = v128u8_or( forceBlendEffectMask, v128u8_and(v128u8_and(srcEffectEnableMask, dstEffectEnableMask), v128u8_cmpeq(colorEffect_vec128, v128u8_set1(ColorEffect_Blend))) );
+	const v128u16 blendPixelsLo = v128u16_and( this->_ColorEffectBlend3D(srcRLo_vec128, srcGLo_vec128, srcBLo_vec128, srcALo_vec128, dstColorLo_vec128), v128u16_cmpeq(v128u8_unpacklo_u16(blendMask), v128u16_set1(0x00FF)) );
+	const v128u16 blendPixelsHi = v128u16_and( this->_ColorEffectBlend3D(srcRHi_vec128, srcGHi_vec128, srcBHi_vec128, srcAHi_vec128, dstColorHi_vec128), v128u16_cmpeq(v128u8_unpackhi_u16(blendMask), v128u16_set1(0x00FF)) );
 	
-	const __m128i disableMask = _mm_xor_si128( _mm_or_si128(brightnessMask, blendMask), _mm_set1_epi32(0xFFFFFFFF) );
-	const __m128i disablePixelsLo = _mm_and_si128( srcColorLo_vec128, _mm_cmpeq_epi16(_mm_unpacklo_epi8(disableMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
-	const __m128i disablePixelsHi = _mm_and_si128( srcColorHi_vec128, _mm_cmpeq_epi16(_mm_unpackhi_epi8(disableMask, _mm_setzero_si128()), _mm_set1_epi16(0x00FF)) );
+	const v128u8 disableMask = v128u8_xor( v128u8_or(brightnessMask, blendMask), v128u8_set1(0xFF) );
+	const v128u16 disablePixelsLo = v128u16_and( srcColorLo_vec128, v128u16_cmpeq(v128u8_unpacklo_u16(disableMask), v128u16_set1(0x00FF)) );
+	const v128u16 disablePixelsHi = v128u16_and( srcColorHi_vec128, v128u16_cmpeq(v128u8_unpackhi_u16(disableMask), v128u16_set1(0x00FF)) );
 	
 	// Combine the final colors.
-	srcColorLo_vec128 = _mm_or_si128( _mm_or_si128(_mm_or_si128(brightnessPixelsLo, blendPixelsLo), disablePixelsLo), _mm_set1_epi16(0x8000) );
-	srcColorHi_vec128 = _mm_or_si128( _mm_or_si128(_mm_or_si128(brightnessPixelsHi, blendPixelsHi), disablePixelsHi), _mm_set1_epi16(0x8000) );
+	const v128u16 combinedSrcColorLo_vec128 = v128u16_or( v128u16_or(v128u16_or(brightnessPixelsLo, blendPixelsLo), disablePixelsLo), v128u16_set1(0x8000) );
+	const v128u16 combinedSrcColorHi_vec128 = v128u16_or( v128u16_or(v128u16_or(brightnessPixelsHi, blendPixelsHi), disablePixelsHi), v128u16_set1(0x8000) );
 	
-	_mm_store_si128( (__m128i *)dstColorLine, _mm_or_si128(_mm_and_si128(passedWindowTestMaskLo, srcColorLo_vec128), _mm_andnot_si128(passedWindowTestMaskLo, dstColorLo_vec128)) );
-	_mm_store_si128( (__m128i *)(dstColorLine + 8), _mm_or_si128(_mm_and_si128(passedWindowTestMaskHi, srcColorHi_vec128), _mm_andnot_si128(passedWindowTestMaskHi, dstColorHi_vec128)) );
-	_mm_store_si128( (__m128i *)dstLayerIDLine, _mm_or_si128(_mm_and_si128(passedWindowTestLayerID, _mm_set1_epi8(GPULayerID_BG0)), _mm_andnot_si128(passedWindowTestLayerID, dstLayerID_vec128)) );
+	v128u16_store( dstColorLine, v128u16_or(v128u16_and(passedWindowTestMaskLo, combinedSrcColorLo_vec128), v128u16_andnot(passedWindowTestMaskLo, dstColorLo_vec128)) );
+	v128u16_store( dstColorLine + 8, v128u16_or(v128u16_and(passedWindowTestMaskHi, combinedSrcColorHi_vec128), v128u16_andnot(passedWindowTestMaskHi, dstColorHi_vec128)) );
+	v128u8_store( dstLayerIDLine, v128u8_or(v128u8_and(passedWindowTestLayerID, v128u8_set1(GPULayerID_BG0)), v128u8_andnot(passedWindowTestLayerID, dstLayerID_vec128)) );
 }
 
 #endif
@@ -2847,26 +2711,26 @@ void GPUEngineBase::_RenderPixelsCustom(void *__restrict dstColorLine, u8 *__res
 #endif
 	
 	const size_t dstPixCount = lineWidth;
-	const size_t ssePixCount = (dstPixCount - (dstPixCount % 8));
+	const size_t vecPixCount = (dstPixCount - (dstPixCount % 16));
 	const size_t lineCount = _gpuDstLineCount[lineIndex];
 	
 	for (size_t l = 0; l < lineCount; l++)
 	{
 		size_t i = 0;
-#ifdef ENABLE_SSE2
-		for (; i < ssePixCount; i+=16)
+#ifdef ENABLE_SIMD128
+		for (; i < vecPixCount; i+=16)
 		{
-			const __m128i srcColorLo_vec128 = _mm_load_si128((__m128i *)(this->_bgLayerColorCustom + i));
-			const __m128i srcColorHi_vec128 = _mm_load_si128((__m128i *)(this->_bgLayerColorCustom + i + 8));
-			const __m128i srcOpaqueMask = _mm_xor_si128( _mm_cmpeq_epi8(_mm_load_si128((__m128i *)(this->_bgLayerIndexCustom + i)), _mm_setzero_si128()), _mm_set1_epi32(0xFFFFFFFF) );
+			const v128u16 srcColorLo_vec128 = v128u16_load(this->_bgLayerColorCustom + i);
+			const v128u16 srcColorHi_vec128 = v128u16_load(this->_bgLayerColorCustom + i + 8);
+			const v128u8 srcOpaqueMask = v128u8_xor( v128u8_cmpeq(v128u8_load(this->_bgLayerIndexCustom + i), v128u8_setzero()), v128u8_set1(0xFF) );
 			
-			this->_RenderPixel16_SSE2<LAYERID, ISDEBUGRENDER, NOWINDOWSENABLEDHINT, COLOREFFECTDISABLEDHINT, true>(i,
-																												   srcColorHi_vec128,
-																												   srcColorLo_vec128,
-																												   srcOpaqueMask,
-																												   NULL,
-																												   (GPU->GetDisplayInfo().colorFormat == NDSColorFormat_BGR555_Rev) ? (u16 *)(dstColorLine16 + i) : (u16 *)(dstColorLine32 + i),
-																												   dstLayerID + i);
+			this->_RenderPixel16_Vec128<LAYERID, ISDEBUGRENDER, NOWINDOWSENABLEDHINT, COLOREFFECTDISABLEDHINT, true>(i,
+																													 srcColorHi_vec128,
+																													 srcColorLo_vec128,
+																													 srcOpaqueMask,
+																													 NULL,
+																													 (GPU->GetDisplayInfo().colorFormat == NDSColorFormat_BGR555_Rev) ? (u16 *)(dstColorLine16 + i) : (u16 *)(dstColorLine32 + i),
+																													 dstLayerID + i);
 		}
 #endif
 		for (; i < dstPixCount; i++)
@@ -2901,24 +2765,24 @@ void GPUEngineBase::_RenderPixelsCustomVRAM(void *__restrict dstColorLine, u8 *_
 	
 	size_t i = 0;
 	
-#ifdef ENABLE_SSE2
-	const size_t ssePixCount = (dstPixCount - (dstPixCount % 8));
-	for (; i < ssePixCount; i+=16)
+#ifdef ENABLE_SIMD128
+	const size_t vecPixCount = (dstPixCount - (dstPixCount % 16));
+	for (; i < vecPixCount; i+=16)
 	{
-		const __m128i srcColorLo_vec128 = _mm_load_si128((__m128i *)(srcLine + i));
-		const __m128i srcColorHi_vec128 = _mm_load_si128((__m128i *)(srcLine + i + 8));
+		const v128u16 srcColorLo_vec128 = v128u16_load(srcLine + i);
+		const v128u16 srcColorHi_vec128 = v128u16_load(srcLine + i + 8);
 		
-		const __m128i srcOpaqueMaskLo = _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16(0x8000), srcColorLo_vec128), _mm_setzero_si128());
-		const __m128i srcOpaqueMaskHi = _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16(0x8000), srcColorHi_vec128), _mm_setzero_si128());
-		const __m128i srcOpaqueMask = _mm_xor_si128( _mm_packs_epi16(srcOpaqueMaskLo, srcOpaqueMaskHi), _mm_set1_epi32(0xFFFFFFFF) );
+		const v128u16 srcOpaqueMaskLo = v128u16_cmpeq(v128u16_and(v128u16_set1(0x8000), srcColorLo_vec128), v128u16_setzero());
+		const v128u16 srcOpaqueMaskHi = v128u16_cmpeq(v128u16_and(v128u16_set1(0x8000), srcColorHi_vec128), v128u16_setzero());
+		const v128u8 srcOpaqueMask = v128u8_xor( v128u8_packmask(srcOpaqueMaskLo, srcOpaqueMaskHi), v128u8_set1(0xFF) );
 		
-		this->_RenderPixel16_SSE2<LAYERID, ISDEBUGRENDER, NOWINDOWSENABLEDHINT, COLOREFFECTDISABLEDHINT, true>(i,
-																											   srcColorHi_vec128,
-																											   srcColorLo_vec128,
-																											   srcOpaqueMask,
-																											   NULL,
-																											   (GPU->GetDisplayInfo().colorFormat == NDSColorFormat_BGR555_Rev) ? (u16 *)(dstColorLine16 + i) : (u16 *)(dstColorLine32 + i),
-																											   dstLayerID + i);
+		this->_RenderPixel16_Vec128<LAYERID, ISDEBUGRENDER, NOWINDOWSENABLEDHINT, COLOREFFECTDISABLEDHINT, true>(i,
+																												 srcColorHi_vec128,
+																												 srcColorLo_vec128,
+																												 srcOpaqueMask,
+																												 NULL,
+																												 (GPU->GetDisplayInfo().colorFormat == NDSColorFormat_BGR555_Rev) ? (u16 *)(dstColorLine16 + i) : (u16 *)(dstColorLine32 + i),
+																												 dstLayerID + i);
 	}
 #endif
 	for (; i < dstPixCount; i++)
@@ -3559,6 +3423,56 @@ u32 GPUEngineBase::_SpriteAddressBMP(const OAMAttributes &spriteInfo, const Spri
 	}
 }
 
+void GPUEngineBase::_BuildSpriteLists(const size_t firstLine)
+{
+	memset(this->_sprLineCount + firstLine, 0, GPU_FRAMEBUFFER_NATIVE_HEIGHT - firstLine);
+	
+	for (size_t i = 0; i < 128; i++)
+	{
+		OAMAttributes spriteInfo = this->_oamList[i];
+		
+		if (spriteInfo.RotScale == 0 && spriteInfo.Disable != 0)
+			continue;
+		
+		spriteInfo.attr[1] = LOCAL_TO_LE_16(spriteInfo.attr[1]);
+		spriteInfo.attr[2] = LOCAL_TO_LE_16(spriteInfo.attr[2]);
+		
+		// Same visibility tests as _SpriteRenderPerform() and _ComputeSpriteVars(), which
+		// only depend on the line through the sprite's Y-coordinate.
+		const SpriteSize sprSize = GPUEngineBase::_sprSizeTab[spriteInfo.Size][spriteInfo.Shape];
+		const s32 sprX = spriteInfo.X;
+		s32 fieldX = sprSize.width;
+		s32 fieldY = sprSize.height;
+		
+		if ( (spriteInfo.RotScale != 0) && (spriteInfo.DoubleSize != 0) )
+		{
+			fieldX <<= 1;
+			fieldY <<= 1;
+		}
+		
+		if ((sprX == GPU_FRAMEBUFFER_NATIVE_WIDTH) || (sprX + fieldX <= 0))
+			continue;
+		
+		// Sprites wrap around vertically at 256 lines.
+		for (s32 y = 0; y < fieldY; y++)
+		{
+			const size_t l = (spriteInfo.Y + y) & 0xFF;
+			if ( (l < firstLine) || (l >= GPU_FRAMEBUFFER_NATIVE_HEIGHT) )
+				continue;
+			
+			this->_sprLineList[l][this->_sprLineCount[l]++] = (u8)i;
+		}
+	}
+	
+	this->_sprListOAMGen = MMU.oamGen[this->_engineID];
+	this->_sprListFirstLine = firstLine;
+}
+
+void GPUEngineBase::InvalidateSpriteLists()
+{
+	this->_sprListFirstLine = GPU_FRAMEBUFFER_NATIVE_HEIGHT;
+}
+
 template <bool ISDEBUGRENDER>
 void GPUEngineBase::_SpriteRender(const u16 lineIndex, u16 *__restrict dst, u8 *__restrict dst_alpha, u8 *__restrict typeTab, u8 *__restrict prioTab)
 {
@@ -3579,8 +3493,19 @@ void GPUEngineBase::_SpriteRenderPerform(const u16 lineIndex, u16 *__restrict ds
 	const IOREG_DISPCNT &DISPCNT = this->_IORegisterMap->DISPCNT;
 	size_t cost = 0;
 	
-	for (size_t i = 0; i < 128; i++)
+	// OAM is usually written once per frame during V-blank, so the lists built for line 0
+	// serve the whole frame. A write mid-frame only rebuilds the lines still to come.
+	if ( (lineIndex < this->_sprListFirstLine) || (this->_sprListOAMGen != MMU.oamGen[this->_engineID]) )
+	{
+		this->_BuildSpriteLists(lineIndex);
+	}
+	
+	const u8 *__restrict spriteList = this->_sprLineList[lineIndex];
+	const size_t spriteCount = this->_sprLineCount[lineIndex];
+	
+	for (size_t n = 0; n < spriteCount; n++)
 	{
+		const size_t i = spriteList[n];
 		OAMAttributes spriteInfo = this->_oamList[i];
 
 		//for each sprite:
@@ -3948,14 +3873,14 @@ void GPUEngineBase::ApplyMasterBrightness()
 				{
 					case NDSColorFormat_BGR555_Rev:
 					{
-#ifdef ENABLE_SSE2
-						const __m128i intensity_vec128 = _mm_set1_epi16(intensity);
+#ifdef ENABLE_SIMD128
+						const v128u16 intensity_vec128 = v128u16_set1(intensity);
 						
-						const size_t ssePixCount = pixCount - (pixCount % 8);
-						for (; i < ssePixCount; i += 8)
+						const size_t vecPixCount = pixCount - (pixCount % 8);
+						for (; i < vecPixCount; i += 8)
 						{
-							const __m128i dstColor_vec128 = _mm_load_si128((__m128i *)((u16 *)dst + i));
-							_mm_store_si128( (__m128i *)((u16 *)dst + i), this->_ColorEffectIncreaseBrightness(dstColor_vec128, intensity_vec128) );
+							const v128u16 dstColor_vec128 = v128u16_load((u16 *)dst + i);
+							v128u16_store( (u16 *)dst + i, this->_ColorEffectIncreaseBrightness(dstColor_vec128, intensity_vec128) );
 						}
 #endif
 						for (; i < pixCount; i++)
@@ -4021,14 +3946,14 @@ void GPUEngineBase::ApplyMasterBrightness()
 				{
 					case NDSColorFormat_BGR555_Rev:
 					{
-#ifdef ENABLE_SSE2
-						const __m128i intensity_vec128 = _mm_set1_epi16(intensity);
+#ifdef ENABLE_SIMD128
+						const v128u16 intensity_vec128 = v128u16_set1(intensity);
 						
-						const size_t ssePixCount = pixCount - (pixCount % 8);
-						for (; i < ssePixCount; i += 8)
+						const size_t vecPixCount = pixCount - (pixCount % 8);
+						for (; i < vecPixCount; i += 8)
 						{
-							const __m128i dstColor_vec128 = _mm_load_si128((__m128i *)((u16 *)dst + i));
-							_mm_store_si128( (__m128i *)((u16 *)dst + i), this->_ColorEffectDecreaseBrightness(dstColor_vec128, intensity_vec128) );
+							const v128u16 dstColor_vec128 = v128u16_load((u16 *)dst + i);
+							v128u16_store( (u16 *)dst + i, this->_ColorEffectDecreaseBrightness(dstColor_vec128, intensity_vec128) );
 						}
 #endif
 						for (; i < pixCount; i++)
@@ -4860,8 +4785,16 @@ void GPUEngineA::RenderLine(const u16 l)
 	this->_SetupWindows<0>(l);
 	this->_SetupWindows<1>(l);
 	
-	// Render the line
-	void *renderLineTarget = this->_RenderLine_Layers(l);
+	// Render the line, unless nothing it depends on has changed since the last frame.
+	// Lines that get captured or that show the 3D layer are always composed.
+	const bool isLineCacheAllowed = (this->_displayOutputMode == GPUDisplayMode_Normal) && (DISPCAPCNT.CaptureEnable == 0) && !this->WillRender3DLayer();
+	void *renderLineTarget = NULL;
+	
+	if (!this->_RenderLine_ReuseCached(l, isLineCacheAllowed))
+	{
+		renderLineTarget = this->_RenderLine_Layers(l);
+		this->_RenderLine_StoreCached(l);
+	}
 	
 	// Fill the display output
 	switch (this->_displayOutputMode)
@@ -4995,14 +4928,14 @@ void* GPUEngineA::_RenderLine_Layers(const u16 l)
 							for (size_t line = 0; line < customLineCount; line++)
 							{
 								size_t dstX = 0;
-#ifdef ENABLE_SSE2
-								const size_t ssePixCount = customLineWidth - (customLineWidth % 16);
-								for (; dstX < ssePixCount; dstX += 16)
+#ifdef ENABLE_SIMD128
+								const size_t vecPixCount = customLineWidth - (customLineWidth % 16);
+								for (; dstX < vecPixCount; dstX += 16)
 								{
-									this->_RenderPixel3D_SSE2<true>(dstX,
-																	srcLine + dstX,
-																	(dispInfo.colorFormat == NDSColorFormat_BGR555_Rev) ? (u16 *)(dstColorLine16 + dstX) : (u16 *)(dstColorLine32 + dstX),
-																	dstLayerIDPtr + dstX);
+									this->_RenderPixel3D_Vec128<true>(dstX,
+																	  srcLine + dstX,
+																	  (dispInfo.colorFormat == NDSColorFormat_BGR555_Rev) ? (u16 *)(dstColorLine16 + dstX) : (u16 *)(dstColorLine32 + dstX),
+																	  dstLayerIDPtr + dstX);
 								}
 #endif
 								for (; dstX < customLineWidth; dstX++)
@@ -5542,16 +5475,16 @@ void GPUEngineA::_RenderLine_DispCapture_Copy(const u16 *src, u16 *dst, const si
 {
 	const u16 alphaBit = (SOURCESWITCH == 0) ? 0x8000 : 0x0000;
 	
-#ifdef ENABLE_SSE2
-	const __m128i alpha_vec128 = _mm_set1_epi16(alphaBit);
+#ifdef ENABLE_SIMD128
+	const v128u16 alpha_vec128 = v128u16_set1(alphaBit);
 #endif
 	
 	if (CAPTURETONATIVEDST)
 	{
 		if (CAPTUREFROMNATIVESRC)
 		{
-#ifdef ENABLE_SSE2
-			MACRODO_N(CAPTURELENGTH / (sizeof(__m128i) / sizeof(u16)), _mm_store_si128((__m128i *)dst + (X), _mm_or_si128( _mm_load_si128( (__m128i *)src + (X)), alpha_vec128 ) ));
+#ifdef ENABLE_SIMD128
+			MACRODO_N(CAPTURELENGTH / (sizeof(v128u16) / sizeof(u16)), v128u16_store(dst + ((X) * 8), v128u16_or( v128u16_load(src + ((X) * 8)), alpha_vec128 ) ));
 #else
 			for (size_t i = 0; i < CAPTURELENGTH; i++)
 			{
@@ -5593,11 +5526,11 @@ void GPUEngineA::_RenderLine_DispCapture_Copy(const u16 *src, u16 *dst, const si
 				const size_t pixCountExt = captureLengthExt * captureLineCount;
 				size_t i = 0;
 				
-#ifdef ENABLE_SSE2
-				const size_t ssePixCount = pixCountExt - (pixCountExt % 8);
-				for (; i < ssePixCount; i += 8)
+#ifdef ENABLE_SIMD128
+				const size_t vecPixCount = pixCountExt - (pixCountExt % 8);
+				for (; i < vecPixCount; i += 8)
 				{
-					_mm_store_si128((__m128i *)(dst + i), _mm_or_si128( _mm_load_si128( (__m128i *)(src + i)), alpha_vec128 ) );
+					v128u16_store(dst + i, v128u16_or( v128u16_load(src + i), alpha_vec128 ) );
 				}
 #endif
 				for (; i < pixCountExt; i++)
@@ -5610,11 +5543,11 @@ void GPUEngineA::_RenderLine_DispCapture_Copy(const u16 *src, u16 *dst, const si
 				for (size_t line = 0; line < captureLineCount; line++)
 				{
 					size_t i = 0;
-#ifdef ENABLE_SSE2
-					const size_t ssePixCount = captureLengthExt - (captureLengthExt % 8);
-					for (; i < ssePixCount; i += 8)
+#ifdef ENABLE_SIMD128
+					const size_t vecPixCount = captureLengthExt - (captureLengthExt % 8);
+					for (; i < vecPixCount; i += 8)
 					{
-						_mm_store_si128((__m128i *)(dst + i), _mm_or_si128( _mm_load_si128( (__m128i *)(src + i)), alpha_vec128 ) );
+						v128u16_store(dst + i, v128u16_or( v128u16_load(src + i), alpha_vec128 ) );
 					}
 #endif
 					for (; i < captureLengthExt; i++)
@@ -5667,91 +5600,91 @@ u16 GPUEngineA::_RenderLine_DispCapture_BlendFunc(const u16 srcA, const u16 srcB
 	return LOCAL_TO_LE_16(a | (b << 10) | (g << 5) | r);
 }
 
-#ifdef ENABLE_SSE2
-__m128i GPUEngineA::_RenderLine_DispCapture_BlendFunc_SSE2(__m128i &srcA, __m128i &srcB, const __m128i &blendEVA, const __m128i &blendEVB)
+#ifdef ENABLE_SIMD128
+v128u16 GPUEngineA::_RenderLine_DispCapture_BlendFunc_Vec128(v128u16 &srcA, v128u16 &srcB, const v128u16 &blendEVA, const v128u16 &blendEVB)
 {
-	const __m128i colorBitMask = _mm_set1_epi16(0x001F);
-	const __m128i srcA_alpha = _mm_and_si128(srcA, _mm_set1_epi16(0x8000));
-	const __m128i srcB_alpha = _mm_and_si128(srcB, _mm_set1_epi16(0x8000));
+	const v128u16 colorBitMask = v128u16_set1(0x001F);
+	const v128u16 srcA_alpha = v128u16_and(srcA, v128u16_set1(0x8000));
+	const v128u16 srcB_alpha = v128u16_and(srcB, v128u16_set1(0x8000));
 	
-	srcA = _mm_andnot_si128( _mm_cmpeq_epi16(srcA_alpha, _mm_setzero_si128()), srcA );
-	srcB = _mm_andnot_si128( _mm_cmpeq_epi16(srcB_alpha, _mm_setzero_si128()), srcB );
+	srcA = v128u16_andnot( v128u16_cmpeq(srcA_alpha, v128u16_setzero()), srcA );
+	srcB = v128u16_andnot( v128u16_cmpeq(srcB_alpha, v128u16_setzero()), srcB );
 	
-	__m128i srcB_r = _mm_and_si128(srcB, colorBitMask);
-	srcB_r = _mm_mullo_epi16(srcB_r, blendEVB);
+	v128u16 srcB_r = v128u16_and(srcB, colorBitMask);
+	srcB_r = v128u16_mullo(srcB_r, blendEVB);
 	
-	__m128i srcB_g = _mm_srli_epi16(srcB, 5);
-	srcB_g = _mm_and_si128(srcB_g, colorBitMask);
-	srcB_g = _mm_mullo_epi16(srcB_g, blendEVB);
+	v128u16 srcB_g = v128u16_srli<5>(srcB);
+	srcB_g = v128u16_and(srcB_g, colorBitMask);
+	srcB_g = v128u16_mullo(srcB_g, blendEVB);
 	
-	__m128i srcB_b = _mm_srli_epi16(srcB, 10);
-	srcB_b = _mm_and_si128(srcB_b, colorBitMask);
-	srcB_b = _mm_mullo_epi16(srcB_b, blendEVB);
+	v128u16 srcB_b = v128u16_srli<10>(srcB);
+	srcB_b = v128u16_and(srcB_b, colorBitMask);
+	srcB_b = v128u16_mullo(srcB_b, blendEVB);
 	
-	__m128i r = _mm_and_si128(srcA, colorBitMask);
-	r = _mm_mullo_epi16(r, blendEVA);
-	r = _mm_add_epi16(r, srcB_r);
-	r = _mm_srli_epi16(r, 4);
-	r = _mm_min_epi16(r, colorBitMask);
+	v128u16 r = v128u16_and(srcA, colorBitMask);
+	r = v128u16_mullo(r, blendEVA);
+	r = v128u16_add(r, srcB_r);
+	r = v128u16_srli<4>(r);
+	r = v128u16_min(r, colorBitMask);
 	
-	__m128i g = _mm_srli_epi16(srcA, 5);
-	g = _mm_and_si128(g, colorBitMask);
-	g = _mm_mullo_epi16(g, blendEVA);
-	g = _mm_add_epi16(g, srcB_g);
-	g = _mm_srli_epi16(g, 4);
-	g = _mm_min_epi16(g, colorBitMask);
-	g = _mm_slli_epi16(g, 5);
+	v128u16 g = v128u16_srli<5>(srcA);
+	g = v128u16_and(g, colorBitMask);
+	g = v128u16_mullo(g, blendEVA);
+	g = v128u16_add(g, srcB_g);
+	g = v128u16_srli<4>(g);
+	g = v128u16_min(g, colorBitMask);
+	g = v128u16_slli<5>(g);
 	
-	__m128i b = _mm_srli_epi16(srcA, 10);
-	b = _mm_and_si128(b, colorBitMask);
-	b = _mm_mullo_epi16(b, blendEVA);
-	b = _mm_add_epi16(b, srcB_b);
-	b = _mm_srli_epi16(b, 4);
-	b = _mm_min_epi16(b, colorBitMask);
-	b = _mm_slli_epi16(b, 10);
+	v128u16 b = v128u16_srli<10>(srcA);
+	b = v128u16_and(b, colorBitMask);
+	b = v128u16_mullo(b, blendEVA);
+	b = v128u16_add(b, srcB_b);
+	b = v128u16_srli<4>(b);
+	b = v128u16_min(b, colorBitMask);
+	b = v128u16_slli<10>(b);
 	
-	const __m128i a = _mm_or_si128(srcA_alpha, srcB_alpha);
+	const v128u16 a = v128u16_or(srcA_alpha, srcB_alpha);
 	
-	return _mm_or_si128(_mm_or_si128(_mm_or_si128(r, g), b), a);
+	return v128u16_or(v128u16_or(v128u16_or(r, g), b), a);
 }
 #endif
 
 template<bool CAPTUREFROMNATIVESRCA, bool CAPTUREFROMNATIVESRCB>
 void GPUEngineA::_RenderLine_DispCapture_BlendToCustomDstBuffer(const u16 *srcA, const u16 *srcB, u16 *dst, const u8 blendEVA, const u8 blendEVB, const size_t length, size_t l)
 {
-#ifdef ENABLE_SSE2
-	const __m128i blendEVA_vec128 = _mm_set1_epi16(blendEVA);
-	const __m128i blendEVB_vec128 = _mm_set1_epi16(blendEVB);
+#ifdef ENABLE_SIMD128
+	const v128u16 blendEVA_vec128 = v128u16_set1(blendEVA);
+	const v128u16 blendEVB_vec128 = v128u16_set1(blendEVB);
 #endif
 	
 	const NDSDisplayInfo &dispInfo = GPU->GetDisplayInfo();
 	size_t offset = _gpuDstToSrcIndex[_gpuDstLineIndex[l] * dispInfo.customWidth] - (l * GPU_FRAMEBUFFER_NATIVE_WIDTH);
 	size_t i = 0;
 	
-#ifdef ENABLE_SSE2
+#ifdef ENABLE_SIMD128
 	
-	const size_t ssePixCount = length - (length % 8);
-	for (; i < ssePixCount; i += 8)
-	{
-		__m128i srcA_vec128 = (!CAPTUREFROMNATIVESRCA) ? _mm_load_si128((__m128i *)(srcA + i)) : _mm_set_epi16(srcA[offset + i + 7],
-																											   srcA[offset + i + 6],
-																											   srcA[offset + i + 5],
-																											   srcA[offset + i + 4],
-																											   srcA[offset + i + 3],
-																											   srcA[offset + i + 2],
-																											   srcA[offset + i + 1],
-																											   srcA[offset + i + 0]);
+	const size_t vecPixCount = length - (length % 8);
+	for (; i < vecPixCount; i += 8)
+	{
+		v128u16 srcA_vec128 = (!CAPTUREFROMNATIVESRCA) ? v128u16_load(srcA + i) : v128u16_set(srcA[offset + i + 0],
+		                                                                                       srcA[offset + i + 1],
+		                                                                                       srcA[offset + i + 2],
+		                                                                                       srcA[offset + i + 3],
+		                                                                                       srcA[offset + i + 4],
+		                                                                                       srcA[offset + i + 5],
+		                                                                                       srcA[offset + i + 6],
+		                                                                                       srcA[offset + i + 7]);
 		
-		__m128i srcB_vec128 = (!CAPTUREFROMNATIVESRCB) ? _mm_load_si128((__m128i *)(srcB + i)) : _mm_set_epi16(srcB[offset + i + 7],
-																											   srcB[offset + i + 6],
-																											   srcB[offset + i + 5],
-																											   srcB[offset + i + 4],
-																											   srcB[offset + i + 3],
-																											   srcB[offset + i + 2],
-																											   srcB[offset + i + 1],
-																											   srcB[offset + i + 0]);
+		v128u16 srcB_vec128 = (!CAPTUREFROMNATIVESRCB) ? v128u16_load(srcB + i) : v128u16_set(srcB[offset + i + 0],
+		                                                                                       srcB[offset + i + 1],
+		                                                                                       srcB[offset + i + 2],
+		                                                                                       srcB[offset + i + 3],
+		                                                                                       srcB[offset + i + 4],
+		                                                                                       srcB[offset + i + 5],
+		                                                                                       srcB[offset + i + 6],
+		                                                                                       srcB[offset + i + 7]);
 		
-		_mm_store_si128( (__m128i *)(dst + i), this->_RenderLine_DispCapture_BlendFunc_SSE2(srcA_vec128, srcB_vec128, blendEVA_vec128, blendEVB_vec128) );
+		v128u16_store( dst + i, this->_RenderLine_DispCapture_BlendFunc_Vec128(srcA_vec128, srcB_vec128, blendEVA_vec128, blendEVB_vec128) );
 	}
 #endif
 	for (; i < length; i++)
@@ -5771,31 +5704,31 @@ void GPUEngineA::_RenderLine_DispCapture_Blend(const u16 *srcA, const u16 *srcB,
 	
 	if (CAPTURETONATIVEDST)
 	{
-#ifdef ENABLE_SSE2
-		const __m128i blendEVA_vec128 = _mm_set1_epi16(blendEVA);
-		const __m128i blendEVB_vec128 = _mm_set1_epi16(blendEVB);
+#ifdef ENABLE_SIMD128
+		const v128u16 blendEVA_vec128 = v128u16_set1(blendEVA);
+		const v128u16 blendEVB_vec128 = v128u16_set1(blendEVB);
 		
 		for (size_t i = 0; i < CAPTURELENGTH; i += 8)
 		{
-			__m128i srcA_vec128 = (CAPTUREFROMNATIVESRCA) ? _mm_load_si128((__m128i *)(srcA + i)) : _mm_set_epi16(srcA[_gpuDstPitchIndex[i+7]],
-			                                                                                                      srcA[_gpuDstPitchIndex[i+6]],
-			                                                                                                      srcA[_gpuDstPitchIndex[i+5]],
-			                                                                                                      srcA[_gpuDstPitchIndex[i+4]],
-			                                                                                                      srcA[_gpuDstPitchIndex[i+3]],
-			                                                                                                      srcA[_gpuDstPitchIndex[i+2]],
-			                                                                                                      srcA[_gpuDstPitchIndex[i+1]],
-			                                                                                                      srcA[_gpuDstPitchIndex[i+0]]);
+			v128u16 srcA_vec128 = (CAPTUREFROMNATIVESRCA) ? v128u16_load(srcA + i) : v128u16_set(srcA[_gpuDstPitchIndex[i+0]],
+			                                                                                     srcA[_gpuDstPitchIndex[i+1]],
+			                                                                                     srcA[_gpuDstPitchIndex[i+2]],
+			                                                                                     srcA[_gpuDstPitchIndex[i+3]],
+			                                                                                     srcA[_gpuDstPitchIndex[i+4]],
+			                                                                                     srcA[_gpuDstPitchIndex[i+5]],
+			                                                                                     srcA[_gpuDstPitchIndex[i+6]],
+			                                                                                     srcA[_gpuDstPitchIndex[i+7]]);
 			
-			__m128i srcB_vec128 = (CAPTUREFROMNATIVESRCB) ? _mm_load_si128((__m128i *)(srcB + i)) : _mm_set_epi16(srcB[_gpuDstPitchIndex[i+7]],
-			                                                                                                      srcB[_gpuDstPitchIndex[i+6]],
-			                                                                                                      srcB[_gpuDstPitchIndex[i+5]],
-			                                                                                                      srcB[_gpuDstPitchIndex[i+4]],
-			                                                                                                      srcB[_gpuDstPitchIndex[i+3]],
-			                                                                                                      srcB[_gpuDstPitchIndex[i+2]],
-			                                                                                                      srcB[_gpuDstPitchIndex[i+1]],
-			                                                                                                      srcB[_gpuDstPitchIndex[i+0]]);
+			v128u16 srcB_vec128 = (CAPTUREFROMNATIVESRCB) ? v128u16_load(srcB + i) : v128u16_set(srcB[_gpuDstPitchIndex[i+0]],
+			                                                                                     srcB[_gpuDstPitchIndex[i+1]],
+			                                                                                     srcB[_gpuDstPitchIndex[i+2]],
+			                                                                                     srcB[_gpuDstPitchIndex[i+3]],
+			                                                                                     srcB[_gpuDstPitchIndex[i+4]],
+			                                                                                     srcB[_gpuDstPitchIndex[i+5]],
+			                                                                                     srcB[_gpuDstPitchIndex[i+6]],
+			                                                                                     srcB[_gpuDstPitchIndex[i+7]]);
 			
-			_mm_store_si128( (__m128i *)(dst + i), this->_RenderLine_DispCapture_BlendFunc_SSE2(srcA_vec128, srcB_vec128, blendEVA_vec128, blendEVB_vec128) );
+			v128u16_store( dst + i, this->_RenderLine_DispCapture_BlendFunc_Vec128(srcA_vec128, srcB_vec128, blendEVA_vec128, blendEVB_vec128) );
 		}
 #else
 		for (size_t i = 0; i < CAPTURELENGTH; i++)
@@ -6107,7 +6040,11 @@ void GPUEngineB::RenderLine(const u16 l)
 			break;
 		
 		case GPUDisplayMode_Normal: // Display BG and OBJ layers
-			this->_RenderLine_Layers(l);
+			if (!this->_RenderLine_ReuseCached(l, true))
+			{
+				this->_RenderLine_Layers(l);
+				this->_RenderLine_StoreCached(l);
+			}
 			this->_HandleDisplayModeNormal(l);
 			break;
 		
@@ -6436,6 +6373,8 @@ void GPUSubsystem::UpdateRenderProperties()
 	this->_engineMain->nativeLineOutputCount = GPU_FRAMEBUFFER_NATIVE_HEIGHT;
 	this->_engineSub->nativeLineRenderCount = GPU_FRAMEBUFFER_NATIVE_HEIGHT;
 	this->_engineSub->nativeLineOutputCount = GPU_FRAMEBUFFER_NATIVE_HEIGHT;
+	this->_engineMain->cachedLineCount = 0;
+	this->_engineSub->cachedLineCount = 0;
 	for (size_t l = 0; l < GPU_FRAMEBUFFER_NATIVE_HEIGHT; l++)
 	{
 		this->_engineMain->isLineRenderNative[l] = true;
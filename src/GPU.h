@@ -25,6 +25,7 @@
 #include <iosfwd>
 
 #include "types.h"
+#include "utils/simd.h"
 
 #ifdef ENABLE_SSE2
 #include <emmintrin.h>
@@ -1231,6 +1232,13 @@ protected:
 	BGLayerInfo _BGLayer[4];
 	
 	CACHE_ALIGN u8 _sprNum[256];
+	
+	// Lists of the OAM entries that intersect each line, in OAM order. These are rebuilt
+	// whenever OAM has been written, and only cover the lines from _sprListFirstLine on.
+	CACHE_ALIGN u8 _sprLineList[GPU_FRAMEBUFFER_NATIVE_HEIGHT][128];
+	u8 _sprLineCount[GPU_FRAMEBUFFER_NATIVE_HEIGHT];
+	u32 _sprListOAMGen;
+	size_t _sprListFirstLine;
 	CACHE_ALIGN u8 _h_win[2][GPU_FRAMEBUFFER_NATIVE_WIDTH];
 	const u8 *_curr_win[2];
 	
@@ -1261,6 +1269,26 @@ protected:
 	u8 _BLDALPHA_EVB;
 	u8 _BLDALPHA_EVY;
 	
+	// Everything a composed native scanline depends on. If the signature taken before
+	// rendering a line matches the one stored for that line on a previous frame, the
+	// stored pixels are copied out instead of composing the line again.
+	struct LineCacheSignature
+	{
+		u8 regs[0x58];						// DISPCNT through BLDY, with DISPSTAT and VCOUNT masked out
+		u32 layerEnable;
+		u32 paletteGen;
+		u32 oamGen;
+		u32 vramMapGen;
+		u32 vramGen;
+	};
+	
+	CACHE_ALIGN u16 _lineCacheColor[GPU_FRAMEBUFFER_NATIVE_WIDTH * GPU_FRAMEBUFFER_NATIVE_HEIGHT];
+	LineCacheSignature _lineCacheSignature[GPU_FRAMEBUFFER_NATIVE_HEIGHT];
+	s32 _lineCacheAffine[GPU_FRAMEBUFFER_NATIVE_HEIGHT][4];
+	bool _isLineCacheValid[GPU_FRAMEBUFFER_NATIVE_HEIGHT];
+	LineCacheSignature _pendingLineSignature;
+	bool _willStoreLineCache;
+	
 	void _InitLUTs();
 	void _Reset_Base();
 	void _ResortBGLayers();
@@ -1291,6 +1319,9 @@ protected:
 	template <GPULayerID LAYERID> void _RenderPixel_CheckWindows(const size_t srcX, bool &didPassWindowTest, bool &enableColorEffect) const;
 	
 	void _RenderLine_Clear(const u16 clearColor, const u16 l, void *renderLineTarget);
+	u32 _GetVRAMGeneration() const;
+	bool _RenderLine_ReuseCached(const u16 l, const bool isCacheAllowed);
+	void _RenderLine_StoreCached(const u16 l);
 	void* _RenderLine_Layers(const u16 l);
 	
 	void _HandleDisplayModeOff(const size_t l);
@@ -1327,16 +1358,17 @@ protected:
 	template<NDSColorFormat OUTPUTFORMAT> FORCEINLINE FragmentColor _ColorEffectDecreaseBrightness(const u16 col, const u16 blendEVY);
 	template<NDSColorFormat OUTPUTFORMAT, NDSColorFormat INPUTFORMAT> FORCEINLINE FragmentColor _ColorEffectDecreaseBrightness(const FragmentColor col, const u16 blendEVY);
 	
-#ifdef ENABLE_SSE2
-	FORCEINLINE __m128i _ColorEffectBlend(const __m128i &colA, const __m128i &colB, const __m128i &blendEVA, const __m128i &blendEVB);
-	FORCEINLINE __m128i _ColorEffectBlend3D(const __m128i &colA_Lo, const __m128i &colA_Hi, const __m128i &colB);
-	FORCEINLINE __m128i _ColorEffectIncreaseBrightness(const __m128i &col, const __m128i &blendEVY);
-	FORCEINLINE __m128i _ColorEffectDecreaseBrightness(const __m128i &col, const __m128i &blendEVY);
-	template<GPULayerID LAYERID, bool ISCUSTOMRENDERINGNEEDED> FORCEINLINE void _RenderPixel_CheckWindows16_SSE2(const size_t dstX, __m128i &didPassWindowTest, __m128i &enableColorEffect) const;
-	template<GPULayerID LAYERID, bool ISCUSTOMRENDERINGNEEDED> FORCEINLINE void _RenderPixel_CheckWindows8_SSE2(const size_t dstX, __m128i &didPassWindowTest, __m128i &enableColorEffect) const;
-	template<GPULayerID LAYERID, bool ISDEBUGRENDER, bool NOWINDOWSENABLEDHINT, bool COLOREFFECTDISABLEDHINT, bool ISCUSTOMRENDERINGNEEDED> FORCEINLINE void _RenderPixel16_SSE2(const size_t dstX, const __m128i &srcColorHi_vec128, const __m128i &srcColorLo_vec128, const __m128i &srcOpaqueMask, const u8 *__restrict srcAlpha, u16 *__restrict dstColorLine, u8 *__restrict dstLayerIDLine);
-	template <GPULayerID LAYERID, bool ISDEBUGRENDER, bool NOWINDOWSENABLEDHINT, bool COLOREFFECTDISABLEDHINT, bool ISCUSTOMRENDERINGNEEDED> FORCEINLINE void _RenderPixel8_SSE2(const size_t dstX, const __m128i &srcColor_vec128, const __m128i &srcOpaqueMask, const u8 *__restrict srcAlpha, u16 *__restrict dstColorLine, u8 *__restrict dstLayerIDLine);
-	template<bool ISCUSTOMRENDERINGNEEDED> FORCEINLINE void _RenderPixel3D_SSE2(const size_t srcX, const FragmentColor *__restrict src, u16 *__restrict dstColorLine, u8 *__restrict dstLayerIDLine);
+#ifdef ENABLE_SIMD128
+	FORCEINLINE v128u16 _ColorEffectBlend(const v128u16 &colA, const v128u16 &colB, const v128u16 &blendEVA, const v128u16 &blendEVB);
+	FORCEINLINE v128u16 _ColorEffectIncreaseBrightness(const v128u16 &col, const v128u16 &blendEVY);
+	FORCEINLINE v128u16 _ColorEffectDecreaseBrightness(const v128u16 &col, const v128u16 &blendEVY);
+	FORCEINLINE v128u16 _ColorEffectBlend3D(const v128u16 &colA_R, const v128u16 &colA_G, const v128u16 &colA_B, const v128u16 &colA_A, const v128u16 &colB);
+	
+	template<size_t PIXELCOUNT> FORCEINLINE v128u8 _RenderPixel_Blend2Mask_Vec128(const u8 *__restrict dstLayerIDLine, const v128u8 &dstLayerID_vec128) const;
+	template<GPULayerID LAYERID, bool ISCUSTOMRENDERINGNEEDED, size_t PIXELCOUNT> FORCEINLINE void _RenderPixel_CheckWindows_Vec128(const size_t dstX, v128u8 &didPassWindowTest, v128u8 &enableColorEffect) const;
+	template<GPULayerID LAYERID, bool ISDEBUGRENDER, bool NOWINDOWSENABLEDHINT, bool COLOREFFECTDISABLEDHINT, bool ISCUSTOMRENDERINGNEEDED> FORCEINLINE void _RenderPixel16_Vec128(const size_t dstX, const v128u16 &srcColorHi_vec128, const v128u16 &srcColorLo_vec128, const v128u8 &srcOpaqueMask, const u8 *__restrict srcAlpha, u16 *__restrict dstColorLine, u8 *__restrict dstLayerIDLine);
+	template<GPULayerID LAYERID, bool ISDEBUGRENDER, bool NOWINDOWSENABLEDHINT, bool COLOREFFECTDISABLEDHINT, bool ISCUSTOMRENDERINGNEEDED> FORCEINLINE void _RenderPixel8_Vec128(const size_t dstX, const v128u16 &srcColor_vec128, const v128u8 &srcOpaqueMask, const u8 *__restrict srcAlpha, u16 *__restrict dstColorLine, u8 *__restrict dstLayerIDLine);
+	template<bool ISCUSTOMRENDERINGNEEDED> FORCEINLINE void _RenderPixel3D_Vec128(const size_t dstX, const FragmentColor *__restrict src, u16 *__restrict dstColorLine, u8 *__restrict dstLayerIDLine);
 #endif
 	
 	template<bool ISDEBUGRENDER> void _RenderSpriteBMP(const u8 spriteNum, const u16 l, u16 *__restrict dst, const u32 srcadr, u8 *__restrict dst_alpha, u8 *__restrict typeTab, u8 *__restrict prioTab, const u8 prio, const size_t lg, size_t sprX, size_t x, const s32 xdir, const u8 alpha);
@@ -1346,6 +1378,7 @@ protected:
 	bool _ComputeSpriteVars(const OAMAttributes &spriteInfo, const u16 l, SpriteSize &sprSize, s32 &sprX, s32 &sprY, s32 &x, s32 &y, s32 &lg, s32 &xdir);
 	
 	u32 _SpriteAddressBMP(const OAMAttributes &spriteInfo, const SpriteSize sprSize, const s32 y);
+	void _BuildSpriteLists(const size_t firstLine);
 	
 	template<bool ISDEBUGRENDER> void _SpriteRender(const u16 lineIndex, u16 *__restrict dst, u8 *__restrict dst_alpha, u8 *__restrict typeTab, u8 *__restrict prioTab);
 	template<SpriteRenderMode MODE, bool ISDEBUGRENDER> void _SpriteRenderPerform(const u16 lineIndex, u16 *__restrict dst, u8 *__restrict dst_alpha, u8 *__restrict typeTab, u8 *__restrict prioTab);
@@ -1376,12 +1409,16 @@ public:
 	
 	void UpdatePropertiesWithoutRender(const u16 l);
 	void FramebufferPostprocess();
+	void InvalidateLineCache();
+	void InvalidateSpriteLists();
 	
 	bool isCustomRenderingNeeded;
 	u8 vramBGLayer;
 	u8 vramBlockBGIndex;
 	u8 vramBlockOBJIndex;
 	
+	size_t cachedLineCount;
+	
 	size_t nativeLineRenderCount;
 	size_t nativeLineOutputCount;
 	bool isLineRenderNative[GPU_FRAMEBUFFER_NATIVE_HEIGHT];
@@ -1460,8 +1497,8 @@ protected:
 	
 	u16 _RenderLine_DispCapture_BlendFunc(const u16 srcA, const u16 srcB, const u8 blendEVA, const u8 blendEVB);
 	
-#ifdef ENABLE_SSE2
-	__m128i _RenderLine_DispCapture_BlendFunc_SSE2(__m128i &srcA, __m128i &srcB, const __m128i &blendEVA, const __m128i &blendEVB);
+#ifdef ENABLE_SIMD128
+	v128u16 _RenderLine_DispCapture_BlendFunc_Vec128(v128u16 &srcA, v128u16 &srcB, const v128u16 &blendEVA, const v128u16 &blendEVB);
 #endif
 	
 	template<bool CAPTUREFROMNATIVESRCA, bool CAPTUREFROMNATIVESRCB>
@@ -0,0 +1,520 @@
+/*
+	Copyright (C) 2016 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "GuestProfiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "armcpu.h"
+#include "MMU.h"
+#include "mem.h"
+#include "Disassembler.h"
+#include "NDSSystem.h"
+#include "driver.h"
+
+struct ProfileHit
+{
+	u32 samples;
+	u64 ticks;
+};
+
+//keyed by address, with bit 0 set for thumb code
+typedef std::map<u32, ProfileHit> ProfileHistogram;
+
+struct ProfileCPU
+{
+	ProfileHistogram hits;
+	ProfileHit halted;		//samples taken while waiting for an irq
+	ProfileHit total;
+};
+
+struct ProfileSymbol
+{
+	std::string name;
+	u32 size;				//0 when the map didn't say; the symbol then runs up to the next one
+};
+typedef std::map<u32, ProfileSymbol> ProfileSymbolMap;
+
+struct ProfileBlock
+{
+	u32 start, end;			//the first and last instruction
+	bool thumb;
+	ProfileHit hit;
+};
+
+GuestProfilerState guestProfiler = { false, 0 };
+
+static ProfileCPU profileCPU[2];
+static std::vector<ProfileSymbolMap> profileSymbols[2];
+static u64 ticksPerSecond;
+static u64 intervalTicks;
+static u64 lastSample;
+static u64 steps;
+
+static const char *cpuNames[2] = { "ARM9", "ARM7" };
+
+static u64 profiler_now()
+{
+	//without a clock every sequencer step counts as a tick
+	return ticksPerSecond ? driver->EMU_GetTicks() : ++steps;
+}
+
+void GuestProfiler_Start()
+{
+	for (int cpu = 0; cpu < 2; cpu++)
+	{
+		profileCPU[cpu].hits.clear();
+		memset(&profileCPU[cpu].halted, 0, sizeof(ProfileHit));
+		memset(&profileCPU[cpu].total, 0, sizeof(ProfileHit));
+	}
+
+	ticksPerSecond = driver->EMU_GetTicksPerSecond();
+	if (!ticksPerSecond)
+		printf("Profiler: the driver has no clock, so samples are taken every %d sequencer steps instead of by host time\n", GUESTPROFILE_INTERVAL_STEPS);
+	intervalTicks = ticksPerSecond ? std::max<u64>(1, ticksPerSecond * GUESTPROFILE_INTERVAL_US / 1000000) : GUESTPROFILE_INTERVAL_STEPS;
+	steps = 0;
+	lastSample = profiler_now();
+	guestProfiler.nextSample = lastSample + intervalTicks;
+	guestProfiler.active = true;
+}
+
+void GuestProfiler_Stop()
+{
+	guestProfiler.active = false;
+}
+
+bool GuestProfiler_IsRunning()
+{
+	return guestProfiler.active;
+}
+
+static void profiler_record(ProfileCPU &prof, const armcpu_t &cpu, u64 weight)
+{
+	prof.total.samples++;
+	prof.total.ticks += weight;
+
+	if (cpu.waitIRQ)
+	{
+		prof.halted.samples++;
+		prof.halted.ticks += weight;
+		return;
+	}
+
+	//next_instruction is what the cpu runs when it's next given time
+	const u32 key = cpu.CPSR.bits.T ? ((cpu.next_instruction & ~1) | 1) : (cpu.next_instruction & ~3);
+	ProfileHit &hit = prof.hits[key];
+	hit.samples++;
+	hit.ticks += weight;
+}
+
+void GuestProfiler_TakeSample()
+{
+	const u64 now = profiler_now();
+	if (now < guestProfiler.nextSample) return;
+
+	const u64 weight = now - lastSample;
+	lastSample = now;
+	guestProfiler.nextSample = now + intervalTicks;
+
+	profiler_record(profileCPU[ARMCPU_ARM9], NDS_ARM9, weight);
+	profiler_record(profileCPU[ARMCPU_ARM7], NDS_ARM7, weight);
+}
+
+//----------------------------------------------------------------------------
+//symbol maps
+
+static void profiler_addSymbol(ProfileSymbolMap &map, u32 addr, const char *name, u32 size, bool preferred)
+{
+	//skip the compiler's $a/$t/$d mapping symbols and no$gba's .arm/.thumb directives
+	if (name[0] == 0 || name[0] == '$' || name[0] == '.') return;
+
+	//where a name is already there, a function beats a label, and one with a size beats one without
+	ProfileSymbolMap::iterator it = map.find(addr);
+	if (it != map.end() && (!preferred || (it->second.size && !size))) return;
+
+	ProfileSymbol &sym = map[addr];
+	sym.name = name;
+	sym.size = size;
+}
+
+static bool profiler_loadElf(const std::vector<u8> &data, ProfileSymbolMap &map)
+{
+	u8 *elf = (u8 *)&data[0];
+	const u32 size = (u32)data.size();
+	if (size < 52 || elf[4] != 1 || elf[5] != 1) return false; //ELF32, little endian
+
+	const u32 shoff = T1ReadLong(elf, 32);
+	const u32 shentsize = T1ReadWord(elf, 46);
+	const u32 shnum = T1ReadWord(elf, 48);
+	if (shentsize < 40 || shoff >= size || (u64)shnum * shentsize > size - shoff) return false;
+
+	for (u32 s = 0; s < shnum; s++)
+	{
+		u8 *sh = elf + shoff + s * shentsize;
+		if (T1ReadLong(sh, 4) != 2) continue; //SHT_SYMTAB
+
+		const u32 symoff = T1ReadLong(sh, 16);
+		const u32 symsize = T1ReadLong(sh, 20);
+		const u32 link = T1ReadLong(sh, 24);
+		if (symoff > size || symsize > size - symoff || link >= shnum) continue;
+
+		u8 *strsh = elf + shoff + link * shentsize;
+		const u32 stroff = T1ReadLong(strsh, 16);
+		const u32 strsize = T1ReadLong(strsh, 20);
+		if (stroff > size || strsize > size - stroff || strsize == 0) continue;
+		const char *strtab = (const char *)elf + stroff;
+
+		for (u32 i = 16; i + 16 <= symsize; i += 16) //the first symbol is always null
+		{
+			u8 *sym = elf + symoff + i;
+			const u32 name = T1ReadLong(sym, 0);
+			const u32 value = T1ReadLong(sym, 4);
+			const u32 symSize = T1ReadLong(sym, 8);
+			const u8 type = sym[12] & 0xF;
+			const u16 shndx = T1ReadWord(sym, 14);
+
+			//functions, and the untyped labels hand written assembly tends to have
+			if (type != 2 && type != 0) continue;
+			if (shndx == 0 || name >= strsize || memchr(strtab + name, 0, strsize - name) == NULL) continue;
+
+			//thumb functions have bit 0 set
+			profiler_addSymbol(map, value & ~1, strtab + name, symSize, type == 2);
+		}
+	}
+
+	return true;
+}
+
+static void profiler_loadText(const std::vector<u8> &data, ProfileSymbolMap &map)
+{
+	std::string text(data.begin(), data.end());
+	size_t pos = 0;
+	while (pos < text.size())
+	{
+		size_t eol = text.find_first_of("\r\n", pos);
+		if (eol == std::string::npos) eol = text.size();
+		std::string line = text.substr(pos, eol - pos);
+		pos = eol + 1;
+		if (line.empty()) continue;
+
+		//address, then optionally a size and/or an nm type letter, then the name
+		std::vector<std::string> tokens;
+		char *tok = strtok(&line[0], " \t");
+		for (; tok != NULL; tok = strtok(NULL, " \t"))
+			tokens.push_back(tok);
+		if (tokens.size() < 2) continue;
+
+		char *end;
+		const u32 addr = (u32)strtoul(tokens[0].c_str(), &end, 16);
+		if (*end != 0) continue;
+
+		u32 size = 0;
+		if (tokens.size() >= 4)
+			size = (u32)strtoul(tokens[1].c_str(), NULL, 16);
+		if (tokens.size() >= 3)
+		{
+			//only code
+			const std::string &type = tokens[tokens.size() - 2];
+			if (type.size() != 1 || !strchr("TtWwAa", type[0])) continue;
+		}
+
+		profiler_addSymbol(map, addr, tokens.back().c_str(), size, false);
+	}
+}
+
+bool GuestProfiler_LoadSymbols(int cpu, const char *fileName)
+{
+	FILE *fp = fopen(fileName, "rb");
+	if (!fp)
+	{
+		printf("Profiler: couldn't open %s\n", fileName);
+		return false;
+	}
+
+	std::vector<u8> data;
+	u8 buf[4096];
+	size_t got;
+	while ((got = fread(buf, 1, sizeof(buf), fp)) > 0)
+		data.insert(data.end(), buf, buf + got);
+	fclose(fp);
+
+	ProfileSymbolMap map;
+	if (data.size() >= 4 && !memcmp(&data[0], "\x7F" "ELF", 4))
+	{
+		if (!profiler_loadElf(data, map))
+		{
+			printf("Profiler: %s isn't a 32 bit little endian ELF\n", fileName);
+			return false;
+		}
+	}
+	else if (!data.empty())
+		profiler_loadText(data, map);
+
+	if (map.empty())
+	{
+		printf("Profiler: no symbols in %s\n", fileName);
+		return false;
+	}
+
+	printf("Profiler: %d %s symbols from %s\n", (int)map.size(), cpuNames[cpu], fileName);
+	profileSymbols[cpu].push_back(map);
+	return true;
+}
+
+//the names of the symbols covering addr in every map, with offsets unless wanted bare
+static std::string profiler_symbolize(int cpu, u32 addr, bool offsets)
+{
+	std::string out;
+	for (size_t m = 0; m < profileSymbols[cpu].size(); m++)
+	{
+		const ProfileSymbolMap &map = profileSymbols[cpu][m];
+		ProfileSymbolMap::const_iterator it = map.upper_bound(addr);
+		if (it == map.begin()) continue;
+		--it;
+
+		//a sized symbol ends where it says; an unsized one at least doesn't leave its memory region
+		const u32 offset = addr - it->first;
+		if (it->second.size ? (offset >= it->second.size) : ((addr ^ it->first) >> 24) != 0) continue;
+
+		if (!out.empty()) out += " / ";
+		out += it->second.name;
+		if (offsets && offset)
+		{
+			char buf[16];
+			sprintf(buf, "+0x%X", offset);
+			out += buf;
+		}
+	}
+	return out;
+}
+
+//----------------------------------------------------------------------------
+//report
+
+static u32 profiler_fetch(int cpu, u32 addr, bool thumb)
+{
+	return thumb ? _MMU_read16(cpu, MMU_AT_DEBUG, addr) : _MMU_read32(cpu, MMU_AT_DEBUG, addr);
+}
+
+//whether the instruction can send the cpu somewhere other than the next one. the odd case (a multiply
+//naming r15, say) is taken for a branch, which only makes a block shorter than it is.
+static bool profiler_endsBlock(u32 i, bool thumb)
+{
+	if (thumb)
+	{
+		if ((i & 0xF000) == 0xD000) return true;	//conditional branch, swi
+		if ((i & 0xF800) == 0xE000) return true;	//b
+		if ((i & 0xF800) == 0xE800) return true;	//blx suffix
+		if ((i & 0xF800) == 0xF800) return true;	//bl suffix
+		if ((i & 0xFF00) == 0x4700) return true;	//bx, blx
+		if ((i & 0xFF00) == 0xBD00) return true;	//pop {...,pc}
+		if ((i & 0xFD87) == 0x4487) return true;	//add/mov pc,rm
+		return false;
+	}
+
+	if ((i & 0x0E000000) == 0x0A000000) return true;	//b, bl, blx
+	if ((i & 0x0FFFFFD0) == 0x012FFF10) return true;	//bx, blx
+	if ((i & 0x0F000000) == 0x0F000000) return true;	//swi
+	if ((i & 0x0E108000) == 0x08108000) return true;	//ldm with pc
+	if ((i & 0x0C10F000) == 0x0410F000) return true;	//ldr pc
+	if ((i & 0x0C00F000) == 0x0000F000)					//data processing into pc, other than the compares
+	{
+		const u32 op = (i >> 21) & 0xF;
+		return (op < 8 || op > 11);
+	}
+	return false;
+}
+
+//the straight line run of code addr is in: back to just after the previous branch, ahead to the next one
+static ProfileBlock profiler_findBlock(int cpu, u32 key)
+{
+	ProfileBlock block;
+	block.thumb = (key & 1) != 0;
+	const u32 step = block.thumb ? 2 : 4;
+	const u32 addr = key & ~1;
+
+	block.start = addr;
+	for (int n = 0; n < GUESTPROFILE_BLOCK_MAX; n++)
+	{
+		if (profiler_endsBlock(profiler_fetch(cpu, block.start - step, block.thumb), block.thumb)) break;
+		block.start -= step;
+	}
+
+	block.end = addr;
+	for (int n = 0; n < GUESTPROFILE_BLOCK_MAX; n++)
+	{
+		if (profiler_endsBlock(profiler_fetch(cpu, block.end, block.thumb), block.thumb)) break;
+		block.end += step;
+	}
+
+	memset(&block.hit, 0, sizeof(ProfileHit));
+	return block;
+}
+
+static void profiler_disassemble(int cpu, u32 addr, bool thumb, char *opcode, char *txt)
+{
+	const u32 i = profiler_fetch(cpu, addr, thumb);
+	if (thumb)
+	{
+		sprintf(opcode, "    %04X", i);
+		des_thumb_instructions_set[(i >> 6) & 1023](addr, i, txt);
+	}
+	else
+	{
+		sprintf(opcode, "%08X", i);
+		des_arm_instructions_set[INSTRUCTION_INDEX(i)](addr, i, txt);
+	}
+}
+
+//ranked by host time when there's a clock, by samples otherwise
+static bool profiler_hotter(const ProfileHit &a, const ProfileHit &b)
+{
+	return ticksPerSecond ? (a.ticks > b.ticks) : (a.samples > b.samples);
+}
+
+template<typename T>
+static bool profiler_hotterPair(const std::pair<T, ProfileHit> &a, const std::pair<T, ProfileHit> &b)
+{
+	return profiler_hotter(a.second, b.second);
+}
+
+static bool profiler_hotterBlock(const ProfileBlock &a, const ProfileBlock &b)
+{
+	return profiler_hotter(a.hit, b.hit);
+}
+
+static double profiler_share(const ProfileHit &hit, const ProfileHit &total)
+{
+	if (ticksPerSecond)
+		return total.ticks ? 100.0 * (double)hit.ticks / (double)total.ticks : 0;
+	return total.samples ? 100.0 * (double)hit.samples / (double)total.samples : 0;
+}
+
+static void profiler_writeCPU(FILE *fp, int cpu)
+{
+	const ProfileCPU &prof = profileCPU[cpu];
+	char opcode[16];
+	char txt[4096];
+
+	fprintf(fp, "\n== %s ==\n", cpuNames[cpu]);
+	fprintf(fp, "%u samples, %.1f%% waiting for an irq\n", prof.total.samples, profiler_share(prof.halted, prof.total));
+	if (prof.hits.empty()) return;
+
+	//addresses
+	std::vector<std::pair<u32, ProfileHit> > addrs(prof.hits.begin(), prof.hits.end());
+	std::sort(addrs.begin(), addrs.end(), profiler_hotterPair<u32>);
+
+	fprintf(fp, "\nhottest addresses\n");
+	fprintf(fp, "  %%time  samples  address   opcode    instruction\n");
+	for (size_t n = 0; n < addrs.size() && n < GUESTPROFILE_REPORT_ADDRS; n++)
+	{
+		const u32 addr = addrs[n].first & ~1;
+		const bool thumb = (addrs[n].first & 1) != 0;
+		profiler_disassemble(cpu, addr, thumb, opcode, txt);
+		const std::string sym = profiler_symbolize(cpu, addr, true);
+		fprintf(fp, " %5.1f%% %8u  %08X  %s  %-32s %s\n", profiler_share(addrs[n].second, prof.total), addrs[n].second.samples, addr, opcode, txt, sym.c_str());
+	}
+
+	//functions, if there are names to go by
+	if (!profileSymbols[cpu].empty())
+	{
+		std::map<std::string, ProfileHit> funcs;
+		for (ProfileHistogram::const_iterator it = prof.hits.begin(); it != prof.hits.end(); ++it)
+		{
+			std::string sym = profiler_symbolize(cpu, it->first & ~1, false);
+			if (sym.empty()) sym = "(no symbol)";
+			ProfileHit &hit = funcs[sym];
+			hit.samples += it->second.samples;
+			hit.ticks += it->second.ticks;
+		}
+
+		std::vector<std::pair<std::string, ProfileHit> > ranked(funcs.begin(), funcs.end());
+		std::sort(ranked.begin(), ranked.end(), profiler_hotterPair<std::string>);
+
+		fprintf(fp, "\nhottest functions\n");
+		fprintf(fp, "  %%time  samples  symbol\n");
+		for (size_t n = 0; n < ranked.size() && n < GUESTPROFILE_REPORT_ADDRS; n++)
+			fprintf(fp, " %5.1f%% %8u  %s\n", profiler_share(ranked[n].second, prof.total), ranked[n].second.samples, ranked[n].first.c_str());
+	}
+
+	//blocks. each sampled address is charged to the run of code around it; addresses in the same run agree on where it starts
+	std::map<u32, ProfileBlock> blocks;
+	for (ProfileHistogram::const_iterator it = prof.hits.begin(); it != prof.hits.end(); ++it)
+	{
+		ProfileBlock found = profiler_findBlock(cpu, it->first);
+		const u32 key = found.start | (found.thumb ? 1 : 0);
+		std::map<u32, ProfileBlock>::iterator b = blocks.find(key);
+		if (b == blocks.end())
+			b = blocks.insert(std::make_pair(key, found)).first;
+		b->second.end = std::max(b->second.end, found.end);
+		b->second.hit.samples += it->second.samples;
+		b->second.hit.ticks += it->second.ticks;
+	}
+
+	std::vector<ProfileBlock> ranked;
+	for (std::map<u32, ProfileBlock>::const_iterator it = blocks.begin(); it != blocks.end(); ++it)
+		ranked.push_back(it->second);
+	std::sort(ranked.begin(), ranked.end(), profiler_hotterBlock);
+
+	fprintf(fp, "\nhottest blocks\n");
+	for (size_t n = 0; n < ranked.size() && n < GUESTPROFILE_REPORT_BLOCKS; n++)
+	{
+		const ProfileBlock &block = ranked[n];
+		const std::string sym = profiler_symbolize(cpu, block.start, true);
+		fprintf(fp, "\n %5.1f%% %8u  %08X-%08X %s %s\n", profiler_share(block.hit, prof.total), block.hit.samples, block.start, block.end, block.thumb ? "thumb" : "arm", sym.c_str());
+
+		for (u32 addr = block.start; addr <= block.end; addr += block.thumb ? 2 : 4)
+		{
+			ProfileHistogram::const_iterator it = prof.hits.find(addr | (block.thumb ? 1 : 0));
+			profiler_disassemble(cpu, addr, block.thumb, opcode, txt);
+			if (it != prof.hits.end())
+				fprintf(fp, " %5.1f%% %8u  %08X  %s  %s\n", profiler_share(it->second, prof.total), it->second.samples, addr, opcode, txt);
+			else
+				fprintf(fp, "                 %08X  %s  %s\n", addr, opcode, txt);
+		}
+	}
+}
+
+bool GuestProfiler_WriteReport(const char *fileName)
+{
+	FILE *fp = fopen(fileName, "w");
+	if (!fp)
+	{
+		printf("Profiler: couldn't open %s\n", fileName);
+		return false;
+	}
+
+	fprintf(fp, "DeSmuME guest profile\n");
+	if (ticksPerSecond)
+		fprintf(fp, "%u samples over %.3f s of host time; %%time is the share of it spent at each place\n", profileCPU[0].total.samples, (double)profileCPU[0].total.ticks / (double)ticksPerSecond);
+	else
+		fprintf(fp, "%u samples; the driver has no clock, so %%time is the share of samples\n", profileCPU[0].total.samples);
+	fprintf(fp, "disassembly is of memory as it was when this report was written\n");
+
+	profiler_writeCPU(fp, ARMCPU_ARM9);
+	profiler_writeCPU(fp, ARMCPU_ARM7);
+
+	fclose(fp);
+	printf("Profiler: wrote %s\n", fileName);
+	return true;
+}
@@ -0,0 +1,70 @@
+/*
+	Copyright (C) 2016 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _GUESTPROFILER_H_
+#define _GUESTPROFILER_H_
+
+#include "types.h"
+
+//Finds out which guest code the host time goes to, for picking idle loops to skip or routines worth
+//special treatment in a particular game.
+//
+//Every so often (GUESTPROFILE_INTERVAL_US of host time) both cpus' pc and thumb state are sampled, and the
+//host time since the previous sample is charged to them. The report lists the hottest addresses and the
+//straight-line blocks around them, disassembled, with names from any symbol maps that were loaded.
+//
+//Sampling happens between sequencer events rather than on a timer interrupt, so a sample lands on whichever
+//instruction was about to run when the interval ran out; over many samples that still converges on where
+//the time goes. Host time comes from driver->EMU_GetTicks(), so with a driver that has none,
+//a sample is taken every GUESTPROFILE_INTERVAL_STEPS sequencer steps and the report can only count them.
+
+#define GUESTPROFILE_INTERVAL_US	250
+#define GUESTPROFILE_INTERVAL_STEPS	16		//without a clock
+#define GUESTPROFILE_REPORT_ADDRS	64
+#define GUESTPROFILE_REPORT_BLOCKS	24
+#define GUESTPROFILE_BLOCK_MAX		64		//instructions either side of a hot address to look for its block's ends
+
+struct GuestProfilerState
+{
+	bool active;
+	u64 nextSample;	//driver ticks; or, without a clock, sequencer steps
+};
+extern GuestProfilerState guestProfiler;
+
+void GuestProfiler_Start();
+void GuestProfiler_Stop();
+bool GuestProfiler_IsRunning();
+
+//loads names for the report from an ELF (its symbol table) or an nm-style text map ("address [type] name"
+//per line, as nm or no$gba .sym files write them). cpu is ARMCPU_ARM9 or ARMCPU_ARM7. overlays can each
+//have a map; where several maps name the same address, the report shows all of them.
+bool GuestProfiler_LoadSymbols(int cpu, const char *fileName);
+
+//the disassembly is of memory as it is when the report is written, so write it while the game is still
+//running the code of interest (an overlay may have been swapped out since)
+bool GuestProfiler_WriteReport(const char *fileName);
+
+void GuestProfiler_TakeSample();
+
+//called between sequencer events
+FORCEINLINE void GuestProfiler_Sample()
+{
+	if (guestProfiler.active)
+		GuestProfiler_TakeSample();
+}
+
+#endif
@@ -46,6 +46,7 @@
 #include "encrypt.h"
 #include "GPU.h"
 #include "SPU.h"
+#include "utils/trace.h"
 
 #ifdef DO_ASSERT_UNALIGNED
 #define ASSERT_UNALIGNED(x) assert(x)
@@ -826,6 +827,7 @@ static inline void MMU_VRAMmapControl(u8 block, u8 VRAMBankCnt)
 	MMU_VRAMmapRefreshBank<VRAM_BANK_B>();
 	MMU_VRAMmapRefreshBank<VRAM_BANK_C>();
 	MMU_VRAMmapRefreshBank<VRAM_BANK_D>();
+	MMU.vramMapGen++;
 
 	//printf(vramConfiguration.describe().c_str());
 	//printf("vram remapped at vcount=%d\n",nds.VCount);
@@ -955,6 +957,11 @@ void MMU_Reset()
 	memset(MMU.ARM9_VMEM, 0, sizeof(MMU.ARM9_VMEM));
 	memset(MMU.MAIN_MEM,  0, sizeof(MMU.MAIN_MEM));
 
+	//video memory was just cleared behind the back of the write handlers
+	MMU.vramMapGen++;
+	MMU.paletteGen[0]++; MMU.paletteGen[1]++;
+	MMU.oamGen[0]++; MMU.oamGen[1]++;
+
 	memset(MMU.UNUSED_RAM,    0, sizeof(MMU.UNUSED_RAM));
 	memset(MMU.MORE_UNUSED_RAM,    0, sizeof(MMU.UNUSED_RAM));
 	
@@ -1246,6 +1253,7 @@ bool DSI_TSC::load_state(EMUFILE* is)
 
 void MMU_GC_endTransfer(u32 PROCNUM)
 {
+	TRACE_END("card transfer");
 	u32 val = T1ReadLong(MMU.MMU_MEM[PROCNUM][0x40], 0x1A4) & 0x7F7FFFFF;
 	T1WriteLong(MMU.MMU_MEM[PROCNUM][0x40], 0x1A4, val);
 
@@ -1340,6 +1348,7 @@ void FASTCALL MMU_writeToGCControl(u32 val)
 	}
 
 	//the transfer size is determined by the specification here in GCROMCTRL, not any logic private to the card.
+	TRACE_BEGIN("card transfer");
 	card.transfer_count = blocksize;
 
 	//if there was nothing to be done here, go ahead and flag it as done
@@ -1852,7 +1861,7 @@ static INLINE u16 read_timer(int proc, int timerIndex)
 		return MMU.timer[proc][timerIndex];
 
 	//for unchained timers, we do not keep the timer up to date. its value will need to be calculated here
-	s32 diff = (s32)(nds.timerCycle[proc][timerIndex] - nds_timer);
+	s32 diff = (s32)(nds.timerCycle[proc][timerIndex] - NDS_CoreTime(proc));
 	assert(diff>=0);
 	if(diff<0) 
 		printf("NEW EMULOOP BAD NEWS PLEASE REPORT: TIME READ DIFF < 0 (%d) (%d) (%d)\n",diff,timerIndex,MMU.timerMODE[proc][timerIndex]);
@@ -1910,7 +1919,7 @@ static INLINE void write_timer(int proc, int timerIndex, u16 val)
 	}
 
 	int remain = 65536 - MMU.timerReload[proc][timerIndex];
-	nds.timerCycle[proc][timerIndex] = nds_timer + (remain<<MMU.timerMODE[proc][timerIndex]);
+	nds.timerCycle[proc][timerIndex] = NDS_CoreTime(proc) + (remain<<MMU.timerMODE[proc][timerIndex]);
 
 	T1WriteWord(MMU.MMU_MEM[proc][0x40], 0x102+timerIndex*4, val);
 	NDS_RescheduleTimers();
@@ -2173,6 +2182,7 @@ void DmaController::write32(const u32 val)
 
 void DmaController::exec()
 {
+	TRACE_ZONE("dma");
 	//this function runs when the DMA ends. the dma start actually queues this event after some kind of guess as to how long the DMA should take
 
 	//printf("ARM%c DMA%d execute, count %08X, mode %d%s\n", procnum?'7':'9', chan, wordcount, startmode, running?" - RUNNING":"");
@@ -2240,6 +2250,19 @@ void DmaController::exec()
 	driver->DEBUG_UpdateIORegView(BaseDriver::EDEBUG_IOREG_DMA);
 }
 
+//a plain memmove would be wrong when the destination overlaps the source from above;
+//the hardware (and the per-unit loops this replaces) copy forward and smear the data
+static FORCEINLINE void MMU_ForwardCopy(u8 *dst, const u8 *src, const u32 len)
+{
+	if(dst > src && dst < src + len)
+	{
+		for(u32 i = 0; i < len; i++)
+			dst[i] = src[i];
+	}
+	else
+		memmove(dst, src, len);
+}
+
 template<int PROCNUM>
 void DmaController::doCopy()
 {
@@ -2295,26 +2318,46 @@ void DmaController::doCopy()
 	//we might make another function to do just the raw copy op which can use them with checks
 	//outside the loop
 	int time_elapsed = 0;
-	if(sz==4) {
-		for(s32 i=(s32)todo; i>0; i--)
+	for(u32 left = todo; left; )
+	{
+		//aligned incrementing copies between plain memory skip the handlers entirely.
+		//the access time only depends on the region, which is constant over a span
+		if(srcinc == sz && dstinc == sz && !((src|dst) & (sz-1)))
 		{
+			u32 srcLen, dstLen;
+			u8 *s = MMU_GetHostSpan<PROCNUM,MMU_AT_DMA>(src, left*sz, 0, srcLen);
+			u8 *d = s ? MMU_GetHostSpan<PROCNUM,MMU_AT_DMA>(dst, left*sz, sz<<3, dstLen) : NULL;
+			const u32 units = d ? std::min(srcLen, dstLen) / sz : 0;
+			if(units)
+			{
+				if(sz==4)
+					time_elapsed += units * (_MMU_accesstime<PROCNUM,MMU_AT_DMA,32,MMU_AD_READ,TRUE>(src,true) + _MMU_accesstime<PROCNUM,MMU_AT_DMA,32,MMU_AD_WRITE,TRUE>(dst,true));
+				else
+					time_elapsed += units * (_MMU_accesstime<PROCNUM,MMU_AT_DMA,16,MMU_AD_READ,TRUE>(src,true) + _MMU_accesstime<PROCNUM,MMU_AT_DMA,16,MMU_AD_WRITE,TRUE>(dst,true));
+				
+				MMU_ForwardCopy(d, s, units*sz);
+
+				dst += units*sz;
+				src += units*sz;
+				left -= units;
+				continue;
+			}
+		}
+
+		if(sz==4) {
 			time_elapsed += _MMU_accesstime<PROCNUM,MMU_AT_DMA,32,MMU_AD_READ,TRUE>(src,true);
 			time_elapsed += _MMU_accesstime<PROCNUM,MMU_AT_DMA,32,MMU_AD_WRITE,TRUE>(dst,true);
 			u32 temp = _MMU_read32(procnum,MMU_AT_DMA,src);
 			_MMU_write32(procnum,MMU_AT_DMA,dst, temp);
-			dst += dstinc;
-			src += srcinc;
-		}
-	} else {
-		for(s32 i=(s32)todo; i>0; i--)
-		{
+		} else {
 			time_elapsed += _MMU_accesstime<PROCNUM,MMU_AT_DMA,16,MMU_AD_READ,TRUE>(src,true);
 			time_elapsed += _MMU_accesstime<PROCNUM,MMU_AT_DMA,16,MMU_AD_WRITE,TRUE>(dst,true);
 			u16 temp = _MMU_read16(procnum,MMU_AT_DMA,src);
 			_MMU_write16(procnum,MMU_AT_DMA,dst, temp);
-			dst += dstinc;
-			src += srcinc;
 		}
+		dst += dstinc;
+		src += srcinc;
+		left--;
 	}
 
 	//printf("ARM%c dma of size %d from 0x%08X to 0x%08X took %d cycles\n",PROCNUM==0?'9':'7',todo*sz,saddr,daddr,time_elapsed);
@@ -2368,7 +2411,7 @@ void DmaController::tryTrigger(EDMAMode mode)
 void DmaController::doSchedule()
 {
 	dmaCheck = TRUE;
-	nextEvent = nds_timer;
+	nextEvent = NDS_CoreTime(procnum);
 	NDS_RescheduleDMA();
 }
 
@@ -3649,6 +3692,7 @@ void FASTCALL _MMU_ARM9_write08(u32 adr, u8 val)
 	adr = MMU_LCDmap<ARMCPU_ARM9>(adr, unmapped, restricted);
 	if(unmapped) return;
 	if(restricted) return; //block 8bit vram writes
+	MMU_TouchVideoMemory(adr);
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM9))
@@ -4215,12 +4259,14 @@ void FASTCALL _MMU_ARM9_write16(u32 adr, u16 val)
 			
 		case 0x07: // OAM attributes
 			T1WriteWord(MMU.ARM9_OAM, adr & 0x07FF, val);
+			MMU.oamGen[(adr>>10)&1]++;
 			return;
 	}
 	
 	bool unmapped, restricted;
 	adr = MMU_LCDmap<ARMCPU_ARM9>(adr, unmapped, restricted);
 	if(unmapped) return;
+	MMU_TouchVideoMemory(adr);
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM9))
@@ -4718,12 +4764,14 @@ void FASTCALL _MMU_ARM9_write32(u32 adr, u32 val)
 			
 		case 0x07: // OAM attributes
 			T1WriteLong(MMU.ARM9_OAM, adr & 0x07FF, val);
+			MMU.oamGen[(adr>>10)&1]++;
 			return;
 	}
 
 	bool unmapped, restricted;
 	adr = MMU_LCDmap<ARMCPU_ARM9>(adr, unmapped, restricted);
 	if(unmapped) return;
+	MMU_TouchVideoMemory(adr);
 
 #ifdef HAVE_JIT
 	if (JIT_MAPPED(adr, ARMCPU_ARM9))
@@ -5800,6 +5848,226 @@ void FASTCALL MMU_DumpMemBlock(u8 proc, u32 address, u32 size, u8 *buffer)
 }
 
 
+//clips a span starting at addr so that it doesn't run into the arm9 dtcm, which sits on top of everything else
+static FORCEINLINE u32 MMU_ClipSpanToDTCM(const u32 addr, const u32 len)
+{
+	const u32 dtcm = MMU.DTCMRegion;
+	if(dtcm > addr && dtcm - addr < len)
+		return dtcm - addr;
+	return len;
+}
+
+template<int PROCNUM, MMU_ACCESS_TYPE AT>
+u8* MMU_GetHostSpan(u32 addr, u32 len, const int writeSize, u32 &spanLen)
+{
+	spanLen = 0;
+	if(len == 0) return NULL;
+
+#ifdef DEVELOPER
+	//debug events are raised by the per-access handlers only, and mean nothing for the debugger's own accesses
+	if(AT != MMU_AT_DEBUG) return NULL;
+#endif
+
+#ifdef HAVE_LUA
+	//so are lua memory hooks, but a span none of them can see doesn't need them
+	if(LuaMemHookSpanHit(PROCNUM, addr, len, writeSize ? LUAMEMHOOK_WRITE : LUAMEMHOOK_READ))
+		return NULL;
+#endif
+
+#ifdef HAVE_JIT
+	//writes would need to invalidate compiled blocks unit by unit
+	if(writeSize) return NULL;
+#endif
+
+	if(AT == MMU_AT_DATA && MMU_coresThreaded && MMU_IsCrossCoreAddress(PROCNUM, addr))
+		return NULL;
+
+	//the following mirrors the order of checks in _MMU_read08 and friends
+	if(PROCNUM==ARMCPU_ARM9 && (addr&(~0x3FFF)) == MMU.DTCMRegion)
+	{
+		//dma can't see the tcm
+		if(AT == MMU_AT_DMA) return NULL;
+		const u32 ofs = addr & 0x3FFF;
+		spanLen = std::min(len, 0x4000 - ofs);
+		return MMU.ARM9_DTCM + ofs;
+	}
+
+	if((addr & 0x0F000000) == 0x02000000)
+	{
+		const u32 ofs = addr & _MMU_MAIN_MEM_MASK;
+		spanLen = std::min(len, _MMU_MAIN_MEM_MASK + 1 - ofs);
+		if(PROCNUM==ARMCPU_ARM9) spanLen = MMU_ClipSpanToDTCM(addr, spanLen);
+		return MMU.MAIN_MEM + ofs;
+	}
+
+	addr &= 0x0FFFFFFF;
+	const u32 bank = addr >> 24;
+
+	switch(bank)
+	{
+		case 0x00:
+		case 0x01:
+		{
+			if(PROCNUM==ARMCPU_ARM7 || AT == MMU_AT_DMA) return NULL; //arm7 bios, or tcm which dma can't see
+			const u32 ofs = addr & 0x7FFF;
+			spanLen = MMU_ClipSpanToDTCM(addr, std::min(len, 0x8000 - ofs));
+			return MMU.ARM9_ITCM + ofs;
+		}
+
+		case 0x05: //palette
+			if(PROCNUM==ARMCPU_ARM7 || writeSize == 8) return NULL; //8bit writes are dropped
+			break;
+
+		case 0x07: //oam
+		{
+			if(PROCNUM==ARMCPU_ARM7 || writeSize == 8) return NULL; //8bit writes are dropped
+			const u32 ofs = addr & 0x07FF;
+			spanLen = MMU_ClipSpanToDTCM(addr, std::min(len, 0x0800 - ofs));
+			if(writeSize)
+			{
+				MMU_TouchVideoMemory(addr);
+				MMU_TouchVideoMemory(addr + spanLen - 1);
+			}
+			return MMU.ARM9_OAM + ofs;
+		}
+
+		case 0x03: //wram
+		case 0x06: //vram
+			break;
+
+		default: //io, slot2, bios
+			return NULL;
+	}
+
+	//everything left lives in 16KB pages which may be remapped independently
+	const u32 pageLen = 0x4000 - (addr & 0x3FFF);
+
+	bool unmapped, restricted;
+	const u32 mapped = MMU_LCDmap<PROCNUM>(addr, unmapped, restricted);
+	if(unmapped) return NULL;
+	if(restricted && writeSize == 8) return NULL; //8bit vram writes are dropped
+
+	const u32 chunk = (mapped >> 20) & 0xFF;
+	const u32 mask = MMU.MMU_MASK[PROCNUM][chunk];
+	const u32 ofs = mapped & mask;
+
+	spanLen = std::min(len, pageLen);
+	spanLen = std::min(spanLen, mask + 1 - ofs);
+	if(PROCNUM==ARMCPU_ARM9) spanLen = MMU_ClipSpanToDTCM(addr, spanLen);
+	if(PROCNUM==ARMCPU_ARM9 && writeSize)
+	{
+		//the caller is about to write through the span, so let the 2d engines know
+		MMU_TouchVideoMemory(mapped);
+		MMU_TouchVideoMemory(mapped + spanLen - 1);
+	}
+	return MMU.MMU_MEM[PROCNUM][chunk] + ofs;
+}
+
+template<int PROCNUM, MMU_ACCESS_TYPE AT>
+int MMU_GetHostSpans(u32 addr, u32 len, const int writeSize, MMU_Span *spans, const int maxSpans)
+{
+	int count = 0;
+	while(len)
+	{
+		if(count == maxSpans) return 0;
+
+		u32 spanLen;
+		u8 *ptr = MMU_GetHostSpan<PROCNUM,AT>(addr, len, writeSize, spanLen);
+		if(ptr == NULL) return 0;
+
+		spans[count].addr = addr;
+		spans[count].ptr = ptr;
+		spans[count].len = spanLen;
+		count++;
+
+		addr += spanLen;
+		len -= spanLen;
+	}
+	return count;
+}
+
+template<int PROCNUM, MMU_ACCESS_TYPE AT>
+void MMU_BulkCopy(u32 dst, u32 src, u32 count, const int size)
+{
+	const u32 unit = size >> 3;
+
+	while(count)
+	{
+		u32 srcLen, dstLen;
+		const bool aligned = !((src|dst) & (unit-1));
+		u8 *s = aligned ? MMU_GetHostSpan<PROCNUM,AT>(src, count*unit, 0, srcLen) : NULL;
+		u8 *d = s ? MMU_GetHostSpan<PROCNUM,AT>(dst, count*unit, size, dstLen) : NULL;
+		const u32 units = d ? std::min(srcLen, dstLen) / unit : 0;
+
+		if(units)
+		{
+			MMU_ForwardCopy(d, s, units*unit);
+			src += units*unit;
+			dst += units*unit;
+			count -= units;
+			continue;
+		}
+
+		switch(size)
+		{
+			case 8: _MMU_write08(PROCNUM,AT,dst,_MMU_read08(PROCNUM,AT,src)); break;
+			case 16: _MMU_write16(PROCNUM,AT,dst,_MMU_read16(PROCNUM,AT,src)); break;
+			case 32: _MMU_write32(PROCNUM,AT,dst,_MMU_read32(PROCNUM,AT,src)); break;
+		}
+		src += unit;
+		dst += unit;
+		count--;
+	}
+}
+
+template<int PROCNUM, MMU_ACCESS_TYPE AT>
+void MMU_BulkFill(u32 dst, const u32 val, u32 count, const int size)
+{
+	const u32 unit = size >> 3;
+
+	while(count)
+	{
+		u32 dstLen;
+		u8 *d = (dst & (unit-1)) ? NULL : MMU_GetHostSpan<PROCNUM,AT>(dst, count*unit, size, dstLen);
+		const u32 units = d ? dstLen / unit : 0;
+
+		if(units)
+		{
+			switch(size)
+			{
+				case 8: memset(d, val, units); break;
+				case 16: for(u32 i = 0; i < units; i++) T1WriteWord(d, i<<1, val); break;
+				case 32: for(u32 i = 0; i < units; i++) T1WriteLong(d, i<<2, val); break;
+			}
+			dst += units*unit;
+			count -= units;
+			continue;
+		}
+
+		switch(size)
+		{
+			case 8: _MMU_write08(PROCNUM,AT,dst,val); break;
+			case 16: _MMU_write16(PROCNUM,AT,dst,val); break;
+			case 32: _MMU_write32(PROCNUM,AT,dst,val); break;
+		}
+		dst += unit;
+		count--;
+	}
+}
+
+template u8* MMU_GetHostSpan<ARMCPU_ARM9,MMU_AT_DATA>(u32 addr, u32 len, const int writeSize, u32 &spanLen);
+template u8* MMU_GetHostSpan<ARMCPU_ARM7,MMU_AT_DATA>(u32 addr, u32 len, const int writeSize, u32 &spanLen);
+template u8* MMU_GetHostSpan<ARMCPU_ARM9,MMU_AT_DMA>(u32 addr, u32 len, const int writeSize, u32 &spanLen);
+template u8* MMU_GetHostSpan<ARMCPU_ARM7,MMU_AT_DMA>(u32 addr, u32 len, const int writeSize, u32 &spanLen);
+template u8* MMU_GetHostSpan<ARMCPU_ARM9,MMU_AT_DEBUG>(u32 addr, u32 len, const int writeSize, u32 &spanLen);
+template u8* MMU_GetHostSpan<ARMCPU_ARM7,MMU_AT_DEBUG>(u32 addr, u32 len, const int writeSize, u32 &spanLen);
+template int MMU_GetHostSpans<ARMCPU_ARM9,MMU_AT_DATA>(u32 addr, u32 len, const int writeSize, MMU_Span *spans, const int maxSpans);
+template int MMU_GetHostSpans<ARMCPU_ARM7,MMU_AT_DATA>(u32 addr, u32 len, const int writeSize, MMU_Span *spans, const int maxSpans);
+template void MMU_BulkCopy<ARMCPU_ARM9,MMU_AT_DATA>(u32 dst, u32 src, u32 count, const int size);
+template void MMU_BulkCopy<ARMCPU_ARM7,MMU_AT_DATA>(u32 dst, u32 src, u32 count, const int size);
+template void MMU_BulkFill<ARMCPU_ARM9,MMU_AT_DATA>(u32 dst, const u32 val, u32 count, const int size);
+template void MMU_BulkFill<ARMCPU_ARM7,MMU_AT_DATA>(u32 dst, const u32 val, u32 count, const int size);
+
 //these templates needed to be instantiated manually
 template u32 MMU_struct::gen_IF<ARMCPU_ARM9>();
 template u32 MMU_struct::gen_IF<ARMCPU_ARM7>();
@@ -381,6 +381,13 @@ struct MMU_struct
 
 	u8* ExtPal[2][4];
 	u8* ObjExtPal[2][2];
+
+	//generation counters for video memory, bumped on every cpu or dma write.
+	//the 2d engines compare these to decide whether a scanline needs to be composed again.
+	u32 vramPageGen[64]; //indexed by physical 16KB page of ARM9_LCD
+	u32 vramMapGen; //bumped whenever the vram bank mapping changes
+	u32 paletteGen[2]; //indexed by engine
+	u32 oamGen[2]; //indexed by engine
 	
 	struct TextureInfo {
 		u8* texPalSlot[6];
@@ -621,6 +628,17 @@ FORCEINLINE void* MMU_gpu_map(const u32 vram_addr)
 	return MMU.ARM9_LCD + (vram_page << 14) + ofs;
 }
 
+//bumps the generation counter covering a palette, oam or (already LCDC-mapped) vram address
+FORCEINLINE void MMU_TouchVideoMemory(const u32 adr)
+{
+	switch(adr>>24)
+	{
+		case 0x05: MMU.paletteGen[(adr>>10)&1]++; break;
+		case 0x06: MMU.vramPageGen[(adr>>14)&63]++; break;
+		case 0x07: MMU.oamGen[(adr>>10)&1]++; break;
+	}
+}
+
 
 template<int PROCNUM, MMU_ACCESS_TYPE AT> u8 _MMU_read08(u32 addr);
 template<int PROCNUM, MMU_ACCESS_TYPE AT> u16 _MMU_read16(u32 addr);
@@ -673,6 +691,49 @@ FORCEINLINE void CheckMemoryDebugEvent(EDEBUG_EVENT event, const MMU_ACCESS_TYPE
 	}
 }
 
+//threaded arm7: while the arm7 runs on its own host thread (see armThreadedLoop in NDSSystem.cpp),
+//data accesses to state which the other core can observe wait until that core has caught up in time.
+//each core only rendezvouses on the addresses listed here; everything else is allowed to drift apart
+//by up to one work unit (CommonSettings.arm7_sync_quantum)
+extern volatile bool MMU_coresThreaded;
+void MMU_SyncCores(const int PROCNUM);
+
+FORCEINLINE bool MMU_IsCrossCoreAddress(const int PROCNUM, const u32 addr)
+{
+	const u32 region = addr & 0x0F000000;
+
+	//ipc sync/fifo, IME/IE/IF, and the memory control registers (WRAMCNT/VRAMCNT) which remap the other core
+	if(region == 0x04000000)
+	{
+		//ipc fifo receive
+		if((addr & 0x0FFFFFF0) == 0x04100000)
+			return true;
+
+		//on the arm9 side, dma and timers too: programming either schedules sequencer events, as the arm7's do
+		if(PROCNUM == ARMCPU_ARM9)
+			return (addr >= 0x040000B0 && addr < 0x04000110) || (addr >= 0x04000180 && addr < 0x04000190) || (addr >= 0x04000200 && addr < 0x04000250);
+
+		//the arm7 touches plenty of io which only it can see (spu, wifi, spi, rtc) but that is
+		//all in its own time. only skip the spu, since the sound driver hammers it
+		return (addr < 0x04000400 || addr >= 0x04000600) && addr < 0x04800000;
+	}
+	//shared wram. on the arm7 side, 0x03800000 and up is its own exclusive wram
+	if(region == 0x03000000)
+		return PROCNUM == ARMCPU_ARM9 || addr < 0x03800000;
+
+	//the arm9 is in main memory constantly, so only the arm7 side pays for it
+	if(region == 0x02000000)
+		return PROCNUM == ARMCPU_ARM7;
+
+	return false;
+}
+
+FORCEINLINE void CheckCoreSync(const MMU_ACCESS_TYPE type, const int procnum, const u32 addr)
+{
+	if(type == MMU_AT_DATA && MMU_coresThreaded && MMU_IsCrossCoreAddress(procnum, addr))
+		MMU_SyncCores(procnum);
+}
+
 
 //ALERT!!!!!!!!!!!!!!
 //the following inline functions dont do the 0x0FFFFFFF mask.
@@ -681,6 +742,7 @@ FORCEINLINE void CheckMemoryDebugEvent(EDEBUG_EVENT event, const MMU_ACCESS_TYPE
 FORCEINLINE u8 _MMU_read08(const int PROCNUM, const MMU_ACCESS_TYPE AT, const u32 addr)
 {
 	CheckMemoryDebugEvent(DEBUG_EVENT_READ,AT,PROCNUM,addr,8,0);
+	CheckCoreSync(AT,PROCNUM,addr);
 
 	//special handling to un-protect the ARM7 bios during debug reading
 	if(PROCNUM == ARMCPU_ARM7 && AT == MMU_AT_DEBUG && addr<0x00004000)
@@ -696,7 +758,7 @@ FORCEINLINE u8 _MMU_read08(const int PROCNUM, const MMU_ACCESS_TYPE AT, const u3
 	}
 
 #ifdef HAVE_LUA
-	CallRegisteredLuaMemHook(addr, 1, /*FIXME*/ 0, LUAMEMHOOK_READ);
+	CallRegisteredLuaMemHook(PROCNUM, addr, 1, /*FIXME*/ 0, LUAMEMHOOK_READ);
 #endif
 
 	if(PROCNUM==ARMCPU_ARM9)
@@ -716,6 +778,7 @@ FORCEINLINE u8 _MMU_read08(const int PROCNUM, const MMU_ACCESS_TYPE AT, const u3
 FORCEINLINE u16 _MMU_read16(const int PROCNUM, const MMU_ACCESS_TYPE AT, const u32 addr) 
 {
 	CheckMemoryDebugEvent(DEBUG_EVENT_READ,AT,PROCNUM,addr,16,0);
+	CheckCoreSync(AT,PROCNUM,addr);
 
 	//special handling to un-protect the ARM7 bios during debug reading
 	if(PROCNUM == ARMCPU_ARM7 && AT == MMU_AT_DEBUG && addr<0x00004000)
@@ -731,7 +794,7 @@ FORCEINLINE u16 _MMU_read16(const int PROCNUM, const MMU_ACCESS_TYPE AT, const u
 	}
 
 #ifdef HAVE_LUA
-	CallRegisteredLuaMemHook(addr, 2, /*FIXME*/ 0, LUAMEMHOOK_READ);
+	CallRegisteredLuaMemHook(PROCNUM, addr, 2, /*FIXME*/ 0, LUAMEMHOOK_READ);
 #endif
 
 	//special handling for execution from arm9, since we spend so much time in there
@@ -764,6 +827,7 @@ dunno:
 FORCEINLINE u32 _MMU_read32(const int PROCNUM, const MMU_ACCESS_TYPE AT, const u32 addr)
 {
 	CheckMemoryDebugEvent(DEBUG_EVENT_READ,AT,PROCNUM,addr,32,0);
+	CheckCoreSync(AT,PROCNUM,addr);
 
 	//special handling to un-protect the ARM7 bios during debug reading
 	if(PROCNUM == ARMCPU_ARM7 && AT == MMU_AT_DEBUG && addr<0x00004000)
@@ -779,7 +843,7 @@ FORCEINLINE u32 _MMU_read32(const int PROCNUM, const MMU_ACCESS_TYPE AT, const u
 	}
 
 #ifdef HAVE_LUA
-	CallRegisteredLuaMemHook(addr, 4, /*FIXME*/ 0, LUAMEMHOOK_READ);
+	CallRegisteredLuaMemHook(PROCNUM, addr, 4, /*FIXME*/ 0, LUAMEMHOOK_READ);
 #endif
 
 	//special handling for execution from arm9, since we spend so much time in there
@@ -829,6 +893,7 @@ dunno:
 FORCEINLINE void _MMU_write08(const int PROCNUM, const MMU_ACCESS_TYPE AT, const u32 addr, u8 val)
 {
 	CheckMemoryDebugEvent(DEBUG_EVENT_WRITE,AT,PROCNUM,addr,8,val);
+	CheckCoreSync(AT,PROCNUM,addr);
 
 	//special handling for DMA: discard writes to TCM
 	if(PROCNUM==ARMCPU_ARM9 && AT == MMU_AT_DMA)
@@ -842,7 +907,7 @@ FORCEINLINE void _MMU_write08(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 		{
 			T1WriteByte(MMU.ARM9_DTCM, addr & 0x3FFF, val);
 #ifdef HAVE_LUA
-			CallRegisteredLuaMemHook(addr, 1, val, LUAMEMHOOK_WRITE);
+			CallRegisteredLuaMemHook(PROCNUM, addr, 1, val, LUAMEMHOOK_WRITE);
 #endif
 			return;
 		}
@@ -853,7 +918,7 @@ FORCEINLINE void _MMU_write08(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 #endif
 		T1WriteByte( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK, val);
 #ifdef HAVE_LUA
-		CallRegisteredLuaMemHook(addr, 1, val, LUAMEMHOOK_WRITE);
+		CallRegisteredLuaMemHook(PROCNUM, addr, 1, val, LUAMEMHOOK_WRITE);
 #endif
 		return;
 	}
@@ -861,13 +926,14 @@ FORCEINLINE void _MMU_write08(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 	if(PROCNUM==ARMCPU_ARM9) _MMU_ARM9_write08(addr,val);
 	else _MMU_ARM7_write08(addr,val);
 #ifdef HAVE_LUA
-	CallRegisteredLuaMemHook(addr, 1, val, LUAMEMHOOK_WRITE);
+	CallRegisteredLuaMemHook(PROCNUM, addr, 1, val, LUAMEMHOOK_WRITE);
 #endif
 }
 
 FORCEINLINE void _MMU_write16(const int PROCNUM, const MMU_ACCESS_TYPE AT, const u32 addr, u16 val)
 {
 	CheckMemoryDebugEvent(DEBUG_EVENT_WRITE,AT,PROCNUM,addr,16,val);
+	CheckCoreSync(AT,PROCNUM,addr);
 
 	//special handling for DMA: discard writes to TCM
 	if(PROCNUM==ARMCPU_ARM9 && AT == MMU_AT_DMA)
@@ -881,7 +947,7 @@ FORCEINLINE void _MMU_write16(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 		{
 			T1WriteWord(MMU.ARM9_DTCM, addr & 0x3FFE, val);
 #ifdef HAVE_LUA
-			CallRegisteredLuaMemHook(addr, 2, val, LUAMEMHOOK_WRITE);
+			CallRegisteredLuaMemHook(PROCNUM, addr, 2, val, LUAMEMHOOK_WRITE);
 #endif
 			return;
 		}
@@ -892,7 +958,7 @@ FORCEINLINE void _MMU_write16(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 #endif
 		T1WriteWord( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK16, val);
 #ifdef HAVE_LUA
-		CallRegisteredLuaMemHook(addr, 2, val, LUAMEMHOOK_WRITE);
+		CallRegisteredLuaMemHook(PROCNUM, addr, 2, val, LUAMEMHOOK_WRITE);
 #endif
 		return;
 	}
@@ -900,13 +966,14 @@ FORCEINLINE void _MMU_write16(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 	if(PROCNUM==ARMCPU_ARM9) _MMU_ARM9_write16(addr,val);
 	else _MMU_ARM7_write16(addr,val);
 #ifdef HAVE_LUA
-	CallRegisteredLuaMemHook(addr, 2, val, LUAMEMHOOK_WRITE);
+	CallRegisteredLuaMemHook(PROCNUM, addr, 2, val, LUAMEMHOOK_WRITE);
 #endif
 }
 
 FORCEINLINE void _MMU_write32(const int PROCNUM, const MMU_ACCESS_TYPE AT, const u32 addr, u32 val)
 {
 	CheckMemoryDebugEvent(DEBUG_EVENT_WRITE,AT,PROCNUM,addr,32,val);
+	CheckCoreSync(AT,PROCNUM,addr);
 
 	//special handling for DMA: discard writes to TCM
 	if(PROCNUM==ARMCPU_ARM9 && AT == MMU_AT_DMA)
@@ -920,7 +987,7 @@ FORCEINLINE void _MMU_write32(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 		{
 			T1WriteLong(MMU.ARM9_DTCM, addr & 0x3FFC, val);
 #ifdef HAVE_LUA
-			CallRegisteredLuaMemHook(addr, 4, val, LUAMEMHOOK_WRITE);
+			CallRegisteredLuaMemHook(PROCNUM, addr, 4, val, LUAMEMHOOK_WRITE);
 #endif
 			return;
 		}
@@ -932,7 +999,7 @@ FORCEINLINE void _MMU_write32(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 #endif
 		T1WriteLong( MMU.MAIN_MEM, addr & _MMU_MAIN_MEM_MASK32, val);
 #ifdef HAVE_LUA
-		CallRegisteredLuaMemHook(addr, 4, val, LUAMEMHOOK_WRITE);
+		CallRegisteredLuaMemHook(PROCNUM, addr, 4, val, LUAMEMHOOK_WRITE);
 #endif
 		return;
 	}
@@ -940,7 +1007,7 @@ FORCEINLINE void _MMU_write32(const int PROCNUM, const MMU_ACCESS_TYPE AT, const
 	if(PROCNUM==ARMCPU_ARM9) _MMU_ARM9_write32(addr,val);
 	else _MMU_ARM7_write32(addr,val);
 #ifdef HAVE_LUA
-	CallRegisteredLuaMemHook(addr, 4, val, LUAMEMHOOK_WRITE);
+	CallRegisteredLuaMemHook(PROCNUM, addr, 4, val, LUAMEMHOOK_WRITE);
 #endif
 }
 
@@ -996,6 +1063,27 @@ FORCEINLINE void _MMU_write16(u32 addr, u16 val) { _MMU_write16(PROCNUM, AT, add
 template<int PROCNUM, MMU_ACCESS_TYPE AT>
 FORCEINLINE void _MMU_write32(u32 addr, u32 val) { _MMU_write32(PROCNUM, AT, addr, val); }
 
-void FASTCALL MMU_DumpMemBlock(u8 proc, u32 address, u32 size, u8 *buffer);
+void FASTCALL MMU_DumpMemBlock(u8 proc, u32 address, u32 size, u8 *buffer);
+
+//bulk access support, for code which would otherwise go through the handlers above one unit at a time.
+//MMU_GetHostSpan resolves as much of [addr, addr+len) as is contiguous in host memory and free of access side effects,
+//returning the host pointer and the usable length in spanLen, or NULL if addr must go through the per-access handlers
+//(io, slot2, bios, unmapped memory...). writeSize is the width in bits of the writes the caller will do, or 0 for reads only.
+//this skips the timing model, so callers do their own accounting.
+struct MMU_Span
+{
+	u32 addr;
+	u8 *ptr;
+	u32 len;
+};
+
+template<int PROCNUM, MMU_ACCESS_TYPE AT> u8* MMU_GetHostSpan(u32 addr, u32 len, const int writeSize, u32 &spanLen);
+
+//splits [addr, addr+len) into host spans. returns the number of spans, or 0 if any part lacks one (or more than maxSpans are needed)
+template<int PROCNUM, MMU_ACCESS_TYPE AT> int MMU_GetHostSpans(u32 addr, u32 len, const int writeSize, MMU_Span *spans, const int maxSpans);
+
+//copy or fill count units of size bits, incrementing, using host spans where possible and the handlers elsewhere
+template<int PROCNUM, MMU_ACCESS_TYPE AT> void MMU_BulkCopy(u32 dst, u32 src, u32 count, const int size);
+template<int PROCNUM, MMU_ACCESS_TYPE AT> void MMU_BulkFill(u32 dst, const u32 val, u32 count, const int size);
 
 #endif
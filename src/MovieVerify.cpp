@@ -0,0 +1,586 @@
+/*
+	Copyright (C) 2016 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MovieVerify.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#ifdef HOST_WINDOWS
+#include <direct.h>
+#elif !defined(_3DS)
+#define MOVIEVERIFY_FORK
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#include "types.h"
+#include "NDSSystem.h"
+#include "MMU.h"
+#include "GPU.h"
+#include "SPU.h"
+#include "render3D.h"
+#include "movie.h"
+#include "saves.h"
+#include "emufile.h"
+#include "ROMPrefetch.h"
+
+struct VerifyFrame
+{
+	u64 screen;
+	u64 ram;
+	u32 usec;
+};
+
+struct VerifyMovie
+{
+	std::string fileName;
+	std::string name;
+	MovieData data;
+};
+
+static std::vector<VerifyMovie> movies;
+static std::vector<VerifyFrame> trace;	//every frame played since power-on, on the way to the current branch
+static std::string reportDir;
+
+#ifdef MOVIEVERIFY_FORK
+//one byte per worker that may start. whoever is emulating holds one, and a worker hands its back when done
+static int jobTokens[2] = { -1, -1 };
+static std::vector<pid_t> workers;
+
+static void verify_PutJob()
+{
+	const char token = 'j';
+	if (write(jobTokens[1], &token, 1) != 1)
+		printf("verify: lost a job\n");
+}
+#endif
+
+static u64 verify_Hash(u64 h, const void *data, size_t size)
+{
+	const u8 *p = (const u8 *)data;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		u64 w;
+		memcpy(&w, p + i, 8);
+		h = (h ^ w) * 0x100000001B3ULL;
+		h ^= h >> 29;
+	}
+	for (; i < size; i++)
+		h = (h ^ p[i]) * 0x100000001B3ULL;
+	return h;
+}
+
+static void verify_RunFrame()
+{
+	const clock_t start = clock();
+
+	NDS_beginProcessingInput();
+	FCEUMOV_HandlePlayback();
+	NDS_endProcessingInput();
+	NDS_exec<false>();
+
+	const clock_t end = clock();
+
+	VerifyFrame frame;
+	frame.screen = 0xCBF29CE484222325ULL;
+	const NDSDisplayInfo &info = GPU->GetDisplayInfo();
+	for (int i = 0; i < 2; i++)
+		frame.screen = verify_Hash(frame.screen, info.renderedBuffer[i], info.renderedWidth[i] * info.renderedHeight[i] * info.pixelBytes);
+	frame.ram = verify_Hash(0xCBF29CE484222325ULL, MMU.MAIN_MEM, _MMU_MAIN_MEM_MASK + 1);
+	frame.usec = (u32)((u64)(end - start) * 1000000 / CLOCKS_PER_SEC);
+	trace.push_back(frame);
+}
+
+static std::string verify_FramesPath(const std::string &dir, const std::string &name)
+{
+	return dir + "/" + name + ".frames";
+}
+
+static void verify_WriteFrames(const VerifyMovie &movie)
+{
+	const std::string fileName = verify_FramesPath(reportDir, movie.name);
+	FILE *fp = fopen(fileName.c_str(), "w");
+	if (!fp)
+	{
+		printf("verify: can't write %s\n", fileName.c_str());
+		return;
+	}
+
+	fprintf(fp, "# %s\n", movie.fileName.c_str());
+	fprintf(fp, "# frame screen ram usec\n");
+	for (size_t i = 0; i < movie.data.records.size(); i++)
+		fprintf(fp, "%u %016llx %016llx %u\n", (u32)i, (unsigned long long)trace[i].screen, (unsigned long long)trace[i].ram, trace[i].usec);
+	fclose(fp);
+
+	printf("verify: %s done, %u frames\n", movie.name.c_str(), (u32)movie.data.records.size());
+}
+
+static bool verify_ReadFrames(const std::string &fileName, std::vector<VerifyFrame> &frames)
+{
+	frames.clear();
+	FILE *fp = fopen(fileName.c_str(), "r");
+	if (!fp) return false;
+
+	char line[128];
+	while (fgets(line, sizeof(line), fp))
+	{
+		unsigned int index, usec;
+		unsigned long long screen, ram;
+		if (line[0] == '#') continue;
+		if (sscanf(line, "%u %llx %llx %u", &index, &screen, &ram, &usec) != 4) continue;
+
+		VerifyFrame frame;
+		frame.screen = screen;
+		frame.ram = ram;
+		frame.usec = usec;
+		frames.push_back(frame);
+	}
+	fclose(fp);
+	return true;
+}
+
+//the movie itself stays out of checkpoints: it's the harness's to keep track of, and a savestate would carry
+//a copy of the whole thing and check it against the movie that's loaded when it comes back
+static void verify_SaveCheckpoint(EMUFILE_MEMORY *fp)
+{
+	movieMode = MOVIEMODE_INACTIVE;
+	savestate_save(fp, 0);
+	movieMode = MOVIEMODE_PLAY;
+}
+
+static void verify_LoadCheckpoint(EMUFILE_MEMORY *fp)
+{
+	movieMode = MOVIEMODE_INACTIVE;
+	fp->fseek(0, SEEK_SET);
+	savestate_load(fp);
+	movieMode = MOVIEMODE_PLAY;
+}
+
+//like fork(): 0 in the new worker, its pid in this process, or -1 if there's no job free (or no fork)
+//and the caller has to do the work itself
+static int verify_Fork()
+{
+#ifdef MOVIEVERIFY_FORK
+	char token;
+	if ((jobTokens[0] < 0) || (read(jobTokens[0], &token, 1) != 1))
+		return -1;
+
+	//or whatever is buffered goes out twice
+	fflush(NULL);
+
+	const pid_t pid = fork();
+	if (pid < 0)
+	{
+		verify_PutJob();
+		return -1;
+	}
+
+	if (pid == 0)
+		workers.clear();
+	else
+		workers.push_back(pid);
+	return (int)pid;
+#else
+	return -1;
+#endif
+}
+
+static void verify_WaitWorkers()
+{
+#ifdef MOVIEVERIFY_FORK
+	for (size_t i = 0; i < workers.size(); i++)
+	{
+		int status = 0;
+		pid_t ret;
+		do
+		{
+			ret = waitpid(workers[i], &status, 0);
+		} while ((ret < 0) && (errno == EINTR));
+
+		//a worker that didn't get to the end still had its job
+		if ((ret < 0) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+		{
+			printf("verify: worker %d died\n", (int)workers[i]);
+			verify_PutJob();
+		}
+	}
+	workers.clear();
+#endif
+}
+
+static void verify_FinishWorker()
+{
+#ifdef MOVIEVERIFY_FORK
+	verify_PutJob();
+	verify_WaitWorkers();
+	fflush(NULL);
+	_exit(0);
+#endif
+}
+
+//plays the movies in group from frame on. they all had the same input before frame, and the machine is there.
+static void verify_Branch(const std::vector<int> &group, int frame)
+{
+	currMovieData = movies[group[0]].data;
+	std::vector<MovieRecord> &records = currMovieData.records;
+
+	//play on while they all agree
+	for (;;)
+	{
+		bool agree = (int)records.size() > frame;
+		for (size_t i = 1; agree && (i < group.size()); i++)
+		{
+			std::vector<MovieRecord> &other = movies[group[i]].data.records;
+			agree = ((int)other.size() > frame) && other[frame].Compare(records[frame]);
+		}
+		if (!agree) break;
+
+		verify_RunFrame();
+		frame++;
+	}
+
+	//movies that end here are done, and the rest go their separate ways
+	std::vector<std::vector<int> > branches;
+	for (size_t i = 0; i < group.size(); i++)
+	{
+		VerifyMovie &movie = movies[group[i]];
+		if ((int)movie.data.records.size() == frame)
+		{
+			verify_WriteFrames(movie);
+			continue;
+		}
+
+		MovieRecord &record = movie.data.records[frame];
+		size_t j = 0;
+		while ((j < branches.size()) && !movies[branches[j][0]].data.records[frame].Compare(record))
+			j++;
+		if (j == branches.size())
+			branches.push_back(std::vector<int>());
+		branches[j].push_back(group[i]);
+	}
+
+	if (branches.empty()) return;
+	if (branches.size() == 1)
+	{
+		verify_Branch(branches[0], frame);
+		return;
+	}
+
+	//the first branch stays here. the others go to workers if there are any free, and what's left over
+	//comes back to the checkpoint after the first is done
+	std::vector<size_t> leftOver;
+	for (size_t i = 1; i < branches.size(); i++)
+	{
+		const int pid = verify_Fork();
+		if (pid == 0)
+		{
+			verify_Branch(branches[i], frame);
+			verify_FinishWorker();
+		}
+		else if (pid < 0)
+			leftOver.push_back(i);
+	}
+
+	EMUFILE_MEMORY *checkpoint = NULL;
+	if (!leftOver.empty())
+	{
+		checkpoint = new EMUFILE_MEMORY();
+		verify_SaveCheckpoint(checkpoint);
+	}
+	const size_t traceSize = trace.size();
+
+	verify_Branch(branches[0], frame);
+
+	for (size_t i = 0; i < leftOver.size(); i++)
+	{
+		verify_LoadCheckpoint(checkpoint);
+		trace.resize(traceSize);
+
+		//a job may have come free in the meantime
+		const int pid = verify_Fork();
+		if (pid == 0)
+		{
+			delete checkpoint;
+			verify_Branch(branches[leftOver[i]], frame);
+			verify_FinishWorker();
+		}
+		else if (pid < 0)
+			verify_Branch(branches[leftOver[i]], frame);
+	}
+	delete checkpoint;
+}
+
+static bool verify_PowerOn(const std::vector<int> &group)
+{
+	const VerifyMovie &movie = movies[group[0]];
+	const char *err = FCEUI_LoadMovie(movie.fileName.c_str(), true, false, -1);
+	if (err)
+	{
+		printf("verify: %s: %s\n", movie.fileName.c_str(), err);
+		return false;
+	}
+
+	trace.clear();
+	return true;
+}
+
+static bool verify_SameStart(const MovieData &a, const MovieData &b)
+{
+	return (a.rtcStart.get_Ticks() == b.rtcStart.get_Ticks()) && (a.sram == b.sram);
+}
+
+static u64 verify_Digest(const std::vector<VerifyFrame> &frames)
+{
+	u64 h = 0xCBF29CE484222325ULL;
+	for (size_t i = 0; i < frames.size(); i++)
+	{
+		h = verify_Hash(h, &frames[i].screen, sizeof(u64));
+		h = verify_Hash(h, &frames[i].ram, sizeof(u64));
+	}
+	return h;
+}
+
+static bool verify_WriteReport(const std::string &baselineDir)
+{
+	const std::string fileName = reportDir + "/report.txt";
+	FILE *fp = fopen(fileName.c_str(), "w");
+	if (!fp)
+	{
+		printf("verify: can't write %s\n", fileName.c_str());
+		return false;
+	}
+
+	fprintf(fp, "rom: %s (%08X)\n", gameInfo.ROMname, gameInfo.crc);
+	fprintf(fp, "movies: %u\n", (u32)movies.size());
+	if (!baselineDir.empty())
+		fprintf(fp, "baseline: %s\n", baselineDir.c_str());
+	fprintf(fp, "\n%-32s %8s %10s %8s %8s %16s  %s\n", "movie", "frames", "cpu ms", "avg us", "max us", "digest", "result");
+
+	bool ok = true;
+	u64 totalUsec = 0;
+	u32 totalFrames = 0;
+	for (size_t i = 0; i < movies.size(); i++)
+	{
+		const VerifyMovie &movie = movies[i];
+		std::vector<VerifyFrame> frames;
+		if (!verify_ReadFrames(verify_FramesPath(reportDir, movie.name), frames) || (frames.size() != movie.data.records.size()))
+		{
+			fprintf(fp, "%-32s %8u %10s %8s %8s %16s  no result (worker died?)\n", movie.name.c_str(), (u32)movie.data.records.size(), "-", "-", "-", "-");
+			ok = false;
+			continue;
+		}
+
+		u64 usec = 0;
+		u32 maxUsec = 0;
+		for (size_t j = 0; j < frames.size(); j++)
+		{
+			usec += frames[j].usec;
+			maxUsec = std::max(maxUsec, frames[j].usec);
+		}
+		totalUsec += usec;
+		totalFrames += (u32)frames.size();
+
+		char result[64] = "ok";
+		if (!baselineDir.empty())
+		{
+			std::vector<VerifyFrame> base;
+			if (!verify_ReadFrames(verify_FramesPath(baselineDir, movie.name), base))
+				strcpy(result, "not in baseline");
+			else
+			{
+				size_t j = 0;
+				while ((j < frames.size()) && (j < base.size()) && (frames[j].screen == base[j].screen) && (frames[j].ram == base[j].ram))
+					j++;
+
+				if ((j == frames.size()) && (j == base.size()))
+					strcpy(result, "matches");
+				else if ((j == frames.size()) || (j == base.size()))
+					sprintf(result, "LENGTH %u, baseline %u", (u32)frames.size(), (u32)base.size());
+				else
+				{
+					const bool screen = frames[j].screen != base[j].screen;
+					const bool ram = frames[j].ram != base[j].ram;
+					sprintf(result, "DIFFERS at frame %u (%s)", (u32)j, (screen && ram) ? "screen, ram" : screen ? "screen" : "ram");
+				}
+				if (strcmp(result, "matches") != 0)
+					ok = false;
+			}
+		}
+
+		fprintf(fp, "%-32s %8u %10.1f %8u %8u %016llx  %s\n", movie.name.c_str(), (u32)frames.size(), usec / 1000.0,
+			frames.empty() ? 0 : (u32)(usec / frames.size()), maxUsec, (unsigned long long)verify_Digest(frames), result);
+	}
+
+	fprintf(fp, "\ntotal: %u frames, %.1f cpu ms (frames shared between movies count once per movie)\n", totalFrames, totalUsec / 1000.0);
+	fprintf(fp, "%s\n", ok ? "PASS" : "FAIL");
+	fclose(fp);
+
+	printf("verify: %s, report in %s\n", ok ? "PASS" : "FAIL", fileName.c_str());
+	return ok;
+}
+
+static std::string verify_MovieName(const std::string &fileName)
+{
+	size_t start = fileName.find_last_of("/\\");
+	start = (start == std::string::npos) ? 0 : start + 1;
+	size_t end = fileName.find_last_of('.');
+	if ((end == std::string::npos) || (end < start))
+		end = fileName.size();
+	return fileName.substr(start, end - start);
+}
+
+int MovieVerify_Run(const std::vector<std::string> &movieFiles, int jobs, const std::string &outDir, const std::string &baselineDir)
+{
+	if (gameInfo.romsize == 0)
+	{
+		printf("verify: no rom loaded\n");
+		return 1;
+	}
+
+	movies.clear();
+	movies.resize(movieFiles.size());
+	for (size_t i = 0; i < movieFiles.size(); i++)
+	{
+		VerifyMovie &movie = movies[i];
+		movie.fileName = movieFiles[i];
+		movie.name = verify_MovieName(movie.fileName);
+
+		EMUFILE_FILE fp(movie.fileName.c_str(), "rb");
+		if (fp.fail() || !LoadFM2(movie.data, &fp, INT_MAX, false))
+		{
+			printf("verify: can't load movie %s\n", movie.fileName.c_str());
+			return 1;
+		}
+
+		for (size_t j = 0; j < i; j++)
+		{
+			if (movies[j].name == movie.name)
+			{
+				printf("verify: %s and %s would both report as %s\n", movies[j].fileName.c_str(), movie.fileName.c_str(), movie.name.c_str());
+				return 1;
+			}
+		}
+	}
+
+	reportDir = outDir.empty() ? "." : outDir;
+#ifdef HOST_WINDOWS
+	_mkdir(reportDir.c_str());
+#else
+	mkdir(reportDir.c_str(), 0755);
+#endif
+
+	//workers can't share what the emulator does on other threads or through a file offset, so none of that
+	//may be going on when they start
+	if (gameInfo.romdata == NULL)
+	{
+		const std::string romFile = gameInfo.romFilePath;
+		CommonSettings.loadToMemory = true;
+		if (NDS_LoadROM(romFile.c_str()) < 0)
+		{
+			printf("verify: can't reload %s into memory\n", romFile.c_str());
+			return 1;
+		}
+	}
+	ROMProfile_End();
+	CommonSettings.num_cores = 1;
+	NDS_3D_ChangeCore(cur3DCore);
+	SPU_ChangeSoundCore(SNDCORE_DUMMY, 0);
+	CommonSettings.autoFrameSkip = false;
+
+#ifdef MOVIEVERIFY_FORK
+	if (jobs < 1)
+		jobs = NDS_GetCPUCoreCount();
+	if ((jobs > 1) && (pipe(jobTokens) == 0))
+	{
+		fcntl(jobTokens[0], F_SETFL, fcntl(jobTokens[0], F_GETFL) | O_NONBLOCK);
+		for (int i = 1; i < jobs; i++)
+			verify_PutJob();
+	}
+#else
+	jobs = 1;
+#endif
+
+	//movies from the same power-on share their frames up to where their input parts
+	std::vector<std::vector<int> > starts;
+	for (size_t i = 0; i < movies.size(); i++)
+	{
+		size_t j = 0;
+		while ((j < starts.size()) && !verify_SameStart(movies[starts[j][0]].data, movies[i].data))
+			j++;
+		if (j == starts.size())
+			starts.push_back(std::vector<int>());
+		starts[j].push_back((int)i);
+	}
+
+	printf("verify: %u movies from %u starting points, %d jobs\n", (u32)movies.size(), (u32)starts.size(), jobs);
+
+	//the same as branches, with power-on as the checkpoint
+	std::vector<size_t> leftOver;
+	for (size_t i = 1; i < starts.size(); i++)
+	{
+		const int pid = verify_Fork();
+		if (pid == 0)
+		{
+			if (verify_PowerOn(starts[i]))
+				verify_Branch(starts[i], 0);
+			verify_FinishWorker();
+		}
+		else if (pid < 0)
+			leftOver.push_back(i);
+	}
+
+	if (verify_PowerOn(starts[0]))
+		verify_Branch(starts[0], 0);
+
+	for (size_t i = 0; i < leftOver.size(); i++)
+	{
+		const int pid = verify_Fork();
+		if (pid <= 0)
+		{
+			if (verify_PowerOn(starts[leftOver[i]]))
+				verify_Branch(starts[leftOver[i]], 0);
+			if (pid == 0)
+				verify_FinishWorker();
+		}
+	}
+	verify_WaitWorkers();
+
+#ifdef MOVIEVERIFY_FORK
+	if (jobTokens[0] >= 0)
+	{
+		close(jobTokens[0]);
+		close(jobTokens[1]);
+		jobTokens[0] = jobTokens[1] = -1;
+	}
+#endif
+
+	FCEUI_StopMovie();
+	NDS_Reset();
+
+	const bool ok = verify_WriteReport(baselineDir);
+	movies.clear();
+	trace.clear();
+	return ok ? 0 : 1;
+}
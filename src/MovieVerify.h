@@ -0,0 +1,43 @@
+/*
+	Copyright (C) 2016 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MOVIEVERIFY_H_
+#define _MOVIEVERIFY_H_
+
+#include <string>
+#include <vector>
+
+//Replays a library of movies against the loaded rom and writes down what every frame looked like, so a change
+//to the core can be checked against a run from before it.
+//
+//Movies that start the same way (same rtc and sram) share their emulation up to the frame where their input
+//first differs. There the machine is checkpointed and each branch carries on from it: where fork() is
+//available a branch gets a worker process of its own (copy-on-write, so the checkpoint costs nothing until
+//the branches write to it), up to jobs of them at once; otherwise, or when every job is busy, the branches
+//take turns reloading the checkpoint in this process.
+//
+//For each movie, <outDir>/<movie name>.frames lists per frame a hash of both screens, a hash of main ram and
+//the cpu time the frame took (shared frames are timed once and that time shows up in every movie sharing
+//them). <outDir>/report.txt sums them up, and with a baseline directory (the outDir of an earlier run) it
+//names the first frame where each movie went another way.
+//
+//Call it with a rom loaded and nothing else going on; it takes over the emulator and leaves it reset.
+//Returns 0 when every movie played through (and matched the baseline, if there was one), else 1.
+
+int MovieVerify_Run(const std::vector<std::string> &movieFiles, int jobs, const std::string &outDir, const std::string &baselineDir);
+
+#endif
@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <math.h>
 #include <zlib.h>
+#include <sys/stat.h>
 
 #include "utils/decrypt/decrypt.h"
 #include "utils/decrypt/crc.h"
@@ -34,6 +35,9 @@
 #include "render3D.h"
 #include "MMU.h"
 #include "NDSSystem.h"
+#include "ROMPrefetch.h"
+#include "GuestProfiler.h"
+#include "utils/trace.h"
 #include "gfx3d.h"
 #include "GPU.h"
 #include "cp15.h"
@@ -59,6 +63,10 @@
 #include "gdbstub.h"
 #endif
 
+#ifdef HAVE_LUA
+#include "lua-engine.h"
+#endif
+
 //int xxctr=0;
 //#define LOG_ARM9
 //#define LOG_ARM7
@@ -97,11 +105,22 @@ int TotalLagFrames;
 
 TSCalInfo TSCal;
 
+//runs the arm7 when CommonSettings.arm7_threaded is set (see armThreadedInnerLoop)
+static Task arm7Task;
+static bool arm7TaskRunning = false;
+
 namespace DLDI
 {
-	bool tryPatch(void* data, size_t size, unsigned int device);
+	int findPatch(const void* data, size_t size, int hint);
+	bool tryPatch(void* data, size_t size, unsigned int device, int patchOffset);
 }
 
+//the rom is read into memory in chunks this big, each folded into the crc as it arrives
+#define ROM_LOAD_CHUNK_SIZE (1024 * 1024)
+
+//block size for --compress-rom. smaller blocks make a random card read cheaper, bigger ones compress better
+#define ROM_BLOCK_COMPRESS_SIZE (32 * 1024)
+
 void Desmume_InitOnce()
 {
 	static bool initOnce = false;
@@ -138,8 +157,26 @@ void NDS_RunAdvansceneAutoImport()
 	}
 }
 
+void NDS_RunCompressROM()
+{
+#ifdef HAVE_LIBZ
+	if(CommonSettings.run_compress_rom != "")
+	{
+		std::string fname = CommonSettings.run_compress_rom;
+		std::string fname_out = fname;
+		if(fname_out.size() > 4 && !strcasecmp(fname_out.c_str() + fname_out.size() - 4, ".nds"))
+			fname_out.resize(fname_out.size() - 4);
+		fname_out += ".ndz";
+		if(BLOCKROM_Compress(fname.c_str(), fname_out.c_str(), ROM_BLOCK_COMPRESS_SIZE))
+			exit(0);
+		else exit(1);
+	}
+#endif
+}
+
 int NDS_Init()
 {
+	TRACE_THREAD_NAME("emulation");
 	nds.idleFrameCounter = 0;
 	memset(nds.runCycleCollector,0,sizeof(nds.runCycleCollector));
 	MMU_Init();
@@ -156,6 +193,7 @@ int NDS_Init()
 
 		//why is this done here? shitty engineering. not intended.
 		NDS_RunAdvansceneAutoImport();
+		NDS_RunCompressROM();
 	}
 	
 	armcpu_new(&NDS_ARM9,0);
@@ -183,11 +221,26 @@ int NDS_Init()
 	cheats = new CHEATS();
 	cheatSearch = new CHEATSEARCH();
 
+	if (!CommonSettings.guest_profile_report.empty())
+	{
+		for (int cpu = 0; cpu < 2; cpu++)
+			for (size_t i = 0; i < CommonSettings.guest_profile_symbols[cpu].size(); i++)
+				GuestProfiler_LoadSymbols(cpu, CommonSettings.guest_profile_symbols[cpu][i].c_str());
+		GuestProfiler_Start();
+	}
+
 	return 0;
 }
 
 void NDS_DeInit(void)
 {
+	//before anything is torn down; the report disassembles from guest memory
+	if (GuestProfiler_IsRunning() && !CommonSettings.guest_profile_report.empty())
+	{
+		GuestProfiler_Stop();
+		GuestProfiler_WriteReport(CommonSettings.guest_profile_report.c_str());
+	}
+
 	gameInfo.closeROM();
 	SPU_DeInit();
 	
@@ -207,6 +260,12 @@ void NDS_DeInit(void)
 	arm_jit_close();
 #endif
 
+	if(arm7TaskRunning)
+	{
+		arm7Task.shutdown();
+		arm7TaskRunning = false;
+	}
+
 #ifdef LOG_ARM7
 	if (fp_dis7 != NULL) 
 	{
@@ -532,13 +591,25 @@ bool GameInfo::loadROM(std::string fname, u32 type)
 			reader->Seek(fROM, headerOffset, SEEK_SET);
 			
 			romdata = new u8[romsize + 4];
-			if (reader->Read(fROM, romdata, romsize) != romsize)
+			
+			//compute the crc while the data is still warm instead of making a second pass over the whole rom
+			crc = 0;
+			for (u32 done = 0; done < romsize; )
 			{
-				delete [] romdata; romdata = NULL;
-				romsize = 0;
+				const u32 todo = std::min<u32>(ROM_LOAD_CHUNK_SIZE, romsize - done);
+				if ((u32)reader->Read(fROM, romdata + done, todo) != todo)
+				{
+					delete [] romdata; romdata = NULL;
+					romsize = 0;
+					crc = 0;
 
-				return false;
+					return false;
+				}
+				
+				crc = crc32(crc, romdata + done, todo);
+				done += todo;
 			}
+			romFilePath = fname;
 
 			if(hasRomBanner())
 			{
@@ -573,6 +644,8 @@ bool GameInfo::loadROM(std::string fname, u32 type)
 		}
 		reader->Seek(fROM, headerOffset, SEEK_SET);
 		lastReadPos = 0;
+		romFilePath = fname;
+		ROMStream_Open(reader, fROM, fname, headerOffset, romsize);
 		return true;
 	}
 
@@ -583,6 +656,9 @@ bool GameInfo::loadROM(std::string fname, u32 type)
 
 void GameInfo::closeROM()
 {
+	ROMProfile_End();
+	ROMStream_Close();
+
 	if (fROM)
 		reader->DeInit(fROM);
 
@@ -592,6 +668,8 @@ void GameInfo::closeROM()
 	fROM = NULL;
 	romdata = NULL;
 	romsize = 0;
+	crc = 0;
+	romFilePath.clear();
 	lastReadPos = 0xFFFFFFFF;
 }
 
@@ -601,10 +679,15 @@ u32 GameInfo::readROM(u32 pos)
 	u32 data;
 	if (!romdata)
 	{
-		if (lastReadPos != pos)
-			reader->Seek(fROM, pos + headerOffset, SEEK_SET);
-		num = reader->Read(fROM, &data, 4);
-		lastReadPos = (pos + num);
+		if (ROMStream_IsOpen())
+			num = ROMStream_Read32(pos, &data);
+		else
+		{
+			if (lastReadPos != pos)
+				reader->Seek(fROM, pos + headerOffset, SEEK_SET);
+			num = reader->Read(fROM, &data, 4);
+			lastReadPos = (pos + num);
+		}
 	}
 	else
 	{
@@ -691,6 +774,85 @@ static int rom_init_path(const char *filename, const char *physicalName, const c
 	return 1;
 }
 
+//what was learned about a rom the last time it was loaded, kept in a small file next to its battery save
+//so the next boot can skip those passes. it is only trusted if the rom's path, size and mtime still match.
+#define ROMMETADATA_MAGIC 0x314D4444 //"DDM1"
+#define ROMMETADATA_DLDI_UNKNOWN -2
+
+struct ROMMetadata
+{
+	u32 fileSize;
+	u64 fileTime;
+	u32 crc;			//0 if the rom has only ever been streamed from disk
+	s32 dldiOffset;		//-1 if there is no DLDI section, ROMMETADATA_DLDI_UNKNOWN if never searched
+};
+
+static std::string ROMMetadata_GetFilename()
+{
+	char buf[MAX_PATH];
+	memset(buf, 0, MAX_PATH);
+	path.getpathnoext(path.BATTERY, buf);
+	strcat(buf, ".dmi");						// DeSmuME rom info
+	return buf;
+}
+
+static bool ROMMetadata_GetKey(const std::string &romFilePath, ROMMetadata &meta)
+{
+	meta.fileSize = 0;
+	meta.fileTime = 0;
+	meta.crc = 0;
+	meta.dldiOffset = ROMMETADATA_DLDI_UNKNOWN;
+
+	struct stat st;
+	if (romFilePath.empty() || (stat(romFilePath.c_str(), &st) != 0))
+		return false;
+
+	meta.fileSize = (u32)st.st_size;
+	meta.fileTime = (u64)st.st_mtime;
+	return true;
+}
+
+static bool ROMMetadata_Load(const std::string &romFilePath, ROMMetadata &meta)
+{
+	EMUFILE_FILE fp(ROMMetadata_GetFilename(), "rb");
+	if (fp.fail())
+		return false;
+
+	u32 magic = 0, pathLen = 0, fileSize = 0, crc = 0;
+	u64 fileTime = 0;
+	s32 dldiOffset = ROMMETADATA_DLDI_UNKNOWN;
+
+	if ((fp.read32le(&magic) != 1) || (magic != ROMMETADATA_MAGIC)) return false;
+	if ((fp.read32le(&pathLen) != 1) || (pathLen != romFilePath.size())) return false;
+
+	std::string storedPath(pathLen, '\0');
+	if ((pathLen > 0) && (fp.fread(&storedPath[0], pathLen) != pathLen)) return false;
+	if ((fp.read32le(&fileSize) != 1) || (fp.read64le(&fileTime) != 1)) return false;
+	if ((fp.read32le(&crc) != 1) || (fp.read32le(&dldiOffset) != 1)) return false;
+
+	if ((storedPath != romFilePath) || (fileSize != meta.fileSize) || (fileTime != meta.fileTime))
+		return false;
+
+	meta.crc = crc;
+	meta.dldiOffset = dldiOffset;
+	return true;
+}
+
+static void ROMMetadata_Save(const std::string &romFilePath, const ROMMetadata &meta)
+{
+	EMUFILE_FILE fp(ROMMetadata_GetFilename(), "wb");
+	if (fp.fail())
+		return;
+
+	fp.write32le((u32)ROMMETADATA_MAGIC);
+	fp.write32le((u32)romFilePath.size());
+	fp.fwrite(romFilePath.c_str(), romFilePath.size());
+	fp.write32le(meta.fileSize);
+	fp.write64le(meta.fileTime);
+	fp.write32le(meta.crc);
+	fp.write32le((u32)meta.dldiOffset);
+}
+
 int NDS_LoadROM(const char *filename, const char *physicalName, const char *logicalFilename)
 {
 	int	ret;
@@ -715,10 +877,21 @@ int NDS_LoadROM(const char *filename, const char *physicalName, const char *logi
 	
 	gameInfo.populate();
 	
+	//a rom loaded to memory had its crc computed as it streamed in. one streamed from disk is never read
+	//in full, so it only has a crc if an earlier load to memory left one in the metadata.
+	ROMMetadata romMeta;
+	if (ROMMetadata_GetKey(gameInfo.romFilePath, romMeta))
+		ROMMetadata_Load(gameInfo.romFilePath, romMeta);
+	const ROMMetadata romMetaLoaded = romMeta;
+	
 	if (CommonSettings.loadToMemory)
-		gameInfo.crc = crc32(0, (u8*)gameInfo.romdata, gameInfo.romsize);
+		romMeta.crc = gameInfo.crc;
 	else
-		gameInfo.crc = 0;
+		gameInfo.crc = romMeta.crc;
+	
+	//card access profiles are kept per crc. a streamed rom may not have one yet, so fall back on its header.
+	if (CommonSettings.romAccessTrace || ROMStream_IsOpen())
+		ROMProfile_Begin(gameInfo.crc ? gameInfo.crc : crc32(0, (u8*)&gameInfo.header, sizeof(gameInfo.header)), gameInfo.romsize, CommonSettings.romAccessTrace);
 
 	gameInfo.chipID  = 0xC2;														// The Manufacturer ID is defined by JEDEC (C2h = Macronix)
 	if (!gameInfo.isHomebrew())
@@ -784,13 +957,21 @@ int NDS_LoadROM(const char *filename, const char *physicalName, const char *logi
 	{
 		if(!CommonSettings.loadToMemory)
 			msgbox->warn("Sorry.. right now, you can't use the default (stream rom from disk) with homebrew due to a bug with DLDI-autopatching");
-		if (slot1_GetCurrentType() == NDS_SLOT1_R4)
-			DLDI::tryPatch((void*)gameInfo.romdata, gameInfo.romsize, 1);
-		else
-			if (slot2_GetCurrentType() == NDS_SLOT2_CFLASH)
-				DLDI::tryPatch((void*)gameInfo.romdata, gameInfo.romsize, 0);
-
+		if (gameInfo.romdata && ((slot1_GetCurrentType() == NDS_SLOT1_R4) || (slot2_GetCurrentType() == NDS_SLOT2_CFLASH)))
+		{
+			//a rom already known to have no DLDI section doesn't get scanned again
+			if (romMeta.dldiOffset != -1)
+				romMeta.dldiOffset = DLDI::findPatch(gameInfo.romdata, gameInfo.romsize, romMeta.dldiOffset);
+			
+			if (slot1_GetCurrentType() == NDS_SLOT1_R4)
+				DLDI::tryPatch((void*)gameInfo.romdata, gameInfo.romsize, 1, romMeta.dldiOffset);
+			else
+				DLDI::tryPatch((void*)gameInfo.romdata, gameInfo.romsize, 0, romMeta.dldiOffset);
+		}
 	}
+	
+	if ((romMeta.fileSize != 0) && ((romMeta.crc != romMetaLoaded.crc) || (romMeta.dldiOffset != romMetaLoaded.dldiOffset)))
+		ROMMetadata_Save(gameInfo.romFilePath, romMeta);
 
 	if (cheats != NULL)
 	{
@@ -820,6 +1001,13 @@ void NDS_TriggerCardEjectIRQ()
 }
 
 
+//when CommonSettings.autoFrameSkip is on, the skipper also decides for itself, from what frames have been costing,
+//whether the next frame can afford its 3d and 2d rendering at the target rate. costs are in driver ticks.
+#define AUTOSKIP_EMA_SHIFT		3	//averages move 1/8 of the way to each new sample
+#define AUTOSKIP_DEBT_FRAMES	4	//never owe more than this many frames; past that, catching up isn't worth the skipping
+#define AUTOSKIP_STALL_FRAMES	8	//a frame this long was a pause, a load or a savestate, not a cost
+#define AUTOSKIP_2D_SAMPLE		8	//time one scanline in this many
+
 class FrameSkipper
 {
 public:
@@ -827,6 +1015,35 @@ public:
 	{
 		nextSkip = true;
 	}
+	void ResetAuto()
+	{
+		autoFrameStart = 0;
+		autoDebt = 0;
+		autoSkipping = false;
+		avgCPU = avg2D = avg3D = 0;
+		cost2D = cost3D = 0;
+		consecutive2DSkips = consecutive3DSkips = 0;
+	}
+	FORCEINLINE void Begin2DLine(int line)
+	{
+		if(autoFrameStart && !(line & (AUTOSKIP_2D_SAMPLE-1)))
+			lineStart = driver->EMU_GetTicks();
+	}
+	FORCEINLINE void End2DLine(int line)
+	{
+		if(autoFrameStart && !(line & (AUTOSKIP_2D_SAMPLE-1)))
+			cost2D += (driver->EMU_GetTicks() - lineStart) * AUTOSKIP_2D_SAMPLE;
+	}
+	FORCEINLINE void Begin3D()
+	{
+		if(autoFrameStart)
+			lineStart = driver->EMU_GetTicks();
+	}
+	FORCEINLINE void End3D()
+	{
+		if(autoFrameStart)
+			cost3D += driver->EMU_GetTicks() - lineStart;
+	}
 	void OmitSkip(bool force, bool forceEvenIfCapturing=false)
 	{
 		nextSkip = false;
@@ -836,7 +1053,10 @@ public:
 			SkipCur3DFrame = false;
 			SkipNext2DFrame = false;
 			if(forceEvenIfCapturing)
+			{
 				consecutiveNonCaptures = 0;
+				ResetAuto();
+			}
 		}
 	}
 	void Advance()
@@ -844,6 +1064,7 @@ public:
 		const GPUEngineA *mainEngine = GPU->GetEngineMain();
 		const IOREG_DISPCAPCNT &DISPCAPCNT = mainEngine->GetIORegisterMap().DISPCAPCNT;
 		const bool capturing = (DISPCAPCNT.CaptureEnable != 0);
+		bool mayAutoSkip = true;
 
 		if(capturing && consecutiveNonCaptures > 30)
 		{
@@ -853,6 +1074,7 @@ public:
 			// despite the risk of 1 frame of 2d/3d mismatch or wrong screen display.
 			SkipNext2DFrame = false;
 			nextSkip = false;
+			mayAutoSkip = false;
 		}
 		else if((lastDisplayTarget != mainEngine->GetDisplayByID()) && lastSkip && !skipped)
 		{
@@ -862,21 +1084,28 @@ public:
 			// this avoids the scenario where we only draw one of the two screens
 			// when a game is switching screens every frame.
 			nextSkip = false;
+			mayAutoSkip = false;
 		}
 
 		if(capturing)
 			consecutiveNonCaptures = 0;
 		else if(!(consecutiveNonCaptures > 9000)) // arbitrary cap to avoid eventual wrap
 			consecutiveNonCaptures++;
-		
+
+		bool auto3D = false, auto2D = false;
+		AdvanceAuto(capturing, mayAutoSkip, auto3D, auto2D);
+
 		lastDisplayTarget = mainEngine->GetDisplayByID();
 		lastSkip = skipped;
-		skipped = nextSkip;
+		skipped = nextSkip || auto2D;
 		nextSkip = false;
 
 		SkipCur2DFrame = SkipNext2DFrame;
-		SkipCur3DFrame = skipped;
+		SkipCur3DFrame = skipped || auto3D;
 		SkipNext2DFrame = skipped;
+
+		consecutive3DSkips = SkipCur3DFrame ? consecutive3DSkips + 1 : 0;
+		consecutive2DSkips = SkipNext2DFrame ? consecutive2DSkips + 1 : 0;
 	}
 	FORCEINLINE bool ShouldSkip2D()
 	{
@@ -896,8 +1125,71 @@ public:
 		SkipCur3DFrame = false;
 		SkipNext2DFrame = false;
 		consecutiveNonCaptures = 0;
+		lineStart = 0;
+		ResetAuto();
 	}
 private:
+	//3d is rendered at the end of a frame and shown by the next frame's 2d, so there are two ways to save time:
+	//drop just the 3d (the next frame shows the previous 3d again), or drop the 3d and the 2d that would show it,
+	//which is what a requested skip does. the first is preferred whenever the 3d alone covers what is owed.
+	void AdvanceAuto(bool capturing, bool mayAutoSkip, bool &auto3D, bool &auto2D)
+	{
+		const u64 ticksPerSecond = CommonSettings.autoFrameSkip ? driver->EMU_GetTicksPerSecond() : 0;
+		if(ticksPerSecond == 0 || CommonSettings.autoFrameSkipTarget <= 0)
+		{
+			autoFrameStart = 0;
+			return;
+		}
+
+		const u64 now = driver->EMU_GetTicks();
+		const u64 frameCost = now - autoFrameStart;
+		const u64 budget = ticksPerSecond / CommonSettings.autoFrameSkipTarget;
+		const bool measured = (autoFrameStart != 0) && (frameCost < budget * AUTOSKIP_STALL_FRAMES);
+		autoFrameStart = now;
+
+		if(measured)
+		{
+			//whatever isn't rendering is the emulation itself, plus whatever the frontend does between frames
+			const u64 costCPU = (frameCost > cost2D + cost3D) ? frameCost - cost2D - cost3D : 0;
+			avgCPU += ((s64)costCPU - (s64)avgCPU) >> AUTOSKIP_EMA_SHIFT;
+
+			//the render averages are what rendering costs when it happens, so skipped frames don't pull them down
+			if(!SkipCur2DFrame)
+				avg2D += ((s64)cost2D - (s64)avg2D) >> AUTOSKIP_EMA_SHIFT;
+			if(!SkipCur3DFrame)
+				avg3D += ((s64)cost3D - (s64)avg3D) >> AUTOSKIP_EMA_SHIFT;
+
+			autoDebt += (s64)frameCost - (s64)budget;
+			if(autoDebt < 0)
+				autoDebt = 0;
+			else if(autoDebt > (s64)budget * AUTOSKIP_DEBT_FRAMES)
+				autoDebt = (s64)budget * AUTOSKIP_DEBT_FRAMES;
+		}
+		cost2D = cost3D = 0;
+
+		//hysteresis: start skipping once half a frame behind, and keep at it until nearly caught up again,
+		//so that a game hovering around the budget doesn't flicker between skipping and not every other frame
+		if(!autoSkipping && autoDebt > (s64)(budget / 2))
+			autoSkipping = true;
+		else if(autoSkipping && autoDebt < (s64)(budget / 8))
+			autoSkipping = false;
+
+		//either way of skipping drops a 3d frame, so the 3d bound applies to both
+		const int maxSkips = CommonSettings.autoFrameSkipMax;
+		if(!autoSkipping || !mayAutoSkip || consecutive3DSkips >= maxSkips)
+			return;
+
+		const s64 excess = (s64)(avgCPU + avg2D + avg3D) - (s64)budget;
+		const bool has3D = (avg3D != 0);
+
+		//while capturing, the 3d is usually being fed back into the next frame, so it goes with the 2d or not at all
+		const bool enough3D = has3D && !capturing && ((s64)avg3D >= excess);
+		if(!enough3D && consecutive2DSkips < maxSkips)
+			auto2D = true;
+		else if(has3D && !capturing)
+			auto3D = true;
+	}
+
 	bool nextSkip;
 	bool skipped;
 	bool lastSkip;
@@ -906,6 +1198,14 @@ private:
 	bool SkipCur2DFrame;
 	bool SkipCur3DFrame;
 	bool SkipNext2DFrame;
+
+	u64 autoFrameStart;
+	u64 lineStart;
+	u64 cost2D, cost3D;
+	u64 avgCPU, avg2D, avg3D;
+	s64 autoDebt;
+	bool autoSkipping;
+	int consecutive2DSkips, consecutive3DSkips;
 };
 static FrameSkipper frameSkipper;
 
@@ -974,6 +1274,7 @@ struct TSequenceItem_GXFIFO : public TSequenceItem
 	FORCEINLINE void exec()
 	{
 		IF_DEVELOPER(DEBUG_statistics.sequencerExecutionCounters[4]++);
+		TRACE_ZONE("seq gxfifo");
 		while(isTriggered()) {
 			enabled = false;
 			gfx3d_execute3D();
@@ -1007,6 +1308,7 @@ template<int procnum, int num> struct TSequenceItem_Timer : public TSequenceItem
 	FORCEINLINE void exec()
 	{
 		IF_DEVELOPER(DEBUG_statistics.sequencerExecutionCounters[13+procnum*4+num]++);
+		TRACE_ZONE("seq timer");
 		u8* regs = procnum==0?MMU.ARM9_REG:MMU.ARM7_REG;
 		bool first = true;
 		//we'll need to check chained timers..
@@ -1075,6 +1377,7 @@ template<int procnum, int chan> struct TSequenceItem_DMA : public TSequenceItem
 	FORCEINLINE void exec()
 	{
 		IF_DEVELOPER(DEBUG_statistics.sequencerExecutionCounters[5+procnum*4+chan]++);
+		TRACE_ZONE("seq dma");
 
 		//if (nds.freezeBus) return;
 
@@ -1131,6 +1434,7 @@ struct TSequenceItem_divider : public TSequenceItem
 	void exec()
 	{
 		IF_DEVELOPER(DEBUG_statistics.sequencerExecutionCounters[2]++);
+		TRACE_ZONE("seq divider");
 		MMU_new.div.busy = 0;
 #ifdef HOST_64 
 		T1WriteQuad(MMU.ARM9_REG, 0x2A0, MMU.divResult);
@@ -1163,6 +1467,7 @@ struct TSequenceItem_sqrtunit : public TSequenceItem
 	FORCEINLINE void exec()
 	{
 		IF_DEVELOPER(DEBUG_statistics.sequencerExecutionCounters[3]++);
+		TRACE_ZONE("seq sqrt");
 		MMU_new.sqrt.busy = 0;
 		T1WriteLong(MMU.ARM9_REG, 0x2B4, MMU.sqrtResult);
 		MMU.sqrtRunning = FALSE;
@@ -1323,7 +1628,12 @@ static void execHardware_hblank()
 	//scroll regs for the next scanline
 	if(nds.VCount<192)
 	{
-		GPU->RenderLine(nds.VCount, frameSkipper.ShouldSkip2D());
+		frameSkipper.Begin2DLine(nds.VCount);
+		{
+			TRACE_ZONE("GPU RenderLine");
+			GPU->RenderLine(nds.VCount, frameSkipper.ShouldSkip2D());
+		}
+		frameSkipper.End2DLine(nds.VCount);
 		
 		//trigger hblank dmas
 		//but notice, we do that just after we finished drawing the line
@@ -1377,6 +1687,7 @@ static void execHardware_hstart_vblankEnd()
 
 static void execHardware_hstart_vblankStart()
 {
+	TRACE_INSTANT("vblank");
 	//printf("--------VBLANK!!!--------\n");
 
 	//fire vblank interrupts if necessary
@@ -1489,7 +1800,9 @@ static void execHardware_hstart()
 	//so..
 	if((CommonSettings.rigorous_timing && nds.VCount==214) || (!CommonSettings.rigorous_timing && nds.VCount==262))
 	{
+		frameSkipper.Begin3D();
 		gfx3d_VBlankEndSignal(frameSkipper.ShouldSkip3D());
+		frameSkipper.End3D();
 	}
 
 	if(nds.VCount==263)
@@ -1617,6 +1930,7 @@ void Sequencer::execHardware()
 	{
 
 		IF_DEVELOPER(DEBUG_statistics.sequencerExecutionCounters[1]++);
+		TRACE_ZONE("seq dispcnt");
 
 		switch(dispcnt.param)
 		{
@@ -1817,6 +2131,7 @@ template<bool doarm9, bool doarm7>
 static /*donotinline*/ std::pair<s32,s32> armInnerLoop(
 	const u64 nds_timer_base, const s32 s32next, s32 arm9, s32 arm7)
 {
+	TRACE_ZONE("armInnerLoop");
 	s32 timer = minarmtime<doarm9,doarm7>(arm9,arm7);
 	while(timer < s32next && !sequencer.reschedule && execute)
 	{
@@ -1881,6 +2196,172 @@ static /*donotinline*/ std::pair<s32,s32> armInnerLoop(
 	return std::make_pair(arm9, arm7);
 }
 
+//threaded arm7 support.
+//within one work unit the arm9 runs on the emulation thread and the arm7 on arm7Task.
+//each core publishes the time of the instruction it is executing; MMU_SyncCores makes an access to
+//cross-core state wait until the other core is at least as far along (ties go to the arm9, as in armInnerLoop).
+//since both cores rendezvous on the same addresses, those accesses are also mutually exclusive.
+static const s32 kArmThreadIdle = 0x7FFFFFFF;
+
+static struct
+{
+	volatile s32 timer[2];
+	volatile bool dirty[2];
+	//each core's own clock, written only by that core's thread (see NDS_CoreTime)
+	u64 coreTime[2];
+} armThread;
+
+volatile bool MMU_coresThreaded = false;
+
+u64 NDS_CoreTime(const int procnum)
+{
+	return MMU_coresThreaded ? armThread.coreTime[procnum] : nds_timer;
+}
+
+void MMU_SyncCores(const int PROCNUM)
+{
+	const s32 now = armThread.timer[PROCNUM];
+
+	if(PROCNUM == ARMCPU_ARM9)
+		while(armThread.timer[ARMCPU_ARM7] < now) {}
+	else
+		while(armThread.timer[ARMCPU_ARM9] <= now) {}
+
+	//make sure we see everything the other core did before it got here,
+	//and that it sees what we do here before we move on (see armThreadPublish)
+	threadMemoryBarrier();
+	armThread.dirty[PROCNUM] = true;
+}
+
+template<int PROCNUM>
+static FORCEINLINE void armThreadPublish(const s32 timer)
+{
+	if(armThread.dirty[PROCNUM])
+	{
+		armThread.dirty[PROCNUM] = false;
+		threadMemoryBarrier();
+	}
+	armThread.timer[PROCNUM] = timer;
+}
+
+template<int PROCNUM>
+static s32 armThreadedLoop(const u64 nds_timer_base, const s32 s32next, s32 timer)
+{
+	while(timer < s32next && !sequencer.reschedule && execute)
+	{
+		armThreadPublish<PROCNUM>(timer);
+
+		if(!ARMPROC.waitIRQ&&!nds.freezeBus)
+		{
+			if(PROCNUM==ARMCPU_ARM9)
+			{
+				arm9log();
+				debug();
+				timer += armcpu_exec<ARMCPU_ARM9>();
+			}
+			else
+			{
+				arm7log();
+				timer += (armcpu_exec<ARMCPU_ARM7>()<<1);
+			}
+		}
+		else
+		{
+			s32 temp = timer;
+			timer = min(s32next, timer + kIrqWait);
+			nds.idleCycles[PROCNUM] += timer-temp;
+			if (PROCNUM==ARMCPU_ARM9 && gxFIFO.size < 255) nds.freezeBus &= ~1;
+		}
+
+		//the arm7 runs ahead or behind on its own clock; nds_timer follows the arm9, and is only read on its thread
+		armThread.coreTime[PROCNUM] = nds_timer_base + timer;
+		if(PROCNUM==ARMCPU_ARM9)
+			nds_timer = armThread.coreTime[PROCNUM];
+	}
+
+	armThreadPublish<PROCNUM>(kArmThreadIdle);
+	return timer;
+}
+
+struct ArmThreadWork
+{
+	u64 nds_timer_base;
+	s32 s32next;
+	s32 arm7;
+};
+
+static void* armThreadedLoopARM7(void *param)
+{
+	ArmThreadWork *work = (ArmThreadWork *)param;
+	TRACE_THREAD_NAME("arm7");
+	TRACE_ZONE("arm7 work unit");
+	work->arm7 = armThreadedLoop<ARMCPU_ARM7>(work->nds_timer_base, work->s32next, work->arm7);
+	return NULL;
+}
+
+static std::pair<s32,s32> armThreadedInnerLoop(const u64 nds_timer_base, const s32 s32next, s32 arm9, s32 arm7)
+{
+	TRACE_ZONE("armThreadedInnerLoop");
+	ArmThreadWork work;
+	work.nds_timer_base = nds_timer_base;
+	work.s32next = s32next;
+	work.arm7 = arm7;
+
+	//publish both starting points before either core can look at the other
+	armThread.timer[ARMCPU_ARM9] = arm9;
+	armThread.timer[ARMCPU_ARM7] = arm7;
+	armThread.dirty[ARMCPU_ARM9] = armThread.dirty[ARMCPU_ARM7] = false;
+	armThread.coreTime[ARMCPU_ARM9] = nds_timer_base + arm9;
+	armThread.coreTime[ARMCPU_ARM7] = nds_timer_base + arm7;
+	MMU_coresThreaded = true;
+	threadMemoryBarrier();
+
+	arm7Task.execute(&armThreadedLoopARM7, &work);
+	arm9 = armThreadedLoop<ARMCPU_ARM9>(nds_timer_base, s32next, arm9);
+	arm7Task.finish();
+
+	MMU_coresThreaded = false;
+	threadMemoryBarrier();
+
+	nds_timer = nds_timer_base + min(arm9, work.arm7);
+	return std::make_pair(arm9, work.arm7);
+}
+
+static bool NDS_ARM7ThreadEnabled()
+{
+	if(!CommonSettings.arm7_threaded)
+		return false;
+
+	//the interleaving between the threads isn't reproducible, so movies always run the cores in lockstep
+	if(movieMode != MOVIEMODE_INACTIVE)
+		return false;
+
+#ifdef HAVE_JIT
+	if(CommonSettings.use_jit)
+		return false;
+#endif
+
+#ifdef HAVE_LUA
+	//memory hooks call into the lua state, which is only safe from this thread
+	if(luaMemHookMask != 0)
+		return false;
+#endif
+
+	if(!arm7TaskRunning)
+	{
+		//without a worker thread the cores just stay in lockstep
+		if(!arm7Task.start(true, true))
+		{
+			printf("ARM7 thread couldn't be created, running the cores in lockstep\n");
+			CommonSettings.arm7_threaded = false;
+			return false;
+		}
+		arm7TaskRunning = true;
+	}
+
+	return true;
+}
+
 void NDS_debug_break()
 {
 	NDS_ARM9.stalled = NDS_ARM7.stalled = 1;
@@ -1904,7 +2385,7 @@ template<bool FORCE>
 void NDS_exec(s32 nb)
 {
 	#ifdef GDB_STUB
-	gdbstub_mutex_lock();
+	gdbstub_exec_begin();
 	#endif
 
 	LagFrameFlag=1;
@@ -1915,6 +2396,9 @@ void NDS_exec(s32 nb)
 
 	IF_DEVELOPER(for(int i=0;i<32;i++) DEBUG_statistics.sequencerExecutionCounters[i] = 0);
 
+	const bool threaded = NDS_ARM7ThreadEnabled();
+	const s32 maxWork = threaded ? CommonSettings.arm7_sync_quantum : kMaxWork;
+
 	if(nds.sleeping)
 	{
 		//speculative code: if ANY irq happens, wake up the arm7.
@@ -1939,12 +2423,13 @@ void NDS_exec(s32 nb)
 					
 					while((NDS_ARM9.stalled || NDS_ARM7.stalled) && execute)
 					{
+					        //step out while stalled, so the stub can answer gdb straight away
 					        #ifdef GDB_STUB
-					        gdbstub_mutex_unlock();
+					        gdbstub_exec_end();
 					        #endif
 						driver->EMU_DebugIdleUpdate();
 					        #ifdef GDB_STUB
-					        gdbstub_mutex_lock();
+					        gdbstub_exec_begin();
 					        #endif
 						nds_debug_continuing[0] = nds_debug_continuing[1] = true;
 					}
@@ -1968,7 +2453,7 @@ void NDS_exec(s32 nb)
 
 			//find next work unit:
 			u64 next = sequencer.findNext();
-			next = min(next,nds_timer+kMaxWork); //lets set an upper limit for now
+			next = min(next,nds_timer+maxWork); //lets set an upper limit for now
 
 			//printf("%d\n",(next-nds_timer));
 
@@ -1988,11 +2473,15 @@ void NDS_exec(s32 nb)
 			#endif
 
 #ifdef HAVE_JIT
-			std::pair<s32,s32> arm9arm7 = CommonSettings.use_jit
+			std::pair<s32,s32> arm9arm7 = threaded
+				? armThreadedInnerLoop(nds_timer_base,s32next,arm9,arm7)
+				: CommonSettings.use_jit
 				? armInnerLoop<true,true,true>(nds_timer_base,s32next,arm9,arm7)
 				: armInnerLoop<true,true,false>(nds_timer_base,s32next,arm9,arm7);
 #else
-				std::pair<s32,s32> arm9arm7 = armInnerLoop<true,true>(nds_timer_base,s32next,arm9,arm7);
+				std::pair<s32,s32> arm9arm7 = threaded
+					? armThreadedInnerLoop(nds_timer_base,s32next,arm9,arm7)
+					: armInnerLoop<true,true>(nds_timer_base,s32next,arm9,arm7);
 #endif
 
 			#ifdef DEVELOPER
@@ -2004,9 +2493,15 @@ void NDS_exec(s32 nb)
 
 			arm9 = arm9arm7.first;
 			arm7 = arm9arm7.second;
+			GuestProfiler_Sample();
 			nds_arm7_timer = nds_timer_base+arm7;
 			nds_arm9_timer = nds_timer_base+arm9;
 
+			//both cores are between instructions here, so it's a good time for the gdb stub's requests
+			#ifdef GDB_STUB
+			if(gdbstub_commands_pending) gdbstub_service_commands();
+			#endif
+
 #ifndef NDEBUG
 			//what we find here is dependent on the timing constants above
 			//if(nds_timer>next && (nds_timer-next)>22)
@@ -2047,7 +2542,7 @@ void NDS_exec(s32 nb)
 	if(cheats) cheats->process(CHEAT_TYPE_INTERNAL);
 
         #ifdef GDB_STUB
-        gdbstub_mutex_unlock();
+        gdbstub_exec_end();
         #endif
 }
 
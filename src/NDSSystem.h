@@ -21,6 +21,7 @@
 
 #include <string.h>
 #include <string>
+#include <vector>
 
 #include "types.h"
 #include "ROMReader.h"
@@ -146,6 +147,9 @@ extern void debug();
 void emu_halt();
 
 extern u64 nds_timer;
+//the time as seen by the given core. while the arm7 runs on its own thread (see armThreadedLoop) each core keeps
+//its own clock and nds_timer follows only the arm9, so timer and dma bookkeeping done on a core's behalf uses this
+u64 NDS_CoreTime(const int procnum);
 void NDS_Reschedule();
 void NDS_RescheduleGXFIFO(u32 cost);
 void NDS_RescheduleDMA();
@@ -324,6 +328,7 @@ struct GameInfo
 	u32 lastReadPos;
 	u32	romType;
 	u32 headerOffset;
+	std::string romFilePath; //the file actually opened, which keys the rom metadata cache
 	char ROMserial[20];
 	char ROMname[20];
 	bool _isDSiEnhanced;
@@ -489,7 +494,13 @@ extern struct TCommonSettings {
 		, GFX3D_TXTHack(false)
 		, GFX3D_PrescaleHD(1)
 		, jit_max_block_size(100)
+		, arm7_threaded(false)
+		, arm7_sync_quantum(4000)
+		, autoFrameSkip(false)
+		, autoFrameSkipTarget(60)
+		, autoFrameSkipMax(3)
 		, loadToMemory(false)
+		, romAccessTrace(false)
 		, UseExtBIOS(false)
 		, SWIFromBIOS(false)
 		, PatchSWI3(false)
@@ -521,6 +532,7 @@ extern struct TCommonSettings {
 		/* WIFI mode: adhoc = 0, infrastructure = 1 */
 		wifi.mode = 1;
 		wifi.infraBridgeAdapter = 0;
+		wifi.adhocTransport = 0;
 
 		for(int i=0;i<16;i++)
 			spu_muteChannels[i] = false;
@@ -555,6 +567,7 @@ extern struct TCommonSettings {
 	int GFX3D_PrescaleHD;
 
 	bool loadToMemory;
+	bool romAccessTrace; //record which parts of the rom the game reads, to prefetch them when streaming later
 
 	bool UseExtBIOS;
 	char ARM9BIOS[256];
@@ -587,10 +600,23 @@ extern struct TCommonSettings {
 
 	bool use_jit;
 	u32	jit_max_block_size;
+
+	//run the arm7 on its own host thread. the cores rendezvous on ipc/shared memory accesses
+	//and otherwise drift apart by at most arm7_sync_quantum cycles. not used during movies, since it isn't deterministic
+	bool arm7_threaded;
+	s32 arm7_sync_quantum;
+
+	//skip 3d, or 3d and 2d, rendering on its own whenever the frames it measures cost more than the target rate allows.
+	//needs a driver that can tell time (EMU_GetTicks). never more than autoFrameSkipMax frames in a row.
+	bool autoFrameSkip;
+	int autoFrameSkipTarget;
+	int autoFrameSkipMax;
 	
 	struct _Wifi {
 		int mode;
 		int infraBridgeAdapter;
+		//ad-hoc frames go over udp (0) or the in-process relay (1), see AdhocTransport.h
+		int adhocTransport;
 	} wifi;
 
 	enum MicMode
@@ -640,11 +666,18 @@ extern struct TCommonSettings {
 		bool ShowInputDisplay, ShowGraphicalInputDisplay, FpsDisplay, FrameCounterDisplay, ShowLagFrameCounter, ShowMicrophone, ShowRTC;
 	} hud;
 
+	//when set, the guest profiler (GuestProfiler.h) runs from NDS_Init and writes its report here at NDS_DeInit,
+	//with names from the symbol maps listed for each cpu (ARM9, ARM7)
+	std::string guest_profile_report;
+	std::vector<std::string> guest_profile_symbols[2];
+
 	std::string run_advanscene_import;
+	std::string run_compress_rom;
 
 } CommonSettings;
 
 void NDS_RunAdvansceneAutoImport();
+void NDS_RunCompressROM();
 
 extern std::string InputDisplayString;
 extern int LagFrameFlag;
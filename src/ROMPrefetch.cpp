@@ -0,0 +1,405 @@
+/*
+	Copyright (C) 2016 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ROMPrefetch.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include "emufile.h"
+#include "movie.h"
+#include "path.h"
+#include "utils/task.h"
+
+#define ROMSTREAM_NO_SLOT		0xFFFF
+#define ROMSTREAM_NO_PAGE		0xFFFFFFFF
+#define ROMPROFILE_NO_ENTRY		0xFFFFFFFF
+#define ROMPROFILE_MAGIC		0x31505244 //"DRP1"
+#define ROMPROFILE_MAX_ENTRIES	65536
+
+ROMTraceState romTrace = { false, 0 };
+
+struct ROMStreamCache
+{
+	ROMReader_struct *reader;
+	void *file;
+	std::string fileName;
+	u32 headerOffset;
+	u32 romSize;
+	u32 pageCount;
+
+	u8 *slotData[ROMSTREAM_CACHE_PAGES];
+	u32 slotLen[ROMSTREAM_CACHE_PAGES];
+	u32 slotPage[ROMSTREAM_CACHE_PAGES];
+	u32 slotAge[ROMSTREAM_CACHE_PAGES];
+	u32 age;
+	std::vector<u16> pageSlot;
+
+	//the emulator fills in prefetchPage and kicks the task, the worker reads those pages through its own
+	//file handle into its own buffers and then raises prefetchDone. nothing else is shared, so no lock.
+	Task prefetchTask;
+	void *prefetchFile;
+	bool prefetchBusy;
+	u32 prefetchCount;
+	u32 prefetchPage[ROMPREFETCH_AHEAD];
+	u32 prefetchLen[ROMPREFETCH_AHEAD];
+	u8 *prefetchData[ROMPREFETCH_AHEAD];
+	volatile bool prefetchDone;
+};
+
+struct ROMProfileEntry
+{
+	u32 frame;
+	u32 page;
+};
+
+struct ROMAccessProfile
+{
+	u32 key;
+	bool trace;
+	bool dirty;
+	u32 lastPage;
+	std::vector<ROMProfileEntry> entries;	//pages in the order they were first read
+	std::vector<u32> pageEntry;				//where each page is in entries
+};
+
+//these are heap allocated so that closing the rom from a static destructor at exit is safe
+static ROMStreamCache *romStream = NULL;
+static ROMAccessProfile *romProfile = NULL;
+
+static u32 ROMStream_PageLength(const ROMStreamCache *s, u32 page)
+{
+	const u32 pos = page << ROMSTREAM_PAGE_SHIFT;
+	return std::min<u32>(ROMSTREAM_PAGE_SIZE, s->romSize - pos);
+}
+
+void ROMStream_Open(ROMReader_struct *reader, void *file, const std::string &fileName, u32 headerOffset, u32 romSize)
+{
+	ROMStream_Close();
+	if (romSize == 0) return;
+
+	ROMStreamCache *s = new ROMStreamCache;
+	s->reader = reader;
+	s->file = file;
+	s->fileName = fileName;
+	s->headerOffset = headerOffset;
+	s->romSize = romSize;
+	s->pageCount = (romSize + ROMSTREAM_PAGE_SIZE - 1) >> ROMSTREAM_PAGE_SHIFT;
+	s->pageSlot.assign(s->pageCount, ROMSTREAM_NO_SLOT);
+	s->age = 0;
+
+	for (int i = 0; i < ROMSTREAM_CACHE_PAGES; i++)
+	{
+		s->slotData[i] = new u8[ROMSTREAM_PAGE_SIZE];
+		s->slotLen[i] = 0;
+		s->slotPage[i] = ROMSTREAM_NO_PAGE;
+		s->slotAge[i] = 0;
+	}
+
+	s->prefetchFile = NULL;
+	s->prefetchBusy = false;
+	s->prefetchCount = 0;
+	s->prefetchDone = false;
+	for (int i = 0; i < ROMPREFETCH_AHEAD; i++)
+		s->prefetchData[i] = new u8[ROMSTREAM_PAGE_SIZE];
+
+	romStream = s;
+}
+
+static void ROMStream_CollectPrefetch(ROMStreamCache *s, bool wait);
+
+void ROMStream_Close()
+{
+	ROMStreamCache *s = romStream;
+	if (!s) return;
+
+	if (s->prefetchFile)
+	{
+		ROMStream_CollectPrefetch(s, true);
+		s->prefetchTask.shutdown();
+		s->reader->DeInit(s->prefetchFile);
+	}
+
+	for (int i = 0; i < ROMSTREAM_CACHE_PAGES; i++)
+		delete [] s->slotData[i];
+	for (int i = 0; i < ROMPREFETCH_AHEAD; i++)
+		delete [] s->prefetchData[i];
+
+	delete s;
+	romStream = NULL;
+}
+
+bool ROMStream_IsOpen()
+{
+	return (romStream != NULL);
+}
+
+//takes the least recently used slot over for a page
+static u32 ROMStream_AllocSlot(ROMStreamCache *s, u32 page)
+{
+	u32 slot = 0;
+	for (u32 i = 1; i < ROMSTREAM_CACHE_PAGES; i++)
+	{
+		if (s->slotAge[i] < s->slotAge[slot])
+			slot = i;
+	}
+
+	if (s->slotPage[slot] != ROMSTREAM_NO_PAGE)
+		s->pageSlot[s->slotPage[slot]] = ROMSTREAM_NO_SLOT;
+
+	s->slotPage[slot] = page;
+	s->slotAge[slot] = ++s->age;
+	s->pageSlot[page] = (u16)slot;
+	return slot;
+}
+
+static void* ROMStream_PrefetchWork(void *arg)
+{
+	ROMStreamCache *s = (ROMStreamCache *)arg;
+
+	for (u32 i = 0; i < s->prefetchCount; i++)
+	{
+		const u32 page = s->prefetchPage[i];
+		s->reader->Seek(s->prefetchFile, (page << ROMSTREAM_PAGE_SHIFT) + s->headerOffset, SEEK_SET);
+		const int num = s->reader->Read(s->prefetchFile, s->prefetchData[i], ROMStream_PageLength(s, page));
+		s->prefetchLen[i] = (num > 0) ? (u32)num : 0;
+	}
+
+	threadMemoryBarrier();
+	s->prefetchDone = true;
+	return NULL;
+}
+
+//moves finished prefetches into the cache. the buffers are swapped rather than copied.
+static void ROMStream_CollectPrefetch(ROMStreamCache *s, bool wait)
+{
+	if (!s->prefetchBusy) return;
+	if (!wait && !s->prefetchDone) return;
+
+	s->prefetchTask.finish();
+	threadMemoryBarrier();
+
+	for (u32 i = 0; i < s->prefetchCount; i++)
+	{
+		const u32 page = s->prefetchPage[i];
+		if ((s->pageSlot[page] != ROMSTREAM_NO_SLOT) || (s->prefetchLen[i] != ROMStream_PageLength(s, page)))
+			continue;
+
+		const u32 slot = ROMStream_AllocSlot(s, page);
+		std::swap(s->slotData[slot], s->prefetchData[i]);
+		s->slotLen[slot] = s->prefetchLen[i];
+	}
+
+	s->prefetchBusy = false;
+	s->prefetchDone = false;
+}
+
+static const u8* ROMStream_GetPage(ROMStreamCache *s, u32 page, u32 &len)
+{
+	u32 slot = s->pageSlot[page];
+	if (slot == ROMSTREAM_NO_SLOT && s->prefetchBusy)
+	{
+		//rather than read it twice, wait for a page that is already on its way
+		bool isInFlight = false;
+		for (u32 i = 0; i < s->prefetchCount; i++)
+			isInFlight = isInFlight || (s->prefetchPage[i] == page);
+
+		ROMStream_CollectPrefetch(s, isInFlight);
+		slot = s->pageSlot[page];
+	}
+
+	if (slot != ROMSTREAM_NO_SLOT)
+	{
+		s->slotAge[slot] = ++s->age;
+		len = s->slotLen[slot];
+		return s->slotData[slot];
+	}
+
+	slot = ROMStream_AllocSlot(s, page);
+	s->reader->Seek(s->file, (page << ROMSTREAM_PAGE_SHIFT) + s->headerOffset, SEEK_SET);
+	const int num = s->reader->Read(s->file, s->slotData[slot], ROMStream_PageLength(s, page));
+	s->slotLen[slot] = (num > 0) ? (u32)num : 0;
+
+	len = s->slotLen[slot];
+	return s->slotData[slot];
+}
+
+u32 ROMStream_Read32(u32 pos, u32 *data)
+{
+	ROMStreamCache *s = romStream;
+	u8 *dst = (u8 *)data;
+	u32 num = 0;
+
+	//a word may straddle two pages, or run off the end of the rom
+	while ((num < 4) && (pos < s->romSize))
+	{
+		u32 len;
+		const u8 *page = ROMStream_GetPage(s, pos >> ROMSTREAM_PAGE_SHIFT, len);
+		const u32 ofs = pos & (ROMSTREAM_PAGE_SIZE - 1);
+		if (ofs >= len) break;
+
+		const u32 todo = std::min<u32>(4 - num, len - ofs);
+		memcpy(dst + num, page + ofs, todo);
+		num += todo;
+		pos += todo;
+	}
+
+	return num;
+}
+
+//queues the pages the profile says were read after this one, if they aren't cached yet
+static void ROMStream_Prefetch(ROMStreamCache *s, const ROMAccessProfile *p, u32 page)
+{
+	if (!s->prefetchFile) return;
+
+	ROMStream_CollectPrefetch(s, false);
+	if (s->prefetchBusy) return;
+
+	const u32 entry = p->pageEntry[page];
+	if (entry == ROMPROFILE_NO_ENTRY) return;
+
+	u32 count = 0;
+	for (u32 i = entry + 1; (i < p->entries.size()) && (count < ROMPREFETCH_AHEAD); i++)
+	{
+		const u32 nextPage = p->entries[i].page;
+		if ((nextPage < s->pageCount) && (s->pageSlot[nextPage] == ROMSTREAM_NO_SLOT))
+			s->prefetchPage[count++] = nextPage;
+	}
+	if (count == 0) return;
+
+	s->prefetchCount = count;
+	s->prefetchDone = false;
+	s->prefetchBusy = true;
+	threadMemoryBarrier();
+	s->prefetchTask.execute(ROMStream_PrefetchWork, s);
+}
+
+static std::string ROMProfile_GetFilename(u32 key)
+{
+	char name[16];
+	sprintf(name, "%08X.drp", key);		// DeSmuME rom profile
+	return path.getpath(path.BATTERY) + name;
+}
+
+static void ROMProfile_Load(ROMAccessProfile *p)
+{
+	EMUFILE_FILE fp(ROMProfile_GetFilename(p->key), "rb");
+	if (fp.fail()) return;
+
+	u32 magic = 0, key = 0, pageShift = 0, count = 0;
+	if ((fp.read32le(&magic) != 1) || (magic != ROMPROFILE_MAGIC)) return;
+	if ((fp.read32le(&key) != 1) || (key != p->key)) return;
+	if ((fp.read32le(&pageShift) != 1) || (pageShift != ROMSTREAM_PAGE_SHIFT)) return;
+	if ((fp.read32le(&count) != 1) || (count > ROMPROFILE_MAX_ENTRIES)) return;
+
+	for (u32 i = 0; i < count; i++)
+	{
+		ROMProfileEntry entry;
+		if ((fp.read32le(&entry.frame) != 1) || (fp.read32le(&entry.page) != 1)) break;
+		if ((entry.page >= p->pageEntry.size()) || (p->pageEntry[entry.page] != ROMPROFILE_NO_ENTRY)) continue;
+
+		p->pageEntry[entry.page] = (u32)p->entries.size();
+		p->entries.push_back(entry);
+	}
+}
+
+static void ROMProfile_Save(const ROMAccessProfile *p)
+{
+	EMUFILE_FILE fp(ROMProfile_GetFilename(p->key), "wb");
+	if (fp.fail()) return;
+
+	fp.write32le((u32)ROMPROFILE_MAGIC);
+	fp.write32le(p->key);
+	fp.write32le((u32)ROMSTREAM_PAGE_SHIFT);
+	fp.write32le((u32)p->entries.size());
+	for (size_t i = 0; i < p->entries.size(); i++)
+	{
+		fp.write32le(p->entries[i].frame);
+		fp.write32le(p->entries[i].page);
+	}
+}
+
+void ROMProfile_Begin(u32 key, u32 romSize, bool trace)
+{
+	ROMProfile_End();
+
+	ROMAccessProfile *p = new ROMAccessProfile;
+	p->key = key;
+	p->trace = trace;
+	p->dirty = false;
+	p->lastPage = ROMPROFILE_NO_ENTRY;
+	p->pageEntry.assign((romSize + ROMSTREAM_PAGE_SIZE - 1) >> ROMSTREAM_PAGE_SHIFT, ROMPROFILE_NO_ENTRY);
+	ROMProfile_Load(p);
+
+	//only a streamed rom with something to go on gets a prefetch thread
+	bool prefetch = false;
+	ROMStreamCache *s = romStream;
+	if (s && !p->entries.empty())
+	{
+		s->prefetchFile = s->reader->Init(s->fileName.c_str());
+		if (s->prefetchFile)
+		{
+			s->prefetchTask.start(false);
+			prefetch = true;
+		}
+	}
+
+	if (trace || prefetch)
+		printf("ROM profile %08X: %u pages known%s%s\n", key, (u32)p->entries.size(), trace ? ", tracing" : "", prefetch ? ", prefetching" : "");
+
+	romProfile = p;
+	romTrace.runEnd = 0xFFFFFFFF;
+	romTrace.active = trace || prefetch;
+}
+
+void ROMProfile_End()
+{
+	ROMAccessProfile *p = romProfile;
+	romTrace.active = false;
+	if (!p) return;
+
+	if (p->trace && p->dirty)
+		ROMProfile_Save(p);
+
+	delete p;
+	romProfile = NULL;
+}
+
+void ROMTrace_Access(u32 addr)
+{
+	romTrace.runEnd = addr + 4;
+
+	ROMAccessProfile *p = romProfile;
+	const u32 page = addr >> ROMSTREAM_PAGE_SHIFT;
+	if (!p || (page == p->lastPage) || (page >= p->pageEntry.size())) return;
+	p->lastPage = page;
+
+	if (p->trace && (p->pageEntry[page] == ROMPROFILE_NO_ENTRY) && (p->entries.size() < ROMPROFILE_MAX_ENTRIES))
+	{
+		ROMProfileEntry entry;
+		entry.frame = (u32)currFrameCounter;
+		entry.page = page;
+		p->pageEntry[page] = (u32)p->entries.size();
+		p->entries.push_back(entry);
+		p->dirty = true;
+	}
+
+	if (romStream)
+		ROMStream_Prefetch(romStream, p, page);
+}
@@ -0,0 +1,70 @@
+/*
+	Copyright (C) 2016 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ROMPREFETCH_H_
+#define _ROMPREFETCH_H_
+
+#include <string>
+#include "types.h"
+#include "ROMReader.h"
+
+//A rom streamed from disk (rather than loaded to memory) is read through a cache of whole pages,
+//so a card transfer costs one read per page instead of one per word.
+//
+//Card reads can also be traced (CommonSettings.romAccessTrace) into a small profile kept per rom,
+//listing pages in the order the game first read them. When a streamed rom has a profile, touching
+//a page queues the pages that came after it last time on a background reader, so e.g. the level
+//data that follows a menu selection is usually in the cache before the game asks for it.
+
+#define ROMSTREAM_PAGE_SHIFT	15
+#define ROMSTREAM_PAGE_SIZE		(1 << ROMSTREAM_PAGE_SHIFT)
+#define ROMSTREAM_CACHE_PAGES	64
+#define ROMPREFETCH_AHEAD		8
+
+void ROMStream_Open(ROMReader_struct *reader, void *file, const std::string &fileName, u32 headerOffset, u32 romSize);
+void ROMStream_Close();
+bool ROMStream_IsOpen();
+
+//reads up to 4 bytes at pos into data, returning how many were available
+u32 ROMStream_Read32(u32 pos, u32 *data);
+
+//key is the rom crc, or something as unique when the crc isn't known
+void ROMProfile_Begin(u32 key, u32 romSize, bool trace);
+void ROMProfile_End();
+
+struct ROMTraceState
+{
+	bool active;	//tracing, or prefetching from a profile
+	u32 runEnd;		//card address just past the current run of sequential reads
+};
+extern ROMTraceState romTrace;
+
+void ROMTrace_Access(u32 addr);
+
+//called with every word address a B7 card read returns. sequential reads within a page stay inline.
+FORCEINLINE void ROMTrace_CardRead(u32 addr)
+{
+	if (!romTrace.active) return;
+	if ((addr == romTrace.runEnd) && (addr & (ROMSTREAM_PAGE_SIZE - 1)))
+	{
+		romTrace.runEnd += 4;
+		return;
+	}
+	ROMTrace_Access(addr);
+}
+
+#endif
@@ -39,6 +39,11 @@ ROMReader_struct * ROMReaderInit(char ** filename)
 		(*filename)[strlen(*filename) - 3] = '\0';
 		return &GZIPROMReader;
 	}
+	if(!strcasecmp(".ndz", *filename + (strlen(*filename) - 4)))
+	{
+		(*filename)[strlen(*filename) - 4] = '\0';
+		return &BLOCKROMReader;
+	}
 #endif
 #ifdef HAVE_LIBZZIP
 	if (!strcasecmp(".zip", *filename + (strlen(*filename) - 4)))
@@ -164,6 +169,295 @@ int GZIPROMReaderRead(void * file, void * buffer, u32 size)
 {
 	return gzread((gzFile)file, buffer, size);
 }
+
+/* Block compressed roms (.ndz). A gz stream can only seek by inflating from the start, so
+ * those roms have to be loaded to memory. Here the image is cut into fixed size blocks that
+ * are each deflated on their own, behind a table of where every block starts, so a random
+ * card read costs at most one block inflate and streaming needs only a few blocks of ram.
+ *
+ * Layout, all little endian:
+ *   u32 magic, u32 version, u32 rom size, u32 block size, u32 block count
+ *   u32 offsets[block count + 1] - file offset of every compressed block, then the end
+ *   the compressed blocks. A block that wouldn't shrink is stored as is, which shows as
+ *   a compressed length equal to its plain length. */
+
+#define BLOCKROM_MAGIC			0x1A5A444E //"NDZ\x1A"
+#define BLOCKROM_VERSION		1
+#define BLOCKROM_HEADER_SIZE	20
+#define BLOCKROM_MIN_BLOCK_SIZE	(4 * 1024)
+#define BLOCKROM_MAX_BLOCK_SIZE	(1024 * 1024)
+#define BLOCKROM_CACHE_BLOCKS	4
+
+typedef struct
+{
+	FILE *fp;
+	u32 romSize;
+	u32 blockSize;
+	u32 blockShift;
+	u32 blockCount;
+	u32 *offsets;
+	u8 *packed;
+	u8 *cacheData;
+	u32 cacheBlock[BLOCKROM_CACHE_BLOCKS];
+	u32 cacheAge[BLOCKROM_CACHE_BLOCKS];
+	u32 age;
+	u32 pos;
+} BLOCKROMFile;
+
+void * BLOCKROMReaderInit(const char * filename);
+void BLOCKROMReaderDeInit(void *);
+u32 BLOCKROMReaderSize(void *);
+int BLOCKROMReaderSeek(void *, int, int);
+int BLOCKROMReaderRead(void *, void *, u32);
+
+ROMReader_struct BLOCKROMReader =
+{
+	ROMREADER_BLOCK,
+	"Block Compressed ROM Reader",
+	BLOCKROMReaderInit,
+	BLOCKROMReaderDeInit,
+	BLOCKROMReaderSize,
+	BLOCKROMReaderSeek,
+	BLOCKROMReaderRead
+};
+
+static bool BLOCKROMRead32(FILE * fp, u32 * val)
+{
+	u32 buf;
+	if (fread(&buf, 1, 4, fp) != 4)
+		return false;
+	*val = LE_TO_LOCAL_32(buf);
+	return true;
+}
+
+static bool BLOCKROMWrite32(FILE * fp, u32 val)
+{
+	const u32 buf = LOCAL_TO_LE_32(val);
+	return (fwrite(&buf, 1, 4, fp) == 4);
+}
+
+static u32 BLOCKROMBlockLength(BLOCKROMFile * f, u32 block)
+{
+	const u32 start = block << f->blockShift;
+	return ((f->romSize - start) < f->blockSize) ? (f->romSize - start) : f->blockSize;
+}
+
+void * BLOCKROMReaderInit(const char * filename)
+{
+	FILE *fp = fopen(filename, "rb");
+	if (!fp) return 0;
+
+	u32 magic, version, romSize, blockSize, blockCount;
+	if (!BLOCKROMRead32(fp, &magic) || !BLOCKROMRead32(fp, &version) || !BLOCKROMRead32(fp, &romSize)
+		|| !BLOCKROMRead32(fp, &blockSize) || !BLOCKROMRead32(fp, &blockCount)
+		|| (magic != BLOCKROM_MAGIC) || (version != BLOCKROM_VERSION)
+		|| (blockSize < BLOCKROM_MIN_BLOCK_SIZE) || (blockSize > BLOCKROM_MAX_BLOCK_SIZE) || (blockSize & (blockSize - 1))
+		|| (blockCount != (u32)(((u64)romSize + blockSize - 1) / blockSize)))
+	{
+		fclose(fp);
+		return 0;
+	}
+
+	BLOCKROMFile *f = new BLOCKROMFile;
+	memset(f, 0, sizeof(BLOCKROMFile));
+	f->fp = fp;
+	f->romSize = romSize;
+	f->blockSize = blockSize;
+	while ((1U << f->blockShift) < blockSize)
+		f->blockShift++;
+	f->blockCount = blockCount;
+	f->offsets = new u32[blockCount + 1];
+	f->packed = new u8[blockSize];
+	f->cacheData = new u8[blockSize * BLOCKROM_CACHE_BLOCKS];
+	for (int i = 0; i < BLOCKROM_CACHE_BLOCKS; i++)
+		f->cacheBlock[i] = 0xFFFFFFFF;
+
+	bool ok = true;
+	for (u32 i = 0; ok && (i <= blockCount); i++)
+		ok = BLOCKROMRead32(fp, &f->offsets[i]);
+
+	//a block never grows past its plain length, so anything else means a broken index
+	for (u32 i = 0; ok && (i < blockCount); i++)
+		ok = (f->offsets[i] <= f->offsets[i + 1]) && ((f->offsets[i + 1] - f->offsets[i]) <= BLOCKROMBlockLength(f, i));
+
+	if (!ok)
+	{
+		BLOCKROMReaderDeInit(f);
+		return 0;
+	}
+
+	return (void *) f;
+}
+
+void BLOCKROMReaderDeInit(void * file)
+{
+	BLOCKROMFile *f = (BLOCKROMFile *)file;
+	if (!f) return;
+	fclose(f->fp);
+	delete [] f->offsets;
+	delete [] f->packed;
+	delete [] f->cacheData;
+	delete f;
+}
+
+u32 BLOCKROMReaderSize(void * file)
+{
+	BLOCKROMFile *f = (BLOCKROMFile *)file;
+	if (!f) return 0;
+	return f->romSize;
+}
+
+int BLOCKROMReaderSeek(void * file, int offset, int whence)
+{
+	BLOCKROMFile *f = (BLOCKROMFile *)file;
+	if (!f) return 0;
+
+	s64 pos = offset;
+	if (whence == SEEK_CUR) pos += f->pos;
+	else if (whence == SEEK_END) pos += f->romSize;
+
+	if ((pos < 0) || (pos > f->romSize))
+		return -1;
+
+	f->pos = (u32)pos;
+	return 0;
+}
+
+//returns the plain contents of a block, inflating it into the least recently used cache slot if needed
+static const u8 * BLOCKROMGetBlock(BLOCKROMFile * f, u32 block)
+{
+	f->age++;
+
+	int slot = 0;
+	for (int i = 0; i < BLOCKROM_CACHE_BLOCKS; i++)
+	{
+		if (f->cacheBlock[i] == block)
+		{
+			f->cacheAge[i] = f->age;
+			return f->cacheData + (i << f->blockShift);
+		}
+		if (f->cacheAge[i] < f->cacheAge[slot])
+			slot = i;
+	}
+
+	u8 *data = f->cacheData + (slot << f->blockShift);
+	const u32 packedLen = f->offsets[block + 1] - f->offsets[block];
+	const u32 plainLen = BLOCKROMBlockLength(f, block);
+	f->cacheBlock[slot] = 0xFFFFFFFF;
+
+	if (fseek(f->fp, f->offsets[block], SEEK_SET) != 0)
+		return NULL;
+
+	if (packedLen == plainLen)
+	{
+		if (fread(data, 1, plainLen, f->fp) != plainLen)
+			return NULL;
+	}
+	else
+	{
+		if (fread(f->packed, 1, packedLen, f->fp) != packedLen)
+			return NULL;
+
+		uLongf destLen = plainLen;
+		if ((uncompress(data, &destLen, f->packed, packedLen) != Z_OK) || (destLen != plainLen))
+			return NULL;
+	}
+
+	f->cacheBlock[slot] = block;
+	f->cacheAge[slot] = f->age;
+	return data;
+}
+
+int BLOCKROMReaderRead(void * file, void * buffer, u32 size)
+{
+	BLOCKROMFile *f = (BLOCKROMFile *)file;
+	if (!f) return 0;
+
+	u32 done = 0;
+	while ((done < size) && (f->pos < f->romSize))
+	{
+		const u8 *data = BLOCKROMGetBlock(f, f->pos >> f->blockShift);
+		if (!data) break;
+
+		const u32 ofs = f->pos & (f->blockSize - 1);
+		u32 todo = f->blockSize - ofs;
+		if (todo > size - done) todo = size - done;
+		if (todo > f->romSize - f->pos) todo = f->romSize - f->pos;
+
+		memcpy((u8 *)buffer + done, data + ofs, todo);
+		done += todo;
+		f->pos += todo;
+	}
+
+	return done;
+}
+
+bool BLOCKROM_Compress(const char * inFilename, const char * outFilename, u32 blockSize)
+{
+	if ((blockSize < BLOCKROM_MIN_BLOCK_SIZE) || (blockSize > BLOCKROM_MAX_BLOCK_SIZE) || (blockSize & (blockSize - 1)))
+		return false;
+
+	void *in = STDROMReaderInit(inFilename);
+	if (!in) return false;
+
+	FILE *out = fopen(outFilename, "wb");
+	if (!out)
+	{
+		STDROMReaderDeInit(in);
+		return false;
+	}
+
+	const u32 romSize = STDROMReaderSize(in);
+	const u32 blockCount = (u32)(((u64)romSize + blockSize - 1) / blockSize);
+	u32 *offsets = new u32[blockCount + 1];
+	u8 *plain = new u8[blockSize];
+	uLongf packedMax = compressBound(blockSize);
+	u8 *packed = new u8[packedMax];
+
+	//the index is written once the block sizes are known, so leave room for it first
+	bool ok = BLOCKROMWrite32(out, BLOCKROM_MAGIC) && BLOCKROMWrite32(out, BLOCKROM_VERSION)
+		&& BLOCKROMWrite32(out, romSize) && BLOCKROMWrite32(out, blockSize) && BLOCKROMWrite32(out, blockCount);
+	for (u32 i = 0; ok && (i <= blockCount); i++)
+		ok = BLOCKROMWrite32(out, 0);
+
+	u32 pos = BLOCKROM_HEADER_SIZE + (blockCount + 1) * 4;
+	for (u32 i = 0; ok && (i < blockCount); i++)
+	{
+		const u32 plainLen = ((romSize - i * blockSize) < blockSize) ? (romSize - i * blockSize) : blockSize;
+		ok = ((u32)STDROMReaderRead(in, plain, plainLen) == plainLen);
+		if (!ok) break;
+
+		uLongf packedLen = packedMax;
+		offsets[i] = pos;
+		if ((compress2(packed, &packedLen, plain, plainLen, Z_BEST_COMPRESSION) == Z_OK) && (packedLen < plainLen))
+		{
+			ok = (fwrite(packed, 1, packedLen, out) == packedLen);
+			pos += packedLen;
+		}
+		else
+		{
+			ok = (fwrite(plain, 1, plainLen, out) == plainLen);
+			pos += plainLen;
+		}
+	}
+	offsets[blockCount] = pos;
+
+	ok = ok && (fseek(out, BLOCKROM_HEADER_SIZE, SEEK_SET) == 0);
+	for (u32 i = 0; ok && (i <= blockCount); i++)
+		ok = BLOCKROMWrite32(out, offsets[i]);
+
+	delete [] offsets;
+	delete [] plain;
+	delete [] packed;
+	STDROMReaderDeInit(in);
+	if (fclose(out) != 0)
+		ok = false;
+
+	if (!ok)
+		remove(outFilename);
+	printf("ROM block compression: %s, %u bytes in %u blocks -> %u bytes\n", ok ? "done" : "error", romSize, blockCount, pos);
+	return ok;
+}
 #endif
 
 #ifdef HAVE_LIBZZIP
@@ -16,6 +16,9 @@
 	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef _ROMREADER_H_
+#define _ROMREADER_H_
+
 #ifdef HAVE_LIBZ
 #include <zlib.h>
 #endif
@@ -27,6 +30,7 @@
 #define ROMREADER_STD	0
 #define ROMREADER_GZIP	1
 #define ROMREADER_ZIP	2
+#define ROMREADER_BLOCK	3
 
 typedef struct
 {
@@ -42,9 +46,17 @@ typedef struct
 extern ROMReader_struct STDROMReader;
 #ifdef HAVE_LIBZ
 extern ROMReader_struct GZIPROMReader;
+extern ROMReader_struct BLOCKROMReader;
 #endif
 #ifdef HAVE_LIBZZIP
 extern ROMReader_struct ZIPROMReader;
 #endif
 
 ROMReader_struct * ROMReaderInit(char ** filename);
+
+#ifdef HAVE_LIBZ
+//converts a plain rom into the block compressed .ndz container read by BLOCKROMReader
+bool BLOCKROM_Compress(const char * inFilename, const char * outFilename, u32 blockSize);
+#endif
+
+#endif
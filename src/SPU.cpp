@@ -40,6 +40,7 @@
 #include "armcpu.h"
 #include "NDSSystem.h"
 #include "matrix.h"
+#include "utils/trace.h"
 
 
 static inline s16 read16(u32 addr) { return (s16)_MMU_read16<ARMCPU_ARM7,MMU_AT_DEBUG>(addr); }
@@ -1653,6 +1654,7 @@ static void SPU_MixAudio(bool actuallyMix, SPU_struct *SPU, int length)
 int spu_core_samples = 0;
 void SPU_Emulate_core()
 {
+	TRACE_ZONE("SPU_Emulate_core");
 	bool needToMix = true;
 	SoundInterface_struct *soundProcessor = SPU_SoundCore();
 	
@@ -19,6 +19,7 @@
 
 #include "../NDSSystem.h"
 #include "../emufile.h"
+#include "../ROMPrefetch.h"
 
 
 void Slot1Comp_Rom::start(eSlot1Operation operation, u32 addr)
@@ -78,6 +79,7 @@ u32 Slot1Comp_Rom::read()
 			}
 
 			//actually read from the ROM provider
+			ROMTrace_CardRead(address);
 			u32 ret = gameInfo.readROM(address);
 
 			//"However, the datastream wraps to the begin of the current 4K block when address+length crosses a 4K boundary (1000h bytes)"
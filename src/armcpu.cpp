@@ -597,8 +597,10 @@ u32 TRAPUNDEF(armcpu_t* cpu)
 //  return TRUE;
 //}
 
-template<int PROCNUM>
-u32 armcpu_exec()
+//EXECHOOK: whether to look for lua exec hooks at all. armcpu_exec picks this copy only while
+//some are registered, so the copy that normally runs has no trace of them
+template<int PROCNUM, bool EXECHOOK>
+static u32 armcpu_execute()
 {
 	// Usually, fetching and executing are processed parallelly.
 	// So this function stores the cycles of each process to
@@ -676,7 +678,8 @@ u32 armcpu_exec()
 			)
 		{
 #ifdef HAVE_LUA
-			CallRegisteredLuaMemHook(ARMPROC.instruct_adr, 4, ARMPROC.instruction, LUAMEMHOOK_EXEC); // should report even if condition=false?
+			if(EXECHOOK)
+				CallRegisteredLuaMemHook(PROCNUM, ARMPROC.instruct_adr, 4, ARMPROC.instruction, LUAMEMHOOK_EXEC); // should report even if condition=false?
 #endif
 			#ifdef DEVELOPER
 			DEBUG_statistics.instructionHits[PROCNUM].arm[INSTRUCTION_INDEX(ARMPROC.instruction)]++;
@@ -697,7 +700,8 @@ u32 armcpu_exec()
 	}
 
 #ifdef HAVE_LUA
-	CallRegisteredLuaMemHook(ARMPROC.instruct_adr, 2, ARMPROC.instruction, LUAMEMHOOK_EXEC);
+	if(EXECHOOK)
+		CallRegisteredLuaMemHook(PROCNUM, ARMPROC.instruct_adr, 2, ARMPROC.instruction, LUAMEMHOOK_EXEC);
 #endif
 	#ifdef DEVELOPER
 	DEBUG_statistics.instructionHits[PROCNUM].thumb[ARMPROC.instruction>>6]++;
@@ -715,6 +719,16 @@ u32 armcpu_exec()
 	return MMU_fetchExecuteCycles<PROCNUM>(cExecute, cFetch);
 }
 
+template<int PROCNUM>
+u32 armcpu_exec()
+{
+#ifdef HAVE_LUA
+	if(LuaMemHookActive(PROCNUM, LUAMEMHOOK_EXEC))
+		return armcpu_execute<PROCNUM,true>();
+#endif
+	return armcpu_execute<PROCNUM,false>();
+}
+
 //these templates needed to be instantiated manually
 template u32 armcpu_exec<0>();
 template u32 armcpu_exec<1>();
@@ -201,6 +201,116 @@ static const u8 getvoltbl[] = {
 0x7C, 0x7D, 0x7E, 0x7F
 };
 
+//sequential guest memory streams for the decompression routines.
+//they go straight to host memory wherever MMU_GetHostSpan allows, and through the regular handlers
+//one access at a time elsewhere (io, misaligned units), so the results are the same either way.
+static const u32 kBiosSpanLen = 0x01000000;
+
+TEMPLATE class BiosReader
+{
+public:
+	BiosReader(u32 _addr) : addr(_addr), ptr(NULL), avail(0) {}
+
+	FORCEINLINE u8 read08()
+	{
+		if(!mapped(1)) return _MMU_read08<PROCNUM>(addr++);
+		addr++; avail--;
+		return *ptr++;
+	}
+
+	FORCEINLINE u16 read16()
+	{
+		u16 val;
+		if((addr & 1) || !mapped(2)) val = _MMU_read16<PROCNUM>(addr);
+		else { val = T1ReadWord(ptr, 0); ptr += 2; avail -= 2; }
+		addr += 2;
+		return val;
+	}
+
+	FORCEINLINE u32 read32()
+	{
+		u32 val;
+		if((addr & 3) || !mapped(4)) val = _MMU_read32<PROCNUM>(addr);
+		else { val = T1ReadLong(ptr, 0); ptr += 4; avail -= 4; }
+		addr += 4;
+		return val;
+	}
+
+	u32 addr;
+
+private:
+	FORCEINLINE bool mapped(const u32 size)
+	{
+		if(avail < size)
+		{
+			ptr = MMU_GetHostSpan<PROCNUM,MMU_AT_DATA>(addr, kBiosSpanLen, 0, avail);
+			if(ptr == NULL) avail = 0;
+		}
+		return avail >= size;
+	}
+
+	u8 *ptr;
+	u32 avail;
+};
+
+TEMPLATE class BiosWriter
+{
+public:
+	BiosWriter(u32 _addr, int _writeSize) : addr(_addr), writeSize(_writeSize), base(NULL), baseAddr(0), ptr(NULL), avail(0) {}
+
+	FORCEINLINE void write08(const u8 val)
+	{
+		if(!mapped(1)) { _MMU_write08<PROCNUM>(addr, val); unmap(); }
+		else { *ptr++ = val; avail--; }
+		addr++;
+	}
+
+	FORCEINLINE void write16(const u16 val)
+	{
+		if((addr & 1) || !mapped(2)) { _MMU_write16<PROCNUM>(addr, val); unmap(); }
+		else { T1WriteWord(ptr, 0, val); ptr += 2; avail -= 2; }
+		addr += 2;
+	}
+
+	FORCEINLINE void write32(const u32 val)
+	{
+		if((addr & 3) || !mapped(4)) { _MMU_write32<PROCNUM>(addr, val); unmap(); }
+		else { T1WriteLong(ptr, 0, val); ptr += 4; avail -= 4; }
+		addr += 4;
+	}
+
+	//reads back output which was already written, as the lz77 window does
+	FORCEINLINE u8 peek08(const u32 at)
+	{
+		if(base != NULL && at >= baseAddr && at < addr)
+			return base[at - baseAddr];
+		return _MMU_read08<PROCNUM>(at);
+	}
+
+	u32 addr;
+
+private:
+	FORCEINLINE bool mapped(const u32 size)
+	{
+		if(avail < size)
+		{
+			ptr = base = MMU_GetHostSpan<PROCNUM,MMU_AT_DATA>(addr, kBiosSpanLen, writeSize, avail);
+			baseAddr = addr;
+			if(ptr == NULL) avail = 0;
+		}
+		return avail >= size;
+	}
+
+	//a write through the handlers may have had side effects on the mapping
+	FORCEINLINE void unmap() { base = ptr = NULL; avail = 0; }
+
+	const int writeSize;
+	u8 *base;
+	u32 baseAddr;
+	u8 *ptr;
+	u32 avail;
+};
+
 TEMPLATE static u32 bios_nop()
 {
 	LOG("SWI: ARM%c Unimplemented BIOS function %02X was used. R0:%08X, R1:%08X, R2:%08X\n", PROCNUM?'7':'9',
@@ -342,26 +452,10 @@ TEMPLATE static u32 copy()
                switch(BIT24(cnt))
                {
                     case 0:
-                         cnt &= 0x1FFFFF;
-                         while(cnt)
-                         {
-                              _MMU_write16<PROCNUM>(dst, _MMU_read16<PROCNUM>(src));
-                              cnt--;
-                              dst+=2;
-                              src+=2;
-                         }
+                         MMU_BulkCopy<PROCNUM,MMU_AT_DATA>(dst, src, cnt & 0x1FFFFF, 16);
                          break;
                     case 1:
-                         {
-                              u16 val = _MMU_read16<PROCNUM>(src);
-                              cnt &= 0x1FFFFF;
-                              while(cnt)
-                              {
-                                   _MMU_write16<PROCNUM>(dst, val);
-                                   cnt--;
-                                   dst+=2;
-                              }
-                         }
+                         MMU_BulkFill<PROCNUM,MMU_AT_DATA>(dst, _MMU_read16<PROCNUM>(src), cnt & 0x1FFFFF, 16);
                          break;
                }
                break;
@@ -371,26 +465,10 @@ TEMPLATE static u32 copy()
                switch(BIT24(cnt))
                {
                     case 0:
-                         cnt &= 0x1FFFFF;
-                         while(cnt)
-                         {
-                              _MMU_write32<PROCNUM>(dst, _MMU_read32<PROCNUM>(src));
-                              cnt--;
-                              dst+=4;
-                              src+=4;
-                         }
+                         MMU_BulkCopy<PROCNUM,MMU_AT_DATA>(dst, src, cnt & 0x1FFFFF, 32);
                          break;
                     case 1:
-                         {
-                              u32 val = _MMU_read32<PROCNUM>(src);
-                              cnt &= 0x1FFFFF;
-                              while(cnt)
-                              {
-                                   _MMU_write32<PROCNUM>(dst, val);
-                                   cnt--;
-                                   dst+=4;
-                              }
-                         }
+                         MMU_BulkFill<PROCNUM,MMU_AT_DATA>(dst, _MMU_read32<PROCNUM>(src), cnt & 0x1FFFFF, 32);
                          break;
                }
                break;
@@ -409,26 +487,10 @@ TEMPLATE static u32 fastCopy()
      switch(BIT24(cnt))
      {
           case 0:
-               cnt &= 0x1FFFFF;
-               while(cnt)
-               {
-                    _MMU_write32<PROCNUM>(dst, _MMU_read32<PROCNUM>(src));
-                    cnt--;
-                    dst+=4;
-                    src+=4;
-               }
+               MMU_BulkCopy<PROCNUM,MMU_AT_DATA>(dst, src, cnt & 0x1FFFFF, 32);
                break;
           case 1:
-               {
-                    u32 val = _MMU_read32<PROCNUM>(src);
-                    cnt &= 0x1FFFFF;
-                    while(cnt)
-                    {
-                         _MMU_write32<PROCNUM>(dst, val);
-                         cnt--;
-                         dst+=4;
-                    }
-               }
+               MMU_BulkFill<PROCNUM,MMU_AT_DATA>(dst, _MMU_read32<PROCNUM>(src), cnt & 0x1FFFFF, 32);
                break;
      }
      return 1;
@@ -458,8 +520,11 @@ TEMPLATE static u32 LZ77UnCompVram()
 
   len = header >> 8;
 
+  BiosReader<PROCNUM> in(source);
+  BiosWriter<PROCNUM> out(dest, 16);
+
   while(len > 0) {
-    u8 d = _MMU_read08<PROCNUM>(source++);
+    u8 d = in.read08();
 
     if(d) {
       for(i1 = 0; i1 < 8; i1++) {
@@ -467,19 +532,18 @@ TEMPLATE static u32 LZ77UnCompVram()
           int length;
           int offset;
           u32 windowOffset;
-          u16 data = _MMU_read08<PROCNUM>(source++) << 8;
-          data |= _MMU_read08<PROCNUM>(source++);
+          u16 data = in.read08() << 8;
+          data |= in.read08();
           length = (data >> 12) + 3;
           offset = (data & 0x0FFF);
-          windowOffset = dest + byteCount - offset - 1;
+          windowOffset = out.addr + byteCount - offset - 1;
           for(i2 = 0; i2 < length; i2++) {
-            writeValue |= (_MMU_read08<PROCNUM>(windowOffset++) << byteShift);
+            writeValue |= (out.peek08(windowOffset++) << byteShift);
             byteShift += 8;
             byteCount++;
 
             if(byteCount == 2) {
-              _MMU_write16<PROCNUM>(dest, writeValue);
-              dest += 2;
+              out.write16(writeValue);
               byteCount = 0;
               byteShift = 0;
               writeValue = 0;
@@ -489,12 +553,11 @@ TEMPLATE static u32 LZ77UnCompVram()
               return 0;
           }
         } else {
-          writeValue |= (_MMU_read08<PROCNUM>(source++) << byteShift);
+          writeValue |= (in.read08() << byteShift);
           byteShift += 8;
           byteCount++;
           if(byteCount == 2) {
-            _MMU_write16<PROCNUM>(dest, writeValue);
-            dest += 2;
+            out.write16(writeValue);
             byteCount = 0;
             byteShift = 0;
             writeValue = 0;
@@ -507,12 +570,11 @@ TEMPLATE static u32 LZ77UnCompVram()
       }
     } else {
       for(i1 = 0; i1 < 8; i1++) {
-        writeValue |= (_MMU_read08<PROCNUM>(source++) << byteShift);
+        writeValue |= (in.read08() << byteShift);
         byteShift += 8;
         byteCount++;
         if(byteCount == 2) {
-          _MMU_write16<PROCNUM>(dest, writeValue);
-          dest += 2;      
+          out.write16(writeValue);
           byteShift = 0;
           byteCount = 0;
           writeValue = 0;
@@ -544,8 +606,11 @@ TEMPLATE static u32 LZ77UnCompWram()
   
   len = header >> 8;
 
+  BiosReader<PROCNUM> in(source);
+  BiosWriter<PROCNUM> out(dest, 8);
+
   while(len > 0) {
-    u8 d = _MMU_read08<PROCNUM>(source++);
+    u8 d = in.read08();
 
     if(d) {
       for(i1 = 0; i1 < 8; i1++) {
@@ -553,19 +618,19 @@ TEMPLATE static u32 LZ77UnCompWram()
           int length;
           int offset;
           u32 windowOffset;
-          u16 data = _MMU_read08<PROCNUM>(source++) << 8;
-          data |= _MMU_read08<PROCNUM>(source++);
+          u16 data = in.read08() << 8;
+          data |= in.read08();
           length = (data >> 12) + 3;
           offset = (data & 0x0FFF);
-          windowOffset = dest - offset - 1;
+          windowOffset = out.addr - offset - 1;
           for(i2 = 0; i2 < length; i2++) {
-            _MMU_write08<PROCNUM>(dest++, _MMU_read08<PROCNUM>(windowOffset++));
+            out.write08(out.peek08(windowOffset++));
             len--;
             if(len == 0)
               return 0;
           }
         } else {
-          _MMU_write08<PROCNUM>(dest++, _MMU_read08<PROCNUM>(source++));
+          out.write08(in.read08());
           len--;
           if(len == 0)
             return 0;
@@ -574,7 +639,7 @@ TEMPLATE static u32 LZ77UnCompWram()
       }
     } else {
       for(i1 = 0; i1 < 8; i1++) {
-        _MMU_write08<PROCNUM>(dest++, _MMU_read08<PROCNUM>(source++));
+        out.write08(in.read08());
         len--;
         if(len == 0)
           return 0;
@@ -608,11 +673,14 @@ TEMPLATE static u32 RLUnCompVram()
   byteShift = 0;
   writeValue = 0;
 
+  BiosReader<PROCNUM> in(source);
+  BiosWriter<PROCNUM> out(dest, 16);
+
   while(len > 0) {
-    u8 d = _MMU_read08<PROCNUM>(source++);
+    u8 d = in.read08();
     int l = d & 0x7F;
     if(d & 0x80) {
-      u8 data = _MMU_read08<PROCNUM>(source++);
+      u8 data = in.read08();
       l += 3;
       for(i = 0;i < l; i++) {
         writeValue |= (data << byteShift);
@@ -620,8 +688,7 @@ TEMPLATE static u32 RLUnCompVram()
         byteCount++;
 
         if(byteCount == 2) {
-          _MMU_write16<PROCNUM>(dest, writeValue);
-          dest += 2;
+          out.write16(writeValue);
           byteCount = 0;
           byteShift = 0;
           writeValue = 0;
@@ -633,12 +700,11 @@ TEMPLATE static u32 RLUnCompVram()
     } else {
       l++;
       for(i = 0; i < l; i++) {
-        writeValue |= (_MMU_read08<PROCNUM>(source++) << byteShift);
+        writeValue |= (in.read08() << byteShift);
         byteShift += 8;
         byteCount++;
         if(byteCount == 2) {
-          _MMU_write16<PROCNUM>(dest, writeValue);
-          dest += 2;
+          out.write16(writeValue);
           byteCount = 0;
           byteShift = 0;
           writeValue = 0;
@@ -674,14 +740,17 @@ TEMPLATE static u32 RLUnCompWram()
   
   len = header >> 8;
 
+  BiosReader<PROCNUM> in(source);
+  BiosWriter<PROCNUM> out(dest, 8);
+
   while(len > 0) {
-    u8 d = _MMU_read08<PROCNUM>(source++);
+    u8 d = in.read08();
     int l = d & 0x7F;
     if(d & 0x80) {
-      u8 data = _MMU_read08<PROCNUM>(source++);
+      u8 data = in.read08();
       l += 3;
       for(i = 0;i < l; i++) {
-        _MMU_write08<PROCNUM>(dest++, data);
+        out.write08(data);
         len--;
         if(len == 0)
           return 0;
@@ -689,7 +758,7 @@ TEMPLATE static u32 RLUnCompWram()
     } else {
       l++;
       for(i = 0; i < l; i++) {
-        _MMU_write08<PROCNUM>(dest++,  _MMU_read08<PROCNUM>(source++));
+        out.write08(in.read08());
         len--;
         if(len == 0)
           return 0;
@@ -706,6 +775,8 @@ TEMPLATE static u32 UnCompHuffman()
   u32 source, dest, writeValue, header, treeStart, mask;
   u32 data;
   u8 treeSize, currentNode, rootNode;
+  u8 tree[512];
+  u32 treeLen;
   int byteCount, byteShift, len, pos;
   int writeData;
 
@@ -726,15 +797,22 @@ TEMPLATE static u32 UnCompHuffman()
   treeStart = source;
 
   source += ((treeSize+1)<<1)-1; // minus because we already skipped one byte
+
+  //the tree is walked once per bit, so keep a copy of it. anything a corrupt tree points past it is read from memory
+  treeLen = ((treeSize+1)<<1)-1;
+  BiosReader<PROCNUM> treeIn(treeStart);
+  for(u32 i = 0; i < treeLen; i++)
+    tree[i] = treeIn.read08();
   
   len = header >> 8;
 
   mask = 0x80000000;
-  data = _MMU_read32<PROCNUM>(source);
-  source += 4;
+  BiosReader<PROCNUM> in(source);
+  BiosWriter<PROCNUM> out(dest, 32);
+  data = in.read32();
 
   pos = 0;
-  rootNode = _MMU_read08<PROCNUM>(treeStart);
+  rootNode = tree[0];
   currentNode = rootNode;
   writeData = 0;
   byteShift = 0;
@@ -753,12 +831,12 @@ TEMPLATE static u32 UnCompHuffman()
         // right
         if(currentNode & 0x40)
           writeData = 1;
-        currentNode = _MMU_read08<PROCNUM>(treeStart+pos+1);
+        currentNode = ((u32)pos+1 < treeLen) ? tree[pos+1] : _MMU_read08<PROCNUM>(treeStart+pos+1);
       } else {
         // left
         if(currentNode & 0x80)
           writeData = 1;
-        currentNode = _MMU_read08<PROCNUM>(treeStart+pos);
+        currentNode = ((u32)pos < treeLen) ? tree[pos] : _MMU_read08<PROCNUM>(treeStart+pos);
       }
       
       if(writeData) {
@@ -773,17 +851,15 @@ TEMPLATE static u32 UnCompHuffman()
         if(byteCount == 4) {
           byteCount = 0;
           byteShift = 0;
-          _MMU_write32<PROCNUM>(dest, writeValue);
+          out.write32(writeValue);
           writeValue = 0;
-          dest += 4;
           len -= 4;
         }
       }
       mask >>= 1;
       if(mask == 0) {
         mask = 0x80000000;
-        data = _MMU_read32<PROCNUM>(source);
-        source += 4;
+        data = in.read32();
       }
     }
   } else {
@@ -800,12 +876,12 @@ TEMPLATE static u32 UnCompHuffman()
         // right
         if(currentNode & 0x40)
           writeData = 1;
-        currentNode = _MMU_read08<PROCNUM>(treeStart+pos+1);
+        currentNode = ((u32)pos+1 < treeLen) ? tree[pos+1] : _MMU_read08<PROCNUM>(treeStart+pos+1);
       } else {
         // left
         if(currentNode & 0x80)
           writeData = 1;
-        currentNode = _MMU_read08<PROCNUM>(treeStart+pos);
+        currentNode = ((u32)pos < treeLen) ? tree[pos] : _MMU_read08<PROCNUM>(treeStart+pos);
       }
       
       if(writeData) {
@@ -826,8 +902,7 @@ TEMPLATE static u32 UnCompHuffman()
           if(byteCount == 4) {
             byteCount = 0;
             byteShift = 0;
-            _MMU_write32<PROCNUM>(dest, writeValue);
-            dest += 4;
+            out.write32(writeValue);
             writeValue = 0;
             len -= 4;
           }
@@ -839,8 +914,7 @@ TEMPLATE static u32 UnCompHuffman()
       mask >>= 1;
       if(mask == 0) {
         mask = 0x80000000;
-        data = _MMU_read32<PROCNUM>(source);
-        source += 4;
+        data = in.read32();
       }
     }    
   }
@@ -889,6 +963,9 @@ TEMPLATE static u32 BitUnPack()
 
 	//INFO("SWI10: bitunpack src 0x%08X dst 0x%08X hdr 0x%08X (src len %05i src bits %02i dst bits %02i)\n\n", source, dest, header, len, bits, dataSize);
 
+	BiosReader<PROCNUM> in(source);
+	BiosWriter<PROCNUM> out(dest, 32);
+
 	data = 0; 
 	bitwritecount = 0; 
 	while(1) {
@@ -896,8 +973,7 @@ TEMPLATE static u32 BitUnPack()
 		if(len < 0)
 			break;
 		mask = 0xff >> revbits; 
-		b = _MMU_read08<PROCNUM>(source); 
-		source++;
+		b = in.read08();
 		bitcount = 0;
 		while(1) {
 			if(bitcount >= 8)
@@ -916,8 +992,7 @@ TEMPLATE static u32 BitUnPack()
 			data |= temp << bitwritecount;
 			bitwritecount += dataSize;
 			if(bitwritecount >= 32) {
-				_MMU_write32<PROCNUM>(dest, data);
-				dest += 4;
+				out.write32(data);
 				data = 0;
 				bitwritecount = 0;
 			}
@@ -942,14 +1017,17 @@ TEMPLATE static u32 Diff8bitUnFilterWram() //this one might be different on arm7
 	if(header.Type() != 8) printf("WARNING: incorrect header passed to Diff8bitUnFilterWram\n");
 	u32 len = header.DecompressedSize();
 
-	u8 data = _MMU_read08<PROCNUM>(source++);
-	_MMU_write08<PROCNUM>(dest++, data);
+	BiosReader<PROCNUM> in(source);
+	BiosWriter<PROCNUM> out(dest, 8);
+
+	u8 data = in.read08();
+	out.write08(data);
 	len--;
 
 	while(len > 0) {
-		u8 diff = _MMU_read08<PROCNUM>(source++);
+		u8 diff = in.read08();
 		data += diff;
-		_MMU_write08<PROCNUM>(dest++, data);
+		out.write08(data);
 		len--;
 	}
 	return 1;
@@ -969,18 +1047,17 @@ TEMPLATE static u32 Diff16bitUnFilter()
 	if(header.Type() != 8) printf("WARNING: incorrect header passed to Diff16bitUnFilter\n");
 	u32 len = header.DecompressedSize();
 
-	u16 data = _MMU_read16<PROCNUM>(source);
-	source += 2;
-	_MMU_write16<PROCNUM>(dest, data);
-	dest += 2;
+	BiosReader<PROCNUM> in(source);
+	BiosWriter<PROCNUM> out(dest, 16);
+
+	u16 data = in.read16();
+	out.write16(data);
 	len -= 2;
 
 	while(len >= 2) {
-		u16 diff = _MMU_read16<PROCNUM>(source);
-		source += 2;
+		u16 diff = in.read16();
 		data += diff;
-		_MMU_write16<PROCNUM>(dest, data);
-		dest += 2;
+		out.write16(data);
 		len -= 2;
 	}
 	return 1;
@@ -56,6 +56,7 @@
 #include "../GPU_osd.h"
 #include "../desmume_config.h"
 #include "../commandline.h"
+#include "../MovieVerify.h"
 #include "../slot2.h"
 #include "../utils/xstring.h"
 
@@ -78,6 +79,16 @@ static float nds_screen_size_ratio = 1.0f;
 
 static SDL_Surface * surface;
 
+class CliDriver : public BaseDriver
+{
+public:
+#if GLIB_CHECK_VERSION(2,28,0)
+  /* a host clock for the guest profiler (--profile-guest) and the tracer */
+  virtual u64 EMU_GetTicks() { return (u64)g_get_monotonic_time(); }
+  virtual u64 EMU_GetTicksPerSecond() { return 1000000; }
+#endif
+};
+
 /* Flags to pass to SDL_SetVideoMode */
 static int sdl_videoFlags;
 
@@ -594,7 +605,7 @@ int main(int argc, char ** argv) {
     g_thread_init( NULL);
   }
 
-  driver = new BaseDriver();
+  driver = new CliDriver();
   
 #ifdef GDB_STUB
   gdbstub_mutex_init();
@@ -653,6 +664,13 @@ int main(int argc, char ** argv) {
     exit(-1);
   }
 
+  if ( !my_config.verify_movie_files.empty()) {
+    int ret = MovieVerify_Run( my_config.verify_movie_files, my_config.verify_jobs,
+                               my_config.verify_out_dir, my_config.verify_baseline_dir);
+    NDS_DeInit();
+    exit( ret);
+  }
+
   execute = true;
 
   if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER) == -1)
@@ -65,6 +65,7 @@ CommandLine::CommandLine()
 , arm9_gdb_port(0)
 , arm7_gdb_port(0)
 , start_paused(FALSE)
+, verify_jobs(0)
 , autodetect_method(-1)
 {
 #ifndef HOST_WINDOWS 
@@ -131,6 +132,11 @@ ENDL
 " --load-slot N              loads savestate from slot N (0-9)" ENDL
 " --play-movie DSM_FILE      automatically plays movie" ENDL
 " --record-movie DSM_FILE    begin recording a movie" ENDL
+" --verify-movie DSM_FILE    replay movies in place of emulation, hashing each frame, and exit" ENDL
+"                            (may be given many times; movies sharing input share frames)" ENDL
+" --verify-jobs N            worker processes for --verify-movie; default one per core" ENDL
+" --verify-out DIR           where --verify-movie puts its results; default ." ENDL
+" --verify-baseline DIR      compare the results with an earlier --verify-out" ENDL
 ENDL
 "Arguments affecting video filters:" ENDL
 " --scanline-filter-a N      Fadeout intensity (N/16) (topleft) (default 0)" ENDL
@@ -138,14 +144,19 @@ ENDL
 " --scanline-filter-c N      Fadeout intensity (N/16) (bottomleft) (default 2)" ENDL
 " --scanline-filter-d N      Fadeout intensity (N/16) (bottomright) (default 4)" ENDL
 ENDL
-#ifdef GDB_STUB
 "Arguments affecting debugging features:" ENDL
+#ifdef GDB_STUB
 " --arm9gdb PORTNUM          Enable the ARM9 GDB stub on the given port" ENDL
 " --arm7gdb PORTNUM          Enable the ARM7 GDB stub on the given port" ENDL
-ENDL
 #endif
+" --profile-guest FILE       Sample where guest code spends host time; report to FILE at exit" ENDL
+" --profile-symbols FILE     Name ARM9 addresses in the report from an ELF or nm-style map" ENDL
+"                            (may be given once per overlay)" ENDL
+" --profile-symbols7 FILE    The same for ARM7" ENDL
+ENDL
 "Utility commands which occur in place of emulation:" ENDL
 " --advanscene-import PATH   Import advanscene, dump .ddb, and exit" ENDL
+" --compress-rom PATH        Convert a rom to a block compressed .ndz, and exit" ENDL
 ENDL
 "These arguments may be reorganized/renamed in the future." ENDL
 ;
@@ -166,6 +177,10 @@ ENDL
 #define OPT_LOAD_SLOT 400
 #define OPT_PLAY_MOVIE 410
 #define OPT_RECORD_MOVIE 411
+#define OPT_VERIFY_MOVIE 420
+#define OPT_VERIFY_JOBS 421
+#define OPT_VERIFY_OUT 422
+#define OPT_VERIFY_BASELINE 423
 
 #define OPT_SLOT2_CFLASH_IMAGE 500
 #define OPT_SLOT2_CFLASH_DIR 501
@@ -178,8 +193,12 @@ ENDL
 
 #define OPT_ARM9GDB 700
 #define OPT_ARM7GDB 701
+#define OPT_PROFILE_GUEST 710
+#define OPT_PROFILE_SYMBOLS 711
+#define OPT_PROFILE_SYMBOLS7 712
 
 #define OPT_ADVANSCENE 900
+#define OPT_COMPRESS_ROM 901
 
 bool CommandLine::parse(int argc,char **argv)
 {
@@ -234,6 +253,10 @@ bool CommandLine::parse(int argc,char **argv)
 			{ "load-slot", required_argument, nullptr, OPT_LOAD_SLOT},
 			{ "play-movie", required_argument, nullptr, OPT_PLAY_MOVIE},
 			{ "record-movie", required_argument, nullptr, OPT_RECORD_MOVIE},
+			{ "verify-movie", required_argument, nullptr, OPT_VERIFY_MOVIE},
+			{ "verify-jobs", required_argument, nullptr, OPT_VERIFY_JOBS},
+			{ "verify-out", required_argument, nullptr, OPT_VERIFY_OUT},
+			{ "verify-baseline", required_argument, nullptr, OPT_VERIFY_BASELINE},
 
 			//video filters
 			{ "scanline-filter-a", required_argument, nullptr, OPT_SCANLINES_A},
@@ -246,9 +269,13 @@ bool CommandLine::parse(int argc,char **argv)
 				{ "arm9gdb", required_argument, nullptr, OPT_ARM9GDB},
 				{ "arm7gdb", required_argument, nullptr, OPT_ARM7GDB},
 			#endif
+			{ "profile-guest", required_argument, nullptr, OPT_PROFILE_GUEST},
+			{ "profile-symbols", required_argument, nullptr, OPT_PROFILE_SYMBOLS},
+			{ "profile-symbols7", required_argument, nullptr, OPT_PROFILE_SYMBOLS7},
 
 			//utilities
 			{ "advanscene-import", required_argument, nullptr, OPT_ADVANSCENE},
+			{ "compress-rom", required_argument, nullptr, OPT_COMPRESS_ROM},
 				
 			{0,0,0,0}
 		};
@@ -286,6 +313,10 @@ bool CommandLine::parse(int argc,char **argv)
 		case OPT_LOAD_SLOT: load_slot = atoi(optarg);  break;
 		case OPT_PLAY_MOVIE: play_movie_file = optarg; break;
 		case OPT_RECORD_MOVIE: record_movie_file = optarg; break;
+		case OPT_VERIFY_MOVIE: verify_movie_files.push_back(optarg); break;
+		case OPT_VERIFY_JOBS: verify_jobs = atoi(optarg); break;
+		case OPT_VERIFY_OUT: verify_out_dir = optarg; break;
+		case OPT_VERIFY_BASELINE: verify_baseline_dir = optarg; break;
 
 		//video filters
 		case OPT_SCANLINES_A: _scanline_filter_a = atoi(optarg); break;
@@ -296,9 +327,13 @@ bool CommandLine::parse(int argc,char **argv)
 		//debugging
 		case OPT_ARM9GDB: arm9_gdb_port = atoi(optarg); break;
 		case OPT_ARM7GDB: arm7_gdb_port = atoi(optarg); break;
+		case OPT_PROFILE_GUEST: CommonSettings.guest_profile_report = optarg; break;
+		case OPT_PROFILE_SYMBOLS: CommonSettings.guest_profile_symbols[0].push_back(optarg); break;
+		case OPT_PROFILE_SYMBOLS7: CommonSettings.guest_profile_symbols[1].push_back(optarg); break;
 
 		//utilities
 		case OPT_ADVANSCENE: CommonSettings.run_advanscene_import = optarg; break;
+		case OPT_COMPRESS_ROM: CommonSettings.run_compress_rom = optarg; break;
 		}
 	} //arg parsing loop
 
@@ -407,6 +442,16 @@ bool CommandLine::validate()
 		return false;
 	}
 
+	if(!verify_movie_files.empty() && (play_movie_file != "" || record_movie_file != "")) {
+		printerror("Cannot verify movies while playing or recording one.\n");
+		return false;
+	}
+
+	if(!verify_movie_files.empty() && nds_file == "") {
+		printerror("Verifying movies needs a ROM.\n");
+		return false;
+	}
+
 	if(cflash_path != "" && cflash_image != "") {
 		printerror("Cannot specify both cflash-image and cflash-path.\n");
 		return false;
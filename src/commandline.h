@@ -19,6 +19,7 @@
 #define _COMMANDLINE_H_
 
 #include <string>
+#include <vector>
 #include "types.h"
 
 //hacky commandline options that i didnt want to route through commonoptions
@@ -38,6 +39,10 @@ public:
 	std::string nds_file;
 	std::string play_movie_file;
 	std::string record_movie_file;
+	std::vector<std::string> verify_movie_files;
+	int verify_jobs;
+	std::string verify_out_dir;
+	std::string verify_baseline_dir;
 	int arm9_gdb_port, arm7_gdb_port;
 	int start_paused;
 	std::string cflash_image;
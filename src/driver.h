@@ -55,6 +55,10 @@ public:
 	virtual bool EMU_IsFastForwarding() { return false; }
 	virtual bool EMU_HasEmulationStarted() { return true; }
 	virtual bool EMU_IsAtFrameBoundary() { return true; }
+
+	//a monotonic clock for the core to time itself with (see CommonSettings.autoFrameSkip). 0 ticks per second means there isn't one
+	virtual u64 EMU_GetTicks() { return 0; }
+	virtual u64 EMU_GetTicksPerSecond() { return 0; }
 	
 	virtual void EMU_DebugIdleEnter() {}
 	virtual void EMU_DebugIdleUpdate() {}
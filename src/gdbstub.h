@@ -27,8 +27,18 @@ struct armcpu_memory_iface;
 
 void gdbstub_mutex_init();
 void gdbstub_mutex_destroy();
-void gdbstub_mutex_lock();
-void gdbstub_mutex_unlock();
+
+/*
+ * The emulator side of the command queue. Stub commands touch the emulated
+ * machine only where it is safe: NDS_exec brackets its work with
+ * gdbstub_exec_begin/end, and while it is inside, commands wait in the queue
+ * until it calls gdbstub_service_commands() between work units (or until
+ * gdbstub_exec_end). Outside NDS_exec the stub threads run them directly.
+ */
+extern volatile int gdbstub_commands_pending;
+void gdbstub_exec_begin();
+void gdbstub_exec_end();
+void gdbstub_service_commands();
 
 /*
  * The function interface
@@ -48,7 +48,31 @@
 #endif
 #endif // HOST_WINDOWS
 
-slock *cpu_mutex = NULL;
+/*
+ * The command queue. Packets which touch the emulated machine are run as
+ * commands: on the stub thread while the emulator is outside NDS_exec, else
+ * queued for the emulator to run between work units.
+ */
+struct gdb_command {
+  struct gdb_command *next;
+  struct gdb_stub_state *stub;
+  const uint8_t *packet;
+  uint32_t packet_len;
+  uint8_t *out_ptr;
+  uint32_t send_size;
+  int send_reply;
+  int done;
+};
+
+static slock_t *command_lock = NULL;
+static scond_t *command_cond = NULL;
+static struct gdb_command *command_queue = NULL;
+/** set while the emulator is inside NDS_exec */
+static int emu_executing = 0;
+/** set while a stub thread runs a command itself */
+static int stub_executing = 0;
+
+volatile int gdbstub_commands_pending = 0;
 
 #ifdef __GNUC__
 #define UNUSED_PARM( parm) parm __attribute__((unused))
@@ -152,36 +176,118 @@ enum target_signal
 // Try defining/undefining this, if you have problems with the GDB stub on Windows.
 #define USE_MUTEX_ON_WINDOWS
 
+static int executePacket_gdb( struct gdb_stub_state *stub, const uint8_t *packet,
+                              uint32_t packet_len, uint8_t *out_ptr, uint32_t *send_size);
+
 void gdbstub_mutex_init()
 {
-  if (cpu_mutex != NULL)
+  if (command_lock != NULL)
   {
     gdbstub_mutex_destroy();
   }
 	
-  cpu_mutex = slock_new();
+  command_lock = slock_new();
+  command_cond = scond_new();
 }
 
 void gdbstub_mutex_destroy()
 {
-  slock_free(cpu_mutex);
-  cpu_mutex = NULL;
+  scond_free(command_cond);
+  slock_free(command_lock);
+  command_cond = NULL;
+  command_lock = NULL;
+  command_queue = NULL;
+  gdbstub_commands_pending = 0;
 }
 
-void gdbstub_mutex_lock()
-{
-  if (cpu_mutex != NULL)
-  {
-    slock_lock(cpu_mutex);
+static void
+runCommand_gdb( struct gdb_command *cmd) {
+  cmd->send_reply = executePacket_gdb( cmd->stub, cmd->packet, cmd->packet_len,
+                                       cmd->out_ptr, &cmd->send_size);
+  cmd->done = 1;
+}
+
+/* run everything queued; called with command_lock held */
+static void
+runQueuedCommands_gdb( void) {
+  while ( command_queue != NULL) {
+    struct gdb_command *cmd = command_queue;
+    command_queue = cmd->next;
+    runCommand_gdb( cmd);
   }
+  gdbstub_commands_pending = 0;
+  scond_broadcast( command_cond);
 }
 
-void gdbstub_mutex_unlock()
-{
-  if (cpu_mutex != NULL)
-  {
-    slock_unlock(cpu_mutex);
+/* runs cmd and waits for it to finish, on whichever thread may touch the machine */
+static void
+postCommand_gdb( struct gdb_command *cmd) {
+  cmd->next = NULL;
+  cmd->done = 0;
+
+  if ( command_lock == NULL) {
+    runCommand_gdb( cmd);
+    return;
   }
+
+  slock_lock( command_lock);
+
+  struct gdb_command **tail = &command_queue;
+  while ( *tail != NULL)
+    tail = &(*tail)->next;
+  *tail = cmd;
+  gdbstub_commands_pending = 1;
+
+  while ( !cmd->done) {
+    if ( !emu_executing && !stub_executing) {
+      /* the emulator isn't running, so take the command back and run it here */
+      for ( tail = &command_queue; *tail != cmd; tail = &(*tail)->next)
+        ;
+      *tail = cmd->next;
+      gdbstub_commands_pending = command_queue != NULL;
+
+      stub_executing = 1;
+      slock_unlock( command_lock);
+      runCommand_gdb( cmd);
+      slock_lock( command_lock);
+      stub_executing = 0;
+      scond_broadcast( command_cond);
+      break;
+    }
+    scond_wait( command_cond, command_lock);
+  }
+
+  slock_unlock( command_lock);
+}
+
+void gdbstub_exec_begin()
+{
+  if (command_lock == NULL) return;
+
+  slock_lock(command_lock);
+  while (stub_executing)
+    scond_wait(command_cond, command_lock);
+  emu_executing = 1;
+  slock_unlock(command_lock);
+}
+
+void gdbstub_exec_end()
+{
+  if (command_lock == NULL) return;
+
+  slock_lock(command_lock);
+  runQueuedCommands_gdb();
+  emu_executing = 0;
+  slock_unlock(command_lock);
+}
+
+void gdbstub_service_commands()
+{
+  if (command_lock == NULL) return;
+
+  slock_lock(command_lock);
+  runQueuedCommands_gdb();
+  slock_unlock(command_lock);
 }
 
 static void
@@ -261,7 +367,11 @@ step_instruction_watch( void *data, uint32_t addr, UNUSED_PARM(int thunmb)) {
 /************************************************************************/
 /* BUFMAX defines the maximum number of characters in inbound/outbound buffers*/
 /* at least NUMREGBYTES*2 are needed for register packets */
-#define BUFMAX 2048
+#define BUFMAX BUFMAX_GDB
+/* the largest packet we take from gdb, as told to it in qSupported */
+#define PACKET_SIZE_GDB (BUFMAX - 2)
+/* the most memory one 'm' reply can carry, as hex plus the packet framing */
+#define MAX_MEM_READ_GDB ((BUFMAX - 8) / 2)
 
 
 
@@ -330,19 +440,52 @@ hexToInt( const uint8_t **ptr, uint32_t *intValue)
  * a 0, else treat a fault like any other fault in the stub.
  */
 
+static u8 *
+getHostSpan_gdb( struct gdb_stub_state *stub, uint32_t addr, uint32_t len,
+                 int write, uint32_t *span_len) {
+  u32 spanLen = 0;
+  u8 *ptr;
+
+  /* debugger writes land whole, as a 32bit store would */
+  if ( stub->procnum == ARMCPU_ARM7)
+    ptr = MMU_GetHostSpan<ARMCPU_ARM7,MMU_AT_DEBUG>( addr, len, write ? 32 : 0, spanLen);
+  else
+    ptr = MMU_GetHostSpan<ARMCPU_ARM9,MMU_AT_DEBUG>( addr, len, write ? 32 : 0, spanLen);
+
+  *span_len = spanLen;
+  return ptr;
+}
+
 static uint8_t *
-mem2hex ( armcpu_memory_iface *memio, uint32_t mem_addr,
-          uint8_t *buf, int count)
+mem2hex ( struct gdb_stub_state *stub, uint32_t mem_addr,
+          uint8_t *buf, uint32_t count)
 {
-  uint8_t ch;
+  armcpu_memory_iface *memio = stub->direct_memio;
 
   //set_mem_fault_trap(may_fault);
 
-  while (count-- > 0)
+  while (count > 0)
     {
-      ch = memio->read8( memio->data, mem_addr++);
+      /* ram, vram and friends are copied straight out of host memory */
+      uint32_t span_len;
+      const u8 *span = getHostSpan_gdb( stub, mem_addr, count, 0, &span_len);
+
+      if ( span != NULL) {
+        uint32_t i;
+        for ( i = 0; i < span_len; i++) {
+          *buf++ = hexchars[span[i] >> 4];
+          *buf++ = hexchars[span[i] & 0xf];
+        }
+        mem_addr += span_len;
+        count -= span_len;
+        continue;
+      }
+
+      /* the rest goes through the memory interface */
+      uint8_t ch = memio->read8( memio->data, mem_addr++);
       *buf++ = hexchars[ch >> 4];
       *buf++ = hexchars[ch & 0xf];
+      count--;
     }
 
   *buf = 0;
@@ -350,6 +493,115 @@ mem2hex ( armcpu_memory_iface *memio, uint32_t mem_addr,
   return buf;
 }
 
+/* write count bytes from mem (already decoded) to the emulated memory */
+static void
+writeMem_gdb( struct gdb_stub_state *stub, uint32_t addr,
+              const uint8_t *mem, uint32_t count) {
+  armcpu_memory_iface *memio = stub->direct_memio;
+
+  while ( count > 0) {
+    uint32_t span_len;
+    u8 *span = getHostSpan_gdb( stub, addr, count, 1, &span_len);
+
+    if ( span != NULL) {
+      memcpy( span, mem, span_len);
+      addr += span_len;
+      mem += span_len;
+      count -= span_len;
+      continue;
+    }
+
+    memio->write8( memio->data, addr++, *mem++);
+    count--;
+  }
+}
+
+/*
+ * Decode the binary data of an 'X' packet, where '}' escapes the following
+ * byte (xored with 0x20). Returns the number of packet bytes used, or -1 if
+ * the packet ran out first.
+ */
+static int
+unescapeBinary_gdb( const uint8_t *buf, uint32_t buf_len,
+                    uint8_t *mem, uint32_t count) {
+  uint32_t in_index = 0;
+  uint32_t i;
+
+  for ( i = 0; i < count; i++) {
+    if ( in_index >= buf_len)
+      return -1;
+
+    if ( buf[in_index] == 0x7d) {
+      if ( in_index + 1 >= buf_len)
+        return -1;
+      mem[i] = buf[in_index + 1] ^ 0x20;
+      in_index += 2;
+    }
+    else {
+      mem[i] = buf[in_index++];
+    }
+  }
+
+  return in_index;
+}
+
+/*
+ * The memory map handed to gdb through qXfer:memory-map:read. It has to
+ * cover everything gdb may want to look at, since it won't touch memory
+ * outside it.
+ */
+struct memory_region_gdb {
+  const char *type;
+  uint32_t start;
+  uint32_t length;
+};
+
+static const struct memory_region_gdb arm9_memory_map[] = {
+  { "ram", 0x00000000, 0x02000000 }, /* itcm (and dtcm, wherever it is) */
+  { "ram", 0x02000000, 0x01000000 }, /* main memory */
+  { "ram", 0x03000000, 0x01000000 }, /* shared wram */
+  { "ram", 0x04000000, 0x01000000 }, /* io */
+  { "ram", 0x05000000, 0x01000000 }, /* palettes */
+  { "ram", 0x06000000, 0x01000000 }, /* vram */
+  { "ram", 0x07000000, 0x01000000 }, /* oam */
+  { "rom", 0x08000000, 0x02000000 }, /* slot2 rom */
+  { "ram", 0x0A000000, 0x06000000 }, /* slot2 ram, and where dtcm likes to go */
+  { "rom", 0xFFFF0000, 0x00010000 }, /* bios */
+  { NULL, 0, 0 }
+};
+
+static const struct memory_region_gdb arm7_memory_map[] = {
+  { "rom", 0x00000000, 0x00004000 }, /* bios */
+  { "ram", 0x02000000, 0x01000000 }, /* main memory */
+  { "ram", 0x03000000, 0x01000000 }, /* shared and arm7 wram */
+  { "ram", 0x04000000, 0x01000000 }, /* io and wifi */
+  { "ram", 0x06000000, 0x01000000 }, /* vram mapped as wram */
+  { "rom", 0x08000000, 0x02000000 }, /* slot2 rom */
+  { "ram", 0x0A000000, 0x01000000 }, /* slot2 ram */
+  { NULL, 0, 0 }
+};
+
+static int
+makeMemoryMap_gdb( struct gdb_stub_state *stub, char *buf, int size) {
+  const struct memory_region_gdb *region =
+    stub->procnum == ARMCPU_ARM7 ? arm7_memory_map : arm9_memory_map;
+  int len;
+
+  len = snprintf( buf, size,
+                  "<?xml version=\"1.0\"?>\n"
+                  "<!DOCTYPE memory-map PUBLIC \"+//IDN gnu.org//DTD GDB Memory Map V1.0//EN\""
+                  " \"http://sourceware.org/gdb/gdb-memory-map.dtd\">\n"
+                  "<memory-map>\n");
+  for ( ; region->type != NULL; region++) {
+    len += snprintf( buf + len, size - len,
+                     "  <memory type=\"%s\" start=\"0x%08x\" length=\"0x%x\"/>\n",
+                     region->type, region->start, region->length);
+  }
+  len += snprintf( buf + len, size - len, "</memory-map>\n");
+
+  return len;
+}
+
 
 
 static enum read_res_gdb
@@ -561,20 +813,15 @@ make_stop_packet( uint8_t *ptr, enum stop_type type, uint32_t stop_address) {
 }
 
 /**
- * Returns -1 if there is a socket error.
+ * Carry out a packet, leaving the reply at out_ptr.
+ * Returns non-zero if the reply should be sent.
  */
 static int
-processPacket_gdb( SOCKET_TYPE sock, const uint8_t *packet,
-		   struct gdb_stub_state *stub) {
-  //  uint8_t remcomOutBuffer[BUFMAX_GDB];
-  struct debug_out_packet *out_packet = getOutPacket();
-  uint8_t *out_ptr = out_packet->start_ptr;
+executePacket_gdb( struct gdb_stub_state *stub, const uint8_t *packet,
+                   uint32_t packet_len, uint8_t *out_ptr, uint32_t *reply_size) {
   int send_reply = 1;
   uint32_t send_size = 0;
 
-  DEBUG_LOG("Processing packet %c\n", packet[0]);
-  gdbstub_mutex_lock();
-
   switch( packet[0]) {
   case 3:
     /* The break command */
@@ -669,7 +916,10 @@ processPacket_gdb( SOCKET_TYPE sock, const uint8_t *packet,
       if ( *rx_ptr++ == ',') {
         if ( hexToInt( &rx_ptr, &length)) {
           //DEBUG_LOG("mem read from %08x (%d)\n", addr, length);
-          if ( !mem2hex( stub->direct_memio, addr, out_ptr, length)) {
+          /* gdb takes a short read and asks again for the rest */
+          if ( length > MAX_MEM_READ_GDB)
+            length = MAX_MEM_READ_GDB;
+          if ( !mem2hex( stub, addr, out_ptr, length)) {
             strcpy ( (char *)out_ptr, "E03");
             send_size = 3;
           }
@@ -696,20 +946,25 @@ processPacket_gdb( SOCKET_TYPE sock, const uint8_t *packet,
     if ( hexToInt(&rx_ptr, &addr)) {
       if ( *rx_ptr++ == ',') {
         if ( hexToInt(&rx_ptr, &length)) {
-          if ( *rx_ptr++ == ':') {
-            uint8_t write_byte;
-            unsigned int i;
+          /* compared this way round so that a huge length can't wrap past the check */
+          if ( *rx_ptr++ == ':' &&
+               (uint32_t)(rx_ptr - packet) <= packet_len &&
+               length <= (packet_len - (uint32_t)(rx_ptr - packet)) / 2) {
+            uint8_t write_bytes[256];
             DEBUG_LOG("Memory write of %d bytes to %08x\n",
                       length, addr);
 
-            for ( i = 0; i < length; i++) {
-              rx_ptr = hex2mem( rx_ptr, &write_byte, 1);
+            while ( length > 0) {
+              uint32_t chunk = length < sizeof( write_bytes) ? length : sizeof( write_bytes);
 
-              stub->direct_memio->write8( stub->direct_memio->data,
-                                         addr++, write_byte);
+              rx_ptr = hex2mem( rx_ptr, write_bytes, chunk);
+              writeMem_gdb( stub, addr, write_bytes, chunk);
+              addr += chunk;
+              length -= chunk;
             }
 
             strcpy( (char *)out_ptr, "OK");
+            send_size = 2;
             error01 = 0;
           }
         }
@@ -727,10 +982,92 @@ processPacket_gdb( SOCKET_TYPE sock, const uint8_t *packet,
 
     if ( error01) {
       strcpy( (char *)out_ptr, "E02");
+      send_size = 3;
+    }
+    break;
+  }
+
+    /* XAA..AA,LLLL:<binary data>: Write LLLL bytes at address AA.AA return OK */
+  case 'X': {
+    const uint8_t *rx_ptr = &packet[1];
+    uint32_t addr = 0;
+    uint32_t length = 0;
+    int error01 = 1;
+
+    /* every byte takes at least one character of data, so a length beyond that is refused
+       up front rather than after part of it was written */
+    if ( hexToInt( &rx_ptr, &addr) && *rx_ptr++ == ',' &&
+         hexToInt( &rx_ptr, &length) && *rx_ptr++ == ':' &&
+         (uint32_t)(rx_ptr - packet) <= packet_len &&
+         length <= packet_len - (uint32_t)(rx_ptr - packet)) {
+      uint32_t data_len = packet_len - (uint32_t)(rx_ptr - packet);
+      uint8_t write_bytes[256];
+
+      /* a zero length write is gdb asking whether we take 'X' at all */
+      error01 = 0;
+      while ( length > 0) {
+        uint32_t chunk = length < sizeof( write_bytes) ? length : sizeof( write_bytes);
+        int used = unescapeBinary_gdb( rx_ptr, data_len, write_bytes, chunk);
+
+        if ( used < 0) {
+          error01 = 1;
+          break;
+        }
+        writeMem_gdb( stub, addr, write_bytes, chunk);
+        rx_ptr += used;
+        data_len -= used;
+        addr += chunk;
+        length -= chunk;
+      }
+    }
+
+    if ( error01) {
+      strcpy( (char *)out_ptr, "E02");
+      send_size = 3;
+    }
+    else {
+      strcpy( (char *)out_ptr, "OK");
+      send_size = 2;
     }
     break;
   }
 
+  case 'q':
+    if ( strncmp( (const char *)packet, "qSupported", 10) == 0) {
+      send_size = sprintf( (char *)out_ptr, "PacketSize=%x;qXfer:memory-map:read+",
+                           PACKET_SIZE_GDB);
+    }
+    else if ( strncmp( (const char *)packet, "qXfer:memory-map:read::", 23) == 0) {
+      /* qXfer:memory-map:read::OFFSET,LENGTH */
+      const uint8_t *rx_ptr = &packet[23];
+      uint32_t offset = 0;
+      uint32_t length = 0;
+
+      if ( hexToInt( &rx_ptr, &offset) && *rx_ptr++ == ',' &&
+           hexToInt( &rx_ptr, &length)) {
+        char map[2048];
+        uint32_t map_len = makeMemoryMap_gdb( stub, map, sizeof( map));
+
+        if ( length > BUFMAX - 8)
+          length = BUFMAX - 8;
+        if ( offset > map_len)
+          offset = map_len;
+        if ( length > map_len - offset)
+          length = map_len - offset;
+
+        /* 'l' marks the last piece; the map has nothing that needs escaping */
+        out_ptr[0] = offset + length < map_len ? 'm' : 'l';
+        memcpy( &out_ptr[1], &map[offset], length);
+        send_size = length + 1;
+      }
+      else {
+        strcpy( (char *)out_ptr, "E01");
+        send_size = 3;
+      }
+    }
+    /* anything else is unsupported, which is an empty reply */
+    break;
+
   case 'Z':
   case 'z': {
     const uint8_t *rx_ptr = &packet[2];
@@ -946,10 +1283,30 @@ processPacket_gdb( SOCKET_TYPE sock, const uint8_t *packet,
     break;
   }
 
-  gdbstub_mutex_unlock();
+  *reply_size = send_size;
+  return send_reply;
+}
+
+/**
+ * Returns -1 if there is a socket error.
+ */
+static int
+processPacket_gdb( SOCKET_TYPE sock, const uint8_t *packet, uint32_t packet_len,
+		   struct gdb_stub_state *stub) {
+  struct debug_out_packet *out_packet = getOutPacket();
+  struct gdb_command cmd;
+
+  DEBUG_LOG("Processing packet %c\n", packet[0]);
+
+  cmd.stub = stub;
+  cmd.packet = packet;
+  cmd.packet_len = packet_len;
+  cmd.out_ptr = out_packet->start_ptr;
+  cmd.send_size = 0;
+  postCommand_gdb( &cmd);
 
-  if ( send_reply) {
-    return putpacket( sock, out_packet, send_size);
+  if ( cmd.send_reply) {
+    return putpacket( sock, out_packet, cmd.send_size);
   }
 
   return 0;
@@ -1251,9 +1608,9 @@ WINAPI listenerThread_gdb( void *data) {
               if ( write_res != 1) {
                 close_socket = 1;
               }
-              else {
+              else if ( process_packet) {
                 if ( processPacket_gdb( gdb_sock, state->rx_packet.buffer,
-                                        state) == -1) {
+                                        state->rx_packet.pos_index, state) == -1) {
                   close_socket = 1;
                 }
               }
@@ -1502,6 +1859,7 @@ createStub_gdb( uint16_t port,
 
   stub = new gdb_stub_state;
   stub->arm_cpu_object = theCPU;
+  stub->procnum = theCPU == &NDS_ARM7 ? ARMCPU_ARM7 : ARMCPU_ARM9;
   stub->active = 0;
 
   /* keep the memory interfaces */
@@ -71,7 +71,7 @@ struct breakpoint_gdb {
 
 /*
  */
-#define BUFMAX_GDB 2048
+#define BUFMAX_GDB 0x4000
 
 struct packet_reader_gdb {
   int state;
@@ -100,6 +100,9 @@ struct gdb_stub_state {
   
   void *arm_cpu_object;
 
+  /** ARMCPU_ARM9 or ARMCPU_ARM7, for the bulk memory paths */
+  int procnum;
+
   /** the id of the cpu the is under control */
   //u32 cpu_id;
 
@@ -53,6 +53,7 @@
 #include "readwrite.h"
 #include "FIFO.h"
 #include "movie.h" //only for currframecounter which really ought to be moved into the core emu....
+#include "utils/trace.h"
 
 //#define _SHOW_VTX_COUNTERS	// show polygon/vertex counters on screen
 #ifdef _SHOW_VTX_COUNTERS
@@ -425,6 +426,14 @@ int			polygonListCompleted = 0;
 static int listTwiddle = 1;
 static u8 triStripToggle;
 
+//the last frame that the renderer actually drew. a frame that flushes the same geometry with the same
+//state, tables and texture memory produces the same output, so its render can be skipped and the
+//output of the last one left in place.
+static bool isLastRenderedFrameValid = false;
+static u64 lastRenderedFrameHash = 0;
+static const Render3D *lastRenderedFrameRenderer = NULL;
+static const FragmentColor *lastRenderedFrameTarget = NULL;
+
 //list-building state
 struct tmpVertInfo
 {
@@ -671,6 +680,7 @@ void gfx3d_reset()
 	gfx3d->_videoFrameCount = 0;
 	gfx3d->render3DFrameCount = 0;
 	Render3DFramesPerSecond = 0;
+	isLastRenderedFrameValid = false;
 	
 	CurrentRenderer->Reset();
 }
@@ -2081,6 +2091,7 @@ static void gfx3d_execute(u8 cmd, u32 param)
 
 void gfx3d_execute3D()
 {
+	TRACE_ZONE("gfx3d_execute3D");
 	u8	cmd = 0;
 	u32	param = 0;
 
@@ -2146,6 +2157,148 @@ void gfx3d_glFlush(u32 v)
 	GFX_DELAY(1);
 }
 
+//64-bit FNV-1a, a word at a time. A collision leaves a stale frame on screen, so 32 bits isn't enough.
+//Structs are hashed field by field so that their padding, which is never written, doesn't leak into
+//the hash.
+static FORCEINLINE u64 gfx3d_HashU32(u64 hash, const u32 value)
+{
+	return (hash ^ value) * 0x00000100000001B3ULL;
+}
+
+static FORCEINLINE u64 gfx3d_HashFloat(u64 hash, const float value)
+{
+	u32 bits;
+	memcpy(&bits, &value, sizeof(u32));
+	return gfx3d_HashU32(hash, bits);
+}
+
+static FORCEINLINE u64 gfx3d_HashWords(u64 hash, const void *data, const size_t byteCount)
+{
+	const u32 *words = (const u32 *)data;
+	
+	for (size_t i = 0; i < byteCount / sizeof(u32); i++)
+		hash = gfx3d_HashU32(hash, words[i]);
+	
+	return hash;
+}
+
+static u64 gfx3d_HashVRAMSlot(u64 hash, const u8 *slot, const size_t pageCount)
+{
+	if (slot < MMU.ARM9_LCD || slot >= MMU.ARM9_LCD + sizeof(MMU.ARM9_LCD))
+		return hash;
+	
+	const size_t firstPage = (slot - MMU.ARM9_LCD) >> 14;
+	for (size_t i = 0; i < pageCount; i++)
+		hash = gfx3d_HashU32(hash, MMU.vramPageGen[(firstPage + i) & 63]);
+	
+	return hash;
+}
+
+static u64 gfx3d_HashPoly(u64 hash, const POLY &poly)
+{
+	hash = gfx3d_HashU32(hash, (u32)poly.type);
+	hash = gfx3d_HashU32(hash, (u32)poly.vtxFormat);
+	for (size_t i = 0; i < (size_t)poly.type; i++)
+		hash = gfx3d_HashU32(hash, poly.vertIndexes[i]);
+	hash = gfx3d_HashU32(hash, poly.polyAttr);
+	hash = gfx3d_HashU32(hash, poly.texParam);
+	hash = gfx3d_HashU32(hash, poly.texPalette);
+	hash = gfx3d_HashU32(hash, poly.viewport);
+	hash = gfx3d_HashFloat(hash, poly.miny);
+	hash = gfx3d_HashFloat(hash, poly.maxy);
+	
+	return hash;
+}
+
+static u64 gfx3d_HashVert(u64 hash, const VERT &vert)
+{
+	for (size_t i = 0; i < 4; i++)
+		hash = gfx3d_HashFloat(hash, vert.coord[i]);
+	hash = gfx3d_HashFloat(hash, vert.u);
+	hash = gfx3d_HashFloat(hash, vert.v);
+	for (size_t i = 0; i < 3; i++)
+	{
+		hash = gfx3d_HashFloat(hash, vert.fcolor[i]);
+		hash = gfx3d_HashU32(hash, vert.color[i]);
+	}
+	
+	return hash;
+}
+
+static u64 gfx3d_HashRenderState(u64 hash, const GFX3D_State &state)
+{
+	hash = gfx3d_HashU32(hash, state.savedDISP3DCNT.value);
+	hash = gfx3d_HashU32(hash, (state.enableTexturing     ? 0x01 : 0) |
+	                           (state.enableAlphaTest     ? 0x02 : 0) |
+	                           (state.enableAlphaBlending ? 0x04 : 0) |
+	                           (state.enableAntialiasing  ? 0x08 : 0) |
+	                           (state.enableEdgeMarking   ? 0x10 : 0) |
+	                           (state.enableClearImage    ? 0x20 : 0) |
+	                           (state.enableFog           ? 0x40 : 0) |
+	                           (state.enableFogAlphaOnly  ? 0x80 : 0) |
+	                           (state.wbuffer             ? 0x100 : 0) |
+	                           (state.sortmode            ? 0x200 : 0) |
+	                           (state.invalidateToon      ? 0x400 : 0));
+	hash = gfx3d_HashU32(hash, state.shading);
+	hash = gfx3d_HashU32(hash, state.alphaTestRef);
+	hash = gfx3d_HashU32(hash, state.activeFlushCommand);
+	hash = gfx3d_HashU32(hash, state.pendingFlushCommand);
+	hash = gfx3d_HashU32(hash, state.clearDepth);
+	hash = gfx3d_HashU32(hash, state.clearColor);
+	hash = gfx3d_HashU32(hash, state.fogColor);
+	hash = gfx3d_HashU32(hash, state.fogOffset);
+	hash = gfx3d_HashU32(hash, state.fogShift);
+	hash = gfx3d_HashWords(hash, state.u16ToonTable, sizeof(state.u16ToonTable));
+	hash = gfx3d_HashWords(hash, state.shininessTable, sizeof(state.shininessTable));
+	
+	// The fog density and edge mark color tables are read straight out of the registers.
+	hash = gfx3d_HashWords(hash, state.fogDensityTable, 32);
+	hash = gfx3d_HashWords(hash, state.edgeMarkColorTable, 8 * sizeof(u16));
+	
+	return hash;
+}
+
+static u64 gfx3d_ComputeFrameHash()
+{
+	const size_t polycount = gfx3d->polylist->count;
+	const size_t vertcount = gfx3d->vertlist->count;
+	u64 hash = 0xCBF29CE484222325ULL;
+	
+	hash = gfx3d_HashU32(hash, (u32)polycount);
+	for (size_t i = 0; i < polycount; i++)
+		hash = gfx3d_HashPoly(hash, gfx3d->polylist->list[i]);
+	hash = gfx3d_HashU32(hash, (u32)vertcount);
+	for (size_t i = 0; i < vertcount; i++)
+		hash = gfx3d_HashVert(hash, gfx3d->vertlist->list[i]);
+	hash = gfx3d_HashWords(hash, gfx3d->indexlist.list, polycount * sizeof(int));
+	
+	hash = gfx3d_HashRenderState(hash, gfx3d->renderState);
+	
+	// Texture memory is covered by the generations of the pages mapped to the texture and palette
+	// slots, which also covers the clear image.
+	hash = gfx3d_HashU32(hash, MMU.vramMapGen);
+	for (size_t i = 0; i < 4; i++)
+		hash = gfx3d_HashVRAMSlot(hash, MMU.texInfo.textureSlotAddr[i], 8);
+	for (size_t i = 0; i < 6; i++)
+		hash = gfx3d_HashVRAMSlot(hash, MMU.texInfo.texPalSlot[i], 1);
+	
+	// Every renderer setting the renderers read while drawing.
+	const u32 settings = (CommonSettings.GFX3D_TXTHack ? 0x01 : 0) |
+	                     (CommonSettings.GFX3D_LineHack ? 0x02 : 0) |
+	                     (CommonSettings.GFX3D_Renderer_TextureDeposterize ? 0x04 : 0) |
+	                     (CommonSettings.GFX3D_Renderer_TextureSmoothing ? 0x08 : 0) |
+	                     (CommonSettings.GFX3D_HighResolutionInterpolateColor ? 0x10 : 0) |
+	                     (CommonSettings.GFX3D_EdgeMark ? 0x20 : 0) |
+	                     (CommonSettings.GFX3D_Fog ? 0x40 : 0) |
+	                     (CommonSettings.GFX3D_Texture ? 0x80 : 0) |
+	                     (CommonSettings.GFX3D_Renderer_Multisample ? 0x100 : 0);
+	hash = gfx3d_HashU32(hash, settings);
+	hash = gfx3d_HashU32(hash, (u32)CommonSettings.GFX3D_Renderer_TextureScalingFactor);
+	hash = gfx3d_HashU32(hash, (u32)CommonSettings.GFX3D_Zelda_Shadow_Depth_Hack);
+	
+	return hash;
+}
+
 static inline bool gfx3d_ysort_compare_orig(int num1, int num2)
 {
 	const POLY &poly1 = polylist->list[num1];
@@ -2191,6 +2344,7 @@ static bool gfx3d_ysort_compare(int num1, int num2)
 
 static void gfx3d_doFlush()
 {
+	TRACE_ZONE("gfx3d_doFlush");
 	gfx3d->render3DFrameCount++;
 
 	//the renderer will get the lists we just built
@@ -2322,6 +2476,32 @@ void gfx3d_VBlankEndSignal(bool skipFrame)
 
 	drawPending = FALSE;
 	
+	if (CommonSettings.showGpu.main)
+	{
+		const u64 frameHash = gfx3d_ComputeFrameHash();
+		
+		if ( isLastRenderedFrameValid &&
+			(frameHash == lastRenderedFrameHash) &&
+			(lastRenderedFrameRenderer == CurrentRenderer) &&
+			(lastRenderedFrameTarget == GPU->GetEngineMain()->Get3DFramebufferRGBA6665()) )
+		{
+			// Nothing that the renderer reads has changed, so the last render (which may still be
+			// in flight) already has this frame's output.
+			gfx3d->render3DReusedFrameCount++;
+			gfx3d->render3DReusedPolyCount += gfx3d->polylist->count;
+			return;
+		}
+		
+		isLastRenderedFrameValid = true;
+		lastRenderedFrameHash = frameHash;
+		lastRenderedFrameRenderer = CurrentRenderer;
+		lastRenderedFrameTarget = GPU->GetEngineMain()->Get3DFramebufferRGBA6665();
+	}
+	else
+	{
+		isLastRenderedFrameValid = false;
+	}
+	
 	if (CurrentRenderer->GetRenderNeedsFinish())
 	{
 		CurrentRenderer->SetFramebufferFlushStates(false, false);
@@ -2542,6 +2722,10 @@ void gfx3d_Update3DFramebuffers(FragmentColor *framebufferRGBA6665, u16 *framebu
 {
 	_gfx3d_colorRGBA6665 = framebufferRGBA6665;
 	_gfx3d_colorRGBA5551 = framebufferRGBA5551;
+	
+	//a new render target doesn't hold the last render. every framebuffer resize and color format
+	//change comes through here, ahead of the renderer's own SetFramebufferSize().
+	isLastRenderedFrameValid = false;
 }
 
 //-------------savestate
@@ -2580,6 +2764,7 @@ bool gfx3d_loadstate(EMUFILE* is, int size)
 	if (read32le(&version,is) != 1) return false;
 	if (size == 8) version = 0;
 
+	isLastRenderedFrameValid = false;
 
 	gfx3d_glPolygonAttrib_cache();
 	gfx3d_glTexImage_cache();
@@ -2844,12 +3029,85 @@ typedef ClipperPlane<1,-1,Stage4> Stage3;        static Stage3 clipper3 (clipper
 typedef ClipperPlane<0, 1,Stage3> Stage2;        static Stage2 clipper2 (clipper3); // right plane
 typedef ClipperPlane<0,-1,Stage2> Stage1;        static Stage1 clipper  (clipper2); // left plane
 
+//one bit per clip plane, set when a vertex is outside of it
+enum
+{
+	CLIP_OUTCODE_LEFT	= 0x01,
+	CLIP_OUTCODE_RIGHT	= 0x02,
+	CLIP_OUTCODE_BOTTOM	= 0x04,
+	CLIP_OUTCODE_TOP	= 0x08,
+	CLIP_OUTCODE_NEAR	= 0x10,
+	CLIP_OUTCODE_FAR	= 0x20
+};
+
+//the side plane bits of a vertex against a frustum widened by sideScale
+static FORCEINLINE u8 clipSideOutcode(const VERT *vert, const float sideScale)
+{
+	const float sideLimit = vert->coord[3] * sideScale;
+	
+	return ((vert->coord[0] < -sideLimit) ? CLIP_OUTCODE_LEFT : 0) |
+	       ((vert->coord[0] >  sideLimit) ? CLIP_OUTCODE_RIGHT : 0) |
+	       ((vert->coord[1] < -sideLimit) ? CLIP_OUTCODE_BOTTOM : 0) |
+	       ((vert->coord[1] >  sideLimit) ? CLIP_OUTCODE_TOP : 0);
+}
+
+static FORCEINLINE u8 clipOutcode(const VERT *vert)
+{
+	return clipSideOutcode(vert, 1.0f) |
+	       ((vert->coord[2] < -vert->coord[3]) ? CLIP_OUTCODE_NEAR : 0) |
+	       ((vert->coord[2] >  vert->coord[3]) ? CLIP_OUTCODE_FAR : 0);
+}
+
 template<bool useHiResInterpolate>
 void GFX3D_Clipper::clipPoly(const POLY &poly, const VERT **verts)
 {
 	CLIPLOG("==Begin poly==\n");
 
 	const PolygonType type = poly.type;
+	
+	//decide the common cases from the vertex outcodes before running the plane chain
+	u8 orOutcode = 0;
+	u8 andOutcode = 0x3F;
+	bool isInsideGuardBand = true;
+	
+	for (size_t i = 0; i < type; i++)
+	{
+		const u8 outcode = clipOutcode(verts[i]);
+		orOutcode |= outcode;
+		andOutcode &= outcode;
+		isInsideGuardBand = isInsideGuardBand && (verts[i]->coord[3] > 0.0f) && (clipSideOutcode(verts[i], CLIPPER_GUARD_BAND_SCALE) == 0);
+	}
+	
+	//every vertex is outside of the same plane, so nothing is left
+	if (andOutcode != 0)
+		return;
+	
+	//the rasterizer scissors guard band polygons to the framebuffer, which is only the same as
+	//clipping them when the viewport covers the whole screen
+	bool isGuardBandAccept = this->useGuardBand && isInsideGuardBand && !(orOutcode & (CLIP_OUTCODE_NEAR | CLIP_OUTCODE_FAR));
+	if (isGuardBandAccept)
+	{
+		VIEWPORT viewport;
+		viewport.decode(poly.viewport);
+		isGuardBandAccept = (viewport.x == 0) && (viewport.y == 0) &&
+		                    (viewport.width == GPU_FRAMEBUFFER_NATIVE_WIDTH) && (viewport.height == GPU_FRAMEBUFFER_NATIVE_HEIGHT);
+	}
+	
+	if (orOutcode == 0 || isGuardBandAccept)
+	{
+		//the plane chain would hand these vertices back untouched, each plane starting the loop one
+		//vertex later, so emit them in the same order it would
+		TClippedPoly &outPoly = clippedPolys[clippedPolyCounter];
+		for (size_t i = 0; i < type; i++)
+			outPoly.clipVerts[i] = *verts[(i + 6) % type];
+		
+		outPoly.type = type;
+		outPoly.poly = (POLY *)&poly;
+		outPoly.needsScissor = (orOutcode != 0);
+		clippedPolyCounter++;
+		return;
+	}
+	
 	numScratchClipVerts = 0;
 
 	clipper.init(clippedPolys[clippedPolyCounter].clipVerts);
@@ -2868,6 +3126,7 @@ void GFX3D_Clipper::clipPoly(const POLY &poly, const VERT **verts)
 	{
 		clippedPolys[clippedPolyCounter].type = outType;
 		clippedPolys[clippedPolyCounter].poly = (POLY *)&poly;
+		clippedPolys[clippedPolyCounter].needsScissor = false;
 		clippedPolyCounter++;
 	}
 }
@@ -2965,6 +3224,7 @@ void GFX3D_Clipper::clipPoly(const POLY &poly, const VERT **verts)
 
 	
 	tempClippedPoly.type = type;
+	tempClippedPoly.needsScissor = false;
 
 	clipPolyVsPlane(0, -1); 
 	clipPolyVsPlane(0, 1);
@@ -608,6 +608,10 @@ struct VIEWPORT {
 //four corners of the hexagon, and you will observe a decagon
 #define MAX_CLIPPED_VERTS 10
 
+//polygons that only cross the side planes, and stay within this multiple of w, can be left unclipped
+//when the rasterizer scissors them instead
+#define CLIPPER_GUARD_BAND_SCALE 2.0f
+
 class GFX3D_Clipper
 {
 public:
@@ -616,8 +620,11 @@ public:
 	{
 		PolygonType type; //otherwise known as "count" of verts
 		POLY *poly;
+		bool needsScissor; //passed through the guard band, so it may reach outside the screen
 		VERT clipVerts[MAX_CLIPPED_VERTS];
 	};
+	
+	GFX3D_Clipper() : useGuardBand(false) {}
 
 	//the entry point for poly clipping
 	template<bool hirez> void clipPoly(const POLY &poly, const VERT **verts);
@@ -627,6 +634,9 @@ public:
 	TClippedPoly *clippedPolys;
 	size_t clippedPolyCounter;
 	void reset() { clippedPolyCounter=0; }
+	
+	//only for users that scissor what they draw. box tests need the exact result.
+	bool useGuardBand;
 
 private:
 	TClippedPoly tempClippedPoly;
@@ -712,7 +722,9 @@ struct GFX3D
 		: polylist(0)
 		, vertlist(0)
 		, _videoFrameCount(0)
-		, render3DFrameCount(0) {
+		, render3DFrameCount(0)
+		, render3DReusedFrameCount(0)
+		, render3DReusedPolyCount(0) {
 	}
 
 	//currently set values
@@ -727,6 +739,8 @@ struct GFX3D
 	
 	u32 _videoFrameCount;			// Internal variable that increments when a video frame is completed. Resets every 60 video frames.
 	u32 render3DFrameCount;			// Increments when gfx3d_doFlush() is called. Resets every 60 video frames.
+	u32 render3DReusedFrameCount;	// Increments when a frame is identical to the last rendered one and isn't rendered again.
+	u64 render3DReusedPolyCount;	// Polygons that didn't need to be rendered because their frame was reused.
 };
 extern GFX3D *gfx3d;
 extern u32 Render3DFramesPerSecond;	// save the current 3D rendering frame count to here every 60 video frames
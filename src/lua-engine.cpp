@@ -242,8 +242,37 @@ static const char* toCString(lua_State* L, int idx=0);
 
 static void CalculateMemHookRegions(LuaMemHookType hookType);
 
+// which cpus' accesses a hook is for: bit 0 for the arm9, bit 1 for the arm7 (whose hooks go in the _SUB tables).
+// without a cpu name (or with "main", which used to be ignored) it's both, as it always was.
+static int MatchHookCPUs(lua_State* L)
+{
+	int cpus = 3;
+
+	int cpunameIndex = 0;
+	if(lua_type(L,2) == LUA_TSTRING)
+		cpunameIndex = 2;
+	else if(lua_type(L,3) == LUA_TSTRING)
+		cpunameIndex = 3;
+
+	if(cpunameIndex)
+	{
+		const char* cpuName = lua_tostring(L, cpunameIndex);
+		if(!stricmp(cpuName, "arm9"))
+			cpus = 1;
+		else if(!stricmp(cpuName, "arm7"))
+			cpus = 2;
+		else if(stricmp(cpuName, "main"))
+			luaL_error(L, "unknown cpu name \"%s\" (expected \"arm9\" or \"arm7\")", cpuName);
+		lua_remove(L, cpunameIndex);
+	}
+
+	return cpus;
+}
+
 static int memory_registerHook(lua_State* L, LuaMemHookType hookType, int defaultSize)
 {
+	int cpus = MatchHookCPUs(L);
+
 	// get first argument: address
 	unsigned int addr = luaL_checkinteger(L,1);
 	//if((addr & ~0xFFFFFF) == ~0xFFFFFF)
@@ -269,92 +298,67 @@ static int memory_registerHook(lua_State* L, LuaMemHookType hookType, int defaul
 		luaL_checktype(L, funcIdx, LUA_TFUNCTION);
 	lua_settop(L,funcIdx);
 
-	// get the address-to-callback table for this hook type of the current script
-	lua_getfield(L, LUA_REGISTRYINDEX, luaMemHookTypeStrings[hookType]);
-
-	// count how many callback functions we'll be displacing
-	int numFuncsAfter = clearing ? 0 : size;
-	int numFuncsBefore = 0;
-	for(unsigned int i = addr; i != addr+size; i++)
-	{
-		lua_rawgeti(L, -1, i);
-		if(lua_isfunction(L, -1))
-			numFuncsBefore++;
-		lua_pop(L,1);
-	}
+	LuaContextInfo& info = GetCurrentInfo();
 
-	// put the callback function in the address slots
-	for(unsigned int i = addr; i != addr+size; i++)
+	for(int cpu = 0; cpu < 2; cpu++)
 	{
-		lua_pushvalue(L, -2);
-		lua_rawseti(L, -2, i);
-	}
-
-	// adjust the count of active hooks
-	LuaContextInfo& info = GetCurrentInfo();
-	info.numMemHooks += numFuncsAfter - numFuncsBefore;
+		if(!(cpus & (1 << cpu)))
+			continue;
+		LuaMemHookType cpuHookType = LuaMemHookTypeForCPU(cpu, hookType);
 
-	// re-cache regions of hooked memory across all scripts
-	CalculateMemHookRegions(hookType);
+		// get the address-to-callback table for this hook type of the current script
+		lua_getfield(L, LUA_REGISTRYINDEX, luaMemHookTypeStrings[cpuHookType]);
 
-	StopScriptIfFinished(luaStateToUIDMap[L->l_G->mainthread]);
-	return 0;
-}
+		// count how many callback functions we'll be displacing
+		int numFuncsAfter = clearing ? 0 : size;
+		int numFuncsBefore = 0;
+		for(unsigned int i = addr; i != addr+size; i++)
+		{
+			lua_rawgeti(L, -1, i);
+			if(lua_isfunction(L, -1))
+				numFuncsBefore++;
+			lua_pop(L,1);
+		}
 
-LuaMemHookType MatchHookTypeToCPU(lua_State* L, LuaMemHookType hookType)
-{
-	int cpuID = 0;
+		// put the callback function in the address slots
+		for(unsigned int i = addr; i != addr+size; i++)
+		{
+			lua_pushvalue(L, funcIdx);
+			lua_rawseti(L, -2, i);
+		}
+		lua_pop(L,1);
 
-	int cpunameIndex = 0;
-	if(lua_type(L,2) == LUA_TSTRING)
-		cpunameIndex = 2;
-	else if(lua_type(L,3) == LUA_TSTRING)
-		cpunameIndex = 3;
+		// adjust the count of active hooks
+		info.numMemHooks += numFuncsAfter - numFuncsBefore;
 
-	if(cpunameIndex)
-	{
-		const char* cpuName = lua_tostring(L, cpunameIndex);
-//		if(!stricmp(cpuName, "sub") || !stricmp(cpuName, "s68k"))
-//			cpuID = 1;
-		lua_remove(L, cpunameIndex);
+		// re-cache regions of hooked memory across all scripts
+		CalculateMemHookRegions(cpuHookType);
 	}
 
-//	switch(cpuID)
-//	{
-//	case 0: // m68k:
-//		return hookType;
-//
-//	case 1: // s68k:
-//		switch(hookType)
-//		{
-//		case LUAMEMHOOK_WRITE: return LUAMEMHOOK_WRITE_SUB;
-//		case LUAMEMHOOK_READ: return LUAMEMHOOK_READ_SUB;
-//		case LUAMEMHOOK_EXEC: return LUAMEMHOOK_EXEC_SUB;
-//		}
-//	}
-	return hookType;
+	StopScriptIfFinished(luaStateToUIDMap[L->l_G->mainthread]);
+	return 0;
 }
 
-DEFINE_LUA_FUNCTION(memory_registerwrite, "address,[size=1,][cpuname=\"main\",]func")
+DEFINE_LUA_FUNCTION(memory_registerwrite, "address,[size=1,][cpuname=\"arm9\"|\"arm7\",]func")
 {
 #ifndef HAVE_LUA
 	luaL_error(L, "memory.registerwrite failed: function is not available in this build.");
 #endif
-	return memory_registerHook(L, MatchHookTypeToCPU(L,LUAMEMHOOK_WRITE), 1);
+	return memory_registerHook(L, LUAMEMHOOK_WRITE, 1);
 }
-DEFINE_LUA_FUNCTION(memory_registerread, "address,[size=1,][cpuname=\"main\",]func")
+DEFINE_LUA_FUNCTION(memory_registerread, "address,[size=1,][cpuname=\"arm9\"|\"arm7\",]func")
 {
 #ifndef HAVE_LUA
 	luaL_error(L, "memory.registerread failed: function is not available in this build.");
 #endif
-	return memory_registerHook(L, MatchHookTypeToCPU(L,LUAMEMHOOK_READ), 1);
+	return memory_registerHook(L, LUAMEMHOOK_READ, 1);
 }
-DEFINE_LUA_FUNCTION(memory_registerexec, "address,[size=2,][cpuname=\"main\",]func")
+DEFINE_LUA_FUNCTION(memory_registerexec, "address,[size=2,][cpuname=\"arm9\"|\"arm7\",]func")
 {
 #ifndef HAVE_LUA
 	luaL_error(L, "memory.registerexec failed: function is not available in this build.");
 #endif
-	return memory_registerHook(L, MatchHookTypeToCPU(L,LUAMEMHOOK_EXEC), 2);
+	return memory_registerHook(L, LUAMEMHOOK_EXEC, 2);
 }
 
 DEFINE_LUA_FUNCTION(emu_registerbefore, "func")
@@ -5405,13 +5409,13 @@ void CloseLuaContext(int uid)
 }
 
 
-TieredRegion hookedRegions [LUAMEMHOOK_COUNT];
+LuaMemHookRegion hookedRegions [LUAMEMHOOK_COUNT];
+unsigned int luaMemHookMask = 0;
 
 
-// currently disabled for desmume,
-// and the performance hit might not be accepable
-// unless we can switch the emulation into a whole separate path
-// that has this callback enabled.
+// accesses nothing has hooked cost a test of luaMemHookMask, or of a page bit when
+// something of their type is hooked elsewhere; the exec hook test isn't even compiled
+// into the interpreter while no exec hooks are set (see armcpu_exec)
 static void CalculateMemHookRegions(LuaMemHookType hookType)
 {
 	std::vector<unsigned int> hookedBytes;
@@ -5444,6 +5448,11 @@ static void CalculateMemHookRegions(LuaMemHookType hookType)
 		++iter;
 	}
 	hookedRegions[hookType].Calculate(hookedBytes);
+
+	if(hookedRegions[hookType].islands.empty())
+		luaMemHookMask &= ~(1 << hookType);
+	else
+		luaMemHookMask |= 1 << hookType;
 }
 
 
@@ -70,7 +70,7 @@ enum LuaMemHookType
 
 	LUAMEMHOOK_COUNT
 };
-void CallRegisteredLuaMemHook(unsigned int address, int size, unsigned int value, LuaMemHookType hookType);
+void CallRegisteredLuaMemHook(const int PROCNUM, unsigned int address, int size, unsigned int value, LuaMemHookType hookType);
 
 struct LuaSaveData
 {
@@ -124,103 +124,121 @@ void DontWorryLua();
 //  otherwise it would definitely be too slow.)
 // calculating the regions when a hook is added/removed may be slow,
 // but this is an intentional tradeoff to obtain a high speed of checking during later execution
-struct TieredRegion
+//
+// an access first tests one bit per 4KB page of the address space; only accesses to a page with
+// a hook in it go on to the exact ranges.
+#define LUAMEMHOOK_PAGE_SHIFT 12
+
+struct LuaMemHookRegion
 {
-	template<unsigned int maxGap>
-	struct Region
+	struct Island
 	{
-		struct Island
-		{
-			unsigned int start;
-			unsigned int end;
-			FORCEINLINE bool Contains(unsigned int address, int size) const { return address < end && address+size > start; }
-		};
-		std::vector<Island> islands;
+		unsigned int start;
+		unsigned int end;
+		bool operator<(const Island& other) const { return start < other.start; }
+	};
+	std::vector<Island> islands; // sorted and disjoint
+	std::vector<unsigned int> pages; // the page bitmap, empty while nothing is hooked
 
-		void Calculate(const std::vector<unsigned int>& bytes)
-		{
-			islands.clear();
+	void Calculate(std::vector<unsigned int>& bytes)
+	{
+		std::sort(bytes.begin(), bytes.end());
 
-			unsigned int lastEnd = ~0;
+		islands.clear();
+		std::vector<unsigned int>().swap(pages);
+		if(bytes.empty())
+			return;
 
-			std::vector<unsigned int>::const_iterator iter = bytes.begin();
-			std::vector<unsigned int>::const_iterator end = bytes.end();
-			for(; iter != end; ++iter)
+		pages.resize(1 << (32 - LUAMEMHOOK_PAGE_SHIFT - 5), 0);
+		for(size_t i = 0; i < bytes.size(); i++)
+		{
+			unsigned int addr = bytes[i];
+			if(islands.empty() || addr > islands.back().end)
 			{
-				unsigned int addr = *iter;
-				if(addr < lastEnd || addr > lastEnd + (long long)maxGap)
-				{
-					islands.push_back(Island());
-					islands.back().start = addr;
-				}
-				islands.back().end = addr+1;
-				lastEnd = addr+1;
+				islands.push_back(Island());
+				islands.back().start = addr;
 			}
-		}
+			islands.back().end = addr+1;
 
-		bool Contains(unsigned int address, int size) const
-		{
-			typename std::vector<Island>::const_iterator iter = islands.begin();
-			typename std::vector<Island>::const_iterator end = islands.end();
-			for(; iter != end; ++iter)
-				if(iter->Contains(address, size))
-					return true;
-			return false;
+			unsigned int page = addr >> LUAMEMHOOK_PAGE_SHIFT;
+			pages[page >> 5] |= 1 << (page & 31);
 		}
-	};
-
-	Region<0xFFFFFFFF> broad;
-	Region<0x1000> mid;
-	Region<0> narrow;
+	}
 
-	void Calculate(std::vector<unsigned int>& bytes)
+	FORCEINLINE bool PageHit(unsigned int page) const
 	{
-		std::sort(bytes.begin(), bytes.end());
-
-		broad.Calculate(bytes);
-		mid.Calculate(bytes);
-		narrow.Calculate(bytes);
+		return (pages[page >> 5] >> (page & 31)) & 1;
 	}
 
-	TieredRegion()
+	// note: it is illegal to call these while nothing is hooked
+	FORCEINLINE bool PageHit(unsigned int address, int size) const
 	{
-		std::vector<unsigned int> somevector;
-		Calculate(somevector);
+		return PageHit(address >> LUAMEMHOOK_PAGE_SHIFT) || PageHit((address+size-1) >> LUAMEMHOOK_PAGE_SHIFT);
 	}
 
-	FORCEINLINE int NotEmpty()
+	bool SpanHit(unsigned int address, unsigned int len) const
 	{
-		return broad.islands.size();
+		unsigned int first = address >> LUAMEMHOOK_PAGE_SHIFT;
+		unsigned int last = (address+len-1) >> LUAMEMHOOK_PAGE_SHIFT;
+		for(unsigned int page = first; ; page++)
+		{
+			if(PageHit(page))
+				return true;
+			if(page == last)
+				return false;
+		}
 	}
 
-	// note: it is illegal to call this if NotEmpty() returns 0
-	FORCEINLINE bool Contains(unsigned int address, int size)
+	bool Contains(unsigned int address, int size) const
 	{
-		return broad.islands[0].Contains(address,size) &&
-		       mid.Contains(address,size) &&
-			   narrow.Contains(address,size);
+		// the last island starting at or before the access's last byte is the only one that can overlap it
+		Island key;
+		key.start = address+size-1;
+		std::vector<Island>::const_iterator iter = std::upper_bound(islands.begin(), islands.end(), key);
+		if(iter == islands.begin())
+			return false;
+		--iter;
+		return iter->end > address || iter->end == 0;
 	}
 };
-extern TieredRegion hookedRegions [LUAMEMHOOK_COUNT];
+extern LuaMemHookRegion hookedRegions [LUAMEMHOOK_COUNT];
+
+// bit n is set while anything is hooked for LuaMemHookType n.
+// the arm9's accesses check the plain types, the arm7's the _SUB ones.
+extern unsigned int luaMemHookMask;
+
+FORCEINLINE LuaMemHookType LuaMemHookTypeForCPU(const int PROCNUM, LuaMemHookType hookType)
+{
+	return PROCNUM ? (LuaMemHookType)(hookType + LUAMEMHOOK_WRITE_SUB) : hookType;
+}
+
+FORCEINLINE bool LuaMemHookActive(const int PROCNUM, LuaMemHookType hookType)
+{
+	return (luaMemHookMask >> LuaMemHookTypeForCPU(PROCNUM, hookType)) & 1;
+}
 
 void CallRegisteredLuaMemHook_LuaMatch(unsigned int address, int size, unsigned int value, LuaMemHookType hookType);
 
-FORCEINLINE void CallRegisteredLuaMemHook(unsigned int address, int size, unsigned int value, LuaMemHookType hookType)
+FORCEINLINE void CallRegisteredLuaMemHook(const int PROCNUM, unsigned int address, int size, unsigned int value, LuaMemHookType hookType)
 {
 	// performance critical! (called VERY frequently)
 	// I suggest timing a large number of calls to this function in Release if you change anything in here,
 	// before and after, because even the most innocent change can make it become 30% to 400% slower.
 	// a good amount to test is: 100000000 calls with no hook set, and another 100000000 with a hook set.
 	// (on my system that consistently took 200 ms total in the former case and 350 ms total in the latter case)
-	if(hookedRegions[hookType].NotEmpty())
+	if(LuaMemHookActive(PROCNUM, hookType))
 	{
-		//if((hookType <= LUAMEMHOOK_EXEC) && (address >= 0xE00000))
-		//	address |= 0xFF0000; // gens: account for mirroring of RAM
-		if(hookedRegions[hookType].Contains(address, size))
-			CallRegisteredLuaMemHook_LuaMatch(address, size, value, hookType); // something has hooked this specific address
+		const LuaMemHookType type = LuaMemHookTypeForCPU(PROCNUM, hookType);
+		if(hookedRegions[type].PageHit(address, size) && hookedRegions[type].Contains(address, size))
+			CallRegisteredLuaMemHook_LuaMatch(address, size, value, type); // something has hooked this specific address
 	}
 }
 
+// whether memory hooks of this type could see any of [address, address+len)
+FORCEINLINE bool LuaMemHookSpanHit(const int PROCNUM, unsigned int address, unsigned int len, LuaMemHookType hookType)
+{
+	return LuaMemHookActive(PROCNUM, hookType) && hookedRegions[LuaMemHookTypeForCPU(PROCNUM, hookType)].SpanHit(address, len);
+}
 
 #endif
 
@@ -62,6 +62,8 @@
 #include "MMU.h"
 #include "NDSSystem.h"
 #include "utils/task.h"
+#include "utils/simd.h"
+#include "utils/trace.h"
 
 //#undef FORCEINLINE
 //#define FORCEINLINE
@@ -341,6 +343,14 @@ protected:
 	VERT* verts[MAX_CLIPPED_VERTS];
 	int polynum;
 	
+	//set for polygons that came through the clipper's guard band, which have to be scissored
+	bool _needsScissor;
+	
+	//render state that stays fixed for the whole frame, read once in mainLoop()
+	bool _isWBuffer;
+	bool _isHighlightShading;
+	u8 _alphaTestRef;
+	
 public:
 	bool _debug_thisPoly;
 	int SLI_MASK;
@@ -419,9 +429,11 @@ public:
 			flip(val,height,hmask);
 		}
 		
+		//WRAP is the wrap mode when it is known at compile time, or -1 to read it from the sampler
+		template<int WRAP>
 		FORCEINLINE void dowrap(s32 &iu, s32 &iv)
 		{
-			switch (wrap)
+			switch ((WRAP < 0) ? wrap : WRAP)
 			{
 				//flip none
 				case 0x0: hclamp(iu); vclamp(iv); break;
@@ -447,6 +459,7 @@ public:
 		}
 	} sampler;
 
+	template<int WRAP>
 	FORCEINLINE FragmentColor sample(const float u, const float v)
 	{
 		//finally, we can use floor here. but, it is slower than we want.
@@ -454,7 +467,8 @@ public:
 		s32 iu = 0;
 		s32 iv = 0;
 		
-		if (!CommonSettings.GFX3D_TXTHack)
+		//the texture coordinate hack only ever runs through the generic (WRAP < 0) shaders
+		if (WRAP >= 0 || !CommonSettings.GFX3D_TXTHack)
 		{
 			iu = s32floor(u);
 			iv = s32floor(v);
@@ -465,7 +479,7 @@ public:
 			iv = round_s(v);
 		}
 		
-		sampler.dowrap(iu, iv);
+		sampler.template dowrap<WRAP>(iu, iv);
 		FragmentColor color;
 		color.color = ((u32*)lastTexKey->decoded)[(iv<<sampler.wshift)+iu];
 		return color;
@@ -484,12 +498,13 @@ public:
 		}
 	}
 	
-	FORCEINLINE void shade(const PolygonMode polygonMode, const FragmentColor src, FragmentColor &dst, const float texCoordU, const float texCoordV)
+	template<PolygonMode MODE, bool TEXTURED, int WRAP>
+	FORCEINLINE void shade(const FragmentColor src, FragmentColor &dst, const float texCoordU, const float texCoordV)
 	{
 		static const FragmentColor colorWhite = MakeFragmentColor(0x3F, 0x3F, 0x3F, 0x1F);
-		const FragmentColor mainTexColor = (sampler.enabled) ? sample(texCoordU, texCoordV) : colorWhite;
+		const FragmentColor mainTexColor = (TEXTURED) ? sample<WRAP>(texCoordU, texCoordV) : colorWhite;
 		
-		switch (polygonMode)
+		switch (MODE)
 		{
 			case POLYGON_MODE_MODULATE:
 				dst.r = modulate_table[mainTexColor.r][src.r];
@@ -512,7 +527,7 @@ public:
 				
 			case POLYGON_MODE_DECAL:
 			{
-				if (sampler.enabled)
+				if (TEXTURED)
 				{
 					dst.r = decal_table[mainTexColor.a][mainTexColor.r][src.r];
 					dst.g = decal_table[mainTexColor.a][mainTexColor.g][src.g];
@@ -530,7 +545,7 @@ public:
 			{
 				const FragmentColor toonColor = this->_softRender->toonColor32LUT[src.r >> 1];
 				
-				if (gfx3d->renderState.shading == PolygonShadingMode_Highlight)
+				if (this->_isHighlightShading)
 				{
 					// Tested in the "Shadows of Almia" logo in the Pokemon Ranger: Shadows of Almia title screen.
 					// Also tested in Advance Wars: Dual Strike and Advance Wars: Days of Ruin when tiles highlight
@@ -561,9 +576,10 @@ public:
 		}
 	}
 	
-	template<bool isShadowPolygon>
+	template<PolygonMode MODE, bool TEXTURED, int WRAP, bool DEPTHEQUAL>
 	FORCEINLINE void pixel(const PolygonAttributes &polyAttr, const size_t fragmentIndex, FragmentColor &dstColor, float r, float g, float b, float invu, float invv, float w, float z)
 	{
+		const bool isShadowPolygon = (MODE == POLYGON_MODE_SHADOW);
 		FragmentColor srcColor;
 		FragmentColor shaderOutput;
 		bool isOpaquePixel;
@@ -580,10 +596,10 @@ public:
 		// When using z-depth, be sure to test against the following test cases:
 		// - The drawing of the overworld map in Dragon Quest IV
 		// - The drawing of all units on the map in Advance Wars: Days of Ruin
-		const u32 newDepth = (gfx3d->renderState.wbuffer) ? u32floor(4096*w) : (u32floor(z*0x7FFF) << 9);
+		const u32 newDepth = (this->_isWBuffer) ? u32floor(4096*w) : (u32floor(z*0x7FFF) << 9);
 		
 		// run the depth test
-		if (polyAttr.enableDepthEqualTest)
+		if (DEPTHEQUAL)
 		{
 			const u32 minDepth = max<u32>(0x00000000, dstAttributeDepth - SOFTRASTERIZER_DEPTH_EQUAL_TEST_TOLERANCE);
 			const u32 maxDepth = min<u32>(0x00FFFFFF, dstAttributeDepth + SOFTRASTERIZER_DEPTH_EQUAL_TEST_TOLERANCE);
@@ -639,11 +655,10 @@ public:
 									 polyAttr.alpha);
 		
 		//pixel shader
-		shade(polyAttr.polygonMode, srcColor, shaderOutput, invu * w, invv * w);
+		shade<MODE, TEXTURED, WRAP>(srcColor, shaderOutput, invu * w, invv * w);
 		
-		// handle alpha test
-		if ( shaderOutput.a == 0 ||
-			(this->_softRender->currentRenderState->enableAlphaTest && shaderOutput.a < this->_softRender->currentRenderState->alphaTestRef) )
+		// handle alpha test (_alphaTestRef also rejects fully transparent fragments)
+		if (shaderOutput.a < this->_alphaTestRef)
 		{
 			goto rejected_fragment;
 		}
@@ -697,8 +712,48 @@ public:
 			dstAttributeStencil--;
 	}
 
+	//the depth tiles of a scanline, computed from the depth buffer the first time this frame that a
+	//span asks for them. every unit only ever touches its own scanlines.
+	u32* getDepthTileRow(const size_t y, const size_t framebufferWidth)
+	{
+		const size_t tileCount = (framebufferWidth + SOFTRASTERIZER_DEPTH_TILE_WIDTH - 1) / SOFTRASTERIZER_DEPTH_TILE_WIDTH;
+		u32 *depthTileMax = this->_softRender->_depthTileMax + (y * tileCount);
+		
+		if (!this->_softRender->_isDepthTileRowValid[y])
+		{
+			for (size_t i = 0; i < tileCount; i++)
+				this->updateDepthTile(depthTileMax, y, i, framebufferWidth);
+			
+			this->_softRender->_isDepthTileRowValid[y] = 1;
+		}
+		
+		return depthTileMax;
+	}
+	
+	//like getDepthTileRow(), but returns NULL rather than computing tiles that nothing has asked for yet
+	u32* peekDepthTileRow(const size_t y, const size_t framebufferWidth)
+	{
+		const size_t tileCount = (framebufferWidth + SOFTRASTERIZER_DEPTH_TILE_WIDTH - 1) / SOFTRASTERIZER_DEPTH_TILE_WIDTH;
+		return (this->_softRender->_isDepthTileRowValid[y]) ? this->_softRender->_depthTileMax + (y * tileCount) : NULL;
+	}
+	
+	//depth-equal polygons can move a depth value farther away, so tiles are recomputed rather than
+	//only ever lowered
+	FORCEINLINE void updateDepthTile(u32 *depthTileMax, const size_t y, const size_t tileIndex, const size_t framebufferWidth)
+	{
+		const size_t x = tileIndex * SOFTRASTERIZER_DEPTH_TILE_WIDTH;
+		const size_t tileWidth = min<size_t>(SOFTRASTERIZER_DEPTH_TILE_WIDTH, framebufferWidth - x);
+		const u32 *depthBuffer = this->_softRender->_framebufferAttributes->depth + (y * framebufferWidth) + x;
+		u32 maxDepth = 0;
+		
+		for (size_t i = 0; i < tileWidth; i++)
+			maxDepth = max<u32>(maxDepth, depthBuffer[i]);
+		
+		depthTileMax[tileIndex] = maxDepth;
+	}
+	
 	//draws a single scanline
-	template <bool isShadowPolygon>
+	template<PolygonMode MODE, bool TEXTURED, int WRAP, bool DEPTHEQUAL>
 	FORCEINLINE void drawscanline(const PolygonAttributes &polyAttr, FragmentColor *dstColor, const size_t framebufferWidth, const size_t framebufferHeight, edge_fx_fl *pLeft, edge_fx_fl *pRight, bool lineHack)
 	{
 		int XStart = pLeft->X;
@@ -740,6 +795,12 @@ public:
 
 		size_t adr = (pLeft->Y*framebufferWidth)+XStart;
 
+		//guard band polygons are expected to reach off the screen
+		if (this->_needsScissor && (pLeft->Y < 0 || pLeft->Y >= (int)framebufferHeight))
+		{
+			return;
+		}
+		
 		//CONSIDER: in case some other math is wrong (shouldve been clipped OK), we might go out of bounds here.
 		//better check the Y value.
 		if (RENDERER && (pLeft->Y < 0 || pLeft->Y > (framebufferHeight - 1)))
@@ -757,7 +818,7 @@ public:
 
 		if (x < 0)
 		{
-			if (RENDERER && !lineHack)
+			if (RENDERER && !lineHack && !this->_needsScissor)
 			{
 				printf("rasterizer rendering at x=%d! oops!\n",x);
 				return;
@@ -775,7 +836,7 @@ public:
 		}
 		if (x+width > framebufferWidth)
 		{
-			if (RENDERER && !lineHack && framebufferWidth == GPU_FRAMEBUFFER_NATIVE_WIDTH)
+			if (RENDERER && !lineHack && !this->_needsScissor && framebufferWidth == GPU_FRAMEBUFFER_NATIVE_WIDTH)
 			{
 				printf("rasterizer rendering at x=%d! oops!\n",x+width-1);
 				return;
@@ -783,24 +844,73 @@ public:
 			width = framebufferWidth - x;
 		}
 		
-		while (width-- > 0)
+		//spans are walked one depth tile at a time. a plain depth test that fails against the tile's
+		//farthest depth fails for every fragment in it, and a failed fragment has no side effects
+		//unless it belongs to a shadow polygon, so the whole run can be skipped. stepping z by a
+		//constant keeps it monotonic, so the run's nearest depth is at one of its ends.
+		const bool isShadowPolygon = (MODE == POLYGON_MODE_SHADOW);
+		const bool canRejectTiles = !isShadowPolygon && !DEPTHEQUAL && !this->_isWBuffer;
+		u32 *depthTileMax = (canRejectTiles) ? this->getDepthTileRow(pLeft->Y, framebufferWidth) : this->peekDepthTileRow(pLeft->Y, framebufferWidth);
+		
+		while (width > 0)
 		{
-			pixel<isShadowPolygon>(polyAttr, adr, dstColor[adr], color[0], color[1], color[2], u, v, 1.0f/invw, z);
-			adr++;
-			x++;
-
-			invw += dinvw_dx;
-			u += du_dx;
-			v += dv_dx;
-			z += dz_dx;
-			color[0] += dc_dx[0];
-			color[1] += dc_dx[1];
-			color[2] += dc_dx[2];
+			const int tileIndex = x / SOFTRASTERIZER_DEPTH_TILE_WIDTH;
+			const int tileWidth = min(width, SOFTRASTERIZER_DEPTH_TILE_WIDTH - (x % SOFTRASTERIZER_DEPTH_TILE_WIDTH));
+			
+			if (canRejectTiles)
+			{
+				float zLast = z;
+				for (int i = 1; i < tileWidth; i++)
+					zLast += dz_dx;
+				
+				const u32 tileNearDepth = min(u32floor(z*0x7FFF) << 9, u32floor(zLast*0x7FFF) << 9);
+				
+				if (tileNearDepth >= depthTileMax[tileIndex])
+				{
+					//step the attributes the same way as drawing them would, so that the fragments
+					//after this run come out exactly as before
+					for (int i = 0; i < tileWidth; i++)
+					{
+						invw += dinvw_dx;
+						u += du_dx;
+						v += dv_dx;
+						z += dz_dx;
+						color[0] += dc_dx[0];
+						color[1] += dc_dx[1];
+						color[2] += dc_dx[2];
+					}
+					
+					adr += tileWidth;
+					x += tileWidth;
+					width -= tileWidth;
+					continue;
+				}
+			}
+			
+			for (int i = 0; i < tileWidth; i++)
+			{
+				pixel<MODE, TEXTURED, WRAP, DEPTHEQUAL>(polyAttr, adr + i, dstColor[adr + i], color[0], color[1], color[2], u, v, 1.0f/invw, z);
+				
+				invw += dinvw_dx;
+				u += du_dx;
+				v += dv_dx;
+				z += dz_dx;
+				color[0] += dc_dx[0];
+				color[1] += dc_dx[1];
+				color[2] += dc_dx[2];
+			}
+			
+			if (depthTileMax != NULL)
+				this->updateDepthTile(depthTileMax, pLeft->Y, tileIndex, framebufferWidth);
+			
+			adr += tileWidth;
+			x += tileWidth;
+			width -= tileWidth;
 		}
 	}
 
 	//runs several scanlines, until an edge is finished
-	template<bool SLI, bool isShadowPolygon>
+	template<bool SLI, PolygonMode MODE, bool TEXTURED, int WRAP, bool DEPTHEQUAL>
 	void runscanlines(const PolygonAttributes &polyAttr, FragmentColor *dstColor, const size_t framebufferWidth, const size_t framebufferHeight, edge_fx_fl *left, edge_fx_fl *right, bool horizontal, bool lineHack)
 	{
 		//oh lord, hack city for edge drawing
@@ -813,20 +923,21 @@ public:
 		if (lineHack && left->Height == 0 && right->Height == 0 && left->Y<framebufferHeight && left->Y>=0)
 		{
 			bool draw = (!SLI || (left->Y & SLI_MASK) == SLI_VALUE);
-			if(draw) drawscanline<isShadowPolygon>(polyAttr, dstColor, framebufferWidth, framebufferHeight, left,right,lineHack);
+			if(draw) drawscanline<MODE, TEXTURED, WRAP, DEPTHEQUAL>(polyAttr, dstColor, framebufferWidth, framebufferHeight, left,right,lineHack);
 		}
 
 		while(Height--)
 		{
 			bool draw = (!SLI || (left->Y & SLI_MASK) == SLI_VALUE);
-			if(draw) drawscanline<isShadowPolygon>(polyAttr, dstColor, framebufferWidth, framebufferHeight, left,right,lineHack);
+			if(draw) drawscanline<MODE, TEXTURED, WRAP, DEPTHEQUAL>(polyAttr, dstColor, framebufferWidth, framebufferHeight, left,right,lineHack);
 			const int xl = left->X;
 			const int xr = right->X;
 			const int y = left->Y;
 			left->Step();
 			right->Step();
 
-			if(!RENDERER && _debug_thisPoly)
+			//(the outline isn't scissored, so it is left off of guard band polygons)
+			if(!RENDERER && _debug_thisPoly && !this->_needsScissor)
 			{
 				//debug drawing
 				bool top = (horizontal&&first);
@@ -939,7 +1050,7 @@ public:
 	//verts must be clockwise.
 	//I didnt reference anything for this algorithm but it seems like I've seen it somewhere before.
 	//Maybe it is like crow's algorithm
-	template<bool SLI, bool isShadowPolygon>
+	template<bool SLI, PolygonMode MODE, bool TEXTURED, int WRAP, bool DEPTHEQUAL>
 	void shape_engine(const PolygonAttributes &polyAttr, FragmentColor *dstColor, const size_t framebufferWidth, const size_t framebufferHeight, int type, const bool backwards, bool lineHack)
 	{
 		bool failure = false;
@@ -980,7 +1091,7 @@ public:
 				return;
 
 			bool horizontal = left.Y == right.Y;
-			runscanlines<SLI, isShadowPolygon>(polyAttr, dstColor, framebufferWidth, framebufferHeight, &left, &right, horizontal, lineHack);
+			runscanlines<SLI, MODE, TEXTURED, WRAP, DEPTHEQUAL>(polyAttr, dstColor, framebufferWidth, framebufferHeight, &left, &right, horizontal, lineHack);
 
 			//if we ran out of an edge, step to the next one
 			if (right.Height == 0)
@@ -999,6 +1110,75 @@ public:
 		}
 	}
 	
+	template<bool SLI, PolygonMode MODE, bool TEXTURED, int WRAP>
+	FORCEINLINE void shape_engine_depth(const PolygonAttributes &polyAttr, FragmentColor *dstColor, const size_t framebufferWidth, const size_t framebufferHeight, int type, const bool backwards, bool lineHack)
+	{
+		if (polyAttr.enableDepthEqualTest)
+			shape_engine<SLI, MODE, TEXTURED, WRAP, true>(polyAttr, dstColor, framebufferWidth, framebufferHeight, type, backwards, lineHack);
+		else
+			shape_engine<SLI, MODE, TEXTURED, WRAP, false>(polyAttr, dstColor, framebufferWidth, framebufferHeight, type, backwards, lineHack);
+	}
+	
+	template<bool SLI, PolygonMode MODE>
+	FORCEINLINE void shape_engine_texture(const PolygonAttributes &polyAttr, FragmentColor *dstColor, const size_t framebufferWidth, const size_t framebufferHeight, int type, const bool backwards, bool lineHack)
+	{
+		//shadow polygons never look at their texture
+		if (MODE == POLYGON_MODE_SHADOW || !sampler.enabled)
+		{
+			shape_engine_depth<SLI, MODE, false, -1>(polyAttr, dstColor, framebufferWidth, framebufferHeight, type, backwards, lineHack);
+			return;
+		}
+		
+		//only the wrap modes that games commonly use get their own shaders. the rest, and anything
+		//drawn with the texture coordinate hack, go through the generic shader.
+		const int wrap = (CommonSettings.GFX3D_TXTHack) ? -1 : sampler.wrap;
+		switch (wrap)
+		{
+			case 0x0:
+			case 0x4:
+			case 0x8:
+			case 0xC:
+				shape_engine_depth<SLI, MODE, true, 0x0>(polyAttr, dstColor, framebufferWidth, framebufferHeight, type, backwards, lineHack);
+				break;
+				
+			case 0x3:
+				shape_engine_depth<SLI, MODE, true, 0x3>(polyAttr, dstColor, framebufferWidth, framebufferHeight, type, backwards, lineHack);
+				break;
+				
+			case 0xF:
+				shape_engine_depth<SLI, MODE, true, 0xF>(polyAttr, dstColor, framebufferWidth, framebufferHeight, type, backwards, lineHack);
+				break;
+				
+			default:
+				shape_engine_depth<SLI, MODE, true, -1>(polyAttr, dstColor, framebufferWidth, framebufferHeight, type, backwards, lineHack);
+				break;
+		}
+	}
+	
+	//selects the span shader for a polygon once, so that the per-fragment code has no state to branch on
+	template<bool SLI>
+	void drawPolygon(const PolygonAttributes &polyAttr, FragmentColor *dstColor, const size_t framebufferWidth, const size_t framebufferHeight, int type, const bool backwards, bool lineHack)
+	{
+		switch (polyAttr.polygonMode)
+		{
+			case POLYGON_MODE_MODULATE:
+				shape_engine_texture<SLI, POLYGON_MODE_MODULATE>(polyAttr, dstColor, framebufferWidth, framebufferHeight, type, backwards, lineHack);
+				break;
+				
+			case POLYGON_MODE_DECAL:
+				shape_engine_texture<SLI, POLYGON_MODE_DECAL>(polyAttr, dstColor, framebufferWidth, framebufferHeight, type, backwards, lineHack);
+				break;
+				
+			case POLYGON_MODE_TOONHIGHLIGHT:
+				shape_engine_texture<SLI, POLYGON_MODE_TOONHIGHLIGHT>(polyAttr, dstColor, framebufferWidth, framebufferHeight, type, backwards, lineHack);
+				break;
+				
+			case POLYGON_MODE_SHADOW:
+				shape_engine_texture<SLI, POLYGON_MODE_SHADOW>(polyAttr, dstColor, framebufferWidth, framebufferHeight, type, backwards, lineHack);
+				break;
+		}
+	}
+	
 	template<bool SLI>
 	FORCEINLINE void mainLoop()
 	{
@@ -1014,6 +1194,17 @@ public:
 		
 		lastTexKey = NULL;
 		
+		const GFX3D_State &renderState = *this->_softRender->currentRenderState;
+		this->_isWBuffer = (renderState.wbuffer != 0);
+		this->_isHighlightShading = (gfx3d->renderState.shading == PolygonShadingMode_Highlight);
+		this->_alphaTestRef = (renderState.enableAlphaTest) ? max<u8>(1, renderState.alphaTestRef) : 1;
+		
+		for (size_t y = 0; y < dstHeight; y++)
+		{
+			if (!SLI || (y & SLI_MASK) == SLI_VALUE)
+				this->_softRender->_isDepthTileRowValid[y] = 0;
+		}
+		
 		const GFX3D_Clipper::TClippedPoly &firstClippedPoly = this->_softRender->clippedPolys[0];
 		const POLY &firstPoly = *firstClippedPoly.poly;
 		PolygonAttributes polyAttr = firstPoly.getAttributes();
@@ -1047,20 +1238,14 @@ public:
 			}
 			
 			lastTexKey = this->_softRender->polyTexKeys[i];
+			this->_needsScissor = clippedPoly.needsScissor;
 			
 			for (int j = 0; j < type; j++)
 				this->verts[j] = &clippedPoly.clipVerts[j];
 			for (int j = type; j < MAX_CLIPPED_VERTS; j++)
 				this->verts[j] = NULL;
 			
-			if (polyAttr.polygonMode == POLYGON_MODE_SHADOW)
-			{
-				shape_engine<SLI, true>(polyAttr, dstColor, dstWidth, dstHeight, type, !this->_softRender->polyBackfacing[i], (thePoly.vtxFormat & 4) && CommonSettings.GFX3D_LineHack);
-			}
-			else
-			{
-				shape_engine<SLI, false>(polyAttr, dstColor, dstWidth, dstHeight, type, !this->_softRender->polyBackfacing[i], (thePoly.vtxFormat & 4) && CommonSettings.GFX3D_LineHack);
-			}
+			drawPolygon<SLI>(polyAttr, dstColor, dstWidth, dstHeight, type, !this->_softRender->polyBackfacing[i], (thePoly.vtxFormat & 4) && CommonSettings.GFX3D_LineHack);
 		}
 	}
 
@@ -1076,6 +1261,7 @@ static bool rasterizerUnitTasksInited = false;
 
 static void* execRasterizerUnit(void *arg)
 {
+	TRACE_ZONE("softras unit");
 	intptr_t which = (intptr_t)arg;
 	rasterizerUnit[which].mainLoop<true>();
 	return 0;
@@ -1083,6 +1269,7 @@ static void* execRasterizerUnit(void *arg)
 
 static void* SoftRasterizer_RunCalculateVertices(void *arg)
 {
+	TRACE_ZONE("softras vertices");
 	SoftRasterizerRenderer *softRender = (SoftRasterizerRenderer *)arg;
 	softRender->performViewportTransforms<false>();
 	softRender->performBackfaceTests();
@@ -1093,6 +1280,7 @@ static void* SoftRasterizer_RunCalculateVertices(void *arg)
 
 static void* SoftRasterizer_RunSetupTextures(void *arg)
 {
+	TRACE_ZONE("softras textures");
 	SoftRasterizerRenderer *softRender = (SoftRasterizerRenderer *)arg;
 	softRender->setupTextures();
 	
@@ -1101,6 +1289,7 @@ static void* SoftRasterizer_RunSetupTextures(void *arg)
 
 static void* SoftRasterizer_RunUpdateTables(void *arg)
 {
+	TRACE_ZONE("softras tables");
 	SoftRasterizerRenderer *softRender = (SoftRasterizerRenderer *)arg;
 	softRender->UpdateToonTable(softRender->currentRenderState->u16ToonTable);
 	softRender->UpdateFogTable(softRender->currentRenderState->fogDensityTable);
@@ -1111,6 +1300,7 @@ static void* SoftRasterizer_RunUpdateTables(void *arg)
 
 static void* SoftRasterizer_RunClearFramebuffer(void *arg)
 {
+	TRACE_ZONE("softras clear");
 	SoftRasterizerRenderer *softRender = (SoftRasterizerRenderer *)arg;
 	softRender->ClearFramebuffer(*softRender->currentRenderState);
 	
@@ -1176,10 +1366,13 @@ SoftRasterizerRenderer::SoftRasterizerRenderer()
 	
 	_debug_drawClippedUserPoly = -1;
 	clippedPolys = clipper.clippedPolys = (GFX3D_Clipper::TClippedPoly*) malloc(sizeof(GFX3D_Clipper::TClippedPoly)*POLYLIST_SIZE*2);
+	clipper.useGuardBand = true; // the rasterizer scissors polygons that reach outside the screen
 	
 	_stateSetupNeedsFinish = false;
 	_renderGeometryNeedsFinish = false;
 	_framebufferAttributes = NULL;
+	_depthTileMax = NULL;
+	_isDepthTileRowValid = NULL;
 	
 	if (!rasterizerUnitTasksInited)
 	{
@@ -1203,6 +1396,7 @@ SoftRasterizerRenderer::SoftRasterizerRenderer()
 			postprocessParam[0].renderer = this;
 			postprocessParam[0].startLine = 0;
 			postprocessParam[0].endLine = _framebufferHeight;
+			postprocessParam[0].bandStride = SOFTRASTERIZER_POSTPROCESS_BAND_HEIGHT;
 			postprocessParam[0].enableEdgeMarking = true;
 			postprocessParam[0].enableFog = true;
 			postprocessParam[0].fogColor = 0x80FFFFFF;
@@ -1210,7 +1404,6 @@ SoftRasterizerRenderer::SoftRasterizerRenderer()
 		}
 		else
 		{
-			const size_t linesPerThread = _framebufferHeight / rasterizerCores;
 			postprocessParam = new SoftRasterizerPostProcessParams[rasterizerCores];
 			
 			for (size_t i = 0; i < rasterizerCores; i++)
@@ -1221,8 +1414,9 @@ SoftRasterizerRenderer::SoftRasterizerRenderer()
 				rasterizerUnitTask[i].start(false);
 				
 				postprocessParam[i].renderer = this;
-				postprocessParam[i].startLine = i * linesPerThread;
-				postprocessParam[i].endLine = (i < rasterizerCores - 1) ? (i + 1) * linesPerThread : _framebufferHeight;
+				postprocessParam[i].startLine = i * SOFTRASTERIZER_POSTPROCESS_BAND_HEIGHT;
+				postprocessParam[i].endLine = _framebufferHeight;
+				postprocessParam[i].bandStride = rasterizerCores * SOFTRASTERIZER_POSTPROCESS_BAND_HEIGHT;
 				postprocessParam[i].enableEdgeMarking = true;
 				postprocessParam[i].enableFog = true;
 				postprocessParam[i].fogColor = 0x80FFFFFF;
@@ -1256,6 +1450,11 @@ SoftRasterizerRenderer::~SoftRasterizerRenderer()
 	
 	delete _framebufferAttributes;
 	_framebufferAttributes = NULL;
+	
+	delete[] _depthTileMax;
+	_depthTileMax = NULL;
+	delete[] _isDepthTileRowValid;
+	_isDepthTileRowValid = NULL;
 }
 
 Render3DError SoftRasterizerRenderer::InitTables()
@@ -1361,8 +1560,12 @@ template<bool CUSTOM> void SoftRasterizerRenderer::performViewportTransforms()
 			
 			//well, i guess we need to do this to keep Princess Debut from rendering huge polys.
 			//there must be something strange going on
-			vert.coord[0] = max(0.0f,min(xmax,vert.coord[0]));
-			vert.coord[1] = max(0.0f,min(ymax,vert.coord[1]));
+			//(guard band polygons are scissored instead, since clamping their vertices would bend their edges)
+			if (!poly.needsScissor)
+			{
+				vert.coord[0] = max(0.0f,min(xmax,vert.coord[0]));
+				vert.coord[1] = max(0.0f,min(ymax,vert.coord[1]));
+			}
 		}
 	}
 }
@@ -1481,6 +1684,7 @@ void SoftRasterizerRenderer::performBackfaceTests()
 
 Render3DError SoftRasterizerRenderer::BeginRender(const GFX3D &engine)
 {
+	TRACE_ZONE("softras BeginRender");
 	if (rasterizerCores > 1)
 	{
 		// Force all threads to finish before rendering with new data
@@ -1538,6 +1742,7 @@ Render3DError SoftRasterizerRenderer::BeginRender(const GFX3D &engine)
 
 Render3DError SoftRasterizerRenderer::RenderGeometry(const GFX3D_State &renderState, const POLYLIST *polyList, const INDEXLIST *indexList)
 {
+	TRACE_ZONE("softras RenderGeometry");
 	// If multithreaded, allow for states to finish setting up
 	if (this->_stateSetupNeedsFinish)
 	{
@@ -1772,76 +1977,151 @@ Render3DError SoftRasterizerRenderer::RenderFog(const u8 *densityTable, const u3
 	return RENDER3DERROR_NOERR;
 }
 
+//a run of pixels that the post-processing passes can test as a whole
+#ifdef ENABLE_SIMD128
+	#define POSTPROCESS_RUN_WIDTH 16
+#else
+	#define POSTPROCESS_RUN_WIDTH 4
+#endif
+
+static FORCEINLINE bool IsPostProcessRunEqual(const u8 *a, const u8 *b)
+{
+#ifdef ENABLE_SIMD128
+	return v128u16_alltrue( v128u16_cmpeq(v128u16_loadu_u8(a), v128u16_loadu_u8(b)) );
+#else
+	u32 wordA, wordB;
+	memcpy(&wordA, a, sizeof(u32));
+	memcpy(&wordB, b, sizeof(u32));
+	return (wordA == wordB);
+#endif
+}
+
+static FORCEINLINE bool IsPostProcessRunZero(const u8 *a)
+{
+#ifdef ENABLE_SIMD128
+	return v128u16_alltrue( v128u16_cmpeq(v128u16_loadu_u8(a), v128u16_setzero()) );
+#else
+	u32 word;
+	memcpy(&word, a, sizeof(u32));
+	return (word == 0);
+#endif
+}
+
 Render3DError SoftRasterizerRenderer::RenderEdgeMarkingAndFog(const SoftRasterizerPostProcessParams &param)
 {
-	for (size_t i = param.startLine * this->_framebufferWidth, y = param.startLine; y < param.endLine; y++)
+	TRACE_ZONE("softras RenderEdgeMarkingAndFog");
+	const u32 fogR = GFX3D_5TO6( (param.fogColor      ) & 0x1F );
+	const u32 fogG = GFX3D_5TO6( (param.fogColor >>  5) & 0x1F );
+	const u32 fogB = GFX3D_5TO6( (param.fogColor >> 10) & 0x1F );
+	const u32 fogA = (param.fogColor >> 16) & 0x1F;
+	
+	const u8 *polyIDBuffer = this->_framebufferAttributes->opaquePolyID;
+	const u8 *isFoggedBuffer = this->_framebufferAttributes->isFogged;
+	
+	for (size_t bandLine = param.startLine; bandLine < param.endLine; bandLine += param.bandStride)
 	{
-		for (size_t x = 0; x < this->_framebufferWidth; x++, i++)
+		const size_t bandEndLine = min<size_t>(bandLine + SOFTRASTERIZER_POSTPROCESS_BAND_HEIGHT, param.endLine);
+		
+		for (size_t y = bandLine; y < bandEndLine; y++)
 		{
-			FragmentColor &dstColor = this->_framebufferColor[i];
-			const u32 depth = this->_framebufferAttributes->depth[i];
-			const u8 polyID = this->_framebufferAttributes->opaquePolyID[i];
+			const bool isInteriorLine = (y > 0) && (y + 1 < this->_framebufferHeight);
 			
-			// TODO: New edge marking algorithm which tests both polyID and depth, but only checks 4 surrounding pixels. Can we keep this one?
-			if (param.enableEdgeMarking)
+			for (size_t x = 0, i = y * this->_framebufferWidth; x < this->_framebufferWidth; )
 			{
-				// this looks ok although it's still pretty much a hack,
-				// it needs to be redone with low-level accuracy at some point,
-				// but that should probably wait until the shape renderer is more accurate.
-				// a good test case for edge marking is Sonic Rush:
-				// - the edges are completely sharp/opaque on the very brief title screen intro,
-				// - the level-start intro gets a pseudo-antialiasing effect around the silhouette,
-				// - the character edges in-level are clearly transparent, and also show well through shield powerups.
+				// Test a run of pixels at once first. A pixel whose polyID matches all four of its
+				// neighbors can't be an edge, and an unfogged pixel is left alone by the fog, so most
+				// runs of a frame need no per-pixel work at all.
+				const size_t runWidth = min<size_t>(POSTPROCESS_RUN_WIDTH, this->_framebufferWidth - x);
+				bool doEdgeMarking = param.enableEdgeMarking;
+				bool doFog = param.enableFog;
+				
+				if (runWidth == POSTPROCESS_RUN_WIDTH)
+				{
+					if (doEdgeMarking && isInteriorLine && (x > 0) && (x + POSTPROCESS_RUN_WIDTH < this->_framebufferWidth))
+					{
+						const u8 *id = polyIDBuffer + i;
+						doEdgeMarking = !( IsPostProcessRunEqual(id, id - 1) &&
+						                   IsPostProcessRunEqual(id, id + 1) &&
+						                   IsPostProcessRunEqual(id, id - this->_framebufferWidth) &&
+						                   IsPostProcessRunEqual(id, id + this->_framebufferWidth) );
+					}
+					
+					if (doFog)
+					{
+						doFog = !IsPostProcessRunZero(isFoggedBuffer + i);
+					}
+				}
 				
-				bool up = false;
-				bool left = false;
-				bool right = false;
-				bool down = false;
+				if (!doEdgeMarking && !doFog)
+				{
+					x += runWidth;
+					i += runWidth;
+					continue;
+				}
 				
+				for (const size_t runEnd = x + runWidth; x < runEnd; x++, i++)
+				{
+					FragmentColor &dstColor = this->_framebufferColor[i];
+					const u32 depth = this->_framebufferAttributes->depth[i];
+					const u8 polyID = this->_framebufferAttributes->opaquePolyID[i];
+					
+					// TODO: New edge marking algorithm which tests both polyID and depth, but only checks 4 surrounding pixels. Can we keep this one?
+					if (doEdgeMarking)
+					{
+						// this looks ok although it's still pretty much a hack,
+						// it needs to be redone with low-level accuracy at some point,
+						// but that should probably wait until the shape renderer is more accurate.
+						// a good test case for edge marking is Sonic Rush:
+						// - the edges are completely sharp/opaque on the very brief title screen intro,
+						// - the level-start intro gets a pseudo-antialiasing effect around the silhouette,
+						// - the character edges in-level are clearly transparent, and also show well through shield powerups.
+						
+						bool up = false;
+						bool left = false;
+						bool right = false;
+						bool down = false;
+						
 #define PIXOFFSET(dx,dy) ((dx)+(this->_framebufferWidth*(dy)))
 #define ISEDGE(dx,dy) ((x+(dx) < this->_framebufferWidth) && (y+(dy) < this->_framebufferHeight) && polyID != this->_framebufferAttributes->opaquePolyID[i+PIXOFFSET(dx,dy)] && depth >= this->_framebufferAttributes->depth[i+PIXOFFSET(dx,dy)])
 #define DRAWEDGE(dx,dy) alphaBlend(dstColor, this->edgeMarkTable[this->_framebufferAttributes->opaquePolyID[i+PIXOFFSET(dx,dy)] >> 3])
-				
-				if (this->edgeMarkDisabled[polyID>>3] || this->_framebufferAttributes->isTranslucentPoly[i] != 0)
-					goto END_EDGE_MARK;
-				
-				up		= ISEDGE( 0,-1);
-				left	= ISEDGE(-1, 0);
-				right	= ISEDGE( 1, 0);
-				down	= ISEDGE( 0, 1);
-				
-				if (right)			DRAWEDGE( 1, 0);
-				else if (down)		DRAWEDGE( 0, 1);
-				else if (left)		DRAWEDGE(-1, 0);
-				else if (up)		DRAWEDGE( 0,-1);
-				
-				
+						
+						if (this->edgeMarkDisabled[polyID>>3] || this->_framebufferAttributes->isTranslucentPoly[i] != 0)
+							goto END_EDGE_MARK;
+						
+						up		= ISEDGE( 0,-1);
+						left	= ISEDGE(-1, 0);
+						right	= ISEDGE( 1, 0);
+						down	= ISEDGE( 0, 1);
+						
+						if (right)			DRAWEDGE( 1, 0);
+						else if (down)		DRAWEDGE( 0, 1);
+						else if (left)		DRAWEDGE(-1, 0);
+						else if (up)		DRAWEDGE( 0,-1);
+						
+						
 #undef PIXOFFSET
 #undef ISEDGE
 #undef DRAWEDGE
-				
+						
 END_EDGE_MARK: ;
-			}
-			
-			if (param.enableFog)
-			{
-				const u32 r = GFX3D_5TO6( (param.fogColor      ) & 0x1F );
-				const u32 g = GFX3D_5TO6( (param.fogColor >>  5) & 0x1F );
-				const u32 b = GFX3D_5TO6( (param.fogColor >> 10) & 0x1F );
-				const u32 a = (param.fogColor >> 16) & 0x1F;
-				
-				const size_t fogIndex = depth >> 9;
-				assert(fogIndex < 32768);
-				const u8 fog = (this->_framebufferAttributes->isFogged[i] != 0) ? this->fogTable[fogIndex] : 0;
-				
-				if (!param.fogAlphaOnly)
-				{
-					dstColor.r = ( (128-fog)*dstColor.r + r*fog ) >> 7;
-					dstColor.g = ( (128-fog)*dstColor.g + g*fog ) >> 7;
-					dstColor.b = ( (128-fog)*dstColor.b + b*fog ) >> 7;
+					}
+					
+					if (doFog && (isFoggedBuffer[i] != 0))
+					{
+						const size_t fogIndex = depth >> 9;
+						assert(fogIndex < 32768);
+						const u8 fog = this->fogTable[fogIndex];
+						
+						if (!param.fogAlphaOnly)
+						{
+							dstColor.r = ( (128-fog)*dstColor.r + fogR*fog ) >> 7;
+							dstColor.g = ( (128-fog)*dstColor.g + fogG*fog ) >> 7;
+							dstColor.b = ( (128-fog)*dstColor.b + fogB*fog ) >> 7;
+						}
+						
+						dstColor.a = ( (128-fog)*dstColor.a + fogA*fog ) >> 7;
+					}
 				}
-				
-				dstColor.a = ( (128-fog)*dstColor.a + a*fog ) >> 7;
 			}
 		}
 	}
@@ -1863,6 +2143,27 @@ Render3DError SoftRasterizerRenderer::UpdateToonTable(const u16 *toonTableBuffer
 
 Render3DError SoftRasterizerRenderer::ClearUsingImage(const u16 *__restrict colorBuffer, const u32 *__restrict depthBuffer, const u8 *__restrict fogBuffer, const u8 *__restrict polyIDBuffer)
 {
+	// At the native size the clear image maps one to one onto the framebuffer, so the attributes
+	// are plain copies and fills.
+	if ( (this->_framebufferWidth == GPU_FRAMEBUFFER_NATIVE_WIDTH) && (this->_framebufferHeight == GPU_FRAMEBUFFER_NATIVE_HEIGHT) )
+	{
+		const size_t pixCount = GPU_FRAMEBUFFER_NATIVE_WIDTH * GPU_FRAMEBUFFER_NATIVE_HEIGHT;
+		
+		for (size_t i = 0; i < pixCount; i++)
+		{
+			this->_framebufferColor[i].color = RGB15TO6665(colorBuffer[i] & 0x7FFF, (colorBuffer[i] >> 15) * 0x1F);
+		}
+		
+		memcpy(this->_framebufferAttributes->depth, depthBuffer, pixCount * sizeof(u32));
+		memcpy(this->_framebufferAttributes->isFogged, fogBuffer, pixCount * sizeof(u8));
+		memcpy(this->_framebufferAttributes->opaquePolyID, polyIDBuffer, pixCount * sizeof(u8));
+		memset(this->_framebufferAttributes->translucentPolyID, kUnsetTranslucentPolyID, pixCount * sizeof(u8));
+		memset(this->_framebufferAttributes->isTranslucentPoly, 0, pixCount * sizeof(u8));
+		memset(this->_framebufferAttributes->stencil, 0, pixCount * sizeof(u8));
+		
+		return RENDER3DERROR_NOERR;
+	}
+	
 	const size_t xRatio = (size_t)((GPU_FRAMEBUFFER_NATIVE_WIDTH << 16) / this->_framebufferWidth) + 1;
 	const size_t yRatio = (size_t)((GPU_FRAMEBUFFER_NATIVE_HEIGHT << 16) / this->_framebufferHeight) + 1;
 	
@@ -1949,6 +2250,7 @@ Render3DError SoftRasterizerRenderer::Render(const GFX3D &engine)
 
 Render3DError SoftRasterizerRenderer::EndRender(const u64 frameCount)
 {
+	TRACE_ZONE("softras EndRender");
 	// If we're not multithreaded, then just do the post-processing steps now.
 	if (!this->_renderGeometryNeedsFinish)
 	{
@@ -1972,6 +2274,7 @@ Render3DError SoftRasterizerRenderer::EndRender(const u64 frameCount)
 
 Render3DError SoftRasterizerRenderer::RenderFinish()
 {
+	TRACE_ZONE("softras RenderFinish");
 	if (!this->_renderNeedsFinish || !this->_renderGeometryNeedsFinish)
 	{
 		return RENDER3DERROR_NOERR;
@@ -2025,19 +2328,27 @@ Render3DError SoftRasterizerRenderer::SetFramebufferSize(size_t w, size_t h)
 	delete this->_framebufferAttributes;
 	this->_framebufferAttributes = new FragmentAttributesBuffer(w * h);
 	
+	delete[] this->_depthTileMax;
+	this->_depthTileMax = new u32[((w + SOFTRASTERIZER_DEPTH_TILE_WIDTH - 1) / SOFTRASTERIZER_DEPTH_TILE_WIDTH) * h];
+	delete[] this->_isDepthTileRowValid;
+	this->_isDepthTileRowValid = new u8[h];
+	memset(this->_isDepthTileRowValid, 0, h);
+	
+	// Post-processing is split into bands that the threads take in turn, rather than one block of
+	// lines per thread, so that fog and edges bunched up in one part of the screen are shared out.
 	if (rasterizerCores == 0 || rasterizerCores == 1)
 	{
 		postprocessParam[0].startLine = 0;
 		postprocessParam[0].endLine = h;
+		postprocessParam[0].bandStride = SOFTRASTERIZER_POSTPROCESS_BAND_HEIGHT;
 	}
 	else
 	{
-		const size_t linesPerThread = h / rasterizerCores;
-		
 		for (size_t i = 0; i < rasterizerCores; i++)
 		{
-			postprocessParam[i].startLine = i * linesPerThread;
-			postprocessParam[i].endLine = (i < rasterizerCores - 1) ? (i + 1) * linesPerThread : h;
+			postprocessParam[i].startLine = i * SOFTRASTERIZER_POSTPROCESS_BAND_HEIGHT;
+			postprocessParam[i].endLine = h;
+			postprocessParam[i].bandStride = rasterizerCores * SOFTRASTERIZER_POSTPROCESS_BAND_HEIGHT;
 		}
 	}
 		
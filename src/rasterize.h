@@ -22,6 +22,8 @@
 #include "gfx3d.h"
 
 #define SOFTRASTERIZER_DEPTH_EQUAL_TEST_TOLERANCE 0x200
+#define SOFTRASTERIZER_DEPTH_TILE_WIDTH 8
+#define SOFTRASTERIZER_POSTPROCESS_BAND_HEIGHT 16
 
 extern GPU3DInterface gpu3DRasterize;
 
@@ -33,6 +35,7 @@ struct SoftRasterizerPostProcessParams
 	SoftRasterizerRenderer *renderer;
 	size_t startLine;
 	size_t endLine;
+	size_t bandStride; // lines from the start of one band of SOFTRASTERIZER_POSTPROCESS_BAND_HEIGHT lines to the next
 	bool enableEdgeMarking;
 	bool enableFog;
 	u32 fogColor;
@@ -77,6 +80,8 @@ public:
 	FragmentColor toonColor32LUT[32];
 	GFX3D_Clipper::TClippedPoly *clippedPolys;
 	FragmentAttributesBuffer *_framebufferAttributes;
+	u32 *_depthTileMax; // farthest depth of each 8x1 tile of the depth buffer
+	u8 *_isDepthTileRowValid;
 	TexCacheItem *polyTexKeys[POLYLIST_SIZE];
 	bool polyVisible[POLYLIST_SIZE];
 	bool polyBackfacing[POLYLIST_SIZE];
@@ -54,6 +54,7 @@
 #include "wifi.h"
 
 #include "path.h"
+#include "utils/trace.h"
 
 #ifdef HOST_WINDOWS
 #include "windows/main.h"
@@ -73,9 +74,22 @@ NDS_SLOT2_TYPE slot2Type = NDS_SLOT2_AUTO;
 
 savestates_t savestates[NB_STATES];
 
-#define SAVESTATE_VERSION       12
+#define SAVESTATE_VERSION       13
+#define SAVESTATE_VERSION_FLAT  12		//before the table of contents; still loaded
 static const char* magic = "DeSmuME SState\0";
 
+//A savestate is, all little endian:
+//  a header: magic, version, desmume version, the number of chunks and some flags (none yet)
+//  a table of contents: for each chunk its type, how it's stored, the offset of its data from the start of
+//    the savestate, and the size of that data as stored and as loaded
+//  the chunks in table order, each its type, its size as stored and its data; then 0xFFFFFFFF
+//Each chunk is compressed on its own. Saved without compression, everything past the table is the same
+//stream of chunks that SAVESTATE_VERSION_FLAT had.
+#define SAVESTATE_TOC_MAX           64
+#define SAVESTATE_STORAGE_RAW       0
+#define SAVESTATE_STORAGE_ZLIB      1
+#define SAVESTATE_COMPRESS_MIN      256		//smaller chunks are stored as they are
+
 //a savestate chunk loader can set this if it wants to permit a silent failure (for compatibility)
 static bool SAV_silent_fail_flag;
 
@@ -164,14 +178,12 @@ SFORMAT SF_ARM9[]={
 	{ 0 }
 };
 
+//main memory and vram have chunks of their own, each compressed on its own
+//(before SAVESTATE_VERSION 13 all three were in chunk 4)
 SFORMAT SF_MEM[]={
 	{ "ITCM", 1, sizeof(MMU.ARM9_ITCM),   MMU.ARM9_ITCM},
 	{ "DTCM", 1, sizeof(MMU.ARM9_DTCM),   MMU.ARM9_DTCM},
 
-	 //for legacy purposes, WRAX is a separate variable. shouldnt be a problem.
-	{ "WRAM", 1, 0x400000, MMU.MAIN_MEM},
-	{ "WRAX", 1, 0x400000, MMU.MAIN_MEM+0x400000},
-
 	//NOTE - this is not as large as the allocated memory.
 	//the memory is overlarge due to the way our memory map system is setup
 	//but there are actually no more registers than this
@@ -179,7 +191,17 @@ SFORMAT SF_MEM[]={
 
 	{ "VMEM", 1, sizeof(MMU.ARM9_VMEM),    MMU.ARM9_VMEM},
 	{ "OAMS", 1, sizeof(MMU.ARM9_OAM),    MMU.ARM9_OAM},
+	{ 0 }
+};
 
+SFORMAT SF_MAINMEM[]={
+	 //for legacy purposes, WRAX is a separate variable. shouldnt be a problem.
+	{ "WRAM", 1, 0x400000, MMU.MAIN_MEM},
+	{ "WRAX", 1, 0x400000, MMU.MAIN_MEM+0x400000},
+	{ 0 }
+};
+
+SFORMAT SF_LCDM[]={
 	//this size is specially chosen to avoid saving the blank space at the end
 	{ "LCDM", 1, 0xA4000,		MMU.ARM9_LCD},
 	{ 0 }
@@ -803,6 +825,21 @@ static bool ReadStateChunk(EMUFILE* is, const SFORMAT *sf, int size)
 	return true;
 }
 
+//chunk 4 of an older savestate also has what's in chunks 41 and 42 now
+static bool ReadMemChunk(EMUFILE* is, int size)
+{
+	const SFORMAT *tables[] = { SF_MEM, SF_MAINMEM, SF_LCDM };
+	const int start = is->ftell();
+
+	for (size_t i = 0; i < ARRAY_SIZE(tables); i++)
+	{
+		is->fseek(start, SEEK_SET);
+		if (!ReadStateChunk(is, tables[i], size))
+			return false;
+	}
+	return true;
+}
+
 
 
 static int SubWrite(EMUFILE* os, const SFORMAT *sf)
@@ -939,10 +976,89 @@ static void savestate_WriteChunk(EMUFILE* os, int type, void (*saveproc)(EMUFILE
 */
 }
 
+struct SavestateChunk
+{
+	u32 type;
+	const SFORMAT *sf;				//its fields,
+	void (*saveproc)(EMUFILE* os);	//or else what writes it
+};
+
+static const SavestateChunk savestateChunks[] = {
+	{ 1, SF_ARM9, NULL },
+	{ 2, SF_ARM7, NULL },
+	{ 3, NULL, cp15_savestate },
+	{ 4, SF_MEM, NULL },
+	{ 41, SF_MAINMEM, NULL },
+	{ 42, SF_LCDM, NULL },
+	{ 5, SF_NDS, NULL },
+	{ 51, NULL, nds_savestate },
+	{ 60, SF_MMU, NULL },
+	{ 61, NULL, mmu_savestate },
+	{ 7, NULL, gpu_savestate },
+	{ 8, NULL, spu_savestate },
+	{ 81, NULL, mic_savestate },
+	{ 90, SF_GFX3D, NULL },
+	{ 91, NULL, gfx3d_savestate },
+	{ 100, SF_MOVIE, NULL },
+	{ 101, NULL, mov_savestate },
+	{ 110, SF_WIFI, NULL },
+	{ 120, SF_RTC, NULL },
+	{ 130, SF_NDS_INFO, NULL },
+	{ 140, NULL, s_slot1_savestate },
+	{ 150, NULL, s_slot2_savestate },
+	// reserved for future versions
+	{ 160, reserveChunks, NULL },
+	{ 170, reserveChunks, NULL },
+	{ 180, reserveChunks, NULL },
+	// ============================
+};
+
+static void savestate_WriteChunk(EMUFILE* os, const SavestateChunk &chunk)
+{
+	if (chunk.sf)
+		savestate_WriteChunk(os, chunk.type, chunk.sf);
+	else
+		savestate_WriteChunk(os, chunk.type, chunk.saveproc);
+}
+
+struct SavestateTocEntry
+{
+	u32 type;
+	u32 storage;
+	u32 offset;
+	u32 storedSize;
+	u32 size;
+};
+
+//finds the chunks in a stream of them as writechunks writes it
+static bool savestate_ScanChunks(const u8 *data, u32 size, std::vector<SavestateTocEntry> &toc)
+{
+	toc.clear();
+	u32 pos = 0;
+	for (;;)
+	{
+		if (pos + 4 > size) return false;
+		const u32 type = LE_TO_LOCAL_32(*(u32 *)(data + pos));
+		if (type == 0xFFFFFFFF) return true;
+		if ((pos + 8 > size) || (toc.size() == SAVESTATE_TOC_MAX)) return false;
+
+		SavestateTocEntry entry;
+		entry.type = type;
+		entry.storage = SAVESTATE_STORAGE_RAW;
+		entry.offset = pos + 8;
+		entry.size = entry.storedSize = LE_TO_LOCAL_32(*(u32 *)(data + pos + 4));
+		if (entry.size > size - entry.offset) return false;
+
+		toc.push_back(entry);
+		pos = entry.offset + entry.size;
+	}
+}
+
 static void writechunks(EMUFILE* os);
 
 bool savestate_save(EMUFILE* outstream, int compressionLevel)
 {
+	TRACE_ZONE("savestate save");
 #ifdef HAVE_JIT 
 	arm_jit_sync();
 #endif
@@ -950,59 +1066,64 @@ bool savestate_save(EMUFILE* outstream, int compressionLevel)
 	compressionLevel = Z_NO_COMPRESSION;
 	#endif
 
+	//generate the savestate in memory first
 	EMUFILE_MEMORY ms;
-	EMUFILE* os;
-	
-	if(compressionLevel != Z_NO_COMPRESSION)
-	{
-		//generate the savestate in memory first
-		os = (EMUFILE*)&ms;
-		writechunks(os);
-	}
-	else
-	{
-		os = outstream;
-		os->fseek(32,SEEK_SET); //skip the header
-		writechunks(os);
-	}
+	writechunks(&ms);
 
-	//save the length of the file
-	u32 len = os->ftell();
+	std::vector<SavestateTocEntry> toc;
+	if (!savestate_ScanChunks(ms.buf(), ms.size(), toc))
+		return false;
 
-	u32 comprlen = 0xFFFFFFFF;
-	u8* cbuf;
+	outstream->fseek(32 + (int)toc.size() * 24, SEEK_SET); //skip the header and the table
 
-	//compress the data
-	int error = Z_OK;
-	if(compressionLevel != Z_NO_COMPRESSION)
+	std::vector<u8> cbuf;
+	for (size_t i = 0; i < toc.size(); i++)
 	{
-		cbuf = ms.buf();
-		uLongf comprlen2;
-		//worst case compression.
-		//zlib says "0.1% larger than sourceLen plus 12 bytes"
-		comprlen = (len>>9)+12 + len;
-		cbuf = new u8[comprlen];
-		// Workaround to make it compile under linux 64bit
-		comprlen2 = comprlen;
-		error = compress2(cbuf,&comprlen2,ms.buf(),len,compressionLevel);
-		comprlen = (u32)comprlen2;
+		SavestateTocEntry &entry = toc[i];
+		const u8 *data = ms.buf() + entry.offset;
+		const u8 *stored = data;
+
+#ifdef HAVE_LIBZ
+		if (compressionLevel != Z_NO_COMPRESSION && entry.size >= SAVESTATE_COMPRESS_MIN)
+		{
+			uLongf comprlen = compressBound(entry.size);
+			cbuf.resize(comprlen);
+			if (compress2(&cbuf[0], &comprlen, data, entry.size, compressionLevel) == Z_OK && comprlen < entry.size)
+			{
+				entry.storage = SAVESTATE_STORAGE_ZLIB;
+				entry.storedSize = (u32)comprlen;
+				stored = &cbuf[0];
+			}
+		}
+#endif
+
+		write32le(entry.type, outstream);
+		write32le(entry.storedSize, outstream);
+		entry.offset = outstream->ftell();
+		outstream->fwrite(stored, entry.storedSize);
 	}
+	write32le(0xFFFFFFFF, outstream);
+	const int end = outstream->ftell();
 
-	//dump the header
+	//dump the header and the table
 	outstream->fseek(0,SEEK_SET);
 	outstream->fwrite(magic,16);
 	write32le(SAVESTATE_VERSION,outstream);
 	write32le(EMU_DESMUME_VERSION_NUMERIC(),outstream); //desmume version
-	write32le(len,outstream); //uncompressed length
-	write32le(comprlen,outstream); //compressed length (-1 if it is not compressed)
-
-	if(compressionLevel != Z_NO_COMPRESSION)
+	write32le((u32)toc.size(),outstream);
+	write32le(0,outstream); //flags
+	for (size_t i = 0; i < toc.size(); i++)
 	{
-		outstream->fwrite((char*)cbuf,comprlen==(u32)-1?len:comprlen);
-		delete[] cbuf;
+		write32le(toc[i].type, outstream);
+		write32le(toc[i].storage, outstream);
+		write32le(toc[i].offset, outstream);
+		write32le(toc[i].storedSize, outstream);
+		write32le(toc[i].size, outstream);
+		write32le(0, outstream); //reserved
 	}
+	outstream->fseek(end, SEEK_SET);
 
-	return error == Z_OK;
+	return !outstream->fail();
 }
 
 bool savestate_save (const char *file_name)
@@ -1031,31 +1152,8 @@ static void writechunks(EMUFILE* os) {
 
 	save_time = tm.get_Ticks();
 
-	savestate_WriteChunk(os,1,SF_ARM9);
-	savestate_WriteChunk(os,2,SF_ARM7);
-	savestate_WriteChunk(os,3,cp15_savestate);
-	savestate_WriteChunk(os,4,SF_MEM);
-	savestate_WriteChunk(os,5,SF_NDS);
-	savestate_WriteChunk(os,51,nds_savestate);
-	savestate_WriteChunk(os,60,SF_MMU);
-	savestate_WriteChunk(os,61,mmu_savestate);
-	savestate_WriteChunk(os,7,gpu_savestate);
-	savestate_WriteChunk(os,8,spu_savestate);
-	savestate_WriteChunk(os,81,mic_savestate);
-	savestate_WriteChunk(os,90,SF_GFX3D);
-	savestate_WriteChunk(os,91,gfx3d_savestate);
-	savestate_WriteChunk(os,100,SF_MOVIE);
-	savestate_WriteChunk(os,101,mov_savestate);
-	savestate_WriteChunk(os,110,SF_WIFI);
-	savestate_WriteChunk(os,120,SF_RTC);
-	savestate_WriteChunk(os,130,SF_NDS_INFO);
-	savestate_WriteChunk(os,140,s_slot1_savestate);
-	savestate_WriteChunk(os,150,s_slot2_savestate);
-	// reserved for future versions
-	savestate_WriteChunk(os,160,reserveChunks);
-	savestate_WriteChunk(os,170,reserveChunks);
-	savestate_WriteChunk(os,180,reserveChunks);
-	// ============================
+	for (size_t i = 0; i < ARRAY_SIZE(savestateChunks); i++)
+		savestate_WriteChunk(os, savestateChunks[i]);
 	savestate_WriteChunk(os,0xFFFFFFFF,(SFORMAT*)0);
 }
 
@@ -1095,7 +1193,9 @@ static bool ReadStateChunks(EMUFILE* is, s32 totalsize)
 			case 1: if(!ReadStateChunk(is,SF_ARM9,size)) ret=false; break;
 			case 2: if(!ReadStateChunk(is,SF_ARM7,size)) ret=false; break;
 			case 3: if(!cp15_loadstate(is,size)) ret=false; break;
-			case 4: if(!ReadStateChunk(is,SF_MEM,size)) ret=false; break;
+			case 4: if(!ReadMemChunk(is,size)) ret=false; break;
+			case 41: if(!ReadStateChunk(is,SF_MAINMEM,size)) ret=false; break;
+			case 42: if(!ReadStateChunk(is,SF_LCDM,size)) ret=false; break;
 			case 5: if(!ReadStateChunk(is,SF_NDS,size)) ret=false; break;
 			case 51: if(!nds_loadstate(is,size)) ret=false; break;
 			case 60: if(!ReadStateChunk(is,SF_MMU,size)) ret=false; break;
@@ -1193,23 +1293,25 @@ static void loadstate()
 	execute = !driver->EMU_IsEmulationPaused();
 }
 
-bool savestate_load(EMUFILE* is)
+//after the version, SAVESTATE_VERSION_FLAT has the sizes of the chunks, uncompressed and compressed;
+//SAVESTATE_VERSION the number of chunks and the flags
+static bool savestate_ReadHeader(EMUFILE* is, u32 &ssversion, u32 &a, u32 &b)
 {
-	SAV_silent_fail_flag = false;
 	char header[16];
 	is->fread(header,16);
 	if(is->fail() || memcmp(header,magic,16))
 		return false;
 
-	u32 ssversion,len,comprlen;
 	if(!read32le(&ssversion,is)) return false;
 	if(!read32le(&_DESMUME_version,is)) return false;
-	if(!read32le(&len,is)) return false;
-	if(!read32le(&comprlen,is)) return false;
-
-	if(ssversion != SAVESTATE_VERSION) return false;
+	if(!read32le(&a,is)) return false;
+	if(!read32le(&b,is)) return false;
+	return true;
+}
 
-	std::vector<u8> buf(len);
+static bool savestate_ReadFlat(EMUFILE* is, u32 len, u32 comprlen, std::vector<u8> &buf)
+{
+	buf.resize(len);
 
 	if(comprlen != 0xFFFFFFFF) {
 #ifndef HAVE_LIBZ
@@ -1229,6 +1331,117 @@ bool savestate_load(EMUFILE* is)
 	} else {
 		is->fread((char*)&buf[0],len-32);
 	}
+	return true;
+}
+
+static bool savestate_ReadToc(EMUFILE* is, u32 count, std::vector<SavestateTocEntry> &toc)
+{
+	if (count > SAVESTATE_TOC_MAX)
+		return false;
+
+	toc.resize(count);
+	for (u32 i = 0; i < count; i++)
+	{
+		SavestateTocEntry &entry = toc[i];
+		u32 reserved;
+		if (!read32le(&entry.type,is)) return false;
+		if (!read32le(&entry.storage,is)) return false;
+		if (!read32le(&entry.offset,is)) return false;
+		if (!read32le(&entry.storedSize,is)) return false;
+		if (!read32le(&entry.size,is)) return false;
+		if (!read32le(&reserved,is)) return false;
+	}
+	return true;
+}
+
+//reads a chunk's data, as it's loaded, to data (entry.size bytes)
+static bool savestate_ReadChunkData(EMUFILE* is, int base, const SavestateTocEntry &entry, u8 *data, std::vector<u8> &cbuf)
+{
+	is->fseek(base + entry.offset, SEEK_SET);
+
+	if (entry.storage == SAVESTATE_STORAGE_RAW)
+	{
+		if (entry.storedSize != entry.size) return false;
+		if (entry.size != 0)
+			is->fread(data, entry.size);
+		return !is->fail();
+	}
+
+#ifdef HAVE_LIBZ
+	if (entry.storage == SAVESTATE_STORAGE_ZLIB && entry.storedSize != 0)
+	{
+		cbuf.resize(entry.storedSize);
+		is->fread(&cbuf[0], entry.storedSize);
+		if (is->fail()) return false;
+
+		uLongf uncomprlen = entry.size;
+		int error = uncompress(data, &uncomprlen, &cbuf[0], entry.storedSize);
+		return (error == Z_OK) && (uncomprlen == entry.size);
+	}
+#endif
+
+	//without libz, we can't decompress this chunk
+	return false;
+}
+
+//puts the chunks listed in the table together into the stream ReadStateChunks parses
+static bool savestate_ReadChunks(EMUFILE* is, int base, u32 count, std::vector<u8> &buf)
+{
+	std::vector<SavestateTocEntry> toc;
+	if (!savestate_ReadToc(is, count, toc))
+		return false;
+
+	u32 len = 4;
+	for (size_t i = 0; i < toc.size(); i++)
+	{
+		//no chunk comes anywhere near this
+		if (toc[i].size > 0x4000000) return false;
+		len += 8 + toc[i].size;
+	}
+	buf.resize(len);
+
+	std::vector<u8> cbuf;
+	u32 pos = 0;
+	for (size_t i = 0; i < toc.size(); i++)
+	{
+		const SavestateTocEntry &entry = toc[i];
+		const u32 header[2] = { LOCAL_TO_LE_32(entry.type), LOCAL_TO_LE_32(entry.size) };
+		memcpy(&buf[pos], header, 8);
+		u8 *data = &buf[pos + 8];
+		pos += 8 + entry.size;
+
+		if (!savestate_ReadChunkData(is, base, entry, data, cbuf))
+			return false;
+	}
+
+	const u32 end = 0xFFFFFFFF;
+	memcpy(&buf[pos], &end, 4);
+	return true;
+}
+
+bool savestate_load(EMUFILE* is)
+{
+	TRACE_ZONE("savestate load");
+	SAV_silent_fail_flag = false;
+
+	const int base = is->ftell();
+	u32 ssversion, a, b;
+	if (!savestate_ReadHeader(is, ssversion, a, b))
+		return false;
+
+	std::vector<u8> buf;
+	if (ssversion == SAVESTATE_VERSION)
+	{
+		if (!savestate_ReadChunks(is, base, a, buf))
+			return false;
+	}
+	else if (ssversion == SAVESTATE_VERSION_FLAT)
+	{
+		if (!savestate_ReadFlat(is, a, b, buf))
+			return false;
+	}
+	else
+		return false;
 
 	//GO!! READ THE SAVESTATE
 	//THERE IS NO GOING BACK NOW
@@ -1252,7 +1465,7 @@ bool savestate_load(EMUFILE* is)
 	//SPU_Reset();
 
 	EMUFILE_MEMORY mstemp(&buf);
-	bool x = ReadStateChunks(&mstemp,(s32)len);
+	bool x = ReadStateChunks(&mstemp,(s32)buf.size());
 
 	if(!x && !SAV_silent_fail_flag)
 	{
@@ -1304,8 +1517,12 @@ void rewindsave () {
 		ms = new EMUFILE_MEMORY(1024*1024*12);
 	}
 
-	if(!savestate_save(ms, Z_NO_COMPRESSION))
-		return;
+	//just the chunks: these never leave memory, so they don't need the header or the table
+#ifdef HAVE_JIT
+	arm_jit_sync();
+#endif
+	ms->fseek(0, SEEK_SET);
+	writechunks(ms);
 
 	rewindbuffer.push_back(ms);
 	
@@ -1332,9 +1549,9 @@ void dorewind()
 	printf("%d", size);
 
 	EMUFILE_MEMORY* loadms = rewindbuffer[size-1];
-	loadms->fseek(32, SEEK_SET);
+	loadms->fseek(0, SEEK_SET);
 
-	ReadStateChunks(loadms,loadms->size()-32);
+	ReadStateChunks(loadms,loadms->size());
 	loadstate();
 
 	if(rewindbuffer.size()>1)
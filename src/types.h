@@ -68,6 +68,10 @@
 	#ifdef __SSSE3__
 		#define ENABLE_SSSE3
 	#endif
+
+	#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+		#define ENABLE_NEON
+	#endif
 #endif
 
 #ifdef _MSC_VER 
@@ -17,6 +17,7 @@
 
 #include <stdio.h>
 #include <time.h>
+#include <algorithm>
 
 #define TIXML_USE_STL
 #include "tinyxml/tinyxml.h"
@@ -33,58 +34,106 @@ ADVANsCEne advsc;
 #define _ADVANsCEne_BASE_VERSION_MINOR 0
 #define _ADVANsCEne_BASE_NAME "ADVANsCEne Nintendo DS Collection"
 
-u8 ADVANsCEne::checkDB(const char *ROMserial, u32 crc)
+#define _ADVANsCEne_RECORD_SIZE 21
+#define _ADVANsCEne_NO_RECORD 0xFFFFFFFF
+
+bool ADVANsCEne::buildIndex()
 {
-	loaded = false;
+	indexBuilt = true;
+	records.clear();
+	serialIndex.clear();
+	crcIndex.clear();
+
 	FILE *fp = fopen(database_path.c_str(), "rb");
-	if (fp)
+	if (!fp) return false;
+
+	bool res = false;
+	char buf[64];
+	memset(buf, 0, sizeof(buf));
+	if ((fread(buf, 1, strlen(_ADVANsCEne_BASE_ID), fp) == strlen(_ADVANsCEne_BASE_ID)) && (strcmp(buf, _ADVANsCEne_BASE_ID) == 0)
+		&& (fread(&versionBase[0], 1, 2, fp) == 2)
+		&& (fread(&version[0], 1, 4, fp) == 4)
+		&& (fread(&createTime, 1, sizeof(time_t), fp) == sizeof(time_t)))
 	{
-		char buf[64];
-		memset(buf, 0, sizeof(buf));
-		if (fread(buf, 1, strlen(_ADVANsCEne_BASE_ID), fp) == strlen(_ADVANsCEne_BASE_ID))
+		//pull every record in with one read rather than 21 bytes at a time
+		const long start = ftell(fp);
+		fseek(fp, 0, SEEK_END);
+		const long end = ftell(fp);
+		fseek(fp, start, SEEK_SET);
+
+		const u32 count = (end > start) ? (u32)(end - start) / _ADVANsCEne_RECORD_SIZE : 0;
+		std::vector<u8> data(count * _ADVANsCEne_RECORD_SIZE + 1);
+		if (fread(&data[0], 1, count * _ADVANsCEne_RECORD_SIZE, fp) == count * _ADVANsCEne_RECORD_SIZE)
 		{
-			//printf("ID: %s\n", buf);
-			if (strcmp(buf, _ADVANsCEne_BASE_ID) == 0)
+			// serial(8) + crc32(4) + save_type(1) = 13 + reserved(8) = 21
+			records.resize(count);
+			serialIndex.resize(count);
+			crcIndex.resize(count);
+			for (u32 i = 0; i < count; i++)
 			{
-				if (fread(&versionBase[0], 1, 2, fp) == 2)
-				{
-					//printf("Version base: %i.%i\n", versionBase[0], versionBase[1]);
-					if (fread(&version[0], 1, 4, fp) == 4)
-					{
-						//printf("Version: %c%c%c%c\n", version[3], version[2], version[1], version[0]);
-						if (fread(&createTime, 1, sizeof(time_t), fp) == sizeof(time_t))
-						{
-							memset(buf, 0,sizeof(buf));
-							// serial(8) + crc32(4) + save_type(1) = 13 + reserved(8) = 21
-							while (true)
-							{
-								if (fread(buf, 1, 21, fp) != 21) break;
-
-								bool serialFound = (memcmp(&buf[4], ROMserial, 4) == 0);
-								u32 dbcrc = LE_TO_LOCAL_32(*(u32*)(buf+8));
-								bool crcFound = (crc == dbcrc);
-
-								if(serialFound || crcFound)
-								{
-									foundAsCrc = crcFound;
-									foundAsSerial = serialFound;
-									memcpy(&crc32, &buf[8], 4);
-									memcpy(&serial[0], &buf[4], 4);
-									//printf("%s founded: crc32=%04X, save type %02X\n", ROMserial, crc32, buf[12]);
-									saveType = buf[12];
-									fclose(fp);
-									loaded = true;
-									return true;
-								}
-							}
-						}
-					}
-				}
+				const u8 *rec = &data[i * _ADVANsCEne_RECORD_SIZE];
+				memcpy(&records[i].serial, rec + 4, 4);
+				records[i].crc = LE_TO_LOCAL_32(*(u32*)(rec + 8));
+				records[i].saveType = rec[12];
+
+				serialIndex[i].key = records[i].serial;
+				serialIndex[i].record = i;
+				crcIndex[i].key = records[i].crc;
+				crcIndex[i].record = i;
 			}
+			std::sort(serialIndex.begin(), serialIndex.end());
+			std::sort(crcIndex.begin(), crcIndex.end());
+			res = true;
 		}
-		fclose(fp);
 	}
-	return false;
+	fclose(fp);
+
+	if (!res)
+	{
+		records.clear();
+		serialIndex.clear();
+		crcIndex.clear();
+	}
+	return res;
+}
+
+//returns the earliest record with the given key, since the index is ordered by record within a key
+u32 ADVANsCEne::findFirstRecord(const std::vector<DBIndexEntry> &index, u32 key) const
+{
+	DBIndexEntry probe;
+	probe.key = key;
+	probe.record = 0;
+	std::vector<DBIndexEntry>::const_iterator it = std::lower_bound(index.begin(), index.end(), probe);
+	if ((it == index.end()) || (it->key != key))
+		return _ADVANsCEne_NO_RECORD;
+	return it->record;
+}
+
+u8 ADVANsCEne::checkDB(const char *ROMserial, u32 crc)
+{
+	loaded = false;
+	if (!indexBuilt)
+		buildIndex();
+	if (records.empty()) return false;
+
+	u32 serialKey;
+	memcpy(&serialKey, ROMserial, 4);
+
+	//the old linear scan took the first record matching either the serial or the crc, so keep that order
+	const u32 bySerial = findFirstRecord(serialIndex, serialKey);
+	const u32 byCrc = findFirstRecord(crcIndex, crc);
+	const u32 found = std::min(bySerial, byCrc);
+	if (found == _ADVANsCEne_NO_RECORD) return false;
+
+	const DBRecord &rec = records[found];
+	foundAsCrc = (rec.crc == crc);
+	foundAsSerial = (rec.serial == serialKey);
+	crc32 = rec.crc;
+	memcpy(&serial[0], &rec.serial, 4);
+	//printf("%s founded: crc32=%04X, save type %02X\n", ROMserial, crc32, rec.saveType);
+	saveType = rec.saveType;
+	loaded = true;
+	return true;
 }
 
  
@@ -94,6 +143,7 @@ void ADVANsCEne::setDatabase(const char *path)
 	
 	//i guess this means it needs (re)loading on account of the path having changed
 	loaded = false;
+	indexBuilt = false;
 }
 
 bool ADVANsCEne::getXMLConfig(const char *in_filename)
@@ -242,5 +292,8 @@ u32 ADVANsCEne::convertDB(const char *in_filename, EMUFILE* output)
 	else
 		printf("error\n");
 	printf("ADVANsCEne converter: %i found\n", count);
+
+	//the database may have just been rewritten underneath us
+	indexBuilt = false;
 	return count;
 }
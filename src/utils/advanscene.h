@@ -16,6 +16,7 @@
 */
 
 #include <string>
+#include <vector>
 #include "../types.h"
 
 class EMUFILE;
@@ -34,6 +35,27 @@ private:
 	bool			loaded;
 	bool foundAsCrc, foundAsSerial;
 
+	// the database is read once and kept as records in file order, plus two indexes sorted by
+	// (key, record) so a lookup is a pair of binary searches instead of a scan of the file
+	struct DBRecord
+	{
+		u32 serial;
+		u32 crc;
+		u8 saveType;
+	};
+	struct DBIndexEntry
+	{
+		u32 key;
+		u32 record;
+		bool operator<(const DBIndexEntry &other) const { return (key < other.key) || ((key == other.key) && (record < other.record)); }
+	};
+	std::vector<DBRecord> records;
+	std::vector<DBIndexEntry> serialIndex;
+	std::vector<DBIndexEntry> crcIndex;
+	bool indexBuilt;
+	bool buildIndex();
+	u32 findFirstRecord(const std::vector<DBIndexEntry> &index, u32 key) const;
+
 	// XML
 	std::string datName;
 	std::string datVersion;
@@ -45,7 +67,8 @@ public:
 	ADVANsCEne()
 		: saveType(0xFF),
 		crc32(0),
-		loaded(false)
+		loaded(false),
+		indexBuilt(false)
 	{
 		memset(versionBase, 0, sizeof(versionBase));
 		memset(version, 0, sizeof(version));
@@ -0,0 +1,223 @@
+/*
+	Copyright (C) 2016 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "blit.h"
+
+#include <string.h>
+#include <algorithm>
+#include "simd.h"
+
+#define BLIT_TILE 8
+
+size_t Blit_PixelBytes(BlitFormat format)
+{
+	switch (format)
+	{
+		case BlitFormat_RGBA8888: return 4;
+		case BlitFormat_RGB565: return 2;
+		case BlitFormat_BGR888: return 3;
+	}
+	return 0;
+}
+
+static size_t blit_srcPixelBytes(NDSColorFormat format)
+{
+	return (format == NDSColorFormat_BGR555_Rev) ? 2 : 4;
+}
+
+//widen a source pixel to 8 bits per channel
+static FORCEINLINE void blit_unpack(const u8 *src, NDSColorFormat format, u8 &r, u8 &g, u8 &b)
+{
+	if (format == NDSColorFormat_BGR555_Rev)
+	{
+		const u16 c = LE_TO_LOCAL_16(*(const u16 *)src);
+		const u8 r5 = c & 0x1F, g5 = (c >> 5) & 0x1F, b5 = (c >> 10) & 0x1F;
+		r = (r5 << 3) | (r5 >> 2);
+		g = (g5 << 3) | (g5 >> 2);
+		b = (b5 << 3) | (b5 >> 2);
+	}
+	else if (format == NDSColorFormat_BGR666_Rev)
+	{
+		//FragmentColor, 6 bits a channel
+		r = (src[0] << 2) | (src[0] >> 4);
+		g = (src[1] << 2) | (src[1] >> 4);
+		b = (src[2] << 2) | (src[2] >> 4);
+	}
+	else
+	{
+		r = src[0];
+		g = src[1];
+		b = src[2];
+	}
+}
+
+static FORCEINLINE void blit_pack(u8 *dst, BlitFormat format, u8 r, u8 g, u8 b)
+{
+	switch (format)
+	{
+		case BlitFormat_RGBA8888:
+			*(u32 *)dst = ((u32)r << 24) | ((u32)g << 16) | ((u32)b << 8) | 0xFF;
+			break;
+
+		case BlitFormat_RGB565:
+			*(u16 *)dst = (u16)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+			break;
+
+		case BlitFormat_BGR888:
+			dst[0] = b;
+			dst[1] = g;
+			dst[2] = r;
+			break;
+	}
+}
+
+//converts n pixels into contiguous output. BGR555 to the 16 and 32 bit formats, which is what the GPU
+//actually hands out today, goes 8 pixels at a time; the rest is per pixel.
+static void blit_convertRow(const u8 *src, NDSColorFormat srcFormat, u8 *dst, BlitFormat dstFormat, size_t n)
+{
+	size_t i = 0;
+
+#if defined(ENABLE_SIMD128) && defined(LOCAL_LE)
+	if (srcFormat == NDSColorFormat_BGR555_Rev && dstFormat != BlitFormat_BGR888)
+	{
+		const v128u16 mask5 = v128u16_set1(0x001F);
+
+		for (; i + 8 <= n; i += 8)
+		{
+			const v128u16 c = v128u16_loadu_u8(src + i * 2);
+			const v128u16 r5 = v128u16_and(c, mask5);
+			const v128u16 g5 = v128u16_and(v128u16_srli<5>(c), mask5);
+			const v128u16 b5 = v128u16_and(v128u16_srli<10>(c), mask5);
+
+			if (dstFormat == BlitFormat_RGB565)
+			{
+				const v128u16 g6 = v128u16_or(v128u16_slli<1>(g5), v128u16_srli<4>(g5));
+				const v128u16 out = v128u16_or(v128u16_or(v128u16_slli<11>(r5), v128u16_slli<5>(g6)), b5);
+				v128u16_storeu((u16 *)(dst + i * 2), out);
+			}
+			else
+			{
+				const v128u16 r8 = v128u16_or(v128u16_slli<3>(r5), v128u16_srli<2>(r5));
+				const v128u16 g8 = v128u16_or(v128u16_slli<3>(g5), v128u16_srli<2>(g5));
+				const v128u16 b8 = v128u16_or(v128u16_slli<3>(b5), v128u16_srli<2>(b5));
+
+				//as u32s, 0xRRGGBBAA is RRGG in the high half and BBAA in the low one
+				const v128u16 hi = v128u16_or(v128u16_slli<8>(r8), g8);
+				const v128u16 lo = v128u16_or(v128u16_slli<8>(b8), v128u16_set1(0x00FF));
+				v128u16_storeu((u16 *)(dst + i * 4), v128u16_unpacklo(lo, hi));
+				v128u16_storeu((u16 *)(dst + i * 4 + 16), v128u16_unpackhi(lo, hi));
+			}
+		}
+	}
+#endif
+
+	const size_t srcBytes = blit_srcPixelBytes(srcFormat);
+	const size_t dstBytes = Blit_PixelBytes(dstFormat);
+	for (; i < n; i++)
+	{
+		u8 r, g, b;
+		blit_unpack(src + i * srcBytes, srcFormat, r, g, b);
+		blit_pack(dst + i * dstBytes, dstFormat, r, g, b);
+	}
+}
+
+//writes a converted tile out through the rotation. the inner loop always runs along the buffer's rows,
+//so each tile column (90/270) or tile row (180) is one short contiguous store.
+template<size_t BYTES>
+static void blit_storeTile(const u8 *tile, size_t tileW, size_t tileH, u8 *dst, ptrdiff_t dx, ptrdiff_t dy)
+{
+	if (dy == 1 || dy == -1)
+	{
+		for (size_t i = 0; i < tileW; i++)
+		{
+			u8 *out = dst + (ptrdiff_t)i * dx * (ptrdiff_t)BYTES;
+			for (size_t j = 0; j < tileH; j++, out += dy * (ptrdiff_t)BYTES)
+				memcpy(out, tile + (j * BLIT_TILE + i) * BYTES, BYTES);
+		}
+	}
+	else
+	{
+		for (size_t j = 0; j < tileH; j++)
+		{
+			u8 *out = dst + (ptrdiff_t)j * dy * (ptrdiff_t)BYTES;
+			for (size_t i = 0; i < tileW; i++, out += dx * (ptrdiff_t)BYTES)
+				memcpy(out, tile + (j * BLIT_TILE + i) * BYTES, BYTES);
+		}
+	}
+}
+
+void Blit_Copy(const void *src, NDSColorFormat srcFormat, size_t srcWidth, size_t srcHeight, const BlitTarget &dst, int x, int y)
+{
+	//clip to the upright target
+	const ptrdiff_t x0 = (x < 0) ? -x : 0;
+	const ptrdiff_t y0 = (y < 0) ? -y : 0;
+	const ptrdiff_t x1 = std::min<ptrdiff_t>((ptrdiff_t)srcWidth, (ptrdiff_t)dst.width - x);
+	const ptrdiff_t y1 = std::min<ptrdiff_t>((ptrdiff_t)srcHeight, (ptrdiff_t)dst.height - y);
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	const size_t srcBytes = blit_srcPixelBytes(srcFormat);
+	const size_t dstBytes = Blit_PixelBytes(dst.format);
+	const size_t srcPitch = srcWidth * srcBytes;
+	const u8 *in = (const u8 *)src;
+	u8 *out = (u8 *)dst.buffer;
+
+	//the buffer index of upright pixel (X,Y) is base + X*dx + Y*dy
+	const ptrdiff_t pitch = (ptrdiff_t)dst.pitch;
+	const ptrdiff_t w = (ptrdiff_t)dst.width, h = (ptrdiff_t)dst.height;
+	ptrdiff_t base, dx, dy;
+	switch (dst.rotation)
+	{
+		default:
+		case BlitRotation_0:   base = 0;                       dx = 1;      dy = pitch;  break;
+		case BlitRotation_90:  base = h - 1;                   dx = pitch;  dy = -1;     break;
+		case BlitRotation_180: base = (h - 1) * pitch + w - 1; dx = -1;     dy = -pitch; break;
+		case BlitRotation_270: base = (w - 1) * pitch;         dx = -pitch; dy = 1;      break;
+	}
+
+	if (dst.rotation == BlitRotation_0)
+	{
+		for (ptrdiff_t j = y0; j < y1; j++)
+			blit_convertRow(in + j * srcPitch + x0 * srcBytes, srcFormat, out + (base + (x + x0) * dx + (y + j) * dy) * dstBytes, dst.format, x1 - x0);
+		return;
+	}
+
+	CACHE_ALIGN u8 tile[BLIT_TILE * BLIT_TILE * 4];
+	for (ptrdiff_t ty = y0; ty < y1; ty += BLIT_TILE)
+	{
+		const size_t tileH = (size_t)std::min<ptrdiff_t>(BLIT_TILE, y1 - ty);
+		for (ptrdiff_t tx = x0; tx < x1; tx += BLIT_TILE)
+		{
+			const size_t tileW = (size_t)std::min<ptrdiff_t>(BLIT_TILE, x1 - tx);
+			for (size_t j = 0; j < tileH; j++)
+				blit_convertRow(in + (ty + j) * srcPitch + tx * srcBytes, srcFormat, tile + j * BLIT_TILE * dstBytes, dst.format, tileW);
+
+			u8 *corner = out + (base + (x + tx) * dx + (y + ty) * dy) * (ptrdiff_t)dstBytes;
+			switch (dstBytes)
+			{
+				case 2: blit_storeTile<2>(tile, tileW, tileH, corner, dx, dy); break;
+				case 3: blit_storeTile<3>(tile, tileW, tileH, corner, dx, dy); break;
+				case 4: blit_storeTile<4>(tile, tileW, tileH, corner, dx, dy); break;
+			}
+		}
+	}
+}
+
+void Blit_Display(const NDSDisplayInfo &info, NDSDisplayID displayID, const BlitTarget &dst, int x, int y)
+{
+	Blit_Copy(info.renderedBuffer[displayID], info.colorFormat, info.renderedWidth[displayID], info.renderedHeight[displayID], dst, x, y);
+}
@@ -0,0 +1,66 @@
+/*
+	Copyright (C) 2016 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _BLIT_H_
+#define _BLIT_H_
+
+#include <stddef.h>
+#include "../types.h"
+#include "../GPU.h"
+
+//Copies a GPU output buffer into a host framebuffer, converting the colors and rotating in one pass.
+//Handhelds commonly scan their panels out sideways, so a frontend otherwise ends up writing one pixel per
+//cache line going down a column; here rotated output is done in 8x8 tiles, which keeps the stores together.
+//Nothing here touches emulator state, so it can be used (and tested) on its own.
+
+enum BlitFormat
+{
+	BlitFormat_RGBA8888,	//u32 0xRRGGBBAA, alpha always opaque (GL_RGBA8_OES on the 3DS)
+	BlitFormat_RGB565,		//u16, red in the top bits
+	BlitFormat_BGR888		//three bytes: blue, green, red
+};
+
+//how the buffer's rows lie relative to the upright picture, as degrees clockwise.
+//with BlitRotation_90, the first row of the buffer is the picture's left column, read bottom to top.
+enum BlitRotation
+{
+	BlitRotation_0,
+	BlitRotation_90,
+	BlitRotation_180,
+	BlitRotation_270
+};
+
+struct BlitTarget
+{
+	void *buffer;
+	BlitFormat format;
+	BlitRotation rotation;
+	size_t width;		//the target as seen upright, in pixels
+	size_t height;
+	size_t pitch;		//pixels from the start of one row of the buffer to the next, as it lies in memory
+};
+
+size_t Blit_PixelBytes(BlitFormat format);
+
+//copies the srcWidth x srcHeight picture at src so that its top left lands at (x,y) of the upright target.
+//anything falling outside the target is clipped.
+void Blit_Copy(const void *src, NDSColorFormat srcFormat, size_t srcWidth, size_t srcHeight, const BlitTarget &dst, int x, int y);
+
+//the same for whatever a display rendered this frame, native or custom sized
+void Blit_Display(const NDSDisplayInfo &info, NDSDisplayID displayID, const BlitTarget &dst, int x, int y);
+
+#endif
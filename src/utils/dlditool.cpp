@@ -779,11 +779,19 @@ data_t r4_dldi[2276] =
 	0x00, 0x00, 0x00, 0x00
 };
 
-bool tryPatch(void* data, size_t size, unsigned int device)
+// Find the DSDI reserved space in the file. A previously found offset (hint) is only re-checked
+// against the magic string, so a cached answer saves scanning the whole image again
+int findPatch(const void* data, size_t size, int hint)
 {
-	// Find the DSDI reserved space in the file
-	addr_t patchOffset = quickFind ((data_t*)data, dldiMagicString, size, sizeof(dldiMagicString)/sizeof(char));
+	const size_t magicLen = sizeof(dldiMagicString)/sizeof(char);
+	if ((hint >= 0) && ((size_t)hint + magicLen <= size) && (memcmp((const data_t*)data + hint, dldiMagicString, magicLen) == 0))
+		return hint;
+
+	return quickFind ((const data_t*)data, dldiMagicString, size, magicLen);
+}
 
+bool tryPatch(void* data, size_t size, unsigned int device, int patchOffset)
+{
 	//no DLDI section
 	if (patchOffset < 0)
 		return false;
@@ -892,4 +900,9 @@ bool tryPatch(void* data, size_t size, unsigned int device)
 	return true;
 }
 
+bool tryPatch(void* data, size_t size, unsigned int device)
+{
+	return tryPatch(data, size, device, findPatch(data, size, -1));
+}
+
 } //namespace DLDI
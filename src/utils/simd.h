@@ -0,0 +1,415 @@
+/*
+	Copyright (C) 2016 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SIMD_H_
+#define _SIMD_H_
+
+#include "../types.h"
+
+//A thin layer over 128-bit vectors of eight 16-bit lanes (v128u16) or sixteen 8-bit lanes
+//(v128u8), so that vector code can be written once for SSE2, NEON and everything else. Every
+//operation has exactly the semantics of the SSE2 intrinsic it is named after, so results are
+//bit-identical between the backends. Hosts with neither unit (the 3DS's ARM11 among them) get
+//a SWAR backend that packs the lanes into 32-bit words, so ENABLE_SIMD128 is always defined.
+
+#if defined(ENABLE_SSE2)
+
+#include <emmintrin.h>
+#define ENABLE_SIMD128
+
+typedef __m128i v128u16;
+
+FORCEINLINE v128u16 v128u16_load(const u16 *p) { return _mm_load_si128((const __m128i *)p); }
+FORCEINLINE v128u16 v128u16_loadu(const u16 *p) { return _mm_loadu_si128((const __m128i *)p); }
+FORCEINLINE void v128u16_store(u16 *p, const v128u16 &v) { _mm_store_si128((__m128i *)p, v); }
+FORCEINLINE void v128u16_storeu(u16 *p, const v128u16 &v) { _mm_storeu_si128((__m128i *)p, v); }
+FORCEINLINE v128u16 v128u16_loadu_u8(const u8 *p) { return _mm_loadu_si128((const __m128i *)p); } //16 bytes, any alignment
+
+FORCEINLINE v128u16 v128u16_set1(const u16 x) { return _mm_set1_epi16((s16)x); }
+FORCEINLINE v128u16 v128u16_setzero() { return _mm_setzero_si128(); }
+
+//lane 0 first
+FORCEINLINE v128u16 v128u16_set(const u16 x0, const u16 x1, const u16 x2, const u16 x3, const u16 x4, const u16 x5, const u16 x6, const u16 x7)
+{
+	return _mm_set_epi16(x7, x6, x5, x4, x3, x2, x1, x0);
+}
+
+FORCEINLINE v128u16 v128u16_and(const v128u16 &a, const v128u16 &b) { return _mm_and_si128(a, b); }
+FORCEINLINE v128u16 v128u16_or(const v128u16 &a, const v128u16 &b) { return _mm_or_si128(a, b); }
+FORCEINLINE v128u16 v128u16_andnot(const v128u16 &a, const v128u16 &b) { return _mm_andnot_si128(a, b); } //(~a) & b
+FORCEINLINE v128u16 v128u16_xor(const v128u16 &a, const v128u16 &b) { return _mm_xor_si128(a, b); }
+
+FORCEINLINE v128u16 v128u16_add(const v128u16 &a, const v128u16 &b) { return _mm_add_epi16(a, b); }
+FORCEINLINE v128u16 v128u16_sub(const v128u16 &a, const v128u16 &b) { return _mm_sub_epi16(a, b); }
+FORCEINLINE v128u16 v128u16_mullo(const v128u16 &a, const v128u16 &b) { return _mm_mullo_epi16(a, b); }
+FORCEINLINE v128u16 v128u16_cmpeq(const v128u16 &a, const v128u16 &b) { return _mm_cmpeq_epi16(a, b); }
+FORCEINLINE bool v128u16_alltrue(const v128u16 &v) { return (_mm_movemask_epi8(v) == 0xFFFF); } //every lane 0xFFFF
+
+//signed, like _mm_min_epi16. the callers only ever compare values below 0x8000.
+FORCEINLINE v128u16 v128u16_min(const v128u16 &a, const v128u16 &b) { return _mm_min_epi16(a, b); }
+
+template<int N> FORCEINLINE v128u16 v128u16_srli(const v128u16 &v) { return _mm_srli_epi16(v, N); }
+template<int N> FORCEINLINE v128u16 v128u16_slli(const v128u16 &v) { return _mm_slli_epi16(v, N); }
+
+//interleave the low (or high) four lanes of a and b: a0 b0 a1 b1 ... which, stored, makes four u32s of (b<<16)|a
+FORCEINLINE v128u16 v128u16_unpacklo(const v128u16 &a, const v128u16 &b) { return _mm_unpacklo_epi16(a, b); }
+FORCEINLINE v128u16 v128u16_unpackhi(const v128u16 &a, const v128u16 &b) { return _mm_unpackhi_epi16(a, b); }
+
+//split eight 4-byte pixels (32 bytes) into one vector per byte: lane i of cN is byte N of pixel i
+FORCEINLINE void v128u16_load_u8x4(const u8 *p, v128u16 &c0, v128u16 &c1, v128u16 &c2, v128u16 &c3)
+{
+	const __m128i lo = _mm_loadu_si128((const __m128i *)p);
+	const __m128i hi = _mm_loadu_si128((const __m128i *)(p + 16));
+	const __m128i byteMask = _mm_set1_epi32(0x000000FF);
+	
+	c0 = _mm_packs_epi32( _mm_and_si128(lo, byteMask), _mm_and_si128(hi, byteMask) );
+	c1 = _mm_packs_epi32( _mm_and_si128(_mm_srli_epi32(lo, 8), byteMask), _mm_and_si128(_mm_srli_epi32(hi, 8), byteMask) );
+	c2 = _mm_packs_epi32( _mm_and_si128(_mm_srli_epi32(lo, 16), byteMask), _mm_and_si128(_mm_srli_epi32(hi, 16), byteMask) );
+	c3 = _mm_packs_epi32( _mm_srli_epi32(lo, 24), _mm_srli_epi32(hi, 24) );
+}
+
+typedef __m128i v128u8;
+
+FORCEINLINE v128u8 v128u8_load(const u8 *p) { return _mm_load_si128((const __m128i *)p); }
+FORCEINLINE v128u8 v128u8_loadu(const u8 *p) { return _mm_loadu_si128((const __m128i *)p); }
+FORCEINLINE v128u8 v128u8_loadl(const u8 *p) { return _mm_loadl_epi64((const __m128i *)p); } //8 bytes, the upper lanes zeroed
+FORCEINLINE void v128u8_store(u8 *p, const v128u8 &v) { _mm_store_si128((__m128i *)p, v); }
+FORCEINLINE void v128u8_storeu(u8 *p, const v128u8 &v) { _mm_storeu_si128((__m128i *)p, v); }
+FORCEINLINE void v128u8_storel(u8 *p, const v128u8 &v) { _mm_storel_epi64((__m128i *)p, v); } //the lower 8 bytes
+
+FORCEINLINE v128u8 v128u8_set1(const u8 x) { return _mm_set1_epi8((s8)x); }
+FORCEINLINE v128u8 v128u8_setzero() { return _mm_setzero_si128(); }
+
+FORCEINLINE v128u8 v128u8_and(const v128u8 &a, const v128u8 &b) { return _mm_and_si128(a, b); }
+FORCEINLINE v128u8 v128u8_or(const v128u8 &a, const v128u8 &b) { return _mm_or_si128(a, b); }
+FORCEINLINE v128u8 v128u8_andnot(const v128u8 &a, const v128u8 &b) { return _mm_andnot_si128(a, b); } //(~a) & b
+FORCEINLINE v128u8 v128u8_xor(const v128u8 &a, const v128u8 &b) { return _mm_xor_si128(a, b); }
+
+FORCEINLINE v128u8 v128u8_sub(const v128u8 &a, const v128u8 &b) { return _mm_sub_epi8(a, b); }
+FORCEINLINE v128u8 v128u8_cmpeq(const v128u8 &a, const v128u8 &b) { return _mm_cmpeq_epi8(a, b); }
+
+//zero-extend the low (or high) eight bytes to 16-bit lanes
+FORCEINLINE v128u16 v128u8_unpacklo_u16(const v128u8 &v) { return _mm_unpacklo_epi8(v, _mm_setzero_si128()); }
+FORCEINLINE v128u16 v128u8_unpackhi_u16(const v128u8 &v) { return _mm_unpackhi_epi8(v, _mm_setzero_si128()); }
+
+//narrow two vectors of 16-bit masks (every lane 0 or 0xFFFF) to one vector of 8-bit masks
+FORCEINLINE v128u8 v128u8_packmask(const v128u16 &lo, const v128u16 &hi) { return _mm_packs_epi16(lo, hi); }
+
+#elif defined(ENABLE_NEON)
+
+#include <arm_neon.h>
+#define ENABLE_SIMD128
+
+typedef uint16x8_t v128u16;
+
+FORCEINLINE v128u16 v128u16_load(const u16 *p) { return vld1q_u16(p); }
+FORCEINLINE v128u16 v128u16_loadu(const u16 *p) { return vld1q_u16(p); }
+FORCEINLINE void v128u16_store(u16 *p, const v128u16 &v) { vst1q_u16(p, v); }
+FORCEINLINE void v128u16_storeu(u16 *p, const v128u16 &v) { vst1q_u16(p, v); }
+FORCEINLINE v128u16 v128u16_loadu_u8(const u8 *p) { return vreinterpretq_u16_u8(vld1q_u8(p)); } //16 bytes, any alignment
+
+FORCEINLINE v128u16 v128u16_set1(const u16 x) { return vdupq_n_u16(x); }
+FORCEINLINE v128u16 v128u16_setzero() { return vdupq_n_u16(0); }
+
+//lane 0 first
+FORCEINLINE v128u16 v128u16_set(const u16 x0, const u16 x1, const u16 x2, const u16 x3, const u16 x4, const u16 x5, const u16 x6, const u16 x7)
+{
+	const u16 lanes[8] = {x0, x1, x2, x3, x4, x5, x6, x7};
+	return vld1q_u16(lanes);
+}
+
+FORCEINLINE v128u16 v128u16_and(const v128u16 &a, const v128u16 &b) { return vandq_u16(a, b); }
+FORCEINLINE v128u16 v128u16_or(const v128u16 &a, const v128u16 &b) { return vorrq_u16(a, b); }
+FORCEINLINE v128u16 v128u16_andnot(const v128u16 &a, const v128u16 &b) { return vbicq_u16(b, a); } //(~a) & b
+FORCEINLINE v128u16 v128u16_xor(const v128u16 &a, const v128u16 &b) { return veorq_u16(a, b); }
+
+FORCEINLINE v128u16 v128u16_add(const v128u16 &a, const v128u16 &b) { return vaddq_u16(a, b); }
+FORCEINLINE v128u16 v128u16_sub(const v128u16 &a, const v128u16 &b) { return vsubq_u16(a, b); }
+FORCEINLINE v128u16 v128u16_mullo(const v128u16 &a, const v128u16 &b) { return vmulq_u16(a, b); }
+FORCEINLINE v128u16 v128u16_cmpeq(const v128u16 &a, const v128u16 &b) { return vceqq_u16(a, b); }
+
+//every lane 0xFFFF
+FORCEINLINE bool v128u16_alltrue(const v128u16 &v)
+{
+	const uint32x2_t halves = vand_u32( vget_low_u32(vreinterpretq_u32_u16(v)), vget_high_u32(vreinterpretq_u32_u16(v)) );
+	return ((vget_lane_u32(halves, 0) & vget_lane_u32(halves, 1)) == 0xFFFFFFFF);
+}
+
+//signed, like _mm_min_epi16. the callers only ever compare values below 0x8000.
+FORCEINLINE v128u16 v128u16_min(const v128u16 &a, const v128u16 &b) { return vreinterpretq_u16_s16( vminq_s16(vreinterpretq_s16_u16(a), vreinterpretq_s16_u16(b)) ); }
+
+template<int N> FORCEINLINE v128u16 v128u16_srli(const v128u16 &v) { return vshrq_n_u16(v, N); }
+template<int N> FORCEINLINE v128u16 v128u16_slli(const v128u16 &v) { return vshlq_n_u16(v, N); }
+
+//interleave the low (or high) four lanes of a and b: a0 b0 a1 b1 ... which, stored, makes four u32s of (b<<16)|a
+FORCEINLINE v128u16 v128u16_unpacklo(const v128u16 &a, const v128u16 &b) { return vzipq_u16(a, b).val[0]; }
+FORCEINLINE v128u16 v128u16_unpackhi(const v128u16 &a, const v128u16 &b) { return vzipq_u16(a, b).val[1]; }
+
+//split eight 4-byte pixels (32 bytes) into one vector per byte: lane i of cN is byte N of pixel i
+FORCEINLINE void v128u16_load_u8x4(const u8 *p, v128u16 &c0, v128u16 &c1, v128u16 &c2, v128u16 &c3)
+{
+	const uint8x8x4_t px = vld4_u8(p);
+	c0 = vmovl_u8(px.val[0]);
+	c1 = vmovl_u8(px.val[1]);
+	c2 = vmovl_u8(px.val[2]);
+	c3 = vmovl_u8(px.val[3]);
+}
+
+typedef uint8x16_t v128u8;
+
+FORCEINLINE v128u8 v128u8_load(const u8 *p) { return vld1q_u8(p); }
+FORCEINLINE v128u8 v128u8_loadu(const u8 *p) { return vld1q_u8(p); }
+FORCEINLINE v128u8 v128u8_loadl(const u8 *p) { return vcombine_u8(vld1_u8(p), vdup_n_u8(0)); } //8 bytes, the upper lanes zeroed
+FORCEINLINE void v128u8_store(u8 *p, const v128u8 &v) { vst1q_u8(p, v); }
+FORCEINLINE void v128u8_storeu(u8 *p, const v128u8 &v) { vst1q_u8(p, v); }
+FORCEINLINE void v128u8_storel(u8 *p, const v128u8 &v) { vst1_u8(p, vget_low_u8(v)); } //the lower 8 bytes
+
+FORCEINLINE v128u8 v128u8_set1(const u8 x) { return vdupq_n_u8(x); }
+FORCEINLINE v128u8 v128u8_setzero() { return vdupq_n_u8(0); }
+
+FORCEINLINE v128u8 v128u8_and(const v128u8 &a, const v128u8 &b) { return vandq_u8(a, b); }
+FORCEINLINE v128u8 v128u8_or(const v128u8 &a, const v128u8 &b) { return vorrq_u8(a, b); }
+FORCEINLINE v128u8 v128u8_andnot(const v128u8 &a, const v128u8 &b) { return vbicq_u8(b, a); } //(~a) & b
+FORCEINLINE v128u8 v128u8_xor(const v128u8 &a, const v128u8 &b) { return veorq_u8(a, b); }
+
+FORCEINLINE v128u8 v128u8_sub(const v128u8 &a, const v128u8 &b) { return vsubq_u8(a, b); }
+FORCEINLINE v128u8 v128u8_cmpeq(const v128u8 &a, const v128u8 &b) { return vceqq_u8(a, b); }
+
+//zero-extend the low (or high) eight bytes to 16-bit lanes
+FORCEINLINE v128u16 v128u8_unpacklo_u16(const v128u8 &v) { return vmovl_u8(vget_low_u8(v)); }
+FORCEINLINE v128u16 v128u8_unpackhi_u16(const v128u8 &v) { return vmovl_u8(vget_high_u8(v)); }
+
+//narrow two vectors of 16-bit masks (every lane 0 or 0xFFFF) to one vector of 8-bit masks
+FORCEINLINE v128u8 v128u8_packmask(const v128u16 &lo, const v128u16 &hi) { return vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)); }
+
+#else
+
+#define ENABLE_SIMD128
+
+//lanes 2i and 2i+1 live in the low and high halves of w[i]. the masks below keep every carry,
+//borrow and shift inside its own lane.
+struct v128u16 { u32 w[4]; };
+
+//lanes 4i to 4i+3 live in w[i], lowest byte first.
+struct v128u8 { u32 w[4]; };
+
+FORCEINLINE v128u16 v128u16_load(const u16 *p)
+{
+	v128u16 v;
+	for (size_t i = 0; i < 4; i++)
+		v.w[i] = (u32)p[i*2] | ((u32)p[i*2+1] << 16);
+	return v;
+}
+
+FORCEINLINE v128u16 v128u16_loadu(const u16 *p) { return v128u16_load(p); }
+
+FORCEINLINE void v128u16_store(u16 *p, const v128u16 &v)
+{
+	for (size_t i = 0; i < 4; i++)
+	{
+		p[i*2]   = (u16)v.w[i];
+		p[i*2+1] = (u16)(v.w[i] >> 16);
+	}
+}
+
+FORCEINLINE void v128u16_storeu(u16 *p, const v128u16 &v) { v128u16_store(p, v); }
+
+//16 bytes, any alignment
+FORCEINLINE v128u16 v128u16_loadu_u8(const u8 *p)
+{
+	v128u16 v;
+	for (size_t i = 0; i < 4; i++)
+		v.w[i] = (u32)p[i*4] | ((u32)p[i*4+1] << 8) | ((u32)p[i*4+2] << 16) | ((u32)p[i*4+3] << 24);
+	return v;
+}
+
+FORCEINLINE v128u16 v128u16_set1(const u16 x)
+{
+	const u32 word = (u32)x * 0x00010001;
+	const v128u16 v = { {word, word, word, word} };
+	return v;
+}
+
+FORCEINLINE v128u16 v128u16_setzero() { return v128u16_set1(0); }
+
+//lane 0 first
+FORCEINLINE v128u16 v128u16_set(const u16 x0, const u16 x1, const u16 x2, const u16 x3, const u16 x4, const u16 x5, const u16 x6, const u16 x7)
+{
+	const v128u16 v = { {(u32)x0 | ((u32)x1 << 16), (u32)x2 | ((u32)x3 << 16), (u32)x4 | ((u32)x5 << 16), (u32)x6 | ((u32)x7 << 16)} };
+	return v;
+}
+
+#define SIMD128_SWAR_OP(type, name, expr) \
+	FORCEINLINE type name(const type &a, const type &b) \
+	{ \
+		type v; \
+		for (size_t i = 0; i < 4; i++) { const u32 x = a.w[i]; const u32 y = b.w[i]; v.w[i] = (expr); } \
+		return v; \
+	}
+
+SIMD128_SWAR_OP(v128u16, v128u16_and, x & y)
+SIMD128_SWAR_OP(v128u16, v128u16_or, x | y)
+SIMD128_SWAR_OP(v128u16, v128u16_andnot, ~x & y) //(~a) & b
+SIMD128_SWAR_OP(v128u16, v128u16_xor, x ^ y)
+
+SIMD128_SWAR_OP(v128u16, v128u16_add, ((x & 0x7FFF7FFF) + (y & 0x7FFF7FFF)) ^ ((x ^ y) & 0x80008000))
+SIMD128_SWAR_OP(v128u16, v128u16_sub, ((x | 0x80008000) - (y & 0x7FFF7FFF)) ^ ((x ^ ~y) & 0x80008000))
+SIMD128_SWAR_OP(v128u16, v128u16_mullo, ((x * y) & 0x0000FFFF) | (((x >> 16) * (y >> 16)) << 16))
+
+//adding 0x7FFF carries into bit 15 of every lane of a^b that is nonzero. the lanes left clear are the equal ones.
+SIMD128_SWAR_OP(v128u16, v128u16_cmpeq, (((((((x ^ y) & 0x7FFF7FFF) + 0x7FFF7FFF) | (x ^ y)) & 0x80008000) >> 15) ^ 0x00010001) * 0xFFFF)
+
+//every lane 0xFFFF
+FORCEINLINE bool v128u16_alltrue(const v128u16 &v)
+{
+	return ((v.w[0] & v.w[1] & v.w[2] & v.w[3]) == 0xFFFFFFFF);
+}
+
+//signed, like _mm_min_epi16. the callers only ever compare values below 0x8000.
+FORCEINLINE v128u16 v128u16_min(const v128u16 &a, const v128u16 &b)
+{
+	v128u16 v;
+	for (size_t i = 0; i < 4; i++)
+	{
+		const s16 aLo = (s16)a.w[i], aHi = (s16)(a.w[i] >> 16);
+		const s16 bLo = (s16)b.w[i], bHi = (s16)(b.w[i] >> 16);
+		v.w[i] = (u32)(u16)((aLo < bLo) ? aLo : bLo) | ((u32)(u16)((aHi < bHi) ? aHi : bHi) << 16);
+	}
+	return v;
+}
+
+template<int N> FORCEINLINE v128u16 v128u16_srli(const v128u16 &v)
+{
+	const u32 mask = (0xFFFFu >> N) * 0x00010001;
+	const v128u16 r = { {(v.w[0] >> N) & mask, (v.w[1] >> N) & mask, (v.w[2] >> N) & mask, (v.w[3] >> N) & mask} };
+	return r;
+}
+
+template<int N> FORCEINLINE v128u16 v128u16_slli(const v128u16 &v)
+{
+	const u32 mask = ((0xFFFFu << N) & 0xFFFF) * 0x00010001;
+	const v128u16 r = { {(v.w[0] << N) & mask, (v.w[1] << N) & mask, (v.w[2] << N) & mask, (v.w[3] << N) & mask} };
+	return r;
+}
+
+//interleave the low (or high) four lanes of a and b: a0 b0 a1 b1 ... which, stored, makes four u32s of (b<<16)|a
+FORCEINLINE v128u16 v128u16_unpacklo(const v128u16 &a, const v128u16 &b)
+{
+	const v128u16 v = { {(a.w[0] & 0xFFFF) | (b.w[0] << 16), (a.w[0] >> 16) | (b.w[0] & 0xFFFF0000),
+	                     (a.w[1] & 0xFFFF) | (b.w[1] << 16), (a.w[1] >> 16) | (b.w[1] & 0xFFFF0000)} };
+	return v;
+}
+
+FORCEINLINE v128u16 v128u16_unpackhi(const v128u16 &a, const v128u16 &b)
+{
+	const v128u16 v = { {(a.w[2] & 0xFFFF) | (b.w[2] << 16), (a.w[2] >> 16) | (b.w[2] & 0xFFFF0000),
+	                     (a.w[3] & 0xFFFF) | (b.w[3] << 16), (a.w[3] >> 16) | (b.w[3] & 0xFFFF0000)} };
+	return v;
+}
+
+//split eight 4-byte pixels (32 bytes) into one vector per byte: lane i of cN is byte N of pixel i
+FORCEINLINE void v128u16_load_u8x4(const u8 *p, v128u16 &c0, v128u16 &c1, v128u16 &c2, v128u16 &c3)
+{
+	for (size_t i = 0; i < 4; i++, p += 8)
+	{
+		c0.w[i] = (u32)p[0] | ((u32)p[4] << 16);
+		c1.w[i] = (u32)p[1] | ((u32)p[5] << 16);
+		c2.w[i] = (u32)p[2] | ((u32)p[6] << 16);
+		c3.w[i] = (u32)p[3] | ((u32)p[7] << 16);
+	}
+}
+
+FORCEINLINE v128u8 v128u8_load(const u8 *p)
+{
+	v128u8 v;
+	for (size_t i = 0; i < 4; i++)
+		v.w[i] = (u32)p[i*4] | ((u32)p[i*4+1] << 8) | ((u32)p[i*4+2] << 16) | ((u32)p[i*4+3] << 24);
+	return v;
+}
+
+FORCEINLINE v128u8 v128u8_loadu(const u8 *p) { return v128u8_load(p); }
+
+//8 bytes, the upper lanes zeroed
+FORCEINLINE v128u8 v128u8_loadl(const u8 *p)
+{
+	const v128u8 v = { {(u32)p[0] | ((u32)p[1] << 8) | ((u32)p[2] << 16) | ((u32)p[3] << 24),
+	                    (u32)p[4] | ((u32)p[5] << 8) | ((u32)p[6] << 16) | ((u32)p[7] << 24), 0, 0} };
+	return v;
+}
+
+//the lower 8 bytes
+FORCEINLINE void v128u8_storel(u8 *p, const v128u8 &v)
+{
+	for (size_t i = 0; i < 8; i++)
+		p[i] = (u8)(v.w[i >> 2] >> ((i & 3) * 8));
+}
+
+FORCEINLINE void v128u8_store(u8 *p, const v128u8 &v)
+{
+	for (size_t i = 0; i < 16; i++)
+		p[i] = (u8)(v.w[i >> 2] >> ((i & 3) * 8));
+}
+
+FORCEINLINE void v128u8_storeu(u8 *p, const v128u8 &v) { v128u8_store(p, v); }
+
+FORCEINLINE v128u8 v128u8_set1(const u8 x)
+{
+	const u32 word = (u32)x * 0x01010101;
+	const v128u8 v = { {word, word, word, word} };
+	return v;
+}
+
+FORCEINLINE v128u8 v128u8_setzero() { return v128u8_set1(0); }
+
+SIMD128_SWAR_OP(v128u8, v128u8_and, x & y)
+SIMD128_SWAR_OP(v128u8, v128u8_or, x | y)
+SIMD128_SWAR_OP(v128u8, v128u8_andnot, ~x & y) //(~a) & b
+SIMD128_SWAR_OP(v128u8, v128u8_xor, x ^ y)
+
+SIMD128_SWAR_OP(v128u8, v128u8_sub, ((x | 0x80808080) - (y & 0x7F7F7F7F)) ^ ((x ^ ~y) & 0x80808080))
+SIMD128_SWAR_OP(v128u8, v128u8_cmpeq, (((((((x ^ y) & 0x7F7F7F7F) + 0x7F7F7F7F) | (x ^ y)) & 0x80808080) >> 7) ^ 0x01010101) * 0xFF)
+
+#undef SIMD128_SWAR_OP
+
+//zero-extend the low (or high) eight bytes to 16-bit lanes
+FORCEINLINE v128u16 v128u8_unpacklo_u16(const v128u8 &v)
+{
+	const v128u16 r = { {(v.w[0] & 0xFF) | ((v.w[0] & 0xFF00) << 8), ((v.w[0] >> 16) & 0xFF) | ((v.w[0] >> 8) & 0xFF0000),
+	                     (v.w[1] & 0xFF) | ((v.w[1] & 0xFF00) << 8), ((v.w[1] >> 16) & 0xFF) | ((v.w[1] >> 8) & 0xFF0000)} };
+	return r;
+}
+
+FORCEINLINE v128u16 v128u8_unpackhi_u16(const v128u8 &v)
+{
+	const v128u16 r = { {(v.w[2] & 0xFF) | ((v.w[2] & 0xFF00) << 8), ((v.w[2] >> 16) & 0xFF) | ((v.w[2] >> 8) & 0xFF0000),
+	                     (v.w[3] & 0xFF) | ((v.w[3] & 0xFF00) << 8), ((v.w[3] >> 16) & 0xFF) | ((v.w[3] >> 8) & 0xFF0000)} };
+	return r;
+}
+
+//narrow two vectors of 16-bit masks (every lane 0 or 0xFFFF) to one vector of 8-bit masks
+FORCEINLINE v128u8 v128u8_packmask(const v128u16 &lo, const v128u16 &hi)
+{
+	const u32 in[8] = {lo.w[0], lo.w[1], lo.w[2], lo.w[3], hi.w[0], hi.w[1], hi.w[2], hi.w[3]};
+	v128u8 v;
+	for (size_t i = 0; i < 4; i++)
+		v.w[i] = (in[i*2] & 0xFF) | ((in[i*2] >> 8) & 0xFF00) | ((in[i*2+1] & 0xFF) << 16) | ((in[i*2+1] & 0xFF0000) << 8);
+	return v;
+}
+
+#endif
+
+#endif
@@ -24,6 +24,7 @@
 #ifdef HOST_WINDOWS
 	#include <windows.h>
 #else
+	#include <pthread.h>
 	#if defined HOST_LINUX
 		#include <unistd.h>
 	#elif defined HOST_BSD || defined HOST_DARWIN
@@ -51,6 +52,70 @@ int getOnlineCores (void)
 #endif
 }
 
+void threadMemoryBarrier()
+{
+#ifdef HOST_WINDOWS
+	MemoryBarrier();
+#else
+	__sync_synchronize();
+#endif
+}
+
+int threadAtomicAdd(volatile int *value, int amount)
+{
+#ifdef HOST_WINDOWS
+	return InterlockedExchangeAdd((volatile LONG *)value, amount);
+#else
+	return __sync_fetch_and_add(value, amount);
+#endif
+}
+
+class ThreadLocalPointer::Impl {
+public:
+#ifdef HOST_WINDOWS
+	DWORD key;
+#else
+	pthread_key_t key;
+#endif
+};
+
+ThreadLocalPointer::ThreadLocalPointer() : impl(new ThreadLocalPointer::Impl())
+{
+#ifdef HOST_WINDOWS
+	impl->key = TlsAlloc();
+#else
+	pthread_key_create(&impl->key, NULL);
+#endif
+}
+
+ThreadLocalPointer::~ThreadLocalPointer()
+{
+#ifdef HOST_WINDOWS
+	TlsFree(impl->key);
+#else
+	pthread_key_delete(impl->key);
+#endif
+	delete impl;
+}
+
+void* ThreadLocalPointer::get() const
+{
+#ifdef HOST_WINDOWS
+	return TlsGetValue(impl->key);
+#else
+	return pthread_getspecific(impl->key);
+#endif
+}
+
+void ThreadLocalPointer::set(void *value)
+{
+#ifdef HOST_WINDOWS
+	TlsSetValue(impl->key, value);
+#else
+	pthread_setspecific(impl->key, value);
+#endif
+}
+
 class Task::Impl {
 private:
 	sthread_t* _thread;
@@ -60,7 +125,7 @@ public:
 	Impl();
 	~Impl();
 
-	void start(bool spinlock);
+	bool start(bool spinlock, bool ownCore);
 	void execute(const TWork &work, void *param);
 	void* finish();
 	void shutdown();
@@ -117,13 +182,13 @@ Task::Impl::~Impl()
 	scond_free(condWork);
 }
 
-void Task::Impl::start(bool spinlock)
+bool Task::Impl::start(bool spinlock, bool ownCore)
 {
 	slock_lock(this->mutex);
 
 	if (this->_isThreadRunning) {
 		slock_unlock(this->mutex);
-		return;
+		return true;
 	}
 
 	this->workFunc = NULL;
@@ -131,9 +196,10 @@ void Task::Impl::start(bool spinlock)
 	this->ret = NULL;
 	this->exitThread = false;
 	this->_thread = sthread_create(&taskProc,this);
-	this->_isThreadRunning = true;
+	this->_isThreadRunning = (this->_thread != NULL);
 
 	slock_unlock(this->mutex);
+	return this->_isThreadRunning;
 }
 
 void Task::Impl::execute(const TWork &work, void *param)
@@ -196,7 +262,7 @@ void Task::Impl::shutdown()
 	slock_unlock(this->mutex);
 }
 
-void Task::start(bool spinlock) { impl->start(spinlock); }
+bool Task::start(bool spinlock, bool ownCore) { return impl->start(spinlock, ownCore); }
 void Task::shutdown() { impl->shutdown(); }
 Task::Task() : impl(new Task::Impl()) {}
 Task::~Task() { delete impl; }
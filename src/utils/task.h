@@ -29,7 +29,9 @@ public:
 	typedef void * (*TWork)(void *);
 
 	// initialize task runner
-	void start(bool spinlock);
+	// ownCore asks for the worker to be placed on a different host core than the caller, where the host lets us choose
+	// returns false when the worker thread couldn't be created; execute() and finish() then do nothing
+	bool start(bool spinlock, bool ownCore = false);
 
 	//execute some work
 	void execute(const TWork &work, void* param);
@@ -47,4 +49,24 @@ public:
 
 int getOnlineCores (void);
 
+//for the few places which hand data between threads without a lock
+//a full memory barrier: nothing is reordered across it, by the compiler or the cpu
+void threadMemoryBarrier();
+//adds amount to *value atomically, returning what *value held before
+int threadAtomicAdd(volatile int *value, int amount);
+
+//a pointer which every thread has its own copy of, NULL until that thread sets it
+class ThreadLocalPointer
+{
+public:
+	ThreadLocalPointer();
+	~ThreadLocalPointer();
+
+	void* get() const;
+	void set(void *value);
+
+	class Impl;
+	Impl *impl;
+};
+
 #endif
@@ -0,0 +1,202 @@
+/*
+	Copyright (C) 2016 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+#ifdef HAVE_TRACE
+
+#include "../driver.h"
+#include "../NDSSystem.h"
+#include "task.h"
+
+struct TraceEvent
+{
+	const char *name;
+	u64 start;
+	u32 duration;
+	u8 phase;
+};
+
+struct TraceBuffer
+{
+	const char *threadName;
+	u32 head; //events ever written; the ring holds the last TRACE_RING_EVENTS of them
+	TraceEvent events[TRACE_RING_EVENTS];
+};
+
+volatile bool traceEnabled = true;
+
+static TraceBuffer *traceBuffers[TRACE_MAX_THREADS];
+static volatile int traceBufferCount = 0;
+
+//NULL until the thread first records, then its buffer. a thread past TRACE_MAX_THREADS gets
+//the address of traceNoBuffer and is left out.
+static ThreadLocalPointer traceThreadBuffer;
+static u8 traceNoBuffer;
+
+static TraceBuffer* trace_getBuffer()
+{
+	TraceBuffer *buffer = (TraceBuffer *)traceThreadBuffer.get();
+	if (buffer == NULL)
+	{
+		const int slot = threadAtomicAdd(&traceBufferCount, 1);
+		if (slot < TRACE_MAX_THREADS)
+		{
+			buffer = new TraceBuffer();
+			buffer->threadName = NULL;
+			buffer->head = 0;
+			threadMemoryBarrier();
+			traceBuffers[slot] = buffer;
+		}
+		else
+		{
+			buffer = (TraceBuffer *)&traceNoBuffer;
+		}
+		traceThreadBuffer.set(buffer);
+	}
+
+	return (buffer != (TraceBuffer *)&traceNoBuffer) ? buffer : NULL;
+}
+
+//async events are paired up by id, so a begin and end of the same name match whichever threads they're on
+static u32 trace_nameId(const char *name)
+{
+	u32 hash = 0x811C9DC5;
+	for (const char *c = name; *c != '\0'; c++)
+		hash = (hash ^ (u8)*c) * 0x01000193;
+	return hash;
+}
+
+u64 Trace_Now()
+{
+	return driver->EMU_GetTicks();
+}
+
+void Trace_Record(const char *name, TracePhase phase, u64 start, u64 end)
+{
+	if (start == 0) return; //no clock
+	TraceBuffer *buffer = trace_getBuffer();
+	if (buffer == NULL) return;
+
+	TraceEvent &e = buffer->events[buffer->head & (TRACE_RING_EVENTS - 1)];
+	e.name = name;
+	e.start = start;
+	e.duration = (end - start > 0xFFFFFFFF) ? 0xFFFFFFFF : (u32)(end - start);
+	e.phase = (u8)phase;
+	buffer->head++;
+}
+
+void Trace_SetEnabled(bool enabled)
+{
+	traceEnabled = enabled;
+}
+
+void Trace_SetThreadName(const char *name)
+{
+	TraceBuffer *buffer = trace_getBuffer();
+	if (buffer != NULL)
+		buffer->threadName = name;
+}
+
+bool Trace_Dump(const char *fileName)
+{
+	const u64 ticksPerSecond = driver->EMU_GetTicksPerSecond();
+	if (ticksPerSecond == 0)
+	{
+		printf("Trace: the driver has no clock, nothing was recorded\n");
+		return false;
+	}
+
+	FILE *fp = fopen(fileName, "w");
+	if (!fp)
+	{
+		printf("Trace: couldn't open %s\n", fileName);
+		return false;
+	}
+
+	//stop recording while the rings are read; the other threads may still be finishing one event each,
+	//which at worst garbles that one event
+	const bool wasEnabled = traceEnabled;
+	traceEnabled = false;
+	threadMemoryBarrier();
+
+	const s32 count = (traceBufferCount < TRACE_MAX_THREADS) ? traceBufferCount : TRACE_MAX_THREADS;
+
+	//timestamps are written relative to the earliest start so they stay readable. zones are recorded as they
+	//end, so that isn't necessarily the first event in a ring
+	u64 origin = ~(u64)0;
+	for (s32 t = 0; t < count; t++)
+	{
+		const TraceBuffer *buffer = traceBuffers[t];
+		if (buffer == NULL) continue;
+		const u32 first = (buffer->head > TRACE_RING_EVENTS) ? buffer->head - TRACE_RING_EVENTS : 0;
+		for (u32 i = first; i != buffer->head; i++)
+			origin = std::min(origin, buffer->events[i & (TRACE_RING_EVENTS - 1)].start);
+	}
+
+	const double usPerTick = 1000000.0 / (double)ticksPerSecond;
+	static const char *phases[] = { "X", "b", "e", "i" };
+	bool comma = false;
+
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (s32 t = 0; t < count; t++)
+	{
+		const TraceBuffer *buffer = traceBuffers[t];
+		if (buffer == NULL) continue;
+
+		char defaultName[32];
+		sprintf(defaultName, "thread %d", (int)t);
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", comma ? ",\n" : "", (int)t, buffer->threadName ? buffer->threadName : defaultName);
+		comma = true;
+
+		const u32 first = (buffer->head > TRACE_RING_EVENTS) ? buffer->head - TRACE_RING_EVENTS : 0;
+		for (u32 i = first; i != buffer->head; i++)
+		{
+			const TraceEvent &e = buffer->events[i & (TRACE_RING_EVENTS - 1)];
+			fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f", e.name, phases[e.phase & 3], (int)t, (double)(e.start - origin) * usPerTick);
+			if (e.phase == TracePhase_Complete)
+				fprintf(fp, ",\"dur\":%.3f", (double)e.duration * usPerTick);
+			else if (e.phase == TracePhase_Instant)
+				fprintf(fp, ",\"s\":\"t\"");
+			else
+				fprintf(fp, ",\"cat\":\"async\",\"id\":\"0x%08x\"", (unsigned int)trace_nameId(e.name));
+			fprintf(fp, "}");
+		}
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+
+	traceEnabled = wasEnabled;
+	printf("Trace: wrote %s\n", fileName);
+	return true;
+}
+
+#else
+
+void Trace_SetEnabled(bool enabled) {}
+void Trace_SetThreadName(const char *name) {}
+
+bool Trace_Dump(const char *fileName)
+{
+	printf("Trace: this build doesn't have tracing (HAVE_TRACE)\n");
+	return false;
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*
+	Copyright (C) 2016 DeSmuME team
+
+	This file is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 2 of the License, or
+	(at your option) any later version.
+
+	This file is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with the this software.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "../types.h"
+
+//A timeline of what the emulator spends its time on, for chrome://tracing or ui.perfetto.dev.
+//Build with HAVE_TRACE to get it; otherwise every TRACE_ macro is empty and costs nothing.
+//
+//Each thread records into its own ring of the last TRACE_RING_EVENTS events, so nothing is shared while
+//recording, and Trace_Dump() writes whatever the rings hold at that moment. Timestamps come from
+//driver->EMU_GetTicks(), so a frontend whose driver has no clock records nothing.
+//
+//Zone names must be string literals (or otherwise live forever); only the pointer is kept.
+
+#define TRACE_RING_EVENTS	32768
+#define TRACE_MAX_THREADS	16
+
+#ifdef HAVE_TRACE
+
+enum TracePhase
+{
+	TracePhase_Complete,	//a zone: start and duration
+	TracePhase_Begin,		//the two ends of something that isn't a scope, like a card transfer. these are
+	TracePhase_End,			//written as async events paired by name, since the ends may be on different threads
+	TracePhase_Instant		//a marker, like the start of a frame
+};
+
+extern volatile bool traceEnabled;
+
+void Trace_Record(const char *name, TracePhase phase, u64 start, u64 end);
+u64 Trace_Now();
+
+class TraceZone
+{
+public:
+	FORCEINLINE TraceZone(const char *name)
+		: _name(name)
+		, _start(traceEnabled ? Trace_Now() : 0)
+	{
+	}
+	FORCEINLINE ~TraceZone()
+	{
+		if (_start != 0)
+			Trace_Record(_name, TracePhase_Complete, _start, Trace_Now());
+	}
+private:
+	const char *_name;
+	u64 _start;
+};
+
+#define TRACE_CONCAT2(a,b) a##b
+#define TRACE_CONCAT(a,b) TRACE_CONCAT2(a,b)
+
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(_traceZone, __LINE__)(name)
+#define TRACE_BEGIN(name) do { if (traceEnabled) { const u64 _t = Trace_Now(); Trace_Record(name, TracePhase_Begin, _t, _t); } } while(0)
+#define TRACE_END(name) do { if (traceEnabled) { const u64 _t = Trace_Now(); Trace_Record(name, TracePhase_End, _t, _t); } } while(0)
+#define TRACE_INSTANT(name) do { if (traceEnabled) { const u64 _t = Trace_Now(); Trace_Record(name, TracePhase_Instant, _t, _t); } } while(0)
+#define TRACE_THREAD_NAME(name) Trace_SetThreadName(name)
+
+#else
+
+#define TRACE_ZONE(name)
+#define TRACE_BEGIN(name)
+#define TRACE_END(name)
+#define TRACE_INSTANT(name)
+#define TRACE_THREAD_NAME(name)
+
+#endif
+
+//these exist either way so that frontends needn't care; without HAVE_TRACE they do nothing and Trace_Dump fails
+void Trace_SetEnabled(bool enabled);
+void Trace_SetThreadName(const char *name);
+bool Trace_Dump(const char *fileName);
+
+#endif
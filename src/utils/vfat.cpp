@@ -1,7 +1,7 @@
 /*
 	Copyright (C) 2006 yopyop
 	Copyright (C) 2006 Mic
-	Copyright (C) 2010-2015 DeSmuME team
+	Copyright (C) 2010-2016 DeSmuME team
 
 	This file is free software: you can redistribute it and/or modify
 	it under the terms of the GNU General Public License as published by
@@ -18,197 +18,625 @@
 */
 
 #include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
 #include <string.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <stack>
+#include <stdarg.h>
+#include <ctype.h>
 
 #include "../types.h"
 #include "../debug.h"
 #include "../emufile.h"
 #include "../fs.h"
+#include "../mem.h"
 
 #include "emufat.h"
 #include "vfat.h"
-#include "libfat/libfat_public_api.h"
 
+//The image is never built. It is a FAT32 volume described by an index of the directory tree, and every
+//sector is made up when it is read: boot sector and FSInfo from the geometry, FAT sectors from the
+//cluster runs handed out to each file and directory, directory sectors from the children's names, and
+//data sectors by reading the host file at the matching offset. Writes land in an overlay of whole
+//sectors that shadows all of that, so the host directory is never modified.
+//Startup time and memory therefore depend on how many entries the tree has, not how big the files are.
+
+#define VFAT_SECTOR_SIZE		512
+#define VFAT_RESERVED_SECTORS	32
+#define VFAT_FSINFO_SECTOR		1
+#define VFAT_BACKUP_BOOT_SECTOR	6
+#define VFAT_FAT_COUNT			2
+#define VFAT_ROOT_CLUSTER		2
+#define VFAT_MIN_CLUSTERS		65536 //comfortably above the 65525 that makes a volume FAT32
+#define VFAT_NO_SECTOR			0xFFFFFFFF
+
+//a fixed timestamp for everything, 2016-01-01 00:00, so the image is deterministic
+#define VFAT_DATE				(((2016 - 1980) << 9) | (1 << 5) | 1)
+#define VFAT_TIME				0
+
+struct VFATNode
+{
+	std::string name;
+	std::string hostPath;
+	bool isDir;
+	u32 size;
+	u32 parent;
+	u32 firstCluster;
+	u32 clusterCount;
+	std::vector<u32> children;
+	std::vector<u8> dirImage; //made on first read, directories only
+};
 
-enum EListCallbackArg {
-	EListCallbackArg_Item, EListCallbackArg_Pop
+class EMUFILE_VFAT : public EMUFILE
+{
+public:
+	EMUFILE_VFAT();
+	virtual ~EMUFILE_VFAT();
+
+	bool build(const char *path, int extra_MB);
+
+	virtual EMUFILE* memwrap();
+	virtual FILE *get_fp() { return NULL; }
+	virtual int fprintf(const char *format, ...);
+	virtual int fgetc();
+	virtual int fputc(int c);
+	virtual size_t _fread(const void *ptr, size_t bytes);
+	virtual size_t fwrite(const void *ptr, size_t bytes);
+	virtual int fseek(int offset, int origin);
+	virtual int ftell() { return (int)pos; }
+	virtual int size() { return (int)(totalSectors * VFAT_SECTOR_SIZE); }
+	virtual void fflush() {}
+	virtual void truncate(s32 length) {} //it's a disk; it has the size it has
+
+private:
+	std::vector<VFATNode> nodes;
+	std::vector<u32> extentCluster; //first cluster of every node with clusters, ascending
+	std::vector<u32> extentNode;
+
+	u32 sectorsPerCluster;
+	u32 clusterCount;
+	u32 usedClusters;
+	u32 fatSectors;
+	u32 dataStartSector;
+	u32 totalSectors;
+	u32 pos;
+
+	std::map<u32, u8*> overlay;
+	u8 sectorCache[VFAT_SECTOR_SIZE];
+	u32 sectorCacheIndex;
+
+	FILE *hostFile;
+	u32 hostFileNode;
+
+	void scan(u32 node);
+	u32 dirEntryCount(const VFATNode &dir) const;
+	void buildDirImage(u32 node);
+	u32 findNode(u32 cluster) const;
+
+	void makeBootSector(u8 *out) const;
+	void makeFSInfoSector(u8 *out) const;
+	void makeFATSector(u32 sector, u8 *out) const;
+	void makeDataSector(u32 sector, u8 *out);
+	const u8* readSector(u32 sector);
 };
 
-typedef void (*ListCallback)(FsEntry* fs, EListCallbackArg);
+EMUFILE_VFAT::EMUFILE_VFAT()
+	: sectorsPerCluster(1)
+	, clusterCount(0)
+	, usedClusters(0)
+	, fatSectors(0)
+	, dataStartSector(0)
+	, totalSectors(0)
+	, pos(0)
+	, sectorCacheIndex(VFAT_NO_SECTOR)
+	, hostFile(NULL)
+	, hostFileNode(0)
+{
+}
 
-// List all files and subdirectories recursively
-static void list_files(const char *filepath, ListCallback list_callback)
+EMUFILE_VFAT::~EMUFILE_VFAT()
 {
-	char DirSpec[255+1], SubDir[255+1];
-	FsEntry entry;
-	void * hFind;
-	char *fname;
-	u32 dwError;
+	if (hostFile)
+		fclose(hostFile);
+	for (std::map<u32, u8*>::iterator it = overlay.begin(); it != overlay.end(); ++it)
+		delete [] it->second;
+}
 
-	strncpy(DirSpec, filepath, ARRAY_SIZE(DirSpec));
-	DirSpec[255] = 0 ; // hard limit the string here
+// Index all files and subdirectories recursively. Only names and sizes are read here.
+void EMUFILE_VFAT::scan(u32 node)
+{
+	FsEntry entry;
+	const std::string dirPath = nodes[node].hostPath;
 
-	hFind = FsReadFirst(DirSpec, &entry);
+	void *hFind = FsReadFirst(dirPath.c_str(), &entry);
 	if (hFind == NULL) return;
 
 	do {
-		fname = (strlen(entry.cAlternateFileName)>0) ? entry.cAlternateFileName : entry.cFileName;
-		list_callback(&entry,EListCallbackArg_Item);
-		printf("cflash added %s\n",entry.cFileName);
+		//we use cFileName always because it is a LFN and we always make a fat32 image
+		const char *fname = entry.cFileName;
+		if (!strcmp(fname, ".") || !strcmp(fname, "..")) continue;
+
+		VFATNode child;
+		child.name = fname;
+		child.hostPath = dirPath + std::string(1, FS_SEPARATOR) + fname;
+		child.isDir = (entry.flags & FS_IS_DIR) != 0;
+		child.size = child.isDir ? 0 : entry.fileSize;
+		child.parent = node;
+		child.firstCluster = 0;
+		child.clusterCount = 0;
+
+		nodes[node].children.push_back((u32)nodes.size());
+		nodes.push_back(child);
+	} while (FsReadNext(hFind, &entry) != 0);
+
+	FsClose(hFind);
+
+	//nodes may be reallocated while recursing, so walk the children by index
+	for (size_t i = 0; i < nodes[node].children.size(); i++)
+	{
+		const u32 child = nodes[node].children[i];
+		if (nodes[child].isDir)
+			scan(child);
+	}
+}
+
+//host names are utf-8; the long name entries hold ucs-2
+static std::vector<u16> vfat_utf8ToUCS2(const std::string &name)
+{
+	std::vector<u16> ret;
+	for (size_t i = 0; i < name.size(); )
+	{
+		const u8 c = (u8)name[i];
+		if (c < 0x80) { ret.push_back(c); i += 1; }
+		else if ((c & 0xE0) == 0xC0 && i + 1 < name.size()) { ret.push_back((u16)(((c & 0x1F) << 6) | (name[i+1] & 0x3F))); i += 2; }
+		else if ((c & 0xF0) == 0xE0 && i + 2 < name.size()) { ret.push_back((u16)(((c & 0x0F) << 12) | ((name[i+1] & 0x3F) << 6) | (name[i+2] & 0x3F))); i += 3; }
+		else { ret.push_back('_'); i += 1; while (i < name.size() && ((u8)name[i] & 0xC0) == 0x80) i++; }
+	}
+	return ret;
+}
+
+//13 ucs-2 characters to a long name entry
+static u32 vfat_lfnEntryCount(const std::vector<u16> &lfn)
+{
+	return ((u32)lfn.size() + 12) / 13;
+}
+
+u32 EMUFILE_VFAT::dirEntryCount(const VFATNode &dir) const
+{
+	u32 count = (&dir == &nodes[0]) ? 0 : 2; //. and ..
+	for (size_t i = 0; i < dir.children.size(); i++)
+		count += vfat_lfnEntryCount(vfat_utf8ToUCS2(nodes[dir.children[i]].name)) + 1;
+	return count;
+}
+
+bool EMUFILE_VFAT::build(const char *path, int extra_MB)
+{
+	VFATNode root;
+	root.hostPath = path;
+	root.isDir = true;
+	root.size = 0;
+	root.parent = 0;
+	root.firstCluster = 0;
+	root.clusterCount = 0;
+	nodes.push_back(root);
+	scan(0);
+
+	//mkdosfs goes to 4K clusters above 260MB; do the same, judged on what the tree needs in 512 byte clusters
+	u64 bytesNeeded = (u64)extra_MB * 1024 * 1024;
+	for (size_t i = 0; i < nodes.size(); i++)
+		bytesNeeded += nodes[i].isDir ? (u64)dirEntryCount(nodes[i]) * 32 + VFAT_SECTOR_SIZE : (u64)nodes[i].size + VFAT_SECTOR_SIZE;
+	sectorsPerCluster = (bytesNeeded > (u64)260 * 1024 * 1024) ? 8 : 1;
+	const u32 clusterSize = sectorsPerCluster * VFAT_SECTOR_SIZE;
+
+	//hand out contiguous cluster runs in index order, the root first so it lands on cluster 2
+	u32 nextCluster = VFAT_ROOT_CLUSTER;
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		VFATNode &node = nodes[i];
+		const u64 bytes = node.isDir ? (u64)dirEntryCount(node) * 32 : node.size;
+		u32 clusters = (u32)((bytes + clusterSize - 1) / clusterSize);
+		if (node.isDir && clusters == 0)
+			clusters = 1;
+		if (clusters == 0) continue;
+
+		node.firstCluster = nextCluster;
+		node.clusterCount = clusters;
+		extentCluster.push_back(nextCluster);
+		extentNode.push_back((u32)i);
+		nextCluster += clusters;
+	}
+	usedClusters = nextCluster - VFAT_ROOT_CLUSTER;
+
+	clusterCount = usedClusters + (u32)(((u64)extra_MB * 1024 * 1024) / clusterSize);
+	if (clusterCount < VFAT_MIN_CLUSTERS)
+		clusterCount = VFAT_MIN_CLUSTERS;
 
-		if ((entry.flags & FS_IS_DIR) && (strcmp(fname, ".")) && (strcmp(fname, ".."))) 
+	fatSectors = ((clusterCount + 2) * 4 + VFAT_SECTOR_SIZE - 1) / VFAT_SECTOR_SIZE;
+	dataStartSector = VFAT_RESERVED_SECTORS + VFAT_FAT_COUNT * fatSectors;
+	const u64 sectors = (u64)dataStartSector + (u64)clusterCount * sectorsPerCluster;
+
+	//the EMUFILE interface is addressed with ints
+	if (sectors >= (0x80000000 >> 9))
+	{
+		printf("error building fat (%u KBytes)\n", (u32)(sectors / 2));
+		printf("total fat sizes > 2GB are never going to work\n");
+		return false;
+	}
+	totalSectors = (u32)sectors;
+
+	printf("cflash indexed %u entries from %s, %u KBytes used of %u KBytes\n", (u32)nodes.size() - 1, path, (usedClusters * clusterSize) / 1024, (u32)(sectors / 2));
+	return true;
+}
+
+void EMUFILE_VFAT::makeBootSector(u8 *out) const
+{
+	TFat32BootSector *bs = (TFat32BootSector *)out;
+	memset(out, 0, VFAT_SECTOR_SIZE);
+
+	bs->jmpToBootCode[0] = 0xEB;
+	bs->jmpToBootCode[1] = 0x58;
+	bs->jmpToBootCode[2] = 0x90;
+	memcpy(bs->oemName, "mkdosfs", 8);
+	bs->bytesPerSector = LE_TO_LOCAL_16(VFAT_SECTOR_SIZE);
+	bs->sectorsPerCluster = (u8)sectorsPerCluster;
+	bs->reservedSectorCount = LE_TO_LOCAL_16(VFAT_RESERVED_SECTORS);
+	bs->fatCount = VFAT_FAT_COUNT;
+	bs->mediaType = 0xF8;
+	bs->sectorsPerTrack = LE_TO_LOCAL_16(32);
+	bs->headCount = LE_TO_LOCAL_16(64);
+	bs->totalSectors32 = LE_TO_LOCAL_32(totalSectors);
+	bs->fat32.sectorsPerFat32 = LE_TO_LOCAL_32(fatSectors);
+	bs->fat32.fat32RootCluster = LE_TO_LOCAL_32(VFAT_ROOT_CLUSTER);
+	bs->fat32.fat32FSInfo = LE_TO_LOCAL_16(VFAT_FSINFO_SECTOR);
+	bs->fat32.fat32BackBootBlock = LE_TO_LOCAL_16(VFAT_BACKUP_BOOT_SECTOR);
+	bs->fat32.vi.drive_number = 0x80;
+	bs->fat32.vi.ext_boot_sign = 0x29;
+	memcpy(bs->fat32.vi.volume_label, "           ", 11);
+	memcpy(bs->fat32.vi.fs_type, "FAT32   ", 8);
+	bs->boot_sign[0] = BOOTSIG0;
+	bs->boot_sign[1] = BOOTSIG1;
+}
+
+void EMUFILE_VFAT::makeFSInfoSector(u8 *out) const
+{
+	memset(out, 0, VFAT_SECTOR_SIZE);
+	T1WriteLong(out, 0, 0x41615252);
+	T1WriteLong(out, 484, 0x61417272);
+	T1WriteLong(out, 488, clusterCount - usedClusters);
+	T1WriteLong(out, 492, VFAT_ROOT_CLUSTER + usedClusters);
+	T1WriteLong(out, 508, 0xAA550000);
+}
+
+//the node owning a cluster, or nodes.size() for a free one
+u32 EMUFILE_VFAT::findNode(u32 cluster) const
+{
+	std::vector<u32>::const_iterator it = std::upper_bound(extentCluster.begin(), extentCluster.end(), cluster);
+	if (it == extentCluster.begin())
+		return (u32)nodes.size();
+
+	const u32 extent = (u32)(it - extentCluster.begin()) - 1;
+	const VFATNode &node = nodes[extentNode[extent]];
+	return (cluster < node.firstCluster + node.clusterCount) ? extentNode[extent] : (u32)nodes.size();
+}
+
+void EMUFILE_VFAT::makeFATSector(u32 sector, u8 *out) const
+{
+	//both FAT copies read the same
+	const u32 firstCluster = (sector % fatSectors) * (VFAT_SECTOR_SIZE / 4);
+
+	for (u32 i = 0; i < VFAT_SECTOR_SIZE / 4; i++)
+	{
+		const u32 cluster = firstCluster + i;
+		u32 entry = 0;
+
+		if (cluster == 0)
+			entry = 0x0FFFFF00 | 0xF8;
+		else if (cluster == 1)
+			entry = FAT32EOC;
+		else if (cluster < VFAT_ROOT_CLUSTER + usedClusters)
 		{
-			if (strlen(fname)+strlen(filepath)+2 < 256) 
-			{
-				sprintf(SubDir, "%s%c%s", filepath, FS_SEPARATOR, fname);
-				list_files(SubDir, list_callback);
-				list_callback(&entry, EListCallbackArg_Pop);
-			}
+			//every run is contiguous, so each cluster just points at the next until the last
+			const u32 node = findNode(cluster);
+			if (node < nodes.size())
+				entry = (cluster + 1 < nodes[node].firstCluster + nodes[node].clusterCount) ? cluster + 1 : FAT32EOC;
 		}
-	} while (FsReadNext(hFind, &entry) != 0);
 
-	dwError = FsError();
-	FsClose(hFind);
-	if (dwError != FS_ERR_NO_MORE_FILES) return;
+		T1WriteLong(out, i * 4, entry);
+	}
 }
 
-static u64 dataSectors = 0;
-void count_ListCallback(FsEntry* fs, EListCallbackArg arg)
+static void vfat_makeShortName(u8 *out, const std::string &name, u32 index)
 {
-	if(arg == EListCallbackArg_Pop) return;
-	u32 sectors = 1;
-	if(fs->flags & FS_IS_DIR)
+	//the long name is what everything shows. the short one only has to be valid and unique in its directory,
+	//so it takes the usual BASE~N form with N being the entry's position
+	char tail[12];
+	sprintf(tail, "~%u", index);
+	const size_t baseLen = 8 - strlen(tail);
+
+	memset(out, ' ', 11);
+
+	const size_t dot = name.rfind('.');
+	const std::string base = (dot == std::string::npos || dot == 0) ? name : name.substr(0, dot);
+	const std::string ext = (dot == std::string::npos || dot == 0) ? "" : name.substr(dot + 1);
+
+	size_t n = 0;
+	for (size_t i = 0; i < base.size() && n < baseLen; i++)
 	{
+		const u8 c = (u8)base[i];
+		if (c < 0x80 && (isalnum(c) || c == '_' || c == '-'))
+			out[n++] = (u8)toupper(c);
+	}
+	memcpy(out + n, tail, strlen(tail));
+
+	n = 0;
+	for (size_t i = 0; i < ext.size() && n < 3; i++)
+	{
+		const u8 c = (u8)ext[i];
+		if (c < 0x80 && (isalnum(c) || c == '_' || c == '-'))
+			out[8 + n++] = (u8)toupper(c);
 	}
-	else
-		sectors += (fs->fileSize+511)/512 + 1;
-	dataSectors += sectors; 
 }
 
-static std::string currPath;
-static std::stack<std::string> pathStack;
-static std::stack<std::string> virtPathStack;
-static std::string currVirtPath;
-void build_ListCallback(FsEntry* fs, EListCallbackArg arg)
+static u8 vfat_shortNameChecksum(const u8 *shortName)
 {
-	char* fname = (strlen(fs->cAlternateFileName)>0) ? fs->cAlternateFileName : fs->cFileName;
+	u8 sum = 0;
+	for (int i = 0; i < 11; i++)
+		sum = (u8)(((sum & 1) << 7) + (sum >> 1) + shortName[i]);
+	return sum;
+}
 
-	//we use cFileName always because it is a LFN and we are making sure that we always make a fat32 image
-	fname = fs->cFileName;
+static void vfat_writeDirEntry(u8 *out, const u8 *shortName, u8 attributes, u32 cluster, u32 size)
+{
+	TDirectoryEntry *de = (TDirectoryEntry *)out;
+	memset(out, 0, sizeof(TDirectoryEntry));
+	memcpy(de->name, shortName, 11);
+	de->attributes = attributes;
+	de->creationTime = de->lastWriteTime = LE_TO_LOCAL_16(VFAT_TIME);
+	de->creationDate = de->lastWriteDate = de->lastAccessDate = LE_TO_LOCAL_16(VFAT_DATE);
+	de->firstClusterHigh = LE_TO_LOCAL_16((u16)(cluster >> 16));
+	de->firstClusterLow = LE_TO_LOCAL_16((u16)(cluster & 0xFFFF));
+	de->fileSize = LE_TO_LOCAL_32(size);
+}
+
+void EMUFILE_VFAT::buildDirImage(u32 index)
+{
+	static const int lfnPos[13] = {1,3,5,7,9,14,16,18,20,22,24,28,30};
 
-	if(arg == EListCallbackArg_Pop) 
+	VFATNode &dir = nodes[index];
+	dir.dirImage.assign(dir.clusterCount * sectorsPerCluster * VFAT_SECTOR_SIZE, 0);
+	u8 *out = &dir.dirImage[0];
+
+	if (index != 0)
 	{
-		currPath = pathStack.top();
-		pathStack.pop();
-		currVirtPath = virtPathStack.top();
-		virtPathStack.pop();
-		return;
+		u8 dotName[11];
+		memset(dotName, ' ', 11);
+		dotName[0] = '.';
+		vfat_writeDirEntry(out, dotName, DIR_ATT_DIRECTORY, dir.firstCluster, 0);
+		out += 32;
+
+		//.. is cluster 0 when the parent is the root
+		dotName[1] = '.';
+		vfat_writeDirEntry(out, dotName, DIR_ATT_DIRECTORY, (dir.parent == 0) ? 0 : nodes[dir.parent].firstCluster, 0);
+		out += 32;
 	}
-	
-	if(fs->flags & FS_IS_DIR)
+
+	for (size_t i = 0; i < dir.children.size(); i++)
 	{
-		if(!strcmp(fname,".")) return;
-		if(!strcmp(fname,"..")) return;
+		const VFATNode &child = nodes[dir.children[i]];
 
-		pathStack.push(currPath);
-		virtPathStack.push(currVirtPath);
+		u8 shortName[11];
+		vfat_makeShortName(shortName, child.name, (u32)i + 1);
+		const u8 checksum = vfat_shortNameChecksum(shortName);
 
-		currVirtPath = currVirtPath + "/" + fname;
-		bool ok = LIBFAT::MkDir(currVirtPath.c_str());
+		//long name pieces go in reverse order, the last one flagged with 0x40
+		const std::vector<u16> lfn = vfat_utf8ToUCS2(child.name);
+		const u32 lfnCount = vfat_lfnEntryCount(lfn);
+		for (u32 e = lfnCount; e > 0; e--)
+		{
+			memset(out, 0, 32);
+			out[0] = (u8)(e | ((e == lfnCount) ? 0x40 : 0));
+			out[11] = DIR_ATT_LONG_NAME;
+			out[13] = checksum;
+			for (u32 k = 0; k < 13; k++)
+			{
+				const u32 c = (e - 1) * 13 + k;
+				const u16 ch = (c < lfn.size()) ? lfn[c] : ((c == lfn.size()) ? 0x0000 : 0xFFFF);
+				T1WriteWord(out, lfnPos[k], ch);
+			}
+			out += 32;
+		}
+
+		vfat_writeDirEntry(out, shortName, child.isDir ? DIR_ATT_DIRECTORY : DIR_ATT_ARCHIVE, child.firstCluster, child.size);
+		out += 32;
+	}
+}
 
-		if(!ok)
-			printf("ERROR adding dir %s via libfat\n",currVirtPath.c_str());
+void EMUFILE_VFAT::makeDataSector(u32 sector, u8 *out)
+{
+	const u32 rel = sector - dataStartSector;
+	const u32 cluster = VFAT_ROOT_CLUSTER + rel / sectorsPerCluster;
+	const u32 index = findNode(cluster);
 
-		currPath = currPath + std::string(1,FS_SEPARATOR) + fname;
+	memset(out, 0, VFAT_SECTOR_SIZE);
+	if (index >= nodes.size())
 		return;
-	}
-	else
+
+	VFATNode &node = nodes[index];
+	const u32 offset = (cluster - node.firstCluster) * sectorsPerCluster * VFAT_SECTOR_SIZE + (rel % sectorsPerCluster) * VFAT_SECTOR_SIZE;
+
+	if (node.isDir)
 	{
-		std::string path = currPath + std::string(1,FS_SEPARATOR) + fname;
+		if (node.dirImage.empty())
+			buildDirImage(index);
+		memcpy(out, &node.dirImage[offset], VFAT_SECTOR_SIZE);
+		return;
+	}
+
+	if (offset >= node.size)
+		return;
 
-		FILE* inf = fopen(path.c_str(),"rb");
-		if(inf)
+	//keep the last file open, since reads come a sector at a time
+	if (!hostFile || hostFileNode != index)
+	{
+		if (hostFile)
+			fclose(hostFile);
+		hostFile = fopen(node.hostPath.c_str(), "rb");
+		hostFileNode = index;
+		if (!hostFile)
 		{
-			fseek(inf,0,SEEK_END);
-			long len = ftell(inf);
-			fseek(inf,0,SEEK_SET);
-			u8 *buf = new u8[len];
-			fread(buf,1,len,inf);
-			fclose(inf);
-
-			std::string path = currVirtPath + "/" + fname;
-			printf("adding path %s for libfat\n",path.c_str());
-			bool ok = LIBFAT::WriteFile(path.c_str(),buf,len);
-			if(!ok) 
-				printf("ERROR adding file to fat\n");
-			delete[] buf;
-		} else printf("ERROR opening file for fat\n");
+			printf("ERROR opening file %s for fat\n", node.hostPath.c_str());
+			return;
+		}
 	}
-		
+
+	::fseek(hostFile, offset, SEEK_SET);
+	::fread(out, 1, std::min<u32>(VFAT_SECTOR_SIZE, node.size - offset), hostFile);
 }
 
+const u8* EMUFILE_VFAT::readSector(u32 sector)
+{
+	//the cflash interface reads two bytes at a time, so hang on to the last sector
+	if (sector == sectorCacheIndex)
+		return sectorCache;
+
+	std::map<u32, u8*>::const_iterator it = overlay.find(sector);
+	if (it != overlay.end())
+		memcpy(sectorCache, it->second, VFAT_SECTOR_SIZE);
+	else if (sector == 0 || sector == VFAT_BACKUP_BOOT_SECTOR)
+		makeBootSector(sectorCache);
+	else if (sector == VFAT_FSINFO_SECTOR || sector == VFAT_BACKUP_BOOT_SECTOR + VFAT_FSINFO_SECTOR)
+		makeFSInfoSector(sectorCache);
+	else if (sector < VFAT_RESERVED_SECTORS)
+		memset(sectorCache, 0, VFAT_SECTOR_SIZE);
+	else if (sector < dataStartSector)
+		makeFATSector(sector - VFAT_RESERVED_SECTORS, sectorCache);
+	else
+		makeDataSector(sector, sectorCache);
+
+	sectorCacheIndex = sector;
+	return sectorCache;
+}
 
+size_t EMUFILE_VFAT::_fread(const void *ptr, size_t bytes)
+{
+	u8 *dst = (u8 *)ptr;
+	const u32 end = (u32)size();
+	size_t done = 0;
 
-bool VFAT::build(const char* path, int extra_MB)
+	while (done < bytes && pos < end)
+	{
+		const u8 *sector = readSector(pos / VFAT_SECTOR_SIZE);
+		const u32 ofs = pos % VFAT_SECTOR_SIZE;
+		const u32 todo = (u32)std::min<size_t>(bytes - done, std::min<u32>(VFAT_SECTOR_SIZE - ofs, end - pos));
+		memcpy(dst + done, sector + ofs, todo);
+		done += todo;
+		pos += todo;
+	}
+
+	if (done < bytes)
+		failbit = true;
+	return done;
+}
+
+size_t EMUFILE_VFAT::fwrite(const void *ptr, size_t bytes)
 {
-	dataSectors = 0;
-	currVirtPath = "";
-	currPath = path;
-	list_files(path, count_ListCallback);
+	const u8 *src = (const u8 *)ptr;
+	const u32 end = (u32)size();
+	size_t done = 0;
 
-	dataSectors += 8; //a few for reserved sectors, etc.
+	while (done < bytes && pos < end)
+	{
+		const u32 index = pos / VFAT_SECTOR_SIZE;
+		const u32 ofs = pos % VFAT_SECTOR_SIZE;
+		const u32 todo = (u32)std::min<size_t>(bytes - done, std::min<u32>(VFAT_SECTOR_SIZE - ofs, end - pos));
 
-	dataSectors += extra_MB*1024*1024/512; //add extra write space
-	//dataSectors += 16*1024*1024/512; //add 16MB worth of write space. this is probably enough for anyone, but maybe it should be configurable.
-	//we could always suggest to users to add a big file to their directory to overwrite (that would cause the image to get padded)
+		//the first write to a sector copies whatever it read as into the overlay
+		u8 *&sector = overlay[index];
+		if (sector == NULL)
+		{
+			sector = new u8[VFAT_SECTOR_SIZE];
+			memcpy(sector, readSector(index), VFAT_SECTOR_SIZE);
+		}
+		memcpy(sector + ofs, src + done, todo);
+		if (index == sectorCacheIndex)
+			memcpy(sectorCache, sector, VFAT_SECTOR_SIZE);
 
-	//this seems to be the minimum size that will turn into a solid fat32
-	if(dataSectors<36*1024*1024/512)
-		dataSectors = 36*1024*1024/512;
+		done += todo;
+		pos += todo;
+	}
 
-	if(dataSectors>=(0x80000000>>9))
+	if (done < bytes)
+		failbit = true;
+	return done;
+}
+
+int EMUFILE_VFAT::fseek(int offset, int origin)
+{
+	switch (origin)
 	{
-		printf("error allocating memory for fat (%d KBytes)\n",(dataSectors*512)/1024);
-		printf("total fat sizes > 2GB are never going to work\n");
+		case SEEK_SET: pos = offset; break;
+		case SEEK_CUR: pos += offset; break;
+		case SEEK_END: pos = size() + offset; break;
+		default: return -1;
 	}
-	
+	return 0;
+}
+
+int EMUFILE_VFAT::fgetc()
+{
+	u8 c;
+	if (_fread(&c, 1) != 1)
+		return -1;
+	return c;
+}
+
+int EMUFILE_VFAT::fputc(int c)
+{
+	const u8 b = (u8)c;
+	fwrite(&b, 1);
+	return 0;
+}
+
+int EMUFILE_VFAT::fprintf(const char *format, ...)
+{
+	char buf[1024];
+	va_list argptr;
+	va_start(argptr, format);
+	const int len = vsnprintf(buf, sizeof(buf), format, argptr);
+	va_end(argptr);
+	if (len > 0)
+		fwrite(buf, std::min<int>(len, sizeof(buf) - 1));
+	return len;
+}
+
+//only for callers that insist on memory. this is exactly the full image we otherwise avoid making.
+EMUFILE* EMUFILE_VFAT::memwrap()
+{
+	EMUFILE_MEMORY *mem = new EMUFILE_MEMORY(size());
+	const u32 oldPos = pos;
+	for (u32 i = 0; i < totalSectors; i++)
+		mem->fwrite(readSector(i), VFAT_SECTOR_SIZE);
+	mem->fseek(0, SEEK_SET);
+	pos = oldPos;
+	return mem;
+}
+
+bool VFAT::build(const char* path, int extra_MB)
+{
 	delete file;
-	//try 
-	//{
-		file = new EMUFILE_MEMORY(dataSectors*512);
-	//}
-	//catch(std::bad_alloc)
-	//{
-		//printf("error allocating memory for fat (%d KBytes)\n",(dataSectors*512)/1024);
-		//printf("(out of memory)\n");
-		//return false;
-	//}
-
-	//debug..
-	//file = new EMUFILE_FILE("c:\\temp.ima","rb+");
-	
-	//format the disk
+	file = NULL;
+
+	EMUFILE_VFAT *vfat = new EMUFILE_VFAT();
+	if (!vfat->build(path, extra_MB))
 	{
-		EmuFat fat(file);
-		EmuFatVolume vol;
-		u8 ok = vol.init(&fat);
-		vol.formatNew(dataSectors);
-
-		//ensure we are working in memory, just in case we were testing with a disk file.
-		//libfat will need to go straight to memory (for now; we could easily change it to work with the disk)
-		file = file->memwrap();
+		delete vfat;
+		return false;
 	}
-	EMUFILE_MEMORY* memf = (EMUFILE_MEMORY*)file;
-
-	//setup libfat and write all the files through it
-	//LIBFAT::Init(memf->buf(),memf->size());
-	list_files(path, build_ListCallback);
-	//LIBFAT::Shutdown();
 
+	file = vfat;
 	return true;
 }
 
@@ -227,4 +655,4 @@ EMUFILE* VFAT::detach()
 	EMUFILE* ret = file;
 	file = NULL;
 	return ret;
-}
\ No newline at end of file
+}
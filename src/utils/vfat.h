@@ -25,6 +25,8 @@ class VFAT
 public:
 	VFAT();
 	~VFAT();
+	//indexes the directory tree at path. nothing is copied: the detached EMUFILE makes each sector up as it is read,
+	//and keeps what is written in memory, so the host files are never touched.
 	bool build(const char* path, int extra_MB=0);
 
 	EMUFILE* detach();
@@ -38,8 +38,10 @@
 #endif
 
 #include "wifi.h"
+#include "AdhocTransport.h"
 
 #include <assert.h>
+#include <algorithm>
 
 #include "armcpu.h"
 #include "NDSSystem.h"
@@ -51,15 +53,11 @@
 	#define INVALID_SOCKET  (socket_t)-1 	 
 #endif 
 
-#define BASEPORT 7000
-
 const u8 BroadcastMAC[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 
 bool bWFCUserWarned = false;
 
 #ifdef EXPERIMENTAL_WIFI_COMM
-socket_t wifi_socket = INVALID_SOCKET;
-sockaddr_t sendAddr;
 #ifndef WIN32
 #include "pcap/pcap.h"
 #endif
@@ -659,6 +657,8 @@ static void WIFI_triggerIRQ(u8 irq)
 }
 
 
+static void WIFI_RXDropPackets();
+
 bool WIFI_Init()
 {
 	WIFI_initCRC32Table();
@@ -697,8 +697,7 @@ void WIFI_Reset()
 	memset(wifiMac.TXSlots, 0, sizeof(wifiMac.TXSlots));
 	wifiMac.TXCurSlot = -1;
 	wifiMac.TXCnt = wifiMac.TXStat = wifiMac.TXSeqNo = wifiMac.TXBusy = 0;
-	while (!wifiMac.RXPacketQueue.empty())
-		wifiMac.RXPacketQueue.pop();
+	WIFI_RXDropPackets();
 
 	if((u32)CommonSettings.wifi.mode >= ARRAY_SIZE(wifiComs))
 		CommonSettings.wifi.mode = 0;
@@ -803,16 +802,74 @@ static void WIFI_RXPutWord(u16 val)
 	wifiMac.RXTXAddr = wifiMac.RXWriteCursor;
 }
 
-#ifdef EXPERIMENTAL_WIFI_COMM
-static void WIFI_RXQueuePacket(u8* packet, u32 len)
+// Same as count WIFI_RXPutWord()s, in at most two copies
+static void WIFI_RXPutBlock(const u16* src, u32 count)
 {
 	if (!(wifiMac.RXCnt & 0x8000)) return;
 
+	const u32 begin = wifiMac.RXRangeBegin >> 1;
+	const u32 end = wifiMac.RXRangeEnd >> 1;
+
+	/* a range that doesn't make sense still gets the word by word treatment */
+	if (begin >= end || end > 0x1000 || wifiMac.RXWriteCursor >= end)
+	{
+		while (count--)
+			WIFI_RXPutWord(*src++);
+		return;
+	}
+
+	while (count > 0)
+	{
+		u32 run = std::min<u32>(count, end - wifiMac.RXWriteCursor);
+		memcpy(&wifiMac.RAM[wifiMac.RXWriteCursor], src, run << 1);
+		src += run;
+		count -= run;
+
+		wifiMac.RXWriteCursor += run;
+		if (wifiMac.RXWriteCursor >= end)
+			wifiMac.RXWriteCursor = begin;
+	}
+
+	wifiMac.RXTXAddr = wifiMac.RXWriteCursor;
+}
+
+static void WIFI_RXFreePacket(Wifi_RXPacket& pkt)
+{
+#ifdef EXPERIMENTAL_WIFI_COMM
+	if (pkt.Slot >= 0)
+	{
+		AdhocTransport_Release(pkt.Slot);
+		return;
+	}
+#endif
+	delete[] pkt.Data;
+}
+
+static void WIFI_RXDropPackets()
+{
+	while (!wifiMac.RXPacketQueue.empty())
+	{
+		WIFI_RXFreePacket(wifiMac.RXPacketQueue.front());
+		wifiMac.RXPacketQueue.pop();
+	}
+}
+
+#ifdef EXPERIMENTAL_WIFI_COMM
+// Takes ownership of packet: new[]'d, or still in ad-hoc transport slot
+static void WIFI_RXQueuePacket(u8* packet, u32 len, int slot = -1)
+{
 	Wifi_RXPacket pkt;
 	pkt.Data = packet;
 	pkt.RemHWords = (len - 11) >> 1;
-	pkt.CurOffset = 12;
 	pkt.NotStarted = true;
+	pkt.Slot = slot;
+
+	if (!(wifiMac.RXCnt & 0x8000))
+	{
+		WIFI_RXFreePacket(pkt);
+		return;
+	}
+
 	wifiMac.RXPacketQueue.push(pkt);
 }
 #endif
@@ -1138,10 +1195,7 @@ void WIFI_write16(u32 address, u16 val)
 				WIFI_IOREG(REG_WIFI_TXBUF_REPLY1) = 0x0000;
 			}
 			if (!BIT15(val))
-			{
-				while (!wifiMac.RXPacketQueue.empty())
-					wifiMac.RXPacketQueue.pop();
-			}
+				WIFI_RXDropPackets();
 			break;
 		case REG_WIFI_RXRANGEBEGIN:
 			wifiMac.RXRangeBegin = val & 0x1FFE;
@@ -1715,12 +1769,10 @@ void WIFI_usTrigger()
 			Wifi_RXPacket& pkt = wifiMac.RXPacketQueue.front();
 			if (pkt.NotStarted)
 			{
-				WIFI_RXPutWord(*(u16*)&pkt.Data[0]);
-				WIFI_RXPutWord(*(u16*)&pkt.Data[2]);
-				WIFI_RXPutWord(*(u16*)&pkt.Data[4]);
-				WIFI_RXPutWord(*(u16*)&pkt.Data[6]);
-				WIFI_RXPutWord(*(u16*)&pkt.Data[8]);
-				WIFI_RXPutWord(*(u16*)&pkt.Data[10]);
+				// The whole packet (RX header and body) goes into the RX buffer right away.
+				// Games only look at it once RXEND has moved RXHWWRITECSR, and that still
+				// comes one halfword's time per halfword later, like before.
+				WIFI_RXPutBlock((u16*)pkt.Data, 6 + pkt.RemHWords);
 
 				WIFI_triggerIRQ(WIFI_IRQ_RXSTART);
 				pkt.NotStarted = false;
@@ -1729,9 +1781,6 @@ void WIFI_usTrigger()
 				wifiMac.rfPins = 0x00C7;
 			}
 
-			WIFI_RXPutWord(*(u16*)&pkt.Data[pkt.CurOffset]);
-
-			pkt.CurOffset += 2;
 			pkt.RemHWords--;
 
 			if (pkt.RemHWords == 0)
@@ -1747,7 +1796,7 @@ void WIFI_usTrigger()
 				WIFI_IncrementRXStat<7>();
 				WIFI_DoAutoReply(pkt.Data);
 
-				delete[] pkt.Data;
+				WIFI_RXFreePacket(pkt);
 				wifiMac.RXPacketQueue.pop();
 
 				wifiMac.rfStatus = 9;
@@ -1768,70 +1817,25 @@ void WIFI_usTrigger()
  *******************************************************************************/
 
 #ifdef EXPERIMENTAL_WIFI_COMM
-#define ADHOC_MAGIC					"NDSWIFI\0"
-#define ADHOC_PROTOCOL_VERSION 		0x0100  // v1.0
-
-typedef struct _Adhoc_FrameHeader
-{
-	char magic[8];			// "NDSWIFI\0" (null terminated string)
-	u16 version;			// Ad-hoc protocol version (for example 0x0502 = v5.2)
-	u16 packetLen;			// Length of the packet
-
-} Adhoc_FrameHeader;
-
+// Frames travel through AdhocTransport, over udp or the in-process relay
+// (CommonSettings.wifi.adhocTransport). Received frames stay in the transport's
+// slot until the RX core is done with them: the ad-hoc header in front of each
+// one is exactly as big as the RX header, so that is written over it in place.
 
 bool Adhoc_Init()
 {
-	BOOL opt_true = TRUE;
-	int res;
-
-	if (!CurrentWifiHandler->WIFI_SocketsAvailable())
+	if ((CommonSettings.wifi.adhocTransport == ADHOC_TRANSPORT_UDP) && !CurrentWifiHandler->WIFI_SocketsAvailable())
 	{
 		WIFI_LOG(1, "Ad-hoc: failed to initialize sockets.\n");
-		wifi_socket = INVALID_SOCKET;
 		return false;
 	}
 
-	// Create an UDP socket
-	wifi_socket = socket(AF_INET, SOCK_DGRAM, 0);
-	if (wifi_socket < 0)
+	if (!AdhocTransport_Open(CommonSettings.wifi.adhocTransport))
 	{
-		WIFI_LOG(1, "Ad-hoc: Failed to create socket.\n");
+		WIFI_LOG(1, "Ad-hoc: failed to open the transport.\n");
 		return false;
 	}
 
-	// Enable the socket to be bound to an address/port that is already in use
-	// This enables us to communicate with another DeSmuME instance running on the same computer.
-	res = setsockopt(wifi_socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&opt_true, sizeof(BOOL));
-
-	// Bind the socket to any address on port 7000
-	sockaddr_t saddr;
-	saddr.sa_family = AF_INET;
-	*(u32*)&saddr.sa_data[2] = htonl(INADDR_ANY); 
-	*(u16*)&saddr.sa_data[0] = htons(BASEPORT);
-	res = bind(wifi_socket, &saddr, sizeof(sockaddr_t));
-	if (res < 0)
-	{
-		WIFI_LOG(1, "Ad-hoc: failed to bind the socket.\n");
-		closesocket(wifi_socket); wifi_socket = INVALID_SOCKET;
-		return false;
-	}
-
-	// Enable broadcast mode
-	// Not doing so results in failure when sendto'ing to broadcast address
-	res = setsockopt(wifi_socket, SOL_SOCKET, SO_BROADCAST, (const char*)&opt_true, sizeof(BOOL));
-	if (res < 0)
-	{
-		WIFI_LOG(1, "Ad-hoc: failed to enable broadcast mode.\n");
-		closesocket(wifi_socket); wifi_socket = INVALID_SOCKET;
-		return false;
-	}
-
-	// Prepare an address structure for sending packets
-	sendAddr.sa_family = AF_INET;
-	*(u32*)&sendAddr.sa_data[2] = htonl(INADDR_BROADCAST); 
-	*(u16*)&sendAddr.sa_data[0] = htons(BASEPORT);
-
 	Adhoc_Reset();
 
 	WIFI_LOG(1, "Ad-hoc: initialization successful.\n");
@@ -1841,8 +1845,9 @@ bool Adhoc_Init()
 
 void Adhoc_DeInit()
 {
-	if (wifi_socket >= 0)
-		closesocket(wifi_socket);
+	// the queue may still hold frames sitting in transport slots
+	WIFI_RXDropPackets();
+	AdhocTransport_Close();
 }
 
 void Adhoc_Reset()
@@ -1856,96 +1861,48 @@ void Adhoc_Reset()
 
 void Adhoc_SendPacket(u8* packet, u32 len)
 {
-	if (wifi_socket < 0)
-		return;
-
 	WIFI_LOG(3, "Ad-hoc: sending a packet of %i bytes, frame control: %04X\n", len, *(u16*)&packet[0]);
 
-	u32 frameLen = sizeof(Adhoc_FrameHeader) + len;
-
-	u8* frame = new u8[frameLen];
-	u8* ptr = frame;
-
-	Adhoc_FrameHeader header;
-	strncpy(header.magic, ADHOC_MAGIC, 8);
-	header.version = ADHOC_PROTOCOL_VERSION;
-	header.packetLen = len;
-	memcpy(ptr, &header, sizeof(Adhoc_FrameHeader));
-	ptr += sizeof(Adhoc_FrameHeader);
-
-	memcpy(ptr, packet, len);
-
-	int nbytes = sendto(wifi_socket, (const char*)frame, frameLen, 0, &sendAddr, sizeof(sockaddr_t));
-	
-	WIFI_LOG(4, "Ad-hoc: sent %i/%i bytes of packet.\n", nbytes, frameLen);
-
-	delete[] frame;
+	// batched; goes out on the next msTrigger at the latest
+	AdhocTransport_Send(packet, len);
 }
 
 void Adhoc_msTrigger()
 {
-	if (wifi_socket < 0)
-		return;
-
-	// Check every millisecond if we received a packet
-	fd_set fd;
-	struct timeval tv;
+	AdhocTransport_Flush();
+	AdhocTransport_Poll();
 
-	FD_ZERO(&fd);
-	FD_SET(wifi_socket, &fd);
-	tv.tv_sec = 0; 
-	tv.tv_usec = 0;
+	u8* packet;
+	u32 frameLen;
+	int slot;
 
-	if (select(1, &fd, 0, 0, &tv))
+	while ((packet = AdhocTransport_Receive(&frameLen, &slot)) != NULL)
 	{
-		sockaddr_t fromAddr;
-		socklen_t fromLen = sizeof(sockaddr_t);
-		u8 buf[1536];
-		u8* ptr;
-		u16 packetLen;
-
-		int nbytes = recvfrom(wifi_socket, (char*)buf, 1536, 0, &fromAddr, &fromLen);
-
-		// No packet arrived (or there was an error)
-		if (nbytes <= 0)
-			return;
+		u8* ptr = packet + ADHOC_HEADER_SIZE;
 
-		ptr = buf;
-		Adhoc_FrameHeader header = *(Adhoc_FrameHeader*)ptr;
-		
-		// Check the magic string in header
-		if (strncmp(header.magic, ADHOC_MAGIC, 8))
-			return;
-
-		// Check the ad-hoc protocol version
-		if (header.version != ADHOC_PROTOCOL_VERSION)
-			return;
+		// Too short to even have the addresses we check
+		if (frameLen < 24)
+		{
+			AdhocTransport_Release(slot);
+			continue;
+		}
 
-		packetLen = header.packetLen - 4;
-		ptr += sizeof(Adhoc_FrameHeader);
+		u16 packetLen = frameLen - 4;
 
 		// If the packet is for us, send it to the wifi core
-		if (!WIFI_compareMAC(&ptr[10], &wifiMac.mac.bytes[0]))
+		if (!WIFI_compareMAC(&ptr[10], &wifiMac.mac.bytes[0]) &&
+			(WIFI_isBroadcastMAC(&ptr[16]) ||
+			 WIFI_compareMAC(&ptr[16], &wifiMac.bss.bytes[0]) ||
+			 WIFI_isBroadcastMAC(&wifiMac.bss.bytes[0])))
 		{
-			if (WIFI_isBroadcastMAC(&ptr[16]) ||
-				WIFI_compareMAC(&ptr[16], &wifiMac.bss.bytes[0]) ||
-				WIFI_isBroadcastMAC(&wifiMac.bss.bytes[0]))
-			{
-			/*	WIFI_LOG(3, "Ad-hoc: received a packet of %i bytes from %i.%i.%i.%i (port %i).\n",
-					nbytes,
-					(u8)fromAddr.sa_data[2], (u8)fromAddr.sa_data[3], 
-					(u8)fromAddr.sa_data[4], (u8)fromAddr.sa_data[5],
-					ntohs(*(u16*)&fromAddr.sa_data[0]));*/
-				WIFI_LOG(3, "Ad-hoc: received a packet of %i bytes, frame control: %04X\n", packetLen, *(u16*)&ptr[0]);
-				WIFI_LOG(4, "Storing packet at %08X.\n", 0x04804000 + (wifiMac.RXWriteCursor<<1));
-
-				u8* packet = new u8[12 + packetLen];
-
-				WIFI_MakeRXHeader(packet, WIFI_GetRXFlags(ptr), 20, packetLen, _wifiMinRSSI, _wifiMaxRSSI);
-				memcpy(&packet[12], ptr, packetLen);
-				WIFI_RXQueuePacket(packet, 12+packetLen);
-			}
+			WIFI_LOG(3, "Ad-hoc: received a packet of %i bytes, frame control: %04X\n", packetLen, *(u16*)&ptr[0]);
+			WIFI_LOG(4, "Storing packet at %08X.\n", 0x04804000 + (wifiMac.RXWriteCursor<<1));
+
+			WIFI_MakeRXHeader(packet, WIFI_GetRXFlags(ptr), 20, packetLen, _wifiMinRSSI, _wifiMaxRSSI);
+			WIFI_RXQueuePacket(packet, 12+packetLen, slot);
 		}
+		else
+			AdhocTransport_Release(slot);
 	}
 }
 
@@ -434,9 +434,10 @@ struct Wifi_TXSlot
 struct Wifi_RXPacket
 {
 	u8* Data;
-	int CurOffset;
 	int RemHWords;
 	bool NotStarted;
+	// ad-hoc transport slot Data lives in, or -1 when it was new[]'d
+	int Slot;
 };
 
 typedef std::queue<Wifi_RXPacket> Wifi_RXPacketQueue;